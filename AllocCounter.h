@@ -0,0 +1,145 @@
+// ============================================================================
+//
+// AllocCounter.h
+// -----------------------------------
+//
+// ALLOCATION COUNTER HEADER FILE
+//
+// Replaces the global operator new / delete with versions that count every
+// C++ heap allocation, over-aligned ones included. The headless benchmark
+// reads the counter around each frame to check that a warm frame does not
+// allocate.
+//
+// Like every header here, the definitions are not inline: the program is
+// built as one translation unit (Main.cpp, through Benchmark.h). The
+// replacements must exist exactly once, so a build that adds another .cpp
+// has to include this header from only one of them.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <new>
+#include <atomic>
+#include <stdlib.h>
+#include <stdint.h>
+
+using namespace std;
+
+// Allocations made so far, by any thread
+atomic<unsigned long long> allocationCount(0);
+
+unsigned long long AllocationCount() {
+	return allocationCount.load(memory_order_relaxed);
+}
+
+// Counting replacements of the global allocation functions
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	void* memory = malloc(size ? size : 1);
+	if (!memory)
+		throw bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void* operator new(size_t size, const nothrow_t&) noexcept {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+	return operator new(size, nothrow);
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, const nothrow_t&) noexcept {
+	free(memory);
+}
+
+void operator delete[](void* memory, const nothrow_t&) noexcept {
+	free(memory);
+}
+
+// Over-aligned types (alignas above the default new alignment) come through
+// the align_val_t overloads. The block is over-allocated and aligned by
+// hand, with the pointer malloc returned kept just in front of it.
+#ifdef __cpp_aligned_new
+static void* allocateAligned(size_t size, size_t alignment) {
+	void* allocation = malloc((size ? size : 1) + alignment + sizeof(void*));
+	if (!allocation)
+		return nullptr;
+	uintptr_t aligned = ((uintptr_t)allocation + sizeof(void*) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	((void**)aligned)[-1] = allocation;
+	return (void*)aligned;
+}
+
+static void freeAligned(void* memory) {
+	if (memory)
+		free(((void**)memory)[-1]);
+}
+
+void* operator new(size_t size, align_val_t alignment) {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	void* memory = allocateAligned(size, (size_t)alignment);
+	if (!memory)
+		throw bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size, align_val_t alignment) {
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+	allocationCount.fetch_add(1, memory_order_relaxed);
+	return allocateAligned(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, align_val_t alignment, const nothrow_t&) noexcept {
+	return operator new(size, alignment, nothrow);
+}
+
+void operator delete(void* memory, align_val_t) noexcept {
+	freeAligned(memory);
+}
+
+void operator delete[](void* memory, align_val_t) noexcept {
+	freeAligned(memory);
+}
+
+void operator delete(void* memory, size_t, align_val_t) noexcept {
+	freeAligned(memory);
+}
+
+void operator delete[](void* memory, size_t, align_val_t) noexcept {
+	freeAligned(memory);
+}
+
+void operator delete(void* memory, align_val_t, const nothrow_t&) noexcept {
+	freeAligned(memory);
+}
+
+void operator delete[](void* memory, align_val_t, const nothrow_t&) noexcept {
+	freeAligned(memory);
+}
+#endif
@@ -0,0 +1,331 @@
+// ============================================================================
+//
+// AssetLoader.h
+// -----------------------------------
+//
+// ASSET LOADER HEADER FILE
+//
+// Loads models and their textures at startup on the job system. Each model
+// is parsed by Assimp on a worker, and every texture it names is read as a
+// job of its own (once, however many models use it, and not at all if the
+// shared texture cache already has it): from its compressed bake, or
+// decoded by SOIL and compressed. The render thread only makes the GL
+// calls: it hands read textures to the cache in batches as they arrive,
+// through a pixel buffer object when enabled, and finishes a model
+// (buffers and materials) once all of its textures are in.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string>
+#include <deque>
+#include <map>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+// Other includes
+#include "ModelObj.h"
+#include "TextureCache.h"
+#include "JobSystem.h"
+
+using namespace std;
+
+// Most decoded bytes uploaded (and staged in the PBO) per batch
+const GLsizeiptr ASSET_UPLOAD_BATCH = 16 << 20;
+
+// Asset loader class
+class AssetLoader {
+private:
+	typedef chrono::high_resolution_clock Clock;
+
+	// One texture file, decoded on a worker
+	struct TextureLoad {
+		string path;
+		TextureImage image;
+		bool decoded;			// false if the file could not be read
+		GLuint id;				// 0 if it was not decoded
+		bool uploaded;
+		AssetLoader* loader;
+	};
+
+	// One model file, parsed on a worker
+	struct ModelLoad {
+		Model* model;
+		string path;
+		vector<TextureLoad*> textures;
+		vector<bool> shared;		// per texture: another model's load holds the reference
+		AssetLoader* loader;
+	};
+
+	// Data
+	JobSystem* jobs;
+	bool usePbo;
+	deque<ModelLoad> models;
+	deque<TextureLoad> textures;		// element addresses stay valid as it grows
+	map<string, TextureLoad*> texturePaths;
+	JobCounter pending;					// parse and decode jobs not finished
+
+	// Handed from the workers to the render thread
+	mutex lock;
+	vector<TextureLoad*> decoded;
+	vector<ModelLoad*> parsed;
+
+	// Upload staging
+	GLuint staging;
+	GLsizeiptr stagingSize;
+
+	// Functions
+	static void parseModel(void* context, GLuint begin, GLuint end);
+	static void decodeTexture(void* context, GLuint begin, GLuint end);
+	void uploadBatch(TextureLoad** batch, GLuint count, GLsizeiptr bytes);
+	void upload(vector<TextureLoad*>& ready);
+	bool finish(ModelLoad& load);
+
+public:
+	// Results of the last Run()
+	GLdouble loadMs;
+	GLdouble parseMs, decodeMs, uploadMs;	// summed over every job / batch
+	GLuint batches;
+
+	AssetLoader();
+	void Init(JobSystem* jobs, bool usePbo);
+	void Add(Model& model, const char* path);
+	void Run();
+};
+
+// Constructor
+AssetLoader::AssetLoader() {
+	this->jobs = nullptr;
+	this->usePbo = false;
+	this->staging = 0;
+	this->stagingSize = 0;
+	this->loadMs = this->parseMs = this->decodeMs = this->uploadMs = 0.0;
+	this->batches = 0;
+}
+
+void AssetLoader::Init(JobSystem* jobs, bool usePbo) {
+	this->jobs = jobs;
+	this->usePbo = usePbo;
+}
+
+// Queue a model. It is loaded into the given object, which must stay where
+// it is until Run() returns; textures it held before are given back.
+void AssetLoader::Add(Model& model, const char* path) {
+	model.ReleaseTextures();
+	ModelLoad load;
+	load.model = &model;
+	load.path = path;
+	load.loader = this;
+	this->models.push_back(load);
+}
+
+// Worker: parse the model, then queue a decode for each texture no other
+// model has asked for yet and the texture cache does not hold
+void AssetLoader::parseModel(void* context, GLuint begin, GLuint end) {
+	ModelLoad& load = *(ModelLoad*)context;
+	AssetLoader* loader = load.loader;
+	Clock::time_point start = Clock::now();
+	load.model->Parse(load.path);
+
+	vector<Texture>& used = load.model->textures_loaded;
+	for (GLuint i = 0; i < used.size(); i++) {
+		string path = load.model->TexturePath(used[i]);
+		TextureLoad* texture;
+		bool shared = false, added = false;
+		{
+			lock_guard<mutex> guard(loader->lock);
+			map<string, TextureLoad*>::iterator found = loader->texturePaths.find(path);
+			if (found != loader->texturePaths.end()) {
+				texture = found->second;
+				shared = true;
+			}
+			else {
+				TextureLoad entry;
+				entry.path = path;
+				entry.id = 0;
+				entry.decoded = false;
+				entry.uploaded = TextureCache::shared.Acquire(path, entry.id);
+				entry.loader = loader;
+				loader->textures.push_back(entry);
+				texture = &loader->textures.back();
+				loader->texturePaths[path] = texture;
+				added = !entry.uploaded;
+			}
+		}
+		load.textures.push_back(texture);
+		load.shared.push_back(shared);
+		if (added) {
+			loader->pending.value.fetch_add(1);
+			loader->jobs->Submit(&AssetLoader::decodeTexture, texture, &loader->pending);
+		}
+	}
+
+	GLdouble ms = chrono::duration<double, milli>(Clock::now() - start).count();
+	lock_guard<mutex> guard(loader->lock);
+	loader->parseMs += ms;
+	loader->parsed.push_back(&load);
+}
+
+// Worker: read one texture, from its bake or by decoding (and baking) it
+void AssetLoader::decodeTexture(void* context, GLuint begin, GLuint end) {
+	TextureLoad& texture = *(TextureLoad*)context;
+	Clock::time_point start = Clock::now();
+	texture.decoded = TextureCache::ReadImage(texture.path, texture.image);
+	if (!texture.decoded) {
+		cout << "ERROR::ASSET_LOADER::TEXTURE_NOT_DECODED " << texture.path << endl;
+		vector<GLubyte>().swap(texture.image.data);
+	}
+	GLdouble ms = chrono::duration<double, milli>(Clock::now() - start).count();
+	lock_guard<mutex> guard(texture.loader->lock);
+	texture.loader->decodeMs += ms;
+	texture.loader->decoded.push_back(&texture);
+}
+
+// Hand a batch of read textures to the texture cache, which uploads the
+// ones whose content it does not hold yet. With a PBO the pixels are copied
+// into one freshly orphaned staging buffer and every texture is specified
+// from it, so the driver can copy them while this thread moves on.
+void AssetLoader::uploadBatch(TextureLoad** batch, GLuint count, GLsizeiptr bytes) {
+	GLubyte* staged = nullptr;
+	if (this->usePbo && bytes > 0) {
+		if (!this->staging)
+			glGenBuffers(1, &this->staging);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, this->staging);
+		this->stagingSize = max(this->stagingSize, bytes);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, this->stagingSize, NULL, GL_STREAM_DRAW);
+		staged = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (!staged)
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
+	GLsizeiptr offset = 0;
+	if (staged) {
+		for (GLuint i = 0; i < count; i++) {
+			GLsizeiptr size = batch[i]->image.data.size();
+			if (size > 0)
+				memcpy(staged + offset, batch[i]->image.data.data(), size);
+			offset += size;
+		}
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		offset = 0;
+	}
+	for (GLuint i = 0; i < count; i++) {
+		// Unreadable files are left out of the cache (their models bind 0)
+		TextureLoad& texture = *batch[i];
+		const GLubyte* pixels = staged ? (const GLubyte*)offset : texture.image.data.data();
+		if (texture.decoded) {
+			cout << texture.path << endl;
+			texture.id = TextureCache::shared.Insert(texture.path, texture.image, pixels);
+		}
+		offset += texture.image.data.size();
+		vector<GLubyte>().swap(texture.image.data);
+		texture.uploaded = true;
+	}
+	if (staged)
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	this->batches++;
+}
+
+// Upload every ready texture, ASSET_UPLOAD_BATCH bytes at a time
+void AssetLoader::upload(vector<TextureLoad*>& ready) {
+	Clock::time_point start = Clock::now();
+	GLuint first = 0;
+	while (first < ready.size()) {
+		GLsizeiptr bytes = 0;
+		GLuint last = first;
+		while (last < ready.size()) {
+			GLsizeiptr size = ready[last]->image.data.size();
+			if (last > first && bytes + size > ASSET_UPLOAD_BATCH)
+				break;
+			bytes += size;
+			last++;
+		}
+		this->uploadBatch(&ready[first], last - first, bytes);
+		first = last;
+	}
+	ready.clear();
+	this->uploadMs += chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// Give the model its texture ids and GL buffers once all its textures are
+// uploaded, taking a cache reference for each texture another model's load
+// brought in; false if it has to wait longer
+bool AssetLoader::finish(ModelLoad& load) {
+	for (GLuint i = 0; i < load.textures.size(); i++) {
+		if (!load.textures[i]->uploaded)
+			return false;
+	}
+	Model& model = *load.model;
+	for (GLuint i = 0; i < model.textures_loaded.size(); i++) {
+		model.textures_loaded[i].id = load.textures[i]->id;
+		if (load.shared[i])
+			TextureCache::shared.AddRef(load.textures[i]->id);
+	}
+	for (GLuint m = 0; m < model.meshes.size(); m++) {
+		vector<Texture>& textures = model.meshes[m].textures;
+		for (GLuint t = 0; t < textures.size(); t++) {
+			for (GLuint i = 0; i < model.textures_loaded.size(); i++) {
+				if (model.textures_loaded[i].path == textures[t].path)
+					textures[t].id = model.textures_loaded[i].id;
+			}
+		}
+	}
+	model.Upload();
+	return true;
+}
+
+// Load everything that was added. Parsing and decoding run on the job
+// system; this thread uploads whatever is ready and, when nothing is,
+// helps with the jobs. Returns once every model can be drawn.
+void AssetLoader::Run() {
+	Clock::time_point start = Clock::now();
+	this->parseMs = this->decodeMs = this->uploadMs = 0.0;
+	this->batches = 0;
+
+	this->pending.value = this->models.size();
+	for (GLuint i = 0; i < this->models.size(); i++)
+		this->jobs->Submit(&AssetLoader::parseModel, &this->models[i], &this->pending);
+
+	vector<TextureLoad*> ready;
+	vector<ModelLoad*> waiting;
+	while (true) {
+		// Read the counter first: whatever its last job handed over is
+		// collected below
+		bool jobsDone = this->pending.value.load(memory_order_acquire) == 0;
+		{
+			lock_guard<mutex> guard(this->lock);
+			ready.insert(ready.end(), this->decoded.begin(), this->decoded.end());
+			waiting.insert(waiting.end(), this->parsed.begin(), this->parsed.end());
+			this->decoded.clear();
+			this->parsed.clear();
+		}
+
+		bool worked = !ready.empty();
+		if (worked)
+			this->upload(ready);
+		for (GLuint i = 0; i < waiting.size();) {
+			if (this->finish(*waiting[i])) {
+				waiting[i] = waiting.back();
+				waiting.pop_back();
+				worked = true;
+			}
+			else
+				i++;
+		}
+
+		if (jobsDone && waiting.empty())
+			break;
+		if (!worked && !this->jobs->Help())
+			this_thread::yield();
+	}
+	this->models.clear();
+	this->loadMs = chrono::duration<double, milli>(Clock::now() - start).count();
+}
@@ -0,0 +1,305 @@
+// ============================================================================
+//
+// Benchmark.h
+// -----------------------------------
+//
+// BENCHMARK HEADER FILE
+//
+// The benchmark class collects the CPU and GPU timings the profiler measures
+// for each named render pass over a fixed number of frames and reports
+// p50 / p95 / p99 values as JSON. Used by the headless mode in Main.cpp so
+// runs can be compared in CI. It also counts the heap allocations made
+// during each recorded frame, the triangles each frame drew and the
+// fragments it shaded per pixel, and reports what the texture cache holds
+// at the end of the run.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+// Custom headers
+#include "Profiler.h"
+#include "AllocCounter.h"
+#include "TextureCache.h"
+#include "Bloom.h"
+#include "RenderTargets.h"
+
+using namespace std;
+
+// Simulated clock step used by headless runs (seconds per frame)
+const double BENCH_TIMESTEP = 1.0 / 60.0;
+
+// Holds every sample recorded for one named pass
+struct PassSamples {
+	string name;
+	vector<double> cpuMs;
+	vector<double> gpuMs;
+};
+
+// Benchmark class
+class Benchmark {
+private:
+	typedef chrono::high_resolution_clock Clock;
+
+	// Data
+	vector<PassSamples> passes;
+	PassSamples frameTotal;
+	GLuint warmupFrames;
+	GLuint frameCount;
+	GLboolean enabled;
+	Clock::time_point frameStart;
+	unsigned long long frameAllocStart;
+	unsigned long long allocTotal, allocMax;	// over recorded frames
+	double loadMs, firstFrameMs;				// startup, see SetStartup()
+	double frameTriangles;						// see SetTriangles()
+	vector<double> triangles;
+	double frameFragments;						// see SetShadedFragments()
+	vector<double> fragments;
+	GLint depthPrepass, depthSort;				// see SetDepthMode(), -1 = not set
+	string bloomPath;							// see SetBloom()
+	GLuint bloomLevels;
+	GLfloat bloomThreshold;
+	BloomComparison bloom;
+	RenderTargetStats targets;					// see SetRenderTargets()
+	GLint displayWidth, displayHeight;
+	GLfloat resolutionScale;
+
+	// Functions
+	GLint findPass(const char* name);
+	bool recording();
+	static double percentile(vector<double> samples, double p);
+	static void writeStats(ostream& out, const char* key, const vector<double>& samples);
+
+public:
+	Benchmark();
+	void Enable(GLuint warmupFrames, GLuint frames);
+	bool Enabled();
+	void BeginFrame();
+	void EndFrame(Profiler& profiler);
+	void SetStartup(double loadMs, double firstFrameMs);
+	void SetTriangles(GLuint triangles);
+	void SetShadedFragments(double perPixel);
+	void SetDepthMode(bool prepass, bool sorted);
+	void SetBloom(const char* path, GLuint levels, GLfloat threshold, const BloomComparison& comparison);
+	void SetRenderTargets(const RenderTargetStats& stats, GLint displayWidth, GLint displayHeight, GLfloat scale);
+	void WriteReport(ostream& out);
+	unsigned long long MaxFrameAllocations();
+};
+
+// Constructor - benchmarking stays off until Enable() is called
+Benchmark::Benchmark() {
+	this->warmupFrames = 0;
+	this->frameCount = 0;
+	this->enabled = false;
+	this->frameAllocStart = 0;
+	this->allocTotal = this->allocMax = 0;
+	this->loadMs = this->firstFrameMs = 0.0;
+	this->frameTriangles = 0.0;
+	this->frameFragments = 0.0;
+	this->depthPrepass = this->depthSort = -1;
+	this->bloomLevels = 0;
+	this->bloomThreshold = 0.0f;
+	this->displayWidth = this->displayHeight = 0;
+	this->resolutionScale = 1.0f;
+	this->frameTotal.name = "total";
+}
+
+// Turn on recording, reserving room for every sample up front
+void Benchmark::Enable(GLuint warmupFrames, GLuint frames) {
+	this->enabled = true;
+	this->warmupFrames = warmupFrames;
+	this->frameTotal.cpuMs.reserve(frames);
+	this->frameTotal.gpuMs.reserve(frames);
+	this->triangles.reserve(frames);
+	this->fragments.reserve(frames);
+}
+
+bool Benchmark::Enabled() {
+	return this->enabled != GL_FALSE;
+}
+
+// Warmup frames run the full pipeline but are left out of the report
+bool Benchmark::recording() {
+	return this->frameCount >= this->warmupFrames;
+}
+
+// Find a pass by name, creating it on first use
+GLint Benchmark::findPass(const char* name) {
+	for (GLuint i = 0; i < this->passes.size(); i++) {
+		if (this->passes[i].name == name)
+			return i;
+	}
+
+	PassSamples pass;
+	pass.name = name;
+	pass.cpuMs.reserve(this->frameTotal.cpuMs.capacity());
+	pass.gpuMs.reserve(this->frameTotal.gpuMs.capacity());
+	this->passes.push_back(pass);
+	return this->passes.size() - 1;
+}
+
+void Benchmark::BeginFrame() {
+	if (!this->enabled)
+		return;
+	this->frameStart = Clock::now();
+	this->frameAllocStart = AllocationCount();
+}
+
+// Wait for the GPU and collect this frame's pass timings from the profiler.
+// The wait is intentional: headless runs measure cost, not throughput.
+void Benchmark::EndFrame(Profiler& profiler) {
+	if (!this->enabled)
+		return;
+	// Counted first: reading back the profiler's results is not the frame's
+	unsigned long long allocs = AllocationCount() - this->frameAllocStart;
+	profiler.EndFrame(true);
+	double cpuTotal = chrono::duration<double, milli>(Clock::now() - this->frameStart).count();
+
+	if (this->recording()) {
+		this->allocTotal += allocs;
+		this->allocMax = max(this->allocMax, allocs);
+
+		double gpuTotal = 0.0;
+		for (GLuint i = 0; i < profiler.PassCount(); i++) {
+			const ProfilerPass& pass = profiler.Pass(i);
+			if (pass.lastFrame != profiler.Frame())
+				continue;
+			PassSamples& samples = this->passes[this->findPass(pass.name)];
+			samples.cpuMs.push_back(pass.lastCpuMs);
+			samples.gpuMs.push_back(pass.lastGpuMs);
+			gpuTotal += pass.lastGpuMs;
+		}
+		this->frameTotal.cpuMs.push_back(cpuTotal);
+		this->frameTotal.gpuMs.push_back(gpuTotal);
+		this->triangles.push_back(this->frameTriangles);
+		this->fragments.push_back(this->frameFragments);
+	}
+	this->frameCount++;
+}
+
+// Nearest-rank percentile of a set of samples
+double Benchmark::percentile(vector<double> samples, double p) {
+	if (samples.empty())
+		return 0.0;
+	sort(samples.begin(), samples.end());
+	size_t rank = (size_t)ceil(p / 100.0 * samples.size());
+	if (rank > 0)
+		rank--;
+	return samples[min(rank, samples.size() - 1)];
+}
+
+void Benchmark::writeStats(ostream& out, const char* key, const vector<double>& samples) {
+	out << "\"" << key << "\": {"
+		<< "\"p50\": " << percentile(samples, 50.0) << ", "
+		<< "\"p95\": " << percentile(samples, 95.0) << ", "
+		<< "\"p99\": " << percentile(samples, 99.0) << "}";
+}
+
+// Model loading time and time from process start to the first frame
+void Benchmark::SetStartup(double loadMs, double firstFrameMs) {
+	this->loadMs = loadMs;
+	this->firstFrameMs = firstFrameMs;
+}
+
+// Triangles drawn this frame
+void Benchmark::SetTriangles(GLuint triangles) {
+	this->frameTriangles = triangles;
+}
+
+// Fragments shaded per rendered pixel (the last value read back)
+void Benchmark::SetShadedFragments(double perPixel) {
+	this->frameFragments = perPixel;
+}
+
+// Whether the scene had a depth pre-pass and was sorted front to back
+void Benchmark::SetDepthMode(bool prepass, bool sorted) {
+	this->depthPrepass = prepass;
+	this->depthSort = sorted;
+}
+
+// Bloom settings and the A/B comparison of both blur paths
+void Benchmark::SetBloom(const char* path, GLuint levels, GLfloat threshold, const BloomComparison& comparison) {
+	this->bloomPath = path;
+	this->bloomLevels = levels;
+	this->bloomThreshold = threshold;
+	this->bloom = comparison;
+}
+
+// Render target pool memory at the end of the run, and the window size /
+// resolution scale it was rendering at
+void Benchmark::SetRenderTargets(const RenderTargetStats& stats, GLint displayWidth, GLint displayHeight, GLfloat scale) {
+	this->targets = stats;
+	this->displayWidth = displayWidth;
+	this->displayHeight = displayHeight;
+	this->resolutionScale = scale;
+}
+
+// Write all recorded passes as a single JSON object
+void Benchmark::WriteReport(ostream& out) {
+	const GLubyte* renderer = glGetString(GL_RENDERER);
+	TextureCacheStats textures = TextureCache::shared.Stats();
+
+	out << "{\n"
+		<< "  \"renderer\": \"" << (renderer ? (const char*)renderer : "unknown") << "\",\n"
+		<< "  \"frames\": " << this->frameTotal.cpuMs.size() << ",\n"
+		<< "  \"warmup\": " << this->warmupFrames << ",\n"
+		<< "  \"timestep\": " << BENCH_TIMESTEP << ",\n"
+		<< "  \"startup\": {\"load_ms\": " << this->loadMs << ", \"first_frame_ms\": " << this->firstFrameMs << "},\n"
+		<< "  \"textures\": {\"resident\": " << textures.textures << ", \"resident_bytes\": " << textures.residentBytes
+		<< ", \"hits\": " << textures.hits << ", \"misses\": " << textures.misses << ", \"hit_rate\": " << textures.hitRate
+		<< ", \"evictions\": " << textures.evictions << "},\n";
+	if (!this->bloomPath.empty()) {
+		out << "  \"bloom\": {\"path\": \"" << this->bloomPath << "\", \"levels\": " << this->bloomLevels
+			<< ", \"threshold\": " << this->bloomThreshold
+			<< ", \"chain_gpu_ms\": " << this->bloom.chainMs << ", \"gaussian_gpu_ms\": " << this->bloom.gaussianMs
+			<< ", \"chain_texel_fetches\": " << this->bloom.chainFetches << ", \"gaussian_texel_fetches\": " << this->bloom.gaussianFetches
+			<< ", \"gaussian_sigma\": " << this->bloom.gaussianSigma			<< ", \"ab_psnr_db\": " << this->bloom.psnr << ", \"ab_max_difference\": " << this->bloom.maxDifference << "},\n";
+	}
+	if (this->displayWidth > 0) {
+		out << "  \"render_targets\": {\"display\": \"" << this->displayWidth << "x" << this->displayHeight
+			<< "\", \"scale\": " << this->resolutionScale << ", \"targets\": " << this->targets.targets
+			<< ", \"resident_bytes\": " << this->targets.residentBytes << ", \"peak_bytes\": " << this->targets.peakBytes
+			<< ", \"requested_bytes\": " << this->targets.requestedBytes << ", \"created\": " << this->targets.created
+			<< ", \"deleted\": " << this->targets.deleted << "},\n";
+	}
+	out << "  \"passes\": [\n";
+	for (GLuint i = 0; i < this->passes.size(); i++) {
+		out << "    {\"name\": \"" << this->passes[i].name << "\", ";
+		writeStats(out, "cpu_ms", this->passes[i].cpuMs);
+		out << ", ";
+		writeStats(out, "gpu_ms", this->passes[i].gpuMs);
+		out << "}" << (i + 1 < this->passes.size() ? "," : "") << "\n";
+	}
+	out << "  ],\n"
+		<< "  \"total\": {";
+	writeStats(out, "cpu_ms", this->frameTotal.cpuMs);
+	out << ", ";
+	writeStats(out, "gpu_ms", this->frameTotal.gpuMs);
+	out << "},\n  ";
+	writeStats(out, "triangles", this->triangles);
+	out << ",\n  ";
+	writeStats(out, "shaded_fragments_per_pixel", this->fragments);
+	out << ",\n";
+	if (this->depthPrepass >= 0) {
+		out << "  \"depth\": {\"prepass\": " << (this->depthPrepass ? "true" : "false")
+			<< ", \"front_to_back\": " << (this->depthSort ? "true" : "false") << "},\n";
+	}
+	out << "  \"allocations\": {\"total\": " << this->allocTotal << ", \"max_per_frame\": " << this->allocMax << "}\n"
+		<< "}" << endl;
+}
+
+// Most heap allocations made by a single recorded frame
+unsigned long long Benchmark::MaxFrameAllocations() {
+	return this->allocMax;
+}
@@ -0,0 +1,400 @@
+// ============================================================================
+//
+// Bloom.h
+// -----------------------------------
+//
+// BLOOM HEADER FILE
+//
+// Blurs the scene's bright pass for the composite. The default path halves
+// it down a chain of smaller and smaller targets with a 13 tap filter, then
+// adds each level back into the one above it with a 3x3 tent filter, so
+// the blur grows with every level for a few million texel fetches a frame.
+// The original path, 50 alternating Gaussian passes at full resolution, is
+// kept to compare against (--bloom gaussian); its kernel is generated for
+// the chosen sigma and compiled into a cached blur shader variant.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "UseShader.h"
+#include "GaussianKernel.h"
+#include "RenderTargets.h"
+
+using namespace std;
+
+// Ways to blur the bright pass
+enum BloomPath {
+	BLOOM_CHAIN,			// downsample / upsample mip chain
+	BLOOM_GAUSSIAN			// full resolution ping-pong Gaussian
+};
+
+// Chain limits: levels are picked so that the smallest is still this big
+const GLuint BLOOM_MAX_LEVELS = 8;
+const GLsizei BLOOM_MIN_LEVEL_SIZE = 8;
+
+// Passes of the Gaussian path (alternating horizontal / vertical), and the
+// sigma of the original 9 tap kernel
+const GLuint BLOOM_GAUSSIAN_PASSES = 50;
+const GLfloat BLOOM_GAUSSIAN_SIGMA = 1.8f;
+
+// Texel fetches per output texel of each filter
+const GLuint BLOOM_DOWN_TAPS = 13;
+const GLuint BLOOM_UP_TAPS = 9;
+
+// A/B comparison of the two paths on the same frame
+struct BloomComparison {
+	GLdouble chainMs, gaussianMs;			// GPU time of each path
+	GLdouble chainFetches, gaussianFetches;	// texel fetches of each path
+	GLfloat gaussianSigma;					// kernel of the Gaussian path
+	GLdouble psnr;							// of the tone mapped composites, dB
+	GLfloat maxDifference;					// largest tone mapped channel difference
+};
+
+// Bloom class
+class Bloom {
+private:
+	// Programs; the blur is the variant for blurSigma
+	ShaderVariants* blurShaders;
+	const Shader* blurShader;
+	GLfloat blurSigma;
+	const Shader* downShader;
+	const Shader* upShader;
+	GLint horizontalLoc, radiusLoc;
+
+	// Targets are taken from the pool at the source's size on every render
+	// and handed back after use. The result (ResultDesc) is either passed
+	// in or also taken from the pool, for the caller to release once the
+	// composite has read it. Chain level 0 is at half the source's
+	// resolution, the Gaussian ping-pong pair at full.
+	RenderTargetPool* targets;
+	GLuint levelsWanted;				// 0 = from the resolution
+	GLsizei width, height;				// last source
+	GLuint result;
+	GLsizei resultWidth, resultHeight;
+
+	// Functions
+	void selectBlur();
+	void renderChain(GLuint source, GLuint target, void (*drawQuad)());
+	void renderGaussian(GLuint source, GLuint target, void (*drawQuad)());
+	void readResult(vector<GLfloat>& pixels);
+
+public:
+	BloomPath path;
+	GLfloat radius;			// upsample tent radius, in source texels
+	GLfloat sigma;			// Gaussian path kernel, in texels
+
+	Bloom();
+	void Init(ShaderVariants& blurShaders, const Shader& downShader, const Shader& upShader, RenderTargetPool& targets, GLsizei width, GLsizei height, GLuint levels);
+	GLuint Render(GLuint source, GLsizei width, GLsizei height, void (*drawQuad)());
+	void Render(GLuint source, GLuint target, GLsizei width, GLsizei height, void (*drawQuad)());
+	RenderTargetDesc ResultDesc(GLsizei width, GLsizei height) const;
+	GLuint Result() const;
+	GLuint LevelCount() const;
+	GLfloat CompositeScale() const;
+	GLdouble TexelFetches(BloomPath path) const;
+	GLuint BlurVariants() const;
+	BloomComparison Compare(GLuint scene, GLuint source, GLsizei width, GLsizei height, GLfloat exposure, void (*drawQuad)());
+
+	static GLuint AutoLevels(GLsizei width, GLsizei height);
+	static const char* PathName(BloomPath path);
+	static bool ParsePath(const char* name, BloomPath& path);
+};
+
+// Constructor
+Bloom::Bloom() {
+	this->blurShaders = nullptr;
+	this->blurShader = this->downShader = this->upShader = nullptr;
+	this->blurSigma = 0.0f;
+	this->targets = nullptr;
+	this->levelsWanted = 0;
+	this->width = this->height = 0;
+	this->result = 0;
+	this->resultWidth = this->resultHeight = 0;
+	this->path = BLOOM_CHAIN;
+	this->radius = 1.0f;
+	this->sigma = BLOOM_GAUSSIAN_SIGMA;
+}
+
+const char* Bloom::PathName(BloomPath path) {
+	static const char* names[2] = { "chain", "gaussian" };
+	return names[path];
+}
+
+// Look a path up by name; false if there is no such path
+bool Bloom::ParsePath(const char* name, BloomPath& path) {
+	for (GLuint i = BLOOM_CHAIN; i <= BLOOM_GAUSSIAN; i++) {
+		if (strcmp(name, PathName((BloomPath)i)) == 0) {
+			path = (BloomPath)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// As many levels as fit before the smaller side drops below
+// BLOOM_MIN_LEVEL_SIZE (6 at 1280x720)
+GLuint Bloom::AutoLevels(GLsizei width, GLsizei height) {
+	GLuint levels = 0;
+	GLsizei side = min(width, height) / 2;
+	while (levels < BLOOM_MAX_LEVELS && side >= BLOOM_MIN_LEVEL_SIZE) {
+		levels++;
+		side /= 2;
+	}
+	return max(levels, 1u);
+}
+
+// Keep the shaders and the pool. width x height is the expected source
+// size (until the first render); levels = 0 picks the chain length from
+// the source's resolution on every render.
+void Bloom::Init(ShaderVariants& blurShaders, const Shader& downShader, const Shader& upShader, RenderTargetPool& targets, GLsizei width, GLsizei height, GLuint levels) {
+	this->blurShaders = &blurShaders;
+	this->downShader = &downShader;
+	this->upShader = &upShader;
+	this->selectBlur();
+	this->radiusLoc = upShader.Uniform("radius");
+	this->targets = &targets;
+	this->width = width;
+	this->height = height;
+	this->levelsWanted = min(levels, BLOOM_MAX_LEVELS);
+}
+
+// Switch to the blur variant for the current sigma. Sigmas are quantized,
+// so changing it only compiles a shader the first time a value is used.
+void Bloom::selectBlur() {
+	GaussianKernel kernel = MakeGaussianKernel(this->sigma);
+	this->blurShader = &this->blurShaders->Get(GaussianDefines(kernel));
+	this->horizontalLoc = this->blurShader->Uniform("horizontal");
+	this->blurSigma = kernel.sigma;
+}
+
+// Downsample the source through every level, then add each level back into
+// the one above it. Level 0, the target, ends up holding the sum of all
+// of them.
+void Bloom::renderChain(GLuint source, GLuint target, void (*drawQuad)()) {
+	GLuint levelCount = this->LevelCount();
+	GLuint levels[BLOOM_MAX_LEVELS];
+	RenderTargetDesc desc[BLOOM_MAX_LEVELS];
+	for (GLuint i = 0; i < levelCount; i++) {
+		desc[i].width = max(this->width >> (i + 1), 1);
+		desc[i].height = max(this->height >> (i + 1), 1);
+		desc[i].format = GL_RGB16F;
+		levels[i] = i == 0 ? target : this->targets->Acquire(desc[i]);
+	}
+
+	glActiveTexture(GL_TEXTURE0);
+	glUseProgram(this->downShader->Program);
+	for (GLuint i = 0; i < levelCount; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, this->targets->Framebuffer(levels[i]));
+		glViewport(0, 0, desc[i].width, desc[i].height);
+		glBindTexture(GL_TEXTURE_2D, i == 0 ? source : levels[i - 1]);
+		drawQuad();
+	}
+
+	glUseProgram(this->upShader->Program);
+	this->upShader->SetFloat(this->radiusLoc, this->radius);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE);
+	for (GLint i = levelCount - 2; i >= 0; i--) {
+		glBindFramebuffer(GL_FRAMEBUFFER, this->targets->Framebuffer(levels[i]));
+		glViewport(0, 0, desc[i].width, desc[i].height);
+		glBindTexture(GL_TEXTURE_2D, levels[i + 1]);
+		drawQuad();
+	}
+	glDisable(GL_BLEND);
+
+	for (GLuint i = 1; i < levelCount; i++)
+		this->targets->Release(levels[i]);
+	this->result = levels[0];
+	this->resultWidth = desc[0].width;
+	this->resultHeight = desc[0].height;
+}
+
+// The original blur: alternate horizontal and vertical passes between the
+// ping-pong targets, starting from the source. The target is the one the
+// last pass writes.
+void Bloom::renderGaussian(GLuint source, GLuint target, void (*drawQuad)()) {
+	if (QuantizeSigma(this->sigma) != this->blurSigma)
+		this->selectBlur();
+	RenderTargetDesc desc = { this->width, this->height, GL_RGB16F };
+	GLuint last = BLOOM_GAUSSIAN_PASSES % 2;
+	GLuint pingPong[2];
+	pingPong[last] = target;
+	pingPong[!last] = this->targets->Acquire(desc);
+
+	glActiveTexture(GL_TEXTURE0);
+	glUseProgram(this->blurShader->Program);
+	glViewport(0, 0, this->width, this->height);
+	GLboolean horizontal = true;
+	for (GLuint i = 0; i < BLOOM_GAUSSIAN_PASSES; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, this->targets->Framebuffer(pingPong[horizontal]));
+		this->blurShader->SetInt(this->horizontalLoc, horizontal);
+		glBindTexture(GL_TEXTURE_2D, i == 0 ? source : pingPong[!horizontal]);
+		drawQuad();
+		horizontal = !horizontal;
+	}
+
+	this->targets->Release(pingPong[!last]);
+	this->result = target;
+	this->resultWidth = this->width;
+	this->resultHeight = this->height;
+}
+
+// Blur the bright pass (a width x height texture) with the current path.
+// Returns the texture the composite adds, scaled by CompositeScale(); the
+// caller releases it to the pool. Leaves the viewport at width x height.
+GLuint Bloom::Render(GLuint source, GLsizei width, GLsizei height, void (*drawQuad)()) {
+	GLuint target = this->targets->Acquire(this->ResultDesc(width, height));
+	this->Render(source, target, width, height, drawQuad);
+	return target;
+}
+
+// The same into a target the caller owns, made to ResultDesc(width, height)
+void Bloom::Render(GLuint source, GLuint target, GLsizei width, GLsizei height, void (*drawQuad)()) {
+	this->width = width;
+	this->height = height;
+	if (this->path == BLOOM_CHAIN)
+		this->renderChain(source, target, drawQuad);
+	else
+		this->renderGaussian(source, target, drawQuad);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glViewport(0, 0, width, height);
+}
+
+// The result the current path gives for a width x height source
+RenderTargetDesc Bloom::ResultDesc(GLsizei width, GLsizei height) const {
+	RenderTargetDesc desc = { width, height, GL_RGB16F };
+	if (this->path == BLOOM_CHAIN) {
+		desc.width = max(width >> 1, 1);
+		desc.height = max(height >> 1, 1);
+	}
+	return desc;
+}
+
+// Blur shader variants compiled so far
+GLuint Bloom::BlurVariants() const {
+	return this->blurShaders->Count();
+}
+
+// Texture holding the last blur
+GLuint Bloom::Result() const {
+	return this->result;
+}
+
+// Chain levels for the last source size
+GLuint Bloom::LevelCount() const {
+	return this->levelsWanted ? this->levelsWanted : AutoLevels(this->width, this->height);
+}
+
+// Each chain level keeps the bright pass's energy and level 0 holds all of
+// them added up, so the composite averages them back
+GLfloat Bloom::CompositeScale() const {
+	return this->path == BLOOM_CHAIN ? 1.0f / this->LevelCount() : 1.0f;
+}
+
+// Texture reads a path makes per frame
+GLdouble Bloom::TexelFetches(BloomPath path) const {
+	if (path == BLOOM_GAUSSIAN)
+		return (GLdouble)BLOOM_GAUSSIAN_PASSES * GaussianFetches(MakeGaussianKernel(this->sigma)) * this->width * this->height;
+	GLdouble fetches = 0.0;
+	GLuint levelCount = this->LevelCount();
+	for (GLuint i = 0; i < levelCount; i++) {
+		GLdouble texels = (GLdouble)max(this->width >> (i + 1), 1) * max(this->height >> (i + 1), 1);
+		fetches += texels * BLOOM_DOWN_TAPS;
+		if (i + 1 < levelCount)
+			fetches += texels * BLOOM_UP_TAPS;
+	}
+	return fetches;
+}
+
+// Last blur at full resolution (the chain's half resolution result is
+// sampled bilinearly, as the composite does)
+void Bloom::readResult(vector<GLfloat>& pixels) {
+	GLsizei w = this->width, h = this->height;
+	pixels.resize((size_t)w * h * 3);
+	glBindTexture(GL_TEXTURE_2D, this->result);
+	if (this->resultWidth == w && this->resultHeight == h) {
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &pixels[0]);
+		return;
+	}
+	GLsizei lw = this->resultWidth, lh = this->resultHeight;
+	vector<GLfloat> level((size_t)lw * lh * 3);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &level[0]);
+	for (GLsizei y = 0; y < h; y++) {
+		GLfloat fy = min(max((y + 0.5f) * lh / h - 0.5f, 0.0f), (GLfloat)(lh - 1));
+		GLsizei y0 = (GLsizei)fy, y1 = min(y0 + 1, lh - 1);
+		GLfloat ty = fy - y0;
+		for (GLsizei x = 0; x < w; x++) {
+			GLfloat fx = min(max((x + 0.5f) * lw / w - 0.5f, 0.0f), (GLfloat)(lw - 1));
+			GLsizei x0 = (GLsizei)fx, x1 = min(x0 + 1, lw - 1);
+			GLfloat tx = fx - x0;
+			for (GLuint c = 0; c < 3; c++) {
+				GLfloat top = level[((size_t)y0 * lw + x0) * 3 + c] * (1.0f - tx) + level[((size_t)y0 * lw + x1) * 3 + c] * tx;
+				GLfloat bottom = level[((size_t)y1 * lw + x0) * 3 + c] * (1.0f - tx) + level[((size_t)y1 * lw + x1) * 3 + c] * tx;
+				pixels[((size_t)y * w + x) * 3 + c] = top * (1.0f - ty) + bottom * ty;
+			}
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Run both paths on the same bright pass, timing each on the GPU, and
+// compare the tone mapped composites they give over the scene (the same
+// mapping as bloom_fshader.glsl). The current path is left as it was.
+BloomComparison Bloom::Compare(GLuint scene, GLuint source, GLsizei width, GLsizei height, GLfloat exposure, void (*drawQuad)()) {
+	const GLuint runs = 3;
+	BloomComparison comparison;
+	BloomPath current = this->path;
+	GLuint query;
+	glGenQueries(1, &query);
+	vector<GLfloat> composites[2], sceneColor((size_t)width * height * 3);
+	glBindTexture(GL_TEXTURE_2D, scene);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, &sceneColor[0]);
+
+	for (GLuint p = BLOOM_CHAIN; p <= BLOOM_GAUSSIAN; p++) {
+		this->path = (BloomPath)p;
+		GLuint64 elapsed = 0;
+		for (GLuint r = 0; r < runs; r++) {
+			GLuint64 ns = 0;
+			glBeginQuery(GL_TIME_ELAPSED, query);
+			this->Render(source, width, height, drawQuad);
+			glEndQuery(GL_TIME_ELAPSED);
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+			elapsed += ns;
+			if (r + 1 < runs)
+				this->targets->Release(this->result);
+		}
+		(p == BLOOM_CHAIN ? comparison.chainMs : comparison.gaussianMs) = elapsed / 1e6 / runs;
+		(p == BLOOM_CHAIN ? comparison.chainFetches : comparison.gaussianFetches) = this->TexelFetches((BloomPath)p);
+
+		vector<GLfloat>& composite = composites[p];
+		this->readResult(composite);
+		this->targets->Release(this->result);
+		GLfloat scale = this->CompositeScale();
+		for (size_t i = 0; i < composite.size(); i++)
+			composite[i] = 1.0f - exp(-(sceneColor[i] + composite[i] * scale) * exposure);
+	}
+	glDeleteQueries(1, &query);
+	comparison.gaussianSigma = this->blurSigma;
+
+	GLdouble squared = 0.0;
+	comparison.maxDifference = 0.0f;
+	for (size_t i = 0; i < sceneColor.size(); i++) {
+		GLfloat d = composites[BLOOM_CHAIN][i] - composites[BLOOM_GAUSSIAN][i];
+		squared += (GLdouble)d * d;
+		comparison.maxDifference = max(comparison.maxDifference, fabs(d));
+	}
+	comparison.psnr = squared > 0.0 ? 10.0 * log10(sceneColor.size() / squared) : 100.0;
+
+	this->path = current;
+	return comparison;
+}
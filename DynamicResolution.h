@@ -0,0 +1,111 @@
+// ============================================================================
+//
+// DynamicResolution.h
+// -----------------------------------
+//
+// DYNAMIC RESOLUTION HEADER FILE
+//
+// Picks the scale the scene is rendered at, relative to the window, from
+// the measured GPU frame time. GPU cost grows with the pixel count, so the
+// scale that would meet the budget is the current one times the square
+// root of budget / time. Scales move in fixed steps (every step is a
+// render target size the pool keeps), only when the averaged time is
+// clearly off the budget, and then settle for a while: timings arrive a
+// frame or two late and a new size costs an allocation.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <cmath>
+#include <algorithm>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+using namespace std;
+
+// Scale limits and step
+const GLfloat DYNAMIC_RES_MIN_SCALE = 0.5f;
+const GLfloat DYNAMIC_RES_STEP = 0.05f;
+const GLfloat DYNAMIC_RES_MAX_CHANGE = 0.15f;	// per adjustment
+
+// Averaged time must leave [budget * low, budget * high] to change scale
+const GLfloat DYNAMIC_RES_LOW = 0.85f;
+const GLfloat DYNAMIC_RES_HIGH = 1.05f;
+
+// Frames to wait after a change, and weight of a new sample in the average
+const GLuint DYNAMIC_RES_SETTLE_FRAMES = 30;
+const GLdouble DYNAMIC_RES_SMOOTHING = 0.1;
+
+// Dynamic Resolution class
+class DynamicResolution {
+private:
+	GLdouble averageMs;
+	GLuint settle;
+
+public:
+	GLfloat budgetMs;		// 0 = keep the scale fixed
+	GLfloat scale;
+
+	DynamicResolution();
+	void Update(GLdouble gpuMs);
+	void Size(GLsizei width, GLsizei height, GLsizei& scaledWidth, GLsizei& scaledHeight) const;
+	GLdouble AverageMs() const;
+
+	static GLfloat Quantize(GLfloat scale);
+};
+
+// Constructor - full resolution, no budget
+DynamicResolution::DynamicResolution() {
+	this->averageMs = 0.0;
+	this->settle = 0;
+	this->budgetMs = 0.0f;
+	this->scale = 1.0f;
+}
+
+// Round to a step within [DYNAMIC_RES_MIN_SCALE, 1]
+GLfloat DynamicResolution::Quantize(GLfloat scale) {
+	scale = floor(scale / DYNAMIC_RES_STEP + 0.5f) * DYNAMIC_RES_STEP;
+	return min(max(scale, DYNAMIC_RES_MIN_SCALE), 1.0f);
+}
+
+// Feed the last measured GPU frame time (0 = nothing measured yet)
+void DynamicResolution::Update(GLdouble gpuMs) {
+	if (this->budgetMs <= 0.0f || gpuMs <= 0.0)
+		return;
+	this->averageMs = this->averageMs == 0.0 ? gpuMs : this->averageMs + (gpuMs - this->averageMs) * DYNAMIC_RES_SMOOTHING;
+	if (this->settle > 0) {
+		this->settle--;
+		return;
+	}
+	if (this->averageMs <= this->budgetMs * DYNAMIC_RES_HIGH && this->averageMs >= this->budgetMs * DYNAMIC_RES_LOW)
+		return;
+
+	GLfloat wanted = this->scale * (GLfloat)sqrt(this->budgetMs / this->averageMs);
+	wanted = min(max(wanted, this->scale - DYNAMIC_RES_MAX_CHANGE), this->scale + DYNAMIC_RES_MAX_CHANGE);
+	GLfloat next = Quantize(wanted);
+
+	// At least one step, so a small miss is not rounded away
+	if (this->averageMs > this->budgetMs && next >= this->scale)
+		next = Quantize(this->scale - DYNAMIC_RES_STEP);
+	else if (this->averageMs < this->budgetMs && next <= this->scale)
+		next = Quantize(this->scale + DYNAMIC_RES_STEP);
+	if (next != this->scale) {
+		this->scale = next;
+		this->settle = DYNAMIC_RES_SETTLE_FRAMES;
+		this->averageMs = 0.0;
+	}
+}
+
+// Render size for a window size
+void DynamicResolution::Size(GLsizei width, GLsizei height, GLsizei& scaledWidth, GLsizei& scaledHeight) const {
+	scaledWidth = max((GLsizei)(width * this->scale + 0.5f), 1);
+	scaledHeight = max((GLsizei)(height * this->scale + 0.5f), 1);
+}
+
+// Averaged GPU frame time since the last change
+GLdouble DynamicResolution::AverageMs() const {
+	return this->averageMs;
+}
@@ -0,0 +1,101 @@
+// ============================================================================
+//
+// GaussianKernel.h
+// -----------------------------------
+//
+// GAUSSIAN KERNEL HEADER FILE
+//
+// Weights of a separable Gaussian blur for any sigma, with neighbouring
+// taps merged into one bilinear fetch: sampling between texels i and i + 1
+// at offset (i w(i) + (i+1) w(i+1)) / (w(i) + w(i+1)) returns their
+// weighted sum, so a radius r kernel costs r + 1 fetches per direction
+// instead of 2r + 1. Kernels are handed to blur_fshader.glsl as #defines,
+// which keeps them compile time constants in each shader variant.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+using namespace std;
+
+// The kernel stops at GAUSSIAN_EXTENT sigma (the original 9 tap blur was
+// sigma 1.8, radius 4) and is renormalized over what is kept
+const GLfloat GAUSSIAN_EXTENT = 2.0f;
+const GLuint GAUSSIAN_MAX_RADIUS = 16;
+const GLuint GAUSSIAN_MAX_TAPS = GAUSSIAN_MAX_RADIUS / 2 + 1;
+
+// Sigmas are rounded to this step so nearby values share a variant
+const GLfloat GAUSSIAN_SIGMA_STEP = 0.1f;
+const GLfloat GAUSSIAN_MIN_SIGMA = 0.5f;
+const GLfloat GAUSSIAN_MAX_SIGMA = GAUSSIAN_MAX_RADIUS / GAUSSIAN_EXTENT;
+
+// One side of a merged kernel. Tap 0 is the centre texel; the others are
+// sampled on both sides at +-offsets[i] texels.
+struct GaussianKernel {
+	GLfloat sigma;
+	GLuint radius;
+	GLuint taps;
+	GLfloat weights[GAUSSIAN_MAX_TAPS];
+	GLfloat offsets[GAUSSIAN_MAX_TAPS];
+};
+
+// Round to the variant step and keep within the supported range
+inline GLfloat QuantizeSigma(GLfloat sigma) {
+	sigma = floor(sigma / GAUSSIAN_SIGMA_STEP + 0.5f) * GAUSSIAN_SIGMA_STEP;
+	return min(max(sigma, GAUSSIAN_MIN_SIGMA), GAUSSIAN_MAX_SIGMA);
+}
+
+// Normalized discrete weights out to the radius, then merged in pairs
+inline GaussianKernel MakeGaussianKernel(GLfloat sigma) {
+	GaussianKernel kernel;
+	kernel.sigma = QuantizeSigma(sigma);
+	kernel.radius = min((GLuint)ceil(kernel.sigma * GAUSSIAN_EXTENT), GAUSSIAN_MAX_RADIUS);
+
+	GLfloat discrete[GAUSSIAN_MAX_RADIUS + 1];
+	GLfloat sum = 0.0f;
+	for (GLuint i = 0; i <= kernel.radius; i++) {
+		discrete[i] = exp(-(GLfloat)(i * i) / (2.0f * kernel.sigma * kernel.sigma));
+		sum += i == 0 ? discrete[i] : 2.0f * discrete[i];
+	}
+	for (GLuint i = 0; i <= kernel.radius; i++)
+		discrete[i] /= sum;
+
+	kernel.weights[0] = discrete[0];
+	kernel.offsets[0] = 0.0f;
+	kernel.taps = 1;
+	for (GLuint i = 1; i <= kernel.radius; i += 2) {
+		GLfloat next = i + 1 <= kernel.radius ? discrete[i + 1] : 0.0f;
+		kernel.weights[kernel.taps] = discrete[i] + next;
+		kernel.offsets[kernel.taps] = (i * discrete[i] + (i + 1) * next) / (discrete[i] + next);
+		kernel.taps++;
+	}
+	return kernel;
+}
+
+// Texture fetches of one pass (one direction)
+inline GLuint GaussianFetches(const GaussianKernel& kernel) {
+	return 2 * kernel.taps - 1;
+}
+
+// #define lines for blur_fshader.glsl: BLUR_TAPS, BLUR_WEIGHTS, BLUR_OFFSETS
+inline string GaussianDefines(const GaussianKernel& kernel) {
+	stringstream weights, offsets;
+	weights.precision(9);
+	offsets.precision(9);
+	for (GLuint i = 0; i < kernel.taps; i++) {
+		weights << (i ? ", " : "") << fixed << kernel.weights[i];
+		offsets << (i ? ", " : "") << fixed << kernel.offsets[i];
+	}
+	return "#define BLUR_TAPS " + to_string(kernel.taps) + "\n"
+		+ "#define BLUR_WEIGHTS float[](" + weights.str() + ")\n"
+		+ "#define BLUR_OFFSETS float[](" + offsets.str() + ")\n";
+}
@@ -0,0 +1,212 @@
+// ============================================================================
+//
+// GpuCuller.h
+// -----------------------------------
+//
+// GPU CULLER HEADER FILE
+//
+// Frustum culling of instances on the GPU with transform feedback (GL 3.3).
+// Each instance is drawn as one point with rasterization disabled; the
+// geometry shader emits only the visible ones, so the feedback buffer ends
+// up holding a compacted list of instance matrices and original indices.
+// The instances are read straight from the buffer they were uploaded to.
+// With GL 4.4 or ARB_query_buffer_object the number of primitives written is
+// copied by the GPU into indirect draw commands and only read back when
+// asked to (benchmarks report triangle counts); otherwise the count is read
+// on the CPU, which waits for the pass.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <cstddef>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+// Other includes
+#include "UseShader.h"
+#include "ModelObj.h"
+#include "InstanceCuller.h"
+
+using namespace std;
+using namespace glm;
+
+// Bytes per instance in the feedback buffer: matrix, then index
+const GLsizei GPU_CULL_STRIDE = sizeof(mat4) + sizeof(GLuint);
+
+// Transform feedback outputs of the cull program, in buffer order
+const GLchar* const GPU_CULL_VARYINGS[2] = { "outMatrix", "outIndex" };
+
+// GPU culler class
+class GpuCuller {
+private:
+	// Cull program and its uniform locations
+	const Shader* program;
+	GLint modelLoc, boundsLoc;
+	GLint planesLoc[6];
+	vec4 bounds;
+
+	// Buffers
+	GLuint inputVAO;
+	GLuint outputBuffer;
+	GLuint commandBuffer;
+	GLuint query;
+	GLuint count, meshCount;
+	bool queryBuffer;
+
+public:
+	// Visible instances after the last Cull(); only read back when the
+	// count cannot stay on the GPU, or when readBack is set
+	GLuint visibleCount;
+	bool readBack;
+
+	GpuCuller();
+	void Init(const Shader& cullShader, const Model& model, GLuint matrixBuffer, GLuint count, const vec4& bounds);
+	void SetSource(GLuint matrixBuffer, GLintptr offset);
+	void BindInstances(Model& model, GLuint matrixAttrib, GLuint indexAttrib);
+	void Cull(const mat4& model, const mat4& viewProjection);
+	void Draw(const Shader& shader, Model& model);
+	bool QueryBuffer();
+};
+
+// Constructor
+GpuCuller::GpuCuller() {
+	this->program = nullptr;
+	this->inputVAO = 0;
+	this->outputBuffer = 0;
+	this->commandBuffer = 0;
+	this->query = 0;
+	this->count = 0;
+	this->meshCount = 0;
+	this->queryBuffer = false;
+	this->visibleCount = 0;
+	this->readBack = false;
+}
+
+// Read count instance matrices from matrixBuffer, and create the feedback
+// buffer and one indirect command per mesh of the model that will draw the
+// survivors
+void GpuCuller::Init(const Shader& cullShader, const Model& model, GLuint matrixBuffer, GLuint count, const vec4& bounds) {
+	this->program = &cullShader;
+	this->modelLoc = cullShader.Uniform("model");
+	this->boundsLoc = cullShader.Uniform("bounds");
+	for (GLuint i = 0; i < 6; i++)
+		this->planesLoc[i] = cullShader.Uniform("planes[" + to_string(i) + "]");
+	this->bounds = bounds;
+	this->count = count;
+	this->meshCount = model.meshes.size();
+	this->queryBuffer = GLEW_VERSION_4_4 || GLEW_ARB_query_buffer_object;
+
+	// Input: one point per instance (the index is gl_VertexID)
+	glGenVertexArrays(1, &this->inputVAO);
+	this->SetSource(matrixBuffer, 0);
+
+	// Output: room for every instance
+	glGenBuffers(1, &this->outputBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, this->outputBuffer);
+	glBufferData(GL_ARRAY_BUFFER, count * GPU_CULL_STRIDE, NULL, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Indirect commands whose instance count the query fills in
+	if (this->queryBuffer) {
+		vector<DrawElementsIndirectCommand> commands(this->meshCount);
+		for (GLuint i = 0; i < commands.size(); i++) {
+			commands[i].count = model.meshes[i].Lod(0).indexCount;
+			commands[i].instanceCount = 0;
+			commands[i].firstIndex = 0;
+			commands[i].baseVertex = 0;
+			commands[i].baseInstance = 0;
+		}
+		glGenBuffers(1, &this->commandBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	glGenQueries(1, &this->query);
+}
+
+// Read the instance matrices from offset in matrixBuffer (for matrices that
+// are rewritten every frame into a different region)
+void GpuCuller::SetSource(GLuint matrixBuffer, GLintptr offset) {
+	glBindVertexArray(this->inputVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, matrixBuffer);
+	for (GLuint i = 0; i < 4; i++) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribPointer(i, 4, GL_FLOAT, GL_FALSE, sizeof(mat4), (GLvoid*)(offset + sizeof(vec4) * i));
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Point the instance attributes of every mesh at the compacted list
+void GpuCuller::BindInstances(Model& model, GLuint matrixAttrib, GLuint indexAttrib) {
+	glBindBuffer(GL_ARRAY_BUFFER, this->outputBuffer);
+	for (GLuint i = 0; i < model.meshes.size(); i++) {
+		glBindVertexArray(model.meshes[i].VAO);
+		for (GLuint j = 0; j < 4; j++) {
+			glEnableVertexAttribArray(matrixAttrib + j);
+			glVertexAttribPointer(matrixAttrib + j, 4, GL_FLOAT, GL_FALSE, GPU_CULL_STRIDE, (GLvoid*)(sizeof(vec4) * j));
+			glVertexAttribDivisor(matrixAttrib + j, 1);
+		}
+		glEnableVertexAttribArray(indexAttrib);
+		glVertexAttribIPointer(indexAttrib, 1, GL_UNSIGNED_INT, GPU_CULL_STRIDE, (GLvoid*)sizeof(mat4));
+		glVertexAttribDivisor(indexAttrib, 1);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Run the cull pass. Leaves the cull program bound.
+void GpuCuller::Cull(const mat4& model, const mat4& viewProjection) {
+	vec4 planes[6];
+	InstanceCuller::FrustumPlanes(viewProjection, planes);
+
+	glUseProgram(this->program->Program);
+	this->program->SetMat4(this->modelLoc, model);
+	this->program->SetVec4(this->boundsLoc, this->bounds);
+	for (GLuint i = 0; i < 6; i++)
+		this->program->SetVec4(this->planesLoc[i], planes[i]);
+
+	// Capture the visible points, nothing is rasterized
+	glEnable(GL_RASTERIZER_DISCARD);
+	glBindVertexArray(this->inputVAO);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, this->outputBuffer);
+	glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, this->query);
+	glBeginTransformFeedback(GL_POINTS);
+	glDrawArrays(GL_POINTS, 0, this->count);
+	glEndTransformFeedback();
+	glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+	glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+	glBindVertexArray(0);
+	glDisable(GL_RASTERIZER_DISCARD);
+
+	// Copy the count into each command's instanceCount on the GPU
+	if (this->queryBuffer) {
+		glBindBuffer(GL_QUERY_BUFFER, this->commandBuffer);
+		for (GLuint i = 0; i < this->meshCount; i++) {
+			GLintptr offset = i * sizeof(DrawElementsIndirectCommand) + offsetof(DrawElementsIndirectCommand, instanceCount);
+			glGetQueryObjectuiv(this->query, GL_QUERY_RESULT, (GLuint*)offset);
+		}
+		glBindBuffer(GL_QUERY_BUFFER, 0);
+	}
+	if (!this->queryBuffer || this->readBack)
+		glGetQueryObjectuiv(this->query, GL_QUERY_RESULT, &this->visibleCount);
+}
+
+// Draw the instances that survived the last Cull()
+void GpuCuller::Draw(const Shader& shader, Model& model) {
+	if (this->queryBuffer)
+		model.DrawInstanceIndirect(shader, this->commandBuffer);
+	else if (this->visibleCount > 0)
+		model.DrawInstance(shader, this->visibleCount);
+}
+
+// True when the visible count never leaves the GPU
+bool GpuCuller::QueryBuffer() {
+	return this->queryBuffer;
+}
@@ -0,0 +1,356 @@
+// ============================================================================
+//
+// InstanceCuller.h
+// -----------------------------------
+//
+// INSTANCE CULLER HEADER FILE
+//
+// Frustum culling for large instance counts. Instance bounding spheres are
+// kept in structure-of-arrays form (x, y, z and radius in separate arrays)
+// so SSE / AVX kernels can test 4 or 8 spheres against a frustum plane per
+// instruction. Culling writes a compacted list of visible instance indices
+// without branching on each result. The visible list can then be sorted
+// front to back by view depth, and into level of detail buckets by
+// projected size, one instanced draw each.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <cmath>
+
+// SIMD intrinsics (SSE2 is always present on x86-64; AVX when compiled for it)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CULL_HAS_SSE 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#define CULL_HAS_AVX 1
+#include <immintrin.h>
+#endif
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Most level of detail buckets SortByLod() fills
+const GLuint CULL_MAX_LODS = 8;
+
+// Culling kernels, from slowest to fastest
+enum CullKernel {
+	CULL_SCALAR,
+	CULL_SSE,
+	CULL_AVX
+};
+
+// Instance culler class
+class InstanceCuller {
+private:
+	// Bounding spheres (structure of arrays)
+	vector<GLfloat> centerX, centerY, centerZ, radius;
+	GLuint count;
+
+	// Scratch for SortByLod() and SortByDepth()
+	vector<GLuint> sorted;
+	vector<GLubyte> levels;
+	vector<GLushort> depthKeys, sortedKeys;
+
+	// Frustum planes: xyz = normal, w = distance
+	vec4 planes[6];
+
+	// Functions
+	GLuint cullScalar(GLuint begin, GLuint end, GLuint* out);
+	GLuint cullSSE(GLuint end, GLuint* out);
+	GLuint cullAVX(GLuint end, GLuint* out);
+
+public:
+	// Indices of the instances that survived the last Cull()
+	vector<GLuint> visible;
+	GLuint visibleCount;
+
+	// Level of detail buckets of the visible list: level l is
+	// visible[lodFirst[l] .. lodFirst[l + 1])
+	GLuint lodFirst[CULL_MAX_LODS + 1];
+	GLuint lodCount;
+
+	InstanceCuller();
+	void Resize(GLuint count);
+	void SetSphere(GLuint index, const vec3& center, GLfloat radius);
+	GLuint Cull(const mat4& viewProjection, CullKernel kernel);
+	void CullNone();
+	void SortByLod(const vec3& eye, const GLfloat* sizeLimits, GLuint lods);
+	void SortByDepth(const vec3& eye, const vec3& forward);
+	GLuint Count();
+
+	static void FrustumPlanes(const mat4& viewProjection, vec4 planes[6]);
+	static CullKernel BestKernel();
+	static const char* KernelName(CullKernel kernel);
+	static GLfloat MaxScale(const mat4& matrix);
+};
+
+// Constructor
+InstanceCuller::InstanceCuller() {
+	this->count = 0;
+	this->visibleCount = 0;
+	this->lodCount = 1;
+	this->lodFirst[0] = this->lodFirst[1] = 0;
+}
+
+// Size every array for count instances
+void InstanceCuller::Resize(GLuint count) {
+	this->count = count;
+	this->centerX.resize(count);
+	this->centerY.resize(count);
+	this->centerZ.resize(count);
+	this->radius.resize(count);
+	this->visible.resize(count);
+	this->sorted.resize(count);
+	this->levels.resize(count);
+	this->depthKeys.resize(count);
+	this->sortedKeys.resize(count);
+}
+
+// Set the world-space bounding sphere of one instance
+void InstanceCuller::SetSphere(GLuint index, const vec3& center, GLfloat radius) {
+	this->centerX[index] = center.x;
+	this->centerY[index] = center.y;
+	this->centerZ[index] = center.z;
+	this->radius[index] = radius;
+}
+
+// Gribb / Hartmann plane extraction from the view-projection rows
+void InstanceCuller::FrustumPlanes(const mat4& m, vec4 planes[6]) {
+	vec4 row[4];
+	for (GLuint r = 0; r < 4; r++)
+		row[r] = vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+	for (GLuint i = 0; i < 3; i++) {
+		planes[i * 2] = row[3] + row[i];
+		planes[i * 2 + 1] = row[3] - row[i];
+	}
+	for (GLuint i = 0; i < 6; i++) {
+		vec4& p = planes[i];
+		p = p / length(vec3(p.x, p.y, p.z));
+	}
+}
+
+// Reference kernel. A sphere is visible unless it is entirely behind one plane.
+GLuint InstanceCuller::cullScalar(GLuint begin, GLuint end, GLuint* out) {
+	GLuint n = 0;
+	for (GLuint i = begin; i < end; i++) {
+		bool inside = true;
+		for (GLuint p = 0; p < 6; p++) {
+			const vec4& plane = this->planes[p];
+			GLfloat dist = plane.x * this->centerX[i] + plane.y * this->centerY[i] + plane.z * this->centerZ[i] + plane.w;
+			inside = inside && dist >= -this->radius[i];
+		}
+		out[n] = i;
+		n += inside;
+	}
+	return n;
+}
+
+// Four spheres per step. Returns how many indices were written; the caller
+// finishes the tail with the scalar kernel.
+GLuint InstanceCuller::cullSSE(GLuint end, GLuint* out) {
+	GLuint n = 0;
+#ifdef CULL_HAS_SSE
+	__m128 px[6], py[6], pz[6], pw[6];
+	for (GLuint p = 0; p < 6; p++) {
+		px[p] = _mm_set1_ps(this->planes[p].x);
+		py[p] = _mm_set1_ps(this->planes[p].y);
+		pz[p] = _mm_set1_ps(this->planes[p].z);
+		pw[p] = _mm_set1_ps(this->planes[p].w);
+	}
+	const __m128 zero = _mm_setzero_ps();
+	for (GLuint i = 0; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(&this->centerX[i]);
+		__m128 y = _mm_loadu_ps(&this->centerY[i]);
+		__m128 z = _mm_loadu_ps(&this->centerZ[i]);
+		__m128 r = _mm_sub_ps(zero, _mm_loadu_ps(&this->radius[i]));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (GLuint p = 0; p < 6; p++) {
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px[p], x), _mm_mul_ps(py[p], y)),
+				_mm_add_ps(_mm_mul_ps(pz[p], z), pw[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(dist, r));
+		}
+		GLuint mask = _mm_movemask_ps(inside);
+		for (GLuint j = 0; j < 4; j++) {
+			out[n] = i + j;
+			n += (mask >> j) & 1;
+		}
+	}
+#endif
+	return n;
+}
+
+// Eight spheres per step
+GLuint InstanceCuller::cullAVX(GLuint end, GLuint* out) {
+	GLuint n = 0;
+#ifdef CULL_HAS_AVX
+	__m256 px[6], py[6], pz[6], pw[6];
+	for (GLuint p = 0; p < 6; p++) {
+		px[p] = _mm256_set1_ps(this->planes[p].x);
+		py[p] = _mm256_set1_ps(this->planes[p].y);
+		pz[p] = _mm256_set1_ps(this->planes[p].z);
+		pw[p] = _mm256_set1_ps(this->planes[p].w);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+	for (GLuint i = 0; i + 8 <= end; i += 8) {
+		__m256 x = _mm256_loadu_ps(&this->centerX[i]);
+		__m256 y = _mm256_loadu_ps(&this->centerY[i]);
+		__m256 z = _mm256_loadu_ps(&this->centerZ[i]);
+		__m256 r = _mm256_sub_ps(zero, _mm256_loadu_ps(&this->radius[i]));
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (GLuint p = 0; p < 6; p++) {
+			__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(px[p], x), _mm256_mul_ps(py[p], y)),
+				_mm256_add_ps(_mm256_mul_ps(pz[p], z), pw[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(dist, r, _CMP_GE_OQ));
+		}
+		GLuint mask = _mm256_movemask_ps(inside);
+		for (GLuint j = 0; j < 8; j++) {
+			out[n] = i + j;
+			n += (mask >> j) & 1;
+		}
+	}
+#endif
+	return n;
+}
+
+// Cull every instance against the frustum. Kernels the build does not
+// support fall back to the next narrower one.
+GLuint InstanceCuller::Cull(const mat4& viewProjection, CullKernel kernel) {
+	FrustumPlanes(viewProjection, this->planes);
+	GLuint* out = this->count ? &this->visible[0] : nullptr;
+
+	GLuint done = 0, n = 0;
+#ifdef CULL_HAS_AVX
+	if (kernel == CULL_AVX) {
+		done = this->count / 8 * 8;
+		n = this->cullAVX(done, out);
+	}
+	else
+#endif
+#ifdef CULL_HAS_SSE
+	if (kernel != CULL_SCALAR) {
+		done = this->count / 4 * 4;
+		n = this->cullSSE(done, out);
+	}
+#endif
+	n += this->cullScalar(done, this->count, out + n);
+	this->visibleCount = n;
+	this->lodCount = 1;
+	this->lodFirst[1] = n;
+	return n;
+}
+
+// Mark every instance visible (culling disabled)
+void InstanceCuller::CullNone() {
+	for (GLuint i = 0; i < this->count; i++)
+		this->visible[i] = i;
+	this->visibleCount = this->count;
+	this->lodCount = 1;
+	this->lodFirst[1] = this->count;
+}
+
+// Sort the visible list into level of detail buckets, finest first. An
+// instance takes the coarsest level l whose sizeLimits[l] its projected
+// size (bounding radius / distance from the eye) is still within;
+// sizeLimits[0] is ignored and the limits shrink with the level.
+void InstanceCuller::SortByLod(const vec3& eye, const GLfloat* sizeLimits, GLuint lods) {
+	lods = std::min(std::max(lods, 1u), CULL_MAX_LODS);
+	GLuint counts[CULL_MAX_LODS] = { 0 };
+	for (GLuint i = 0; i < this->visibleCount; i++) {
+		GLuint index = this->visible[i];
+		GLfloat dx = this->centerX[index] - eye.x, dy = this->centerY[index] - eye.y, dz = this->centerZ[index] - eye.z;
+		GLfloat size = this->radius[index] / std::max(sqrt(dx * dx + dy * dy + dz * dz), 1e-3f);
+		GLuint level = 0;
+		while (level + 1 < lods && size <= sizeLimits[level + 1])
+			level++;
+		this->levels[i] = level;
+		counts[level]++;
+	}
+
+	// Counting sort, stable within a level
+	this->lodFirst[0] = 0;
+	for (GLuint l = 0; l < lods; l++)
+		this->lodFirst[l + 1] = this->lodFirst[l] + counts[l];
+	GLuint next[CULL_MAX_LODS];
+	for (GLuint l = 0; l < lods; l++)
+		next[l] = this->lodFirst[l];
+	for (GLuint i = 0; i < this->visibleCount; i++)
+		this->sorted[next[this->levels[i]]++] = this->visible[i];
+	this->visible.swap(this->sorted);
+	this->lodCount = lods;
+}
+
+// Sort the visible list front to back by the depth of each sphere's center
+// along the view direction. Depths are quantized to 16 bits over the range
+// they span, then put in order with two 8 bit counting passes, which are
+// stable, so SortByLod() afterwards keeps each bucket front to back.
+void InstanceCuller::SortByDepth(const vec3& eye, const vec3& forward) {
+	if (this->visibleCount < 2)
+		return;
+	GLfloat nearest = 1e30f, farthest = -1e30f;
+	for (GLuint i = 0; i < this->visibleCount; i++) {
+		GLuint index = this->visible[i];
+		GLfloat depth = (this->centerX[index] - eye.x) * forward.x + (this->centerY[index] - eye.y) * forward.y
+			+ (this->centerZ[index] - eye.z) * forward.z;
+		nearest = std::min(nearest, depth);
+		farthest = std::max(farthest, depth);
+	}
+	GLfloat scale = farthest > nearest ? 65535.0f / (farthest - nearest) : 0.0f;
+	for (GLuint i = 0; i < this->visibleCount; i++) {
+		GLuint index = this->visible[i];
+		GLfloat depth = (this->centerX[index] - eye.x) * forward.x + (this->centerY[index] - eye.y) * forward.y
+			+ (this->centerZ[index] - eye.z) * forward.z;
+		this->depthKeys[i] = (GLushort)((depth - nearest) * scale);
+	}
+
+	for (GLuint shift = 0; shift < 16; shift += 8) {
+		GLuint next[257] = { 0 };
+		for (GLuint i = 0; i < this->visibleCount; i++)
+			next[((this->depthKeys[i] >> shift) & 255) + 1]++;
+		for (GLuint b = 1; b < 257; b++)
+			next[b] += next[b - 1];
+		for (GLuint i = 0; i < this->visibleCount; i++) {
+			GLuint slot = next[(this->depthKeys[i] >> shift) & 255]++;
+			this->sorted[slot] = this->visible[i];
+			this->sortedKeys[slot] = this->depthKeys[i];
+		}
+		this->visible.swap(this->sorted);
+		this->depthKeys.swap(this->sortedKeys);
+	}
+}
+
+GLuint InstanceCuller::Count() {
+	return this->count;
+}
+
+// Widest kernel this build supports
+CullKernel InstanceCuller::BestKernel() {
+#if defined(CULL_HAS_AVX)
+	return CULL_AVX;
+#elif defined(CULL_HAS_SSE)
+	return CULL_SSE;
+#else
+	return CULL_SCALAR;
+#endif
+}
+
+const char* InstanceCuller::KernelName(CullKernel kernel) {
+	static const char* names[3] = { "scalar", "sse", "avx" };
+	return names[kernel];
+}
+
+// Largest axis scale of a transform, to scale a bounding sphere's radius
+GLfloat InstanceCuller::MaxScale(const mat4& m) {
+	GLfloat sx = dot(vec3(m[0]), vec3(m[0]));
+	GLfloat sy = dot(vec3(m[1]), vec3(m[1]));
+	GLfloat sz = dot(vec3(m[2]), vec3(m[2]));
+	return sqrt(max(sx, max(sy, sz)));
+}
@@ -0,0 +1,243 @@
+// ============================================================================
+//
+// InstanceFormat.h
+// -----------------------------------
+//
+// INSTANCE FORMAT HEADER FILE
+//
+// Per-instance vertex data layouts. Every butterfly transform is only a
+// translation, a uniform scale and a rotation, so besides the full mat4
+// (64 bytes) it can be sent as position + scale and a quaternion, either in
+// floats (32 bytes) or as unorm16 and snorm16 (16 bytes). Packed positions
+// and scales are stored within a box around the whole field, so their error
+// is the same everywhere in it instead of growing with the distance from
+// the origin as half floats' does. The vertex shader rebuilds the matrix
+// from the compact forms.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <cmath>
+#include <cstring>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+#include "glm\gtc\packing.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Instance layouts, from largest to smallest
+enum InstanceFormat {
+	INSTANCE_MAT4,
+	INSTANCE_TRS,
+	INSTANCE_TRS_PACKED
+};
+
+// Position (xyz) + uniform scale (w), rotation quaternion (xyzw)
+struct InstanceTRS {
+	vec4 positionScale;
+	vec4 rotation;
+};
+
+// The same, as four unorm16 values within the quantization box and four
+// snorm16 values
+struct InstancePackedTRS {
+	GLuint positionScale[2];
+	GLuint rotation[2];
+};
+
+// Box the packed positions and scales span: value = offset + unorm * scale
+struct InstanceQuantization {
+	vec4 offset;
+	vec4 scale;
+};
+
+// Bytes per instance
+GLuint InstanceStride(InstanceFormat format) {
+	static const GLuint strides[3] = { sizeof(mat4), sizeof(InstanceTRS), sizeof(InstancePackedTRS) };
+	return strides[format];
+}
+
+const char* InstanceFormatName(InstanceFormat format) {
+	static const char* names[3] = { "mat4", "trs", "packed" };
+	return names[format];
+}
+
+// Look a format up by name; false if there is no such format
+bool ParseInstanceFormat(const char* name, InstanceFormat& format) {
+	for (GLuint i = INSTANCE_MAT4; i <= INSTANCE_TRS_PACKED; i++) {
+		if (strcmp(name, InstanceFormatName((InstanceFormat)i)) == 0) {
+			format = (InstanceFormat)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Unit quaternion (xyz = axis * sin, w = cos) of a pure rotation matrix
+vec4 RotationQuat(const mat3& m) {
+	vec4 q;
+	GLfloat trace = m[0][0] + m[1][1] + m[2][2];
+	if (trace > 0.0f) {
+		GLfloat s = sqrt(trace + 1.0f) * 2.0f;
+		q = vec4((m[1][2] - m[2][1]) / s, (m[2][0] - m[0][2]) / s, (m[0][1] - m[1][0]) / s, 0.25f * s);
+	}
+	else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+		GLfloat s = sqrt(1.0f + m[0][0] - m[1][1] - m[2][2]) * 2.0f;
+		q = vec4(0.25f * s, (m[1][0] + m[0][1]) / s, (m[2][0] + m[0][2]) / s, (m[1][2] - m[2][1]) / s);
+	}
+	else if (m[1][1] > m[2][2]) {
+		GLfloat s = sqrt(1.0f + m[1][1] - m[0][0] - m[2][2]) * 2.0f;
+		q = vec4((m[1][0] + m[0][1]) / s, 0.25f * s, (m[2][1] + m[1][2]) / s, (m[2][0] - m[0][2]) / s);
+	}
+	else {
+		GLfloat s = sqrt(1.0f + m[2][2] - m[0][0] - m[1][1]) * 2.0f;
+		q = vec4((m[2][0] + m[0][2]) / s, (m[2][1] + m[1][2]) / s, 0.25f * s, (m[0][1] - m[1][0]) / s);
+	}
+	return normalize(q);
+}
+
+// Box around the positions and scales of the instances, with margin room
+// on every side of the positions for instances that move. Flat sides get
+// a scale of 1 so that they still decode exactly.
+InstanceQuantization InstanceQuantizationOf(const mat4* instances, GLuint count, GLfloat margin) {
+	InstanceQuantization quantization = { vec4(0.0f), vec4(1.0f) };
+	if (!count)
+		return quantization;
+	vec4 lo(vec3(instances[0][3]), length(vec3(instances[0][0]))), hi = lo;
+	for (GLuint i = 1; i < count; i++) {
+		vec4 value(vec3(instances[i][3]), length(vec3(instances[i][0])));
+		lo = min(lo, value);
+		hi = max(hi, value);
+	}
+	lo -= vec4(margin, margin, margin, 0.0f);
+	hi += vec4(margin, margin, margin, 0.0f);
+	quantization.offset = lo;
+	for (GLuint a = 0; a < 4; a++)
+		quantization.scale[a] = hi[a] > lo[a] ? hi[a] - lo[a] : 1.0f;
+	return quantization;
+}
+
+// Split a translate * uniform scale * rotation matrix into its parts
+InstanceTRS DecomposeInstance(const mat4& m) {
+	InstanceTRS trs;
+	GLfloat scale = length(vec3(m[0]));
+	trs.positionScale = vec4(vec3(m[3]), scale);
+	trs.rotation = RotationQuat(mat3(vec3(m[0]) / scale, vec3(m[1]) / scale, vec3(m[2]) / scale));
+	return trs;
+}
+
+// Matrix of a translate * uniform scale * rotate instance
+mat4 TRSMatrix(const InstanceTRS& trs) {
+	mat4 matrix;
+	const vec4& q = trs.rotation;
+	GLfloat s = trs.positionScale.w;
+	matrix[0] = vec4(s * (1.0f - 2.0f * (q.y * q.y + q.z * q.z)), s * 2.0f * (q.x * q.y + q.w * q.z), s * 2.0f * (q.x * q.z - q.w * q.y), 0.0f);
+	matrix[1] = vec4(s * 2.0f * (q.x * q.y - q.w * q.z), s * (1.0f - 2.0f * (q.x * q.x + q.z * q.z)), s * 2.0f * (q.y * q.z + q.w * q.x), 0.0f);
+	matrix[2] = vec4(s * 2.0f * (q.x * q.z + q.w * q.y), s * 2.0f * (q.y * q.z - q.w * q.x), s * (1.0f - 2.0f * (q.x * q.x + q.y * q.y)), 0.0f);
+	matrix[3] = vec4(vec3(trs.positionScale), 1.0f);
+	return matrix;
+}
+
+// Write one instance, given as its parts, in the given format. Packed
+// values outside the quantization box are clamped to it.
+void EncodeInstance(InstanceFormat format, const InstanceTRS& trs, const InstanceQuantization& quantization, GLubyte* out) {
+	if (format == INSTANCE_MAT4) {
+		mat4 matrix = TRSMatrix(trs);
+		memcpy(out, &matrix, sizeof(mat4));
+	}
+	else if (format == INSTANCE_TRS)
+		memcpy(out, &trs, sizeof(InstanceTRS));
+	else {
+		InstancePackedTRS packed;
+		vec4 p = clamp((trs.positionScale - quantization.offset) / quantization.scale, 0.0f, 1.0f);
+		const vec4& q = trs.rotation;
+		packed.positionScale[0] = packUnorm2x16(vec2(p.x, p.y));
+		packed.positionScale[1] = packUnorm2x16(vec2(p.z, p.w));
+		packed.rotation[0] = packSnorm2x16(vec2(q.x, q.y));
+		packed.rotation[1] = packSnorm2x16(vec2(q.z, q.w));
+		memcpy(out, &packed, sizeof(InstancePackedTRS));
+	}
+}
+
+// Write one instance, given as a matrix, in the given format
+void EncodeInstance(InstanceFormat format, const mat4& matrix, const InstanceQuantization& quantization, GLubyte* out) {
+	if (format == INSTANCE_MAT4)
+		memcpy(out, &matrix, sizeof(mat4));
+	else
+		EncodeInstance(format, DecomposeInstance(matrix), quantization, out);
+}
+
+// Rebuild the matrix the way main_vshader.glsl does (for checking)
+mat4 DecodeInstance(InstanceFormat format, const GLubyte* data, const InstanceQuantization& quantization) {
+	if (format == INSTANCE_MAT4) {
+		mat4 matrix;
+		memcpy(&matrix, data, sizeof(mat4));
+		return matrix;
+	}
+	InstanceTRS trs;
+	if (format == INSTANCE_TRS)
+		memcpy(&trs, data, sizeof(InstanceTRS));
+	else {
+		InstancePackedTRS packed;
+		memcpy(&packed, data, sizeof(InstancePackedTRS));
+		vec2 pxy = unpackUnorm2x16(packed.positionScale[0]), pzw = unpackUnorm2x16(packed.positionScale[1]);
+		vec2 qxy = unpackSnorm2x16(packed.rotation[0]), qzw = unpackSnorm2x16(packed.rotation[1]);
+		trs.positionScale = quantization.offset + vec4(pxy.x, pxy.y, pzw.x, pzw.y) * quantization.scale;
+		trs.rotation = vec4(qxy.x, qxy.y, qzw.x, qzw.y);
+	}
+	return TRSMatrix(trs);
+}
+
+// Copy the listed instances (stored contiguously in the given format) to out
+template<class Instance>
+void gatherInstances(const GLubyte* source, const GLuint* indices, GLuint count, GLubyte* out) {
+	const Instance* from = (const Instance*)source;
+	Instance* to = (Instance*)out;
+	for (GLuint i = 0; i < count; i++)
+		to[i] = from[indices[i]];
+}
+
+void GatherInstances(InstanceFormat format, const GLubyte* source, const GLuint* indices, GLuint count, GLubyte* out) {
+	if (format == INSTANCE_MAT4)
+		gatherInstances<mat4>(source, indices, count, out);
+	else if (format == INSTANCE_TRS)
+		gatherInstances<InstanceTRS>(source, indices, count, out);
+	else
+		gatherInstances<InstancePackedTRS>(source, indices, count, out);
+}
+
+// Point attributes first .. first + 3 of the bound VAO at instances in the
+// bound GL_ARRAY_BUFFER, starting at offset. Compact formats use the first
+// two; the others are disabled and read as (0, 0, 0, 1).
+void SetInstanceAttributes(InstanceFormat format, GLuint first, GLintptr offset) {
+	GLsizei stride = InstanceStride(format);
+	if (format == INSTANCE_MAT4) {
+		for (GLuint j = 0; j < 4; j++) {
+			glEnableVertexAttribArray(first + j);
+			glVertexAttribPointer(first + j, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(offset + sizeof(vec4) * j));
+			glVertexAttribDivisor(first + j, 1);
+		}
+		return;
+	}
+	if (format == INSTANCE_TRS) {
+		glVertexAttribPointer(first, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offset);
+		glVertexAttribPointer(first + 1, 4, GL_FLOAT, GL_FALSE, stride, (GLvoid*)(offset + sizeof(vec4)));
+	}
+	else {
+		glVertexAttribPointer(first, 4, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)offset);
+		glVertexAttribPointer(first + 1, 4, GL_SHORT, GL_TRUE, stride, (GLvoid*)(offset + 2 * sizeof(GLuint)));
+	}
+	for (GLuint j = 0; j < 4; j++) {
+		if (j < 2) {
+			glEnableVertexAttribArray(first + j);
+			glVertexAttribDivisor(first + j, 1);
+		}
+		else
+			glDisableVertexAttribArray(first + j);
+	}
+}
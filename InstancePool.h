@@ -0,0 +1,188 @@
+// ============================================================================
+//
+// InstancePool.h
+// -----------------------------------
+//
+// INSTANCE POOL HEADER FILE
+//
+// Growable, cache-line aligned storage for instance matrices, sized at run
+// time, plus the GL buffer they are uploaded to. Generation runs on the
+// job system; every block of instances draws from its own seeded random
+// stream, so the result is the same for a given seed whatever the number
+// of threads.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+// Other includes
+#include "JobSystem.h"
+
+using namespace std;
+using namespace glm;
+
+// Storage alignment (one cache line)
+const size_t INSTANCE_POOL_ALIGNMENT = 64;
+
+// Instances generated from one random stream
+const GLuint INSTANCE_RNG_BLOCK = 4096;
+
+// Small, fast random stream (xorshift64*), seeded through splitmix64
+struct InstanceRng {
+	uint64_t state;
+
+	InstanceRng(uint64_t seed) {
+		uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		this->state = (z ^ (z >> 31)) | 1;
+	}
+
+	// Next 32 random bits
+	GLuint Next() {
+		this->state ^= this->state >> 12;
+		this->state ^= this->state << 25;
+		this->state ^= this->state >> 27;
+		return (GLuint)((this->state * 0x2545F4914F6CDD1Dull) >> 32);
+	}
+
+	// Uniform in [0, 1)
+	GLfloat Uniform() {
+		return (this->Next() >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+// Instance pool class
+class InstancePool {
+private:
+	// Data
+	mat4* matrices;
+	void* allocation;
+	GLuint count, capacity;
+	JobSystem* pool;
+
+	// GL buffer
+	GLuint buffer;
+	GLuint bufferCapacity;
+
+public:
+	InstancePool();
+	~InstancePool();
+	void Init(JobSystem* pool);
+	bool Resize(GLuint count);
+
+	// Calls generate(rng, index) for every instance, on all cores
+	template<class Generator>
+	void Generate(GLuint seed, Generator& generate);
+
+	void Upload();
+	mat4* Matrices();
+	mat4& operator[](GLuint index);
+	GLuint Count();
+	GLuint Buffer();
+};
+
+// Constructor
+InstancePool::InstancePool() {
+	this->matrices = nullptr;
+	this->allocation = nullptr;
+	this->count = 0;
+	this->capacity = 0;
+	this->pool = nullptr;
+	this->buffer = 0;
+	this->bufferCapacity = 0;
+}
+
+// Free the storage (the GL buffer goes with the context)
+InstancePool::~InstancePool() {
+	free(this->allocation);
+}
+
+// Generation is spread over the pool when one is given
+void InstancePool::Init(JobSystem* pool) {
+	this->pool = pool;
+}
+
+// Set the instance count. Growing keeps the existing instances; the storage
+// at least doubles so repeated growth stays cheap. False, with the pool
+// left as it was, if the storage cannot grow.
+bool InstancePool::Resize(GLuint count) {
+	if (count > this->capacity) {
+		size_t capacity = min(max((size_t)count, (size_t)this->capacity * 2), (size_t)UINT32_MAX);
+		void* allocation = nullptr;
+		if (capacity <= (SIZE_MAX - INSTANCE_POOL_ALIGNMENT) / sizeof(mat4))
+			allocation = malloc(capacity * sizeof(mat4) + INSTANCE_POOL_ALIGNMENT);
+		if (!allocation) {
+			cout << "ERROR::INSTANCE_POOL::OUT_OF_MEMORY " << capacity << " instances" << endl;
+			return false;
+		}
+		mat4* matrices = (mat4*)(((uintptr_t)allocation + INSTANCE_POOL_ALIGNMENT - 1) & ~(uintptr_t)(INSTANCE_POOL_ALIGNMENT - 1));
+		if (this->count)
+			memcpy(matrices, this->matrices, this->count * sizeof(mat4));
+		free(this->allocation);
+		this->allocation = allocation;
+		this->matrices = matrices;
+		this->capacity = (GLuint)capacity;
+	}
+	this->count = count;
+	return true;
+}
+
+// Block b always uses the stream seeded with (seed, b)
+template<class Generator>
+void InstancePool::Generate(GLuint seed, Generator& generate) {
+	GLuint blocks = (this->count + INSTANCE_RNG_BLOCK - 1) / INSTANCE_RNG_BLOCK;
+	auto body = [&](GLuint begin, GLuint end) {
+		for (GLuint b = begin; b < end; b++) {
+			InstanceRng rng(((uint64_t)seed << 32) | b);
+			GLuint last = min((b + 1) * INSTANCE_RNG_BLOCK, this->count);
+			for (GLuint i = b * INSTANCE_RNG_BLOCK; i < last; i++)
+				this->matrices[i] = generate(rng, i);
+		}
+	};
+	if (this->pool)
+		this->pool->ParallelFor(blocks, 1, body);
+	else
+		body(0, blocks);
+}
+
+// Copy the instances to the GL buffer. The buffer keeps its name when it
+// has to grow, so VAOs that point at it stay valid.
+void InstancePool::Upload() {
+	if (!this->buffer)
+		glGenBuffers(1, &this->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+	if (this->count > this->bufferCapacity) {
+		this->bufferCapacity = this->capacity;
+		glBufferData(GL_ARRAY_BUFFER, this->bufferCapacity * sizeof(mat4), NULL, GL_STATIC_DRAW);
+	}
+	if (this->count)
+		glBufferSubData(GL_ARRAY_BUFFER, 0, this->count * sizeof(mat4), this->matrices);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+mat4* InstancePool::Matrices() {
+	return this->matrices;
+}
+
+mat4& InstancePool::operator[](GLuint index) {
+	return this->matrices[index];
+}
+
+GLuint InstancePool::Count() {
+	return this->count;
+}
+
+GLuint InstancePool::Buffer() {
+	return this->buffer;
+}
@@ -0,0 +1,263 @@
+// ============================================================================
+//
+// InstanceSim.h
+// -----------------------------------
+//
+// INSTANCE SIMULATION HEADER FILE
+//
+// Per-frame motion for every instance. State is kept in structure-of-arrays
+// form and updated in chunks on the job system. Each instance steers toward
+// its home spot carried along by its flock, matches the flock's drift and
+// wanders a little; wings flap as a roll about the heading. An instance's
+// update only reads its own state and the per-frame flock values, so the
+// result does not depend on how the work is split. Transforms are encoded
+// straight into the caller's (mapped) instance buffer.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <cmath>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+// Other includes
+#include "JobSystem.h"
+#include "InstancePool.h"
+#include "InstanceFormat.h"
+#include "InstanceCuller.h"
+
+using namespace std;
+using namespace glm;
+
+// Simulation settings (instance units, before the model transform)
+const GLuint SIM_FLOCKS = 4;			// matches the four glow groups
+const GLuint SIM_GRAIN = 2048;			// instances per job
+const GLfloat SIM_MAX_SPEED = 60.0f;
+const GLfloat SIM_COHESION = 0.5f;		// pull toward the home spot
+const GLfloat SIM_ALIGNMENT = 0.8f;		// pull toward the flock's drift
+const GLfloat SIM_WANDER = 40.0f;
+const GLfloat SIM_WANDER_PHASE[3] = { 1.3f, 2.1f, 1.7f };	// per axis, times the instance phase
+const GLfloat SIM_WANDER_RATE[3] = { 0.7f, 1.1f, 0.9f };	// per axis, radians per second
+const GLfloat SIM_FLAP_ANGLE = 0.6f;	// radians of roll at full flap
+const GLfloat SIM_MAX_STEP = 0.1f;		// longest time step simulated at once
+const GLfloat SIM_REACH = 320.0f;		// farthest an instance strays from its home spot
+
+// Instance simulation class
+class InstanceSimulation {
+private:
+	// State (structure of arrays)
+	vector<GLfloat> posX, posY, posZ;
+	vector<GLfloat> velX, velY, velZ;
+	vector<GLfloat> homeX, homeY, homeZ;
+	vector<GLfloat> rotX, rotY, rotZ, rotW;
+	vector<GLfloat> scale, phase, flapRate;
+	vector<GLfloat> wanderSin[3], wanderCos[3];	// of each wander axis' phase
+	GLuint count;
+	JobSystem* pool;
+
+	// Culling spheres are written in world space
+	mat4 model;
+	GLfloat modelScale;
+	vec4 bounds;
+
+	// Current frame
+	GLfloat dt, time;
+	vec3 flockOffset[SIM_FLOCKS], flockDrift[SIM_FLOCKS];
+	GLfloat timeSin[3], timeCos[3];
+
+	// Functions
+	void step(GLuint begin, GLuint end, InstanceCuller* culler);
+	InstanceTRS transform(GLuint index);
+
+public:
+	InstanceSimulation();
+	void Init(JobSystem* pool, InstancePool& instances, const mat4& model, const vec4& bounds);
+	void Update(GLfloat dt, GLdouble time, InstanceCuller* culler);
+	void Write(InstanceFormat format, const InstanceQuantization& quantization, const GLuint* indices, GLuint count, GLubyte* out);
+	void WriteAll(InstanceFormat format, const InstanceQuantization& quantization, GLubyte* out);
+	GLuint Count();
+};
+
+// Constructor
+InstanceSimulation::InstanceSimulation() {
+	this->count = 0;
+	this->pool = nullptr;
+	this->dt = 0.0f;
+	this->time = 0.0f;
+}
+
+// Start every instance at rest in its generated spot, facing a random way
+void InstanceSimulation::Init(JobSystem* pool, InstancePool& instances, const mat4& model, const vec4& bounds) {
+	this->pool = pool;
+	this->model = model;
+	this->modelScale = InstanceCuller::MaxScale(model);
+	this->bounds = bounds;
+	this->count = instances.Count();
+
+	vector<GLfloat>* arrays[16] = { &this->posX, &this->posY, &this->posZ, &this->velX, &this->velY, &this->velZ,
+		&this->homeX, &this->homeY, &this->homeZ, &this->rotX, &this->rotY, &this->rotZ, &this->rotW,
+		&this->scale, &this->phase, &this->flapRate };
+	for (GLuint a = 0; a < 16; a++)
+		arrays[a]->assign(this->count, 0.0f);
+	for (GLuint a = 0; a < 3; a++) {
+		this->wanderSin[a].assign(this->count, 0.0f);
+		this->wanderCos[a].assign(this->count, 0.0f);
+	}
+
+	InstanceRng rng(0x5EED);
+	for (GLuint i = 0; i < this->count; i++) {
+		InstanceTRS trs = DecomposeInstance(instances[i]);
+		this->posX[i] = this->homeX[i] = trs.positionScale.x;
+		this->posY[i] = this->homeY[i] = trs.positionScale.y;
+		this->posZ[i] = this->homeZ[i] = trs.positionScale.z;
+		this->scale[i] = trs.positionScale.w;
+		this->rotX[i] = trs.rotation.x;
+		this->rotY[i] = trs.rotation.y;
+		this->rotZ[i] = trs.rotation.z;
+		this->rotW[i] = trs.rotation.w;
+		this->phase[i] = 6.2831853f * rng.Uniform();
+		this->flapRate[i] = 8.0f + 4.0f * rng.Uniform();
+		for (GLuint a = 0; a < 3; a++) {
+			this->wanderSin[a][i] = sin(SIM_WANDER_PHASE[a] * this->phase[i]);
+			this->wanderCos[a][i] = cos(SIM_WANDER_PHASE[a] * this->phase[i]);
+		}
+	}
+}
+
+// Advance every instance by dt seconds and, when a culler is given,
+// refresh its bounding spheres
+void InstanceSimulation::Update(GLfloat dt, GLdouble time, InstanceCuller* culler) {
+	this->dt = min(max(dt, 0.0f), SIM_MAX_STEP);
+	this->time = (GLfloat)time;
+
+	// Each flock drifts along its own slow loop around the field
+	for (GLuint f = 0; f < SIM_FLOCKS; f++) {
+		GLfloat a = 0.13f * this->time + f * 1.5707963f;
+		GLfloat b = 0.21f * this->time + f;
+		GLfloat c = 0.11f * this->time + f * 1.5707963f;
+		this->flockOffset[f] = vec3(150.0f * sin(a), 40.0f * sin(b), 150.0f * cos(c));
+		this->flockDrift[f] = vec3(150.0f * 0.13f * cos(a), 40.0f * 0.21f * cos(b), -150.0f * 0.11f * sin(c));
+	}
+
+	// Wander angles are phase + rate * time; the time part is shared
+	for (GLuint a = 0; a < 3; a++) {
+		this->timeSin[a] = sin(SIM_WANDER_RATE[a] * this->time);
+		this->timeCos[a] = cos(SIM_WANDER_RATE[a] * this->time);
+	}
+
+	auto body = [this, culler](GLuint begin, GLuint end) {
+		this->step(begin, end, culler);
+	};
+	if (this->pool)
+		this->pool->ParallelFor(this->count, SIM_GRAIN, body);
+	else
+		body(0, this->count);
+}
+
+// Steer, move and orient one chunk of instances. Only the flap needs a sine
+// per instance: wander uses angle sums of precomputed sines, and the
+// orientation comes from half-angle identities and small-angle series.
+void InstanceSimulation::step(GLuint begin, GLuint end, InstanceCuller* culler) {
+	GLfloat dt = this->dt, t = this->time;
+	for (GLuint i = begin; i < end; i++) {
+		GLuint f = i % SIM_FLOCKS;
+		vec3 p(this->posX[i], this->posY[i], this->posZ[i]);
+		vec3 v(this->velX[i], this->velY[i], this->velZ[i]);
+		vec3 home(this->homeX[i], this->homeY[i], this->homeZ[i]);
+
+		// Cohesion, alignment and wander
+		vec3 wander(this->wanderSin[0][i] * this->timeCos[0] + this->wanderCos[0][i] * this->timeSin[0],
+			0.5f * (this->wanderSin[1][i] * this->timeCos[1] + this->wanderCos[1][i] * this->timeSin[1]),
+			this->wanderCos[2][i] * this->timeCos[2] - this->wanderSin[2][i] * this->timeSin[2]);
+		vec3 steer = (home + this->flockOffset[f] - p) * SIM_COHESION + (this->flockDrift[f] - v) * SIM_ALIGNMENT + wander * SIM_WANDER;
+		v = v + steer * dt;
+		GLfloat speed = length(v);
+		if (speed > SIM_MAX_SPEED)
+			v = v * (SIM_MAX_SPEED / speed);
+		p = p + v * dt;
+
+		// Yaw to face the direction of travel (half angle from its cosine)
+		GLfloat flat = sqrt(v.x * v.x + v.z * v.z);
+		GLfloat cosYaw = flat > 1.0e-6f ? v.z / flat : 1.0f;
+		GLfloat cy = sqrt(max(0.5f * (1.0f + cosYaw), 0.0f));
+		GLfloat sy = sqrt(max(0.5f * (1.0f - cosYaw), 0.0f));
+		sy = v.x < 0.0f ? -sy : sy;
+
+		// Pitch with the climb (a quarter of the climb angle), roll to flap
+		GLfloat hp = min(max(-0.25f * v.y / max(speed, 1.0e-6f), -0.4f), 0.4f);
+		GLfloat hr = 0.5f * SIM_FLAP_ANGLE * sin(this->phase[i] + t * this->flapRate[i]);
+		GLfloat sp = hp - hp * hp * hp / 6.0f, cp = 1.0f - hp * hp * (0.5f - hp * hp / 24.0f);
+		GLfloat sr = hr - hr * hr * hr / 6.0f, cr = 1.0f - hr * hr * (0.5f - hr * hr / 24.0f);
+
+		// q = yaw (Y) * pitch (X) * roll (Z)
+		GLfloat qx = cy * sp * cr + sy * cp * sr;
+		GLfloat qy = sy * cp * cr - cy * sp * sr;
+		GLfloat qz = cy * cp * sr - sy * sp * cr;
+		GLfloat qw = cy * cp * cr + sy * sp * sr;
+		GLfloat n = 1.0f / sqrt(qx * qx + qy * qy + qz * qz + qw * qw);
+
+		this->posX[i] = p.x;
+		this->posY[i] = p.y;
+		this->posZ[i] = p.z;
+		this->velX[i] = v.x;
+		this->velY[i] = v.y;
+		this->velZ[i] = v.z;
+		this->rotX[i] = qx * n;
+		this->rotY[i] = qy * n;
+		this->rotZ[i] = qz * n;
+		this->rotW[i] = qw * n;
+
+		// World-space bounding sphere (rotate the mesh's sphere center)
+		if (culler) {
+			vec3 q(qx * n, qy * n, qz * n);
+			vec3 c = vec3(this->bounds) * this->scale[i];
+			c = c + cross(q, cross(q, c) + c * (qw * n)) * 2.0f;
+			vec3 center = vec3(this->model * vec4(p + c, 1.0f));
+			culler->SetSphere(i, center, this->bounds.w * this->scale[i] * this->modelScale);
+		}
+	}
+}
+
+// Current transform of one instance
+InstanceTRS InstanceSimulation::transform(GLuint i) {
+	InstanceTRS trs;
+	trs.positionScale = vec4(this->posX[i], this->posY[i], this->posZ[i], this->scale[i]);
+	trs.rotation = vec4(this->rotX[i], this->rotY[i], this->rotZ[i], this->rotW[i]);
+	return trs;
+}
+
+// Encode the listed instances, in order, into out (packed positions within
+// a box with SIM_REACH of room around the generated field)
+void InstanceSimulation::Write(InstanceFormat format, const InstanceQuantization& quantization, const GLuint* indices, GLuint count, GLubyte* out) {
+	GLuint stride = InstanceStride(format);
+	auto body = [&](GLuint begin, GLuint end) {
+		for (GLuint k = begin; k < end; k++)
+			EncodeInstance(format, this->transform(indices[k]), quantization, out + k * stride);
+	};
+	if (this->pool)
+		this->pool->ParallelFor(count, SIM_GRAIN, body);
+	else
+		body(0, count);
+}
+
+// Encode every instance into out
+void InstanceSimulation::WriteAll(InstanceFormat format, const InstanceQuantization& quantization, GLubyte* out) {
+	GLuint stride = InstanceStride(format);
+	auto body = [&](GLuint begin, GLuint end) {
+		for (GLuint i = begin; i < end; i++)
+			EncodeInstance(format, this->transform(i), quantization, out + i * stride);
+	};
+	if (this->pool)
+		this->pool->ParallelFor(this->count, SIM_GRAIN, body);
+	else
+		body(0, this->count);
+}
+
+GLuint InstanceSimulation::Count() {
+	return this->count;
+}
@@ -0,0 +1,382 @@
+// ============================================================================
+//
+// JobSystem.h
+// -----------------------------------
+//
+// JOB SYSTEM HEADER FILE
+//
+// A work-stealing job scheduler for CPU-side frame work. Every thread (the
+// workers and the thread that owns the system) has its own job deque: it
+// pushes and pops jobs at the bottom, and idle threads steal from the top of
+// someone else's. ParallelFor splits its range in halves down to the grain,
+// so idle threads pick up large pieces first. Completion is tracked with
+// counters; a thread waiting on one keeps running jobs until it reaches
+// zero, so jobs may wait on (and spawn) other jobs. Jobs are copied into
+// fixed-size deques, so dispatching does not allocate.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdint>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+using namespace std;
+
+// Scheduler limits
+const GLuint JOB_QUEUE_SIZE = 1024;		// jobs queued per thread (a power of two)
+const GLuint JOB_SPIN_COUNT = 64;		// failed searches before a worker sleeps
+
+typedef void (*JobFunc)(void* context, GLuint begin, GLuint end);
+
+// Number of jobs (or tasks) still to finish
+struct JobCounter {
+	atomic<GLuint> value;
+
+	JobCounter() : value(0) {}
+};
+
+// One piece of work: func(context, begin, end). Ranges wider than grain are
+// split further by whoever runs them.
+struct Job {
+	JobFunc func;
+	void* context;
+	GLuint begin, end, grain;
+	JobCounter* counter;
+};
+
+// Scheduler activity, summed over every thread
+struct JobStats {
+	GLuint64 executed;
+	GLuint64 steals;
+	GLuint64 failedSteals;		// lost a race for the last job in a deque
+};
+
+// Job system class
+class JobSystem {
+private:
+	// Per-thread deque (Chase-Lev), ends kept on separate cache lines. A
+	// thief copies a slot before claiming it; the owner cannot reuse the
+	// slot until the claim moves top past it.
+	struct JobQueue {
+		atomic<int64_t> top;
+		GLubyte padTop[64 - sizeof(int64_t)];
+		atomic<int64_t> bottom;
+		GLubyte padBottom[64 - sizeof(int64_t)];
+		Job slots[JOB_QUEUE_SIZE];
+		GLuint random;
+		GLuint64 executed, steals, failedSteals;
+		GLubyte padEnd[64];
+	};
+
+	// Data
+	vector<thread> workers;
+	JobQueue* queues;
+	GLuint queueCount;
+	mutex lock;
+	condition_variable wake;
+	atomic<GLuint> queued;		// jobs sitting in a deque
+	atomic<GLuint> sleeping;
+	atomic<bool> quit;
+
+	// Thread identity: workers know their system and deque, every other
+	// thread uses deque 0
+	static thread_local JobSystem* threadSystem;
+	static thread_local GLuint threadIndex;
+
+	// Functions
+	GLuint current();
+	bool push(GLuint index, const Job& job);
+	bool pop(GLuint index, Job& job);
+	bool steal(GLuint thief, GLuint victim, Job& job);
+	bool find(GLuint index, Job& job);
+	void execute(GLuint index, Job job);
+	void workerLoop(GLuint index);
+
+	template<class Body>
+	static void invoke(void* context, GLuint begin, GLuint end) {
+		(*(Body*)context)(begin, end);
+	}
+
+public:
+	JobSystem();
+	~JobSystem();
+	void Init(GLint workers = -1);
+	GLuint ThreadCount();
+
+	// Queue func(context, 0, 1) on the calling thread's deque. The counter
+	// must already include it; it is decremented when the job finishes.
+	void Submit(JobFunc func, void* context, JobCounter* counter);
+
+	// Run jobs until the counter reaches zero
+	void Wait(JobCounter& counter);
+
+	// Run one queued job, if any; false when there was none
+	bool Help();
+
+	// Calls body(begin, end) over [0, count) in chunks of at most grain that
+	// start on multiples of grain. May be called from inside a job.
+	template<class Body>
+	void ParallelFor(GLuint count, GLuint grain, Body& body) {
+		this->parallelFor(&JobSystem::invoke<Body>, &body, count, grain);
+	}
+	void parallelFor(JobFunc func, void* context, GLuint count, GLuint grain);
+
+	JobStats Stats();
+	void ResetStats();
+};
+
+thread_local JobSystem* JobSystem::threadSystem = nullptr;
+thread_local GLuint JobSystem::threadIndex = 0;
+
+// Constructor - workers are started by Init()
+JobSystem::JobSystem() : queued(0), sleeping(0), quit(false) {
+	this->queues = nullptr;
+	this->queueCount = 0;
+}
+
+// Stop and join the workers
+JobSystem::~JobSystem() {
+	{
+		lock_guard<mutex> guard(this->lock);
+		this->quit = true;
+	}
+	this->wake.notify_all();
+	for (GLuint i = 0; i < this->workers.size(); i++)
+		this->workers[i].join();
+	delete[] this->queues;
+}
+
+// Start the workers. By default one per hardware thread, minus the caller.
+// Only the calling thread and the workers may submit jobs.
+void JobSystem::Init(GLint workers) {
+	if (workers < 0) {
+		GLint hardware = thread::hardware_concurrency();
+		workers = hardware > 1 ? hardware - 1 : 0;
+	}
+	this->queueCount = workers + 1;
+	this->queues = new JobQueue[this->queueCount];
+	for (GLuint i = 0; i < this->queueCount; i++) {
+		JobQueue& queue = this->queues[i];
+		queue.top = 0;
+		queue.bottom = 0;
+		queue.random = 0x9E3779B9u * (i + 1);
+		queue.executed = queue.steals = queue.failedSteals = 0;
+	}
+	for (GLuint i = 1; i < this->queueCount; i++)
+		this->workers.push_back(thread(&JobSystem::workerLoop, this, i));
+}
+
+// Number of threads that run jobs, including the caller
+GLuint JobSystem::ThreadCount() {
+	return this->workers.size() + 1;
+}
+
+// Deque of the calling thread
+GLuint JobSystem::current() {
+	return threadSystem == this ? threadIndex : 0;
+}
+
+// Owner only: add a job at the bottom. False when the deque is full.
+bool JobSystem::push(GLuint index, const Job& job) {
+	JobQueue& queue = this->queues[index];
+	int64_t b = queue.bottom.load(memory_order_relaxed);
+	int64_t t = queue.top.load(memory_order_acquire);
+	if (b - t >= (int64_t)JOB_QUEUE_SIZE)
+		return false;
+	queue.slots[b & (JOB_QUEUE_SIZE - 1)] = job;
+	queue.bottom.store(b + 1, memory_order_release);
+
+	// Wake a sleeper. Either it sees the new job before sleeping, or it is
+	// already waiting when the lock is taken here.
+	this->queued.fetch_add(1);
+	if (this->sleeping.load() > 0) {
+		lock_guard<mutex> guard(this->lock);
+		this->wake.notify_one();
+	}
+	return true;
+}
+
+// Owner only: take the newest job
+bool JobSystem::pop(GLuint index, Job& job) {
+	JobQueue& queue = this->queues[index];
+	int64_t b = queue.bottom.load(memory_order_relaxed) - 1;
+	queue.bottom.store(b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t t = queue.top.load(memory_order_relaxed);
+	if (t > b) {
+		queue.bottom.store(b + 1, memory_order_relaxed);
+		return false;
+	}
+	job = queue.slots[b & (JOB_QUEUE_SIZE - 1)];
+	if (t == b) {
+		// Last job: race the thieves for it
+		bool won = queue.top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+		queue.bottom.store(b + 1, memory_order_relaxed);
+		if (!won)
+			return false;
+	}
+	this->queued.fetch_sub(1);
+	return true;
+}
+
+// Any thread: take the oldest job of the victim's deque
+bool JobSystem::steal(GLuint thief, GLuint victim, Job& job) {
+	JobQueue& queue = this->queues[victim];
+	int64_t t = queue.top.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t b = queue.bottom.load(memory_order_acquire);
+	if (t >= b)
+		return false;
+	job = queue.slots[t & (JOB_QUEUE_SIZE - 1)];
+	if (!queue.top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+		this->queues[thief].failedSteals++;
+		return false;
+	}
+	this->queues[thief].steals++;
+	this->queued.fetch_sub(1);
+	return true;
+}
+
+// Own deque first, then every other deque from a random starting point
+bool JobSystem::find(GLuint index, Job& job) {
+	if (this->pop(index, job))
+		return true;
+	if (this->queueCount == 1)
+		return false;
+	GLuint& random = this->queues[index].random;
+	random ^= random << 13;
+	random ^= random >> 17;
+	random ^= random << 5;
+	GLuint start = random % this->queueCount;
+	for (GLuint i = 0; i < this->queueCount; i++) {
+		GLuint victim = (start + i) % this->queueCount;
+		if (victim != index && this->steal(index, victim, job))
+			return true;
+	}
+	return false;
+}
+
+// Split the job down to its grain, queueing the upper halves, then run what
+// is left. Halves are cut on grain boundaries.
+void JobSystem::execute(GLuint index, Job job) {
+	GLuint chunks = (job.end - job.begin + job.grain - 1) / job.grain;
+	while (chunks > 1) {
+		Job half = job;
+		half.begin = job.begin + (chunks / 2) * job.grain;
+		job.counter->value.fetch_add(1);
+		if (!this->push(index, half)) {
+			job.counter->value.fetch_sub(1);
+			break;
+		}
+		job.end = half.begin;
+		chunks = (job.end - job.begin + job.grain - 1) / job.grain;
+	}
+
+	job.func(job.context, job.begin, job.end);
+	this->queues[index].executed++;
+	job.counter->value.fetch_sub(1, memory_order_release);
+}
+
+// Workers look for jobs, spin for a while when there are none, then sleep
+void JobSystem::workerLoop(GLuint index) {
+	threadSystem = this;
+	threadIndex = index;
+	GLuint idle = 0;
+	Job job;
+	while (!this->quit.load(memory_order_relaxed)) {
+		if (this->find(index, job)) {
+			this->execute(index, job);
+			idle = 0;
+			continue;
+		}
+		if (++idle < JOB_SPIN_COUNT) {
+			this_thread::yield();
+			continue;
+		}
+
+		unique_lock<mutex> guard(this->lock);
+		this->sleeping.fetch_add(1);
+		if (this->queued.load() == 0 && !this->quit)
+			this->wake.wait(guard);
+		this->sleeping.fetch_sub(1);
+		idle = 0;
+	}
+}
+
+void JobSystem::Submit(JobFunc func, void* context, JobCounter* counter) {
+	if (!this->queues) {
+		func(context, 0, 1);
+		counter->value.fetch_sub(1, memory_order_release);
+		return;
+	}
+	Job job = { func, context, 0, 1, 1, counter };
+	GLuint index = this->current();
+	if (!this->push(index, job))
+		this->execute(index, job);
+}
+
+// Waiting threads help: they run their own jobs first, then steal
+void JobSystem::Wait(JobCounter& counter) {
+	GLuint index = this->current();
+	Job job;
+	while (counter.value.load(memory_order_acquire) != 0) {
+		if (this->find(index, job))
+			this->execute(index, job);
+		else
+			this_thread::yield();
+	}
+}
+
+bool JobSystem::Help() {
+	Job job;
+	if (!this->queues || !this->find(this->current(), job))
+		return false;
+	this->execute(this->current(), job);
+	return true;
+}
+
+// Run the first half of the range here (splitting off the rest), then help
+// until every piece is done
+void JobSystem::parallelFor(JobFunc func, void* context, GLuint count, GLuint grain) {
+	if (count == 0)
+		return;
+	grain = max(grain, 1u);
+
+	// Nothing to share: run inline
+	if (this->workers.empty() || count <= grain) {
+		func(context, 0, count);
+		return;
+	}
+
+	JobCounter counter;
+	counter.value = 1;
+	Job job = { func, context, 0, count, grain, &counter };
+	this->execute(this->current(), job);
+	this->Wait(counter);
+}
+
+// Totals since the last ResetStats (read while no jobs are running)
+JobStats JobSystem::Stats() {
+	JobStats stats = { 0, 0, 0 };
+	for (GLuint i = 0; i < this->queueCount; i++) {
+		stats.executed += this->queues[i].executed;
+		stats.steals += this->queues[i].steals;
+		stats.failedSteals += this->queues[i].failedSteals;
+	}
+	return stats;
+}
+
+void JobSystem::ResetStats() {
+	for (GLuint i = 0; i < this->queueCount; i++)
+		this->queues[i].executed = this->queues[i].steals = this->queues[i].failedSteals = 0;
+}
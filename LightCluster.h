@@ -0,0 +1,288 @@
+// ============================================================================
+//
+// LightCluster.h
+// -----------------------------------
+//
+// LIGHT CLUSTER HEADER FILE
+//
+// Clustered forward lighting. The view frustum is split into a grid of
+// froxels (screen tiles x exponential depth slices), and every frame each
+// point light is binned into the froxels its sphere of influence touches.
+// Binning runs on the CPU across the job system and makes no GL calls, so
+// it can be run and measured without a GPU. The results are uploaded as
+// texture buffers and the fragment shader only shades its froxel's lights.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+// Custom headers
+#include "UniformBuffer.h"
+#include "JobSystem.h"
+
+using namespace std;
+using namespace glm;
+
+// Cluster grid settings
+const GLuint CLUSTER_X = 16;
+const GLuint CLUSTER_Y = 9;
+const GLuint CLUSTER_Z = 24;
+const GLuint CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+const GLuint MAX_POINT_LIGHTS = 1024;
+const GLuint MAX_LIGHTS_PER_CLUSTER = 256;
+
+// Attenuated intensity below which a light no longer contributes
+const GLfloat LIGHT_CUTOFF = 0.01f;
+
+// Light cluster class
+class LightClusters {
+private:
+	// View-space bounds of every cluster
+	vector<vec3> clusterMin, clusterMax;
+	GLfloat fovY, aspect, zNear, zFar;
+
+	// Lights in view space (xyz = position, w = radius)
+	vector<vec4> viewLights;
+	GLuint lightCount;
+
+	// Per-cluster lists filled in parallel, then compacted
+	vector<GLushort> scratch;
+	vector<GLuint> scratchCount;
+	vector<GLushort> sliceLights;
+	JobSystem* pool;
+
+	// Texture buffers
+	GLuint buffers[3], textures[3];
+	GLsizeiptr capacities[3];
+
+	// Functions
+	void buildClusters();
+	GLfloat sliceDepth(GLuint slice);
+	void binSlice(GLuint slice);
+
+public:
+	// Compacted output: (offset, count) per cluster, and the light indices
+	vector<GLuint> grid;
+	vector<GLushort> indices;
+	GLuint indexCount;
+
+	LightClusters();
+	void Init(JobSystem* pool);
+	void SetProjection(GLfloat fovY, GLfloat aspect, GLfloat zNear, GLfloat zFar);
+	void Bin(const PointLightData* lights, GLuint count, const mat4& view);
+	void FillBlock(LightBlock& block, GLuint width, GLuint height);
+	static GLfloat LightRadius(const PointLightData& light);
+
+	// GPU side
+	void InitBuffers();
+	void Upload(const PointLightData* lights, GLuint count);
+	void BindTextures(GLuint firstUnit);
+};
+
+// Constructor
+LightClusters::LightClusters() {
+	this->fovY = this->aspect = this->zNear = this->zFar = 0.0f;
+	this->lightCount = 0;
+	this->indexCount = 0;
+	this->pool = nullptr;
+	for (GLuint i = 0; i < 3; i++) {
+		this->buffers[i] = this->textures[i] = 0;
+		this->capacities[i] = 0;
+	}
+}
+
+// Reserve every array up front so binning never allocates
+void LightClusters::Init(JobSystem* pool) {
+	this->pool = pool;
+	this->clusterMin.resize(CLUSTER_COUNT);
+	this->clusterMax.resize(CLUSTER_COUNT);
+	this->viewLights.resize(MAX_POINT_LIGHTS);
+	this->scratch.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+	this->scratchCount.resize(CLUSTER_COUNT);
+	this->sliceLights.resize(CLUSTER_Z * MAX_POINT_LIGHTS);
+	this->grid.resize(CLUSTER_COUNT * 2);
+	this->indices.resize(CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER);
+}
+
+// Rebuild the cluster bounds only when the projection changes
+void LightClusters::SetProjection(GLfloat fovY, GLfloat aspect, GLfloat zNear, GLfloat zFar) {
+	if (fovY == this->fovY && aspect == this->aspect && zNear == this->zNear && zFar == this->zFar)
+		return;
+	this->fovY = fovY;
+	this->aspect = aspect;
+	this->zNear = zNear;
+	this->zFar = zFar;
+	this->buildClusters();
+}
+
+// View distance where a depth slice starts (slices are exponential in depth)
+GLfloat LightClusters::sliceDepth(GLuint slice) {
+	return this->zNear * pow(this->zFar / this->zNear, (GLfloat)slice / CLUSTER_Z);
+}
+
+// View-space AABB of each froxel, from its tile corners at both slice depths
+void LightClusters::buildClusters() {
+	GLfloat tanY = tan(this->fovY * 0.5f);
+	GLfloat tanX = tanY * this->aspect;
+
+	for (GLuint z = 0; z < CLUSTER_Z; z++) {
+		GLfloat depth[2] = { this->sliceDepth(z), this->sliceDepth(z + 1) };
+		for (GLuint y = 0; y < CLUSTER_Y; y++) {
+			for (GLuint x = 0; x < CLUSTER_X; x++) {
+				GLfloat ndcX[2] = { -1.0f + 2.0f * x / CLUSTER_X, -1.0f + 2.0f * (x + 1) / CLUSTER_X };
+				GLfloat ndcY[2] = { -1.0f + 2.0f * y / CLUSTER_Y, -1.0f + 2.0f * (y + 1) / CLUSTER_Y };
+				vec3 lo(1e30f), hi(-1e30f);
+				for (GLuint i = 0; i < 8; i++) {
+					GLfloat d = depth[i & 1];
+					vec3 corner(ndcX[(i >> 1) & 1] * tanX * d, ndcY[(i >> 2) & 1] * tanY * d, -d);
+					lo = min(lo, corner);
+					hi = max(hi, corner);
+				}
+				GLuint c = x + y * CLUSTER_X + z * CLUSTER_X * CLUSTER_Y;
+				this->clusterMin[c] = lo;
+				this->clusterMax[c] = hi;
+			}
+		}
+	}
+}
+
+// Bin every light touching one depth slice into that slice's clusters
+void LightClusters::binSlice(GLuint slice) {
+	GLfloat sliceNear = this->sliceDepth(slice);
+	GLfloat sliceFar = this->sliceDepth(slice + 1);
+
+	// Lights whose depth range overlaps the slice
+	GLushort* candidates = &this->sliceLights[slice * MAX_POINT_LIGHTS];
+	GLuint candidateCount = 0;
+	for (GLuint i = 0; i < this->lightCount; i++) {
+		GLfloat depth = -this->viewLights[i].z;
+		GLfloat radius = this->viewLights[i].w;
+		if (depth + radius >= sliceNear && depth - radius <= sliceFar)
+			candidates[candidateCount++] = i;
+	}
+
+	// Sphere vs AABB against each tile in the slice
+	GLuint first = slice * CLUSTER_X * CLUSTER_Y;
+	for (GLuint c = first; c < first + CLUSTER_X * CLUSTER_Y; c++) {
+		GLushort* list = &this->scratch[c * MAX_LIGHTS_PER_CLUSTER];
+		GLuint count = 0;
+		for (GLuint i = 0; i < candidateCount && count < MAX_LIGHTS_PER_CLUSTER; i++) {
+			const vec4& light = this->viewLights[candidates[i]];
+			vec3 center(light.x, light.y, light.z);
+			vec3 closest = clamp(center, this->clusterMin[c], this->clusterMax[c]);
+			vec3 delta = closest - center;
+			if (dot(delta, delta) <= light.w * light.w)
+				list[count++] = candidates[i];
+		}
+		this->scratchCount[c] = count;
+	}
+}
+
+// Bin lights into clusters. Slices are binned in parallel, then the per
+// cluster lists are packed into one index list with a prefix sum.
+void LightClusters::Bin(const PointLightData* lights, GLuint count, const mat4& view) {
+	this->lightCount = min(count, MAX_POINT_LIGHTS);
+	for (GLuint i = 0; i < this->lightCount; i++)
+		this->viewLights[i] = vec4(vec3(view * vec4(lights[i].lightPos, 1.0f)), lights[i].radius);
+
+	auto body = [this](GLuint begin, GLuint end) {
+		for (GLuint slice = begin; slice < end; slice++)
+			this->binSlice(slice);
+	};
+	if (this->pool)
+		this->pool->ParallelFor(CLUSTER_Z, 1, body);
+	else
+		body(0, CLUSTER_Z);
+
+	GLuint offset = 0;
+	for (GLuint c = 0; c < CLUSTER_COUNT; c++) {
+		GLuint n = this->scratchCount[c];
+		copy(&this->scratch[c * MAX_LIGHTS_PER_CLUSTER], &this->scratch[c * MAX_LIGHTS_PER_CLUSTER] + n, &this->indices[offset]);
+		this->grid[c * 2] = offset;
+		this->grid[c * 2 + 1] = n;
+		offset += n;
+	}
+	this->indexCount = offset;
+}
+
+// Cluster parameters the fragment shader needs to find its cluster
+void LightClusters::FillBlock(LightBlock& block, GLuint width, GLuint height) {
+	GLfloat logRange = log(this->zFar / this->zNear);
+	block.clusterDims[0] = CLUSTER_X;
+	block.clusterDims[1] = CLUSTER_Y;
+	block.clusterDims[2] = CLUSTER_Z;
+	block.clusterDims[3] = this->lightCount;
+	block.clusterDepth = vec4(this->zNear, this->zFar, CLUSTER_Z / logRange, -(GLfloat)CLUSTER_Z * log(this->zNear) / logRange);
+	block.clusterTile = vec4((GLfloat)width / CLUSTER_X, (GLfloat)height / CLUSTER_Y, 0.0f, 0.0f);
+}
+
+// Distance where the light's attenuated intensity drops below LIGHT_CUTOFF:
+// solves quadratic * d^2 + linear * d + constant = intensity / LIGHT_CUTOFF
+GLfloat LightClusters::LightRadius(const PointLightData& light) {
+	// The shader's ambient term (0.2) is attenuated by the same light
+	GLfloat intensity = max(max(light.lightColor.x, max(light.lightColor.y, light.lightColor.z)), 0.2f);
+	GLfloat c = light.constant - intensity / LIGHT_CUTOFF;
+	if (light.quadratic <= 0.0f)
+		return light.linear > 0.0f ? -c / light.linear : 1e30f;
+	return (-light.linear + sqrt(light.linear * light.linear - 4.0f * light.quadratic * c)) / (2.0f * light.quadratic);
+}
+
+// Create the light, grid and index texture buffers at full capacity
+void LightClusters::InitBuffers() {
+	static const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	static const GLsizeiptr sizes[3] = {
+		MAX_POINT_LIGHTS * sizeof(PointLightData),
+		CLUSTER_COUNT * 2 * sizeof(GLuint),
+		CLUSTER_COUNT * MAX_LIGHTS_PER_CLUSTER * sizeof(GLushort)
+	};
+
+	glGenBuffers(3, this->buffers);
+	glGenTextures(3, this->textures);
+	for (GLuint i = 0; i < 3; i++) {
+		this->capacities[i] = sizes[i];
+		glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, sizes[i], NULL, GL_STREAM_DRAW);
+		glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], this->buffers[i]);
+	}
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Upload this frame's lights and binning results. Each buffer is orphaned
+// first so the upload never waits on the previous frame's draws.
+void LightClusters::Upload(const PointLightData* lights, GLuint count) {
+	const void* data[3] = { lights, &this->grid[0], &this->indices[0] };
+	GLsizeiptr sizes[3] = {
+		min(count, MAX_POINT_LIGHTS) * sizeof(PointLightData),
+		CLUSTER_COUNT * 2 * sizeof(GLuint),
+		this->indexCount * sizeof(GLushort)
+	};
+
+	for (GLuint i = 0; i < 3; i++) {
+		if (sizes[i] == 0)
+			continue;
+		glBindBuffer(GL_TEXTURE_BUFFER, this->buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, this->capacities[i], NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+	}
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+// Bind light data, cluster grid and light indices to three texture units
+void LightClusters::BindTextures(GLuint firstUnit) {
+	for (GLuint i = 0; i < 3; i++) {
+		glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+		glBindTexture(GL_TEXTURE_BUFFER, this->textures[i]);
+	}
+	glActiveTexture(GL_TEXTURE0);
+}
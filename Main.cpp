@@ -1,575 +1,1561 @@
-// ===================================================================================
-//
-// Main.cpp  
-//
-// -----------------------------------
-//
-// By Justin Cheng
-// Instancing and Bloom Demo
-//
-// ===================================================================================
-
-// Standard Includes
-#include "stdafx.h"
-#include "cmath"
-#include <math.h>
-#include <time.h> 
-
-// Include various libraries
-#include "GL\glew.h"	// GLEW
-#include "GL\glfw3.h"	// GLFW
-
-#include "glm\glm.hpp"	// GLM stuff
-#include "glm\gtc\matrix_transform.hpp"
-#include "glm\gtc\type_ptr.hpp"
- 
-// Custom header includes
-#include "UseShader.h"
-#include "ModelObj.h"
-#include "Camera.h"
-
-// Imgui test
-#include "imgui.h"
-#include "imgui_impl_glfw_gl3.h"
-
-using namespace std;
-using namespace glm;
-
-#define PI 3.1415926535897932384626433832795
-#define POINT_LIGHTS 2
-
-// Function Prototypes
-void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
-void mouseCallback(GLFWwindow* window, double xpos, double ypos);
-void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
-void doMovement();
-GLfloat distToLinear(GLfloat dist);
-GLfloat distToQuad(GLfloat dist);
-void RenderScene(Shader &shader);
-void RenderFX(Shader &shader);
-void RenderQuad();
-
-// Window Size
-const GLuint SCREEN_WIDTH = 1280;
-const GLuint SCREEN_HEIGHT = 720;
-
-// Camera Settings
-Camera camera(vec3(0.0f, 2.5f, 8.0f));
-GLfloat lastX = SCREEN_WIDTH / 2.0;
-GLfloat lastY = SCREEN_HEIGHT / 2.0;
-bool keys[1024];
-bool keysPressed[1024];
-bool firstMouse = true;
-bool camRotate = true;
-
-// Deltatime
-GLfloat deltaTime = 0.0f;
-GLfloat lastFrame = 0.0f;
-
-// Light Settings
-vec3 lightPos[POINT_LIGHTS];
-GLboolean hdr = true; 
-GLboolean bloom = true;
-GLfloat exposure = 3.0f; 
-
-// Imgui
-void drawGui();
-bool free_look = true;
-
-// Misc
-Model figureModel, groundModel, poiModel, particleModel;
-const GLint instanceNum = 10000;
-mat4 instanceMatrices[instanceNum];
-
-// Framebuffer Texture
-GLuint quadVAO = 0;
-GLuint quadVBO;
-GLuint colorBuffer[2]; 
-GLuint hdrBuffer; 
-GLuint ppBuffer[2];
-GLuint ppColorBuffer[2];
-
-// Main Function
-int main(int argc, char **argv) {
-
-	cout << "Starting GLFW context, OpenGL 3.3" << endl;
-
-	cout << "-----------------------------------\n" 
-		<< " Demo Scene\n"
-		<< "-----------------------------------\n"
-		<< "Features Implemented:\n"
-		<< "* Framebuffers: High Dynamic Range\n"
-		<< "* Framebuffers: Bloom\n"
-		<< "* Instancing: 10000 objects\n"
-		<< endl
-
-		<< " Camera Controls:\n"
-		<< "* Move around the scene with [W][A][S][D] keys\n"
-		<< "* Adjust camera angle by moving the [MOUSE]\n"
-		<< "* Zoom in and out using the [SCROLL-WHEEL]\n"
-		<< "* Press [R] for camera auto-rotation\n"
-		<< "* Use [SPACE] to lock mouse controls for camera\n"
-		<< "* Exit the program with the [ESC] key\n"
-		<< endl
-
-		<< " Feature Controls:\n"
-		<< "* Use [H] to toggle HDR on/off \n"
-		<< "* Use [B] to toggle Bloom on/off \n"
-		<< "* Use [Q] & [E] to increase/decrease light exposure \n"	
-		<< endl;
-
-	// Initialzie required options -----------------------
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-	glfwWindowHint(GLFW_SAMPLES, 4);
-
-	// Make a Window  & Set Callbacks --------------------
-	GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Demo Scene", nullptr, nullptr);
-	glfwMakeContextCurrent(window);
-
-	glfwSetKeyCallback(window, keyCallback);
-	glfwSetCursorPosCallback(window, mouseCallback);
-	glfwSetScrollCallback(window, scrollCallback);
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-
-	glewExperimental = GL_TRUE;
-	glewInit();
-
-	// Define viewport dimensions 
-	glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-
-	// Enable Depth Test --------------------------------
-	glEnable(GL_MULTISAMPLE);
-	glEnable(GL_DEPTH_TEST);
-
-	// Build, Compile, and Link Shaders -----------------
-	Shader shader("Shaders/main_vshader.glsl", "Shaders/main_fshader.glsl");
-	Shader blurShader("Shaders/blur_vshader.glsl", "Shaders/blur_fshader.glsl");
-	Shader bloomShader("Shaders/bloom_vshader.glsl", "Shaders/bloom_fshader.glsl");
-
-	bloomShader.Use();
-	glUniform1i(glGetUniformLocation(bloomShader.Program, "scene"), 0);
-	glUniform1i(glGetUniformLocation(bloomShader.Program, "bloomTex"), 1);
-
-	// Load Models --------------------------------------
-
-	figureModel = Model("Models/Objs/Char.obj");
-	poiModel = Model("Models/Objs/FirePoi.obj");
-	groundModel = Model("Models/Objs/Ground.obj");
-	particleModel = Model("Models/Objs/Butterfly2.obj");
-
-	// Light positions
-	lightPos[0] = vec3(-1.6f, 0.5f, 0.55f);
-	lightPos[1] = vec3(1.6f, 4.6f, 1.55f);
-
-	// Set up instancing here ---------------------------
-	
-	// Generate orientation of each butterfly
-	srand(glfwGetTime());
-	GLfloat radius = 10.00f;
-	GLfloat offset = 2.50f;
-	GLfloat expanse = 2000.0f;
-	for (GLuint i = 0; i < instanceNum; i++) {
-		mat4 model = mat4();
-		model = translate(model, vec3(0.0f, 0.0f, 0.0f));
-
-		GLfloat x = (expanse / 2 - expanse * ((rand() % 100) / 100.f));
-		GLfloat y = 0.32 * (expanse * ((rand() % 100) / 100.0));
-		GLfloat z = (expanse / 2 - expanse * ((rand() % 100) / 100.0));
-		model = translate(model, vec3(x, y, z));
-
-		GLfloat scale_size = 0.5 + 0.5 * ((rand() % 100) / 100.0);
-		model = scale(model, vec3(scale_size));
-		
-		GLfloat rotation_x = 5 - (rand() % 10);
-		GLfloat rotation_y = atan2(z, x);
-		GLfloat rotation_z = 5 - (rand() % 10);
-		model = rotate(model, rotation_x, vec3(1.0, 0.0, 0.0));
-		model = rotate(model, rotation_y, vec3(0.0, 1.0, 0.0));
-		model = rotate(model, rotation_z, vec3(0.0, 0.0, 1.0));
-
-		instanceMatrices[i] = model;
-	}
-
-	// Attach orientation to butterfly VAO
-	for (GLuint i = 0; i < particleModel.meshes.size(); i++) {
-		GLuint VAO = particleModel.meshes[i].VAO;
-		GLuint buffer;
-		glBindVertexArray(VAO);
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, instanceNum * sizeof(glm::mat4), &instanceMatrices[0], GL_STATIC_DRAW);
-
-		for (int i = 0; i < 4; i++) {
-			glEnableVertexAttribArray(3 + i);
-			glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4)*i));		
-			glVertexAttribDivisor(3 + i, 1);
-		}
-		glBindVertexArray(0);
-	}
-
-	// Initialize HDR / Bloom ---------------------------
-	glGenFramebuffers(1, &hdrBuffer); 
-	glBindFramebuffer(GL_FRAMEBUFFER, hdrBuffer);
-
-	// Floating point color buffer: 1 for rendering, 1 for brightness
-	glGenTextures(2, colorBuffer);
-	for (int i = 0; i < 2; i++) {
-		glBindTexture(GL_TEXTURE_2D, colorBuffer[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);  
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffer[i], 0);
-	}
-
-	// Depth buffer
-	GLuint depthRenderbuffer;
-	glGenRenderbuffers(1, &depthRenderbuffer);
-	glBindRenderbuffer(GL_RENDERBUFFER, depthRenderbuffer);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCREEN_WIDTH, SCREEN_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRenderbuffer);
-
-	// Assign buffers to color attachments
-	static GLuint colorAttach[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-	glDrawBuffers(2, colorAttach);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	// Clear colorbuffer
-	//glClearColor(0.1f, 0.05f, 0.15f, 1.0f);
-	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-
-	// Initialize Ping-Pong Buffers -----------------
-	// The Ping-Pong buffers are used so you can Gaussian blur a framebuffer multiple times	
-	glGenFramebuffers(2, ppBuffer);
-	glGenTextures(2, ppColorBuffer);
-	for (GLuint i = 0; i < 2; i++) {
-		glBindFramebuffer(GL_FRAMEBUFFER, ppBuffer[i]);
-		glBindTexture(GL_TEXTURE_2D, ppColorBuffer[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ppColorBuffer[i], 0);
-	}
-
-	// Imgui Test
-	ImGui_ImplGlfwGL3_Init(window, false);
-
-	// Loop ---------------------------------------------
-	while (!glfwWindowShouldClose(window)) {
-		// Calculate deltatime between frames
-		GLfloat currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
-
-		// Check for events 
-		glfwPollEvents();
-		doMovement();
-
-		// Imgui 
-		ImGui_ImplGlfwGL3_NewFrame();
-		drawGui();
-
-		// Set up camera --------------------------
-		glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		shader.Use();
-		mat4 view;
-
-		if (camRotate) {
-			camera.position.x = sin(0.3*glfwGetTime()) * 9.5f;
-			camera.position.z = cos(0.3*glfwGetTime()) * 9.5f;
-			view = glm::lookAt(glm::vec3(camera.position.x, camera.position.y, camera.position.z), glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		}
-		else 
-			view = camera.GetViewMatrix();
-
-		mat4 projection = perspective(camera.zoom, (float)SCREEN_WIDTH / (float)SCREEN_HEIGHT, 0.1f, 100.0f);
-		glUniformMatrix4fv(glGetUniformLocation(shader.Program, "projection"), 1, GL_FALSE, value_ptr(projection));
-		glUniformMatrix4fv(glGetUniformLocation(shader.Program, "view"), 1, GL_FALSE, value_ptr(view));
-
-		// Set light uniforms ---------------------
-		vec3 lightColor;
-
-		GLfloat lightDist = sin(glfwGetTime()) * 9.0f;
-		GLfloat linear = distToLinear(29 + lightDist);
-		GLfloat quadratic = distToQuad(29 + lightDist);
-
-		glUniform3f(glGetUniformLocation(shader.Program, "pointLights[0].lightColor"), 0.45f, 0.3f, 0.3f);  
-		glUniform3f(glGetUniformLocation(shader.Program, "pointLights[0].lightPos"), lightPos[0].x,lightPos[0].y,lightPos[0].z);
-		glUniform1f(glGetUniformLocation(shader.Program, "pointLights[0].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(shader.Program, "pointLights[0].linear"), linear);
-		glUniform1f(glGetUniformLocation(shader.Program, "pointLights[0].quadratic"), quadratic);
-
-		glUniform3f(glGetUniformLocation(shader.Program, "pointLights[1].lightColor"), 0.45f, 0.3f, 0.3f);  
-		glUniform3f(glGetUniformLocation(shader.Program, "pointLights[1].lightPos"), lightPos[1].x, lightPos[1].y, lightPos[1].z);
-		glUniform1f(glGetUniformLocation(shader.Program, "pointLights[1].constant"), 1.0f);
-		glUniform1f(glGetUniformLocation(shader.Program, "pointLights[1].linear"), linear);
-		glUniform1f(glGetUniformLocation(shader.Program, "pointLights[1].quadratic"), quadratic);
-
-		glUniform3fv(glGetUniformLocation(shader.Program, "viewPos"), 1, &camera.position[0]);
-
-		// Pass1: Render scene into framebuffer 
-		// --------------------------------------------
-		glBindFramebuffer(GL_FRAMEBUFFER, hdrBuffer);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		shader.Use();
-		RenderScene(shader);	
-		RenderFX(shader);
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		// Blur the bright areas of the framebuffer using pingpong and gaussian blur
-		GLboolean horiz = true;
-		GLboolean first_blur = true;
-		blurShader.Use();
-		int iteration = 50;
-		for (int i = 0; i < iteration; i++) {
-			glBindFramebuffer(GL_FRAMEBUFFER, ppBuffer[horiz]);
-			glUniform1i(glGetUniformLocation(blurShader.Program, "horizontal"), horiz);
-			glBindTexture(GL_TEXTURE_2D, first_blur? colorBuffer[1] : ppColorBuffer[!horiz]);  // bind texture of other framebuffer (or scene if first iteration)
-			RenderQuad();
-			horiz = !horiz;
-			if (first_blur)
-				first_blur = false;
-		}
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-		// Pass2: Add HDR / Bloom effects to framebuffer 
-		// --------------------------------------------
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		bloomShader.Use();
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, colorBuffer[0]);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, ppColorBuffer[!horiz]);
-		glUniform1i(glGetUniformLocation(bloomShader.Program, "hdr"), hdr);
-		glUniform1i(glGetUniformLocation(bloomShader.Program, "bloom"), bloom);
-		glUniform1f(glGetUniformLocation(bloomShader.Program, "exposure"), exposure);
-		RenderQuad();
-
-		// Swap frame buffers
-		ImGui::Render();
-		glfwSwapBuffers(window);
-	}
-
-	// End ----------------------------------------------
-	// Terminate
-	ImGui_ImplGlfwGL3_Shutdown();
-	glfwTerminate();
-	return 0;
-}
-
-//Imgui stuff
-void drawGui() {
-	bool show_test_window = true;
-	bool show_another_window = false;
-	//ImVec4 clear_color = ImColor(114, 144, 154);
-
-	ImGui::Text("Framebuffers: High Dynamic Range (HDR), Bloom");
-	ImGui::Text("Instancing: 10000 objects");
-	ImGui::Text("\n");
-
-	ImGui::Text("[W][A][S][D] - Pan camera | [ESC] - Exit program");
-	ImGui::Text("[MOUSE SCROLL] - Look around | [MOUSE WHEEL] - Dolly camera");
-	ImGui::Text("[R] - Auto-rotate camera | [SPACE] - Lock mouse");
-	ImGui::Text("[H] - toggle HDR on/off | [B] - toggle Bloom on/off");
-	ImGui::Text("[Q][E] - increase/decrease camera light exposure");
-	ImGui::Text("\n");
-
-	ImGui::Text("Auto-rotate: %s | Freelook: %s", camRotate ? "on" : "off", free_look ? "on" : "off");
-	ImGui::Text("HDR: %s | Bloom: %s", hdr ? "on" : "off", bloom ? "on" : "off");
-	ImGui::Text("Exposure: %f", exposure);
-	ImGui::Text("\n");
-	
-	ImGui::Text("Bloom Texture Preview (<- Extracted | Blurred ->):");
-	ImGui::ImageButton((void*)colorBuffer[1], ImVec2(192, 108));
-	ImGui::SameLine();
-	ImGui::ImageButton((void*)ppColorBuffer[1], ImVec2(192, 108));
-}
-
-// Display Models
-void RenderScene(Shader &shader) {
-	// Set Emission intensity;
-	GLfloat emiInten;
-
-	// Figure
-	mat4 model;
-	model = mat4();
-	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
-	model = scale(model, vec3(0.2f, 0.2f, 0.2f));
-	emiInten = sin(1.6 * glfwGetTime()) * 0.1f;
-	glUniform1i(glGetUniformLocation(shader.Program, "instance"), 0);
-	glUniform1f(glGetUniformLocation(shader.Program, "emiIntensity"), 0.9f + emiInten);
-	glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"), 1, GL_FALSE, value_ptr(model));
-	figureModel.Draw(shader);
-
-	// Flames
-	model = mat4();
-	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
-	model = scale(model, vec3(0.2f, 0.2f, 0.2f));
-	emiInten = sin(glfwGetTime()) * 0.4f;
-	glUniform1i(glGetUniformLocation(shader.Program, "instance"), 0);
-	glUniform1f(glGetUniformLocation(shader.Program, "emiIntensity"), 0.6f + emiInten);
-	glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"), 1, GL_FALSE, value_ptr(model));
-	poiModel.Draw(shader);	
-
-	// Ground
-	model = mat4();
-	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
-	model = scale(model, vec3(0.2f, 0.2f, 0.2f));
-	glUniform1i(glGetUniformLocation(shader.Program, "instance"), 0);
-	glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"), 1, GL_FALSE, value_ptr(model));
-	groundModel.Draw(shader);	
-}
-
-// Display more FX stuff
-void RenderFX(Shader &shader) {
-	// Set Emission intensity;
-	GLfloat partInten, partInten2, partInten3, partInten4;
-	
-	mat4 model;
-	model = mat4();
-	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
-	model = scale(model, vec3(0.025f, 0.025f, 0.025f));
-
-	// Set timing for butterfly glows
-	partInten = sin(0.5 * glfwGetTime()) * 0.3f;
-	partInten2 = sin(0.5 * glfwGetTime() + 0.5 * PI) * 0.3f;
-	partInten3 = sin(0.5 * glfwGetTime() + 1.0 * PI) * 0.3f;
-	partInten4 = sin(0.5 * glfwGetTime() + 1.5 * PI) * 0.3f;
-	glUniform1f(glGetUniformLocation(shader.Program, "particleIntensity1"), 0.7f + partInten);
-	glUniform1f(glGetUniformLocation(shader.Program, "particleIntensity2"), 0.7f + partInten2);
-	glUniform1f(glGetUniformLocation(shader.Program, "particleIntensity3"), 0.7f + partInten3);
-	glUniform1f(glGetUniformLocation(shader.Program, "particleIntensity4"), 0.7f + partInten4);
-
-	// Render butterfly as instance
-	glUniform1i(glGetUniformLocation(shader.Program, "instance"), 1);
-	glUniform1i(glGetUniformLocation(shader.Program, "instanceNum"), instanceNum);
-	glUniformMatrix4fv(glGetUniformLocation(shader.Program, "model"), 1, GL_FALSE, value_ptr(model));
-	particleModel.DrawInstance(shader, instanceNum);
-}
-
-// Display framebuffer quad
-void RenderQuad() {
-	if (quadVAO == 0) {
-		GLfloat quadVertices[] = {
-			// Positions			// Texture Coords
-			-1.0f, 1.0f, 0.0f,		0.0f, 1.0f,
-			-1.0f, -1.0f, 0.0f,		0.0f, 0.0f,
-			1.0f, 1.0f, 0.0f,		1.0f, 1.0f,
-			1.0f, -1.0f, 0.0f,		1.0f, 0.0f,
-		};
-
-		// Setup plane VAO
-		glGenVertexArrays(1, &quadVAO);
-		glGenBuffers(1, &quadVBO);
-		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
-	}
-	glBindVertexArray(quadVAO);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-	glBindVertexArray(0);
-}
-
-// Convert distance to light linear constant
-GLfloat distToLinear(GLfloat dist) {
-	return 5.4399f * pow(dist, -1.063);
-}
-
-// Convert distance to light quadratic constant
-GLfloat distToQuad(GLfloat dist) {
-	return 107.35f * pow(dist, -2.115);
-}
-
-// Track mouse movements
-void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
-	if (firstMouse) {
-		lastX = xpos;
-		lastY = ypos;
-		firstMouse = false;
-	}
-
-	GLfloat xoffset = xpos - lastX;
-	GLfloat yoffset = lastY - ypos;
-
-	lastX = xpos;
-	lastY = ypos;
-
-	if (free_look) 
-		camera.ProcessMouseMovement(xoffset, yoffset);	
-}
-
-// Track mouse scrollwheel
-void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
-	camera.ProcessMouseScroll(yoffset);
-}
-
-// Handler for whenever a key is pressed
-void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
-	if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
-		glfwSetWindowShouldClose(window, GL_TRUE);
-	if(key >= 0 && key < 1024) {
-		if(action == GLFW_PRESS)
-			keys[key] = true;
-		else if (action == GLFW_RELEASE) {
-			keys[key] = false;
-			keysPressed[key] = false;
-		}
-	}
-}
-
-// Track keyboard presses
-void doMovement() {
-	//ImGui_ImplGlfwGL3_KeyCallback();
-
-	// Camera Movement
-	GLfloat cameraSpeed = 8.0f * deltaTime;
-	if(keys[GLFW_KEY_W])
-		camera.ProcessKeyboard(FORWARD, deltaTime);
-	if(keys[GLFW_KEY_S])
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
-	if(keys[GLFW_KEY_A])
-		camera.ProcessKeyboard(LEFT, deltaTime);
-	if(keys[GLFW_KEY_D])
-		camera.ProcessKeyboard(RIGHT, deltaTime);
-
-	// HDR / Bloom Controls
-	if (keys[GLFW_KEY_H] && !keysPressed[GLFW_KEY_H]) {
-		hdr = !hdr;
-		keysPressed[GLFW_KEY_H] = true;
-	}
-
-	if (keys[GLFW_KEY_B] && !keysPressed[GLFW_KEY_B]) {
-		bloom = !bloom;
-		keysPressed[GLFW_KEY_B] = true;
-	}
-
-	if (keys[GLFW_KEY_Q])
-		exposure -= 2.0 * deltaTime;
-	else if (keys[GLFW_KEY_E])
-		exposure += 2.0 * deltaTime;
-
-	// Freelook
-	if (keys[GLFW_KEY_SPACE] && !keysPressed[GLFW_KEY_SPACE]) {
-		free_look = !free_look;
-		keysPressed[GLFW_KEY_SPACE] = true;
-	}
-
-	// Camera Auto-rotate
-	if (keys[GLFW_KEY_R] && !keysPressed[GLFW_KEY_R]) {
-		camRotate = !camRotate;
-		keysPressed[GLFW_KEY_R] = true;
-	}
-}
-
+// ===================================================================================
+//
+// Main.cpp  
+//
+// -----------------------------------
+//
+// By Justin Cheng
+// Instancing and Bloom Demo
+//
+// ===================================================================================
+
+// Standard Includes
+#include "stdafx.h"
+#include "cmath"
+#include <math.h>
+#include <time.h> 
+#include <string.h>
+#include <stdlib.h>
+#include <fstream>
+
+// Include various libraries
+#include "GL\glew.h"	// GLEW
+#include "GL\glfw3.h"	// GLFW
+
+#include "glm\glm.hpp"	// GLM stuff
+#include "glm\gtc\matrix_transform.hpp"
+#include "glm\gtc\type_ptr.hpp"
+ 
+// Custom header includes
+#include "UseShader.h"
+#include "ModelObj.h"
+#include "Camera.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "UniformBuffer.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
+#include "AssetLoader.h"
+#include "LightCluster.h"
+#include "Microbench.h"
+#include "StaticBatch.h"
+#include "InstanceCuller.h"
+#include "StreamBuffer.h"
+#include "GpuCuller.h"
+#include "InstancePool.h"
+#include "InstanceFormat.h"
+#include "InstanceSim.h"
+#include "Bloom.h"
+#include "RenderTargets.h"
+#include "DynamicResolution.h"
+#include "RenderGraph.h"
+#include "Overdraw.h"
+
+// Imgui test
+#include "imgui.h"
+#include "imgui_impl_glfw_gl3.h"
+
+using namespace std;
+using namespace glm;
+
+#define PI 3.1415926535897932384626433832795
+
+// Function Prototypes
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode);
+void mouseCallback(GLFWwindow* window, double xpos, double ypos);
+void scrollCallback(GLFWwindow* window, double xoffset, double yoffset);
+void framebufferSizeCallback(GLFWwindow* window, int width, int height);
+void doMovement();
+GLfloat distToLinear(GLfloat dist);
+GLfloat distToQuad(GLfloat dist);
+struct SceneUniforms;
+void RenderScene(Shader &shader, const SceneUniforms &loc);
+void RenderExtraModels(Shader &shader, const SceneUniforms &loc);
+void RenderFX(Shader &shader, const SceneUniforms &loc);
+void RenderQuad();
+void LoadUniformHandles(Shader &shader, Shader &depthShader, Shader &bloomShader);
+void LoadSceneUniforms(Shader &shader, SceneUniforms &loc);
+void UpdateLights();
+void BuildFrameGraph();
+void CullInstances(const mat4& viewProjection);
+void SortButterflyLods();
+void WriteVisibleInstances(GLubyte* data);
+void BindVisibleInstances(GLuint first);
+GLuint ModelLod(Model& model, const vec4& sphere, const mat4& world, GLfloat scale);
+void ReleaseModels();
+bool CheckTextureRelease();
+vec3 ViewForward(const mat4& view);
+
+// Window Size (initial; the window can be resized, see --resolution)
+const GLuint SCREEN_WIDTH = 1280;
+const GLuint SCREEN_HEIGHT = 720;
+GLsizei displayWidth = SCREEN_WIDTH, displayHeight = SCREEN_HEIGHT;
+
+// Camera Settings
+Camera camera(vec3(0.0f, 2.5f, 8.0f));
+GLfloat lastX = SCREEN_WIDTH / 2.0;
+GLfloat lastY = SCREEN_HEIGHT / 2.0;
+bool keys[1024];
+bool keysPressed[1024];
+bool firstMouse = true;
+bool camRotate = true;
+
+// Deltatime
+GLfloat deltaTime = 0.0f;
+GLfloat lastFrame = 0.0f;
+GLdouble sceneTime = 0.0;
+
+// Headless benchmark settings
+bool headless = false;
+GLuint benchFrames = 300;
+GLuint benchWarmup = 30;
+const char* benchOutput = "benchmark.json";
+const char* traceOutput = nullptr;
+bool checkAllocs = false;
+Benchmark benchmark;
+
+// Per-pass CPU / GPU timings
+Profiler profiler;
+
+// Light Settings
+vector<PointLightData> lights(MAX_POINT_LIGHTS);
+GLint lightCount = 2;	// two fire lights, the rest are embers
+GLboolean hdr = true; 
+GLboolean bloom = true;
+GLfloat exposure = 3.0f; 
+
+// Imgui
+void drawGui();
+bool free_look = true;
+
+// Misc
+Model figureModel, groundModel, poiModel, particleModel;
+
+// Models are parsed and their textures decoded on the job system unless
+// --sync-load is given. --models adds figure / flame pairs around the scene.
+const GLint MAX_MODELS = 1000;
+GLint modelNum = 4;
+vector<Model> extraModels;
+bool syncLoad = false;
+bool pboUpload = true;
+
+// Butterfly instances, count set with --instances
+const GLint MAX_INSTANCES = 2000000;
+GLint instanceNum = 10000;
+InstancePool butterflies;
+
+// Layout the visible butterflies are streamed in (see InstanceFormat.h)
+InstanceFormat instanceFormat = INSTANCE_TRS;
+vector<GLubyte> encodedButterflies;		// every butterfly, in instanceFormat (when not animated)
+InstanceQuantization butterflyBox;		// field the packed format stores positions within
+
+// Flocking / flapping motion, simulated on the job system every frame
+InstanceSimulation butterflySim;
+bool animateInstances = true;
+
+// Figure, flames and ground drawn as one multi-draw batch
+StaticBatch staticBatch;
+GLuint figureBatch, poiBatch, groundBatch;
+bool useStaticBatch = true;
+
+// Butterflies are frustum culled and only the visible ones are streamed
+const GLfloat BUTTERFLY_SCALE = 0.025f;
+const GLuint INSTANCE_INDEX_ATTRIB = 8;
+InstanceCuller butterflyCuller;
+StreamBuffer instanceStream;
+bool cullInstances = true;
+
+// ... or culled and compacted on the GPU with transform feedback
+GpuCuller gpuCuller;
+bool gpuCull = false;
+
+// Levels of detail are picked per model, and per butterfly on the CPU cull
+// path, as the coarsest level whose error stays within lodTolerance pixels
+// (--lod forces one level everywhere)
+GLint forcedLod = -1;
+GLfloat lodTolerance = 1.0f;
+vec4 figureSphere, poiSphere, groundSphere, butterflyBounds;	// object space
+vector<vec4> extraSpheres;
+GLuint figureLod = 0, poiLod = 0, groundLod = 0;
+GLuint frameTriangles = 0;
+
+// Extra models in view depth order, nearest first
+vector<GLuint> extraOrder;
+vector<GLfloat> extraDepths;
+
+// Uniform handles, looked up once after the shaders are linked (the depth
+// pre-pass program has its own)
+struct SceneUniforms {
+	GLint model;
+	GLint instance, instanceNum, instanceFormat, instanceOffset, instanceScale, emiIntensity;
+	GLint particleIntensity[4];
+	GLint overdraw;
+} sceneLoc, depthLoc;
+
+struct PostUniforms {
+	GLint scene, bloomTex, hdr, bloom, exposure, bloomScale, overdraw;
+} postLoc;
+
+// Per-frame Camera / Lights blocks, one ring slot per frame in flight
+UniformRing frameRing;
+GLsizeiptr lightBlockOffset;
+
+// Clustered lighting, binned on the worker threads
+LightClusters lightClusters;
+const GLuint LIGHT_TEXTURE_UNIT = 4;	// light data, cluster grid, light indices
+
+// CPU frame work (light binning, simulation, culling, instance encoding) runs
+// as a task graph on the job system while this thread makes the GL calls
+JobSystem jobSystem;
+TaskGraph frameGraph;
+GLuint lightsTask, simulateTask, cullTask, streamTask;
+
+// What this frame's tasks read and write
+struct FrameState {
+	mat4 view, projection;
+	vec3 eye;
+	GLfloat aspect;
+	GLsizei height;			// rendered height in pixels
+	GLubyte* instances;		// this frame's mapped instance stream region
+} frameState;
+
+// Framebuffer Texture
+GLuint quadVAO = 0;
+GLuint quadVBO;
+
+// Intermediate targets are taken from a pool each frame at the render size:
+// the window size times the dynamic resolution scale
+RenderTargetPool renderTargets;
+DynamicResolution dynamicRes;
+GLsizei renderWidth, renderHeight;
+GLuint sceneColor, sceneBright;		// last frame's HDR color / bright pass
+
+// GPU passes of the frame, declared every frame with the targets they read
+// and write (see RenderGraph.h)
+RenderGraph renderGraph;
+GLuint colorTarget, brightTarget, depthTarget, bloomTarget, instanceTarget;
+
+// Depth pre-pass (the shading passes then test depth for EQUAL), front to
+// back sorting, and the overdraw view: shaded fragments per pixel as a heat
+// map, counted with occlusion queries either way
+bool depthPrepass = false;
+bool depthSort = true;
+bool showOverdraw = false;
+OverdrawCounter overdrawCounter;
+
+// Bloom blur of the bright pass
+Bloom bloomPass;
+GLuint bloomLevels = 0;			// 0 = from the resolution
+GLfloat bloomThreshold = 1.0f;
+
+// Main Function
+int main(int argc, char **argv) {
+	chrono::high_resolution_clock::time_point startupBegin = chrono::high_resolution_clock::now();
+
+	// Command line options -----------------------------
+	// --headless            render offscreen on a fixed clock and write a report
+	// --frames <n>          number of recorded frames (default 300)
+	// --warmup <n>          frames to run before recording (default 30)
+	// --out <file>          report path (default benchmark.json)
+	// --trace <file>        also write the recorded frames as a Chrome trace
+	// --check-allocs        fail if a recorded frame makes any heap allocation
+	// --instances <n>       butterflies in the scene (default 10000, max 2000000)
+	// --instance-format <f> streamed butterfly layout: mat4, trs (default) or packed
+	// --lights <n>          point lights in the scene (default 2, max 1024)
+	// --no-batch            draw the static models mesh by mesh
+	// --no-cull             draw every butterfly instead of only the visible ones
+	// --gpu-cull            cull the butterflies on the GPU (transform feedback)
+	// --no-animate          keep the butterflies still
+	// --threads <n>         threads running frame tasks, this one included (default: all hardware threads)
+	// --models <n>          models in the scene (default 4, the rest are extra figure / flame pairs)
+	// --sync-load           load the models one after another on this thread
+	// --no-pbo              upload textures straight from memory instead of through a PBO
+	// --texture-budget <mb> memory unused textures may keep resident in the texture cache (default 256)
+	// --no-texture-compression upload textures as decoded RGB instead of BC1 levels from .ktx bakes
+	// --no-mesh-cache       always import models through Assimp, without reading or writing .mesh bakes
+	// --no-mesh-opt         keep imported meshes in file order (no vertex cache / overdraw optimization)
+	// --no-lod              import meshes without simplified levels of detail
+	// --lod <n>             draw every model and butterfly at level n (0 = full detail)
+	// --lod-error <px>      screen error allowed when picking levels (default 1 pixel)
+	// --vertex-format <f>   mesh vertex buffer layout: float (default) or packed
+	// --bloom <path>        bloom blur: chain (default, downsample / upsample mip chain) or gaussian (50 full resolution passes)
+	// --bloom-levels <n>    levels in the bloom chain (default: down to 8 pixels, 6 at 1280x720; max 8)
+	// --bloom-threshold <x> brightness a fragment needs to bloom (default 1.0)
+	// --bloom-sigma <x>     Gaussian path blur sigma in texels, 0.5 to 8 (default 1.8)
+	// --resolution <w>x<h>  window size (default 1280x720)
+	// --resolution-scale <s> render the scene at this fraction of the window size, 0.5 to 1 (default 1)
+	// --dynamic-res <ms>    scale the render resolution to hold this GPU frame time
+	// --depth-prepass       lay down depth with a minimal shader first, then shade with an EQUAL depth test
+	// --no-depth-sort       draw the butterflies and extra models in their stored order instead of front to back
+	// --overdraw            show shaded fragments per pixel as a heat map instead of the scene
+	// --bench-instances     CPU-only instance format sizes and encode / stream times at 1M, written to --out
+	// --bench-sim           CPU-only butterfly simulation at 100k instances on 1 to N threads, written to --out
+	// --bench-cull          CPU-only culling kernels at 10k, 100k and 1M instances, written to --out
+	// --bench-lights        CPU-only light binning sweep, 2 to 1024 lights, written to --out
+	// --bench-jobs          CPU-only job system scaling / contention on 1 to N threads, written to --out
+	// --bench-mesh-cache    CPU-only model load times, Assimp against the baked mesh cache, written to --out
+	// --bench-mesh-opt      CPU-only vertex cache ACMR / ATVR of every mesh before and after optimization, written to --out
+	// --bench-lod           CPU-only LOD chain triangles / error / build time of every mesh, written to --out
+	// --bench-vertex-format CPU-only packed vertex error bounds and fetch bytes / time per layout, written to --out
+	// --bench-textures      CPU-only BC1 encode / .ktx read times, memory and PSNR of every texture, written to --out
+	bool benchLights = false;
+	bool benchCull = false;
+	bool benchInstances = false;
+	bool benchSim = false;
+	bool benchJobs = false;
+	bool benchMeshCache = false;
+	bool benchMeshOpt = false;
+	bool benchVertexFormat = false;
+	bool benchLod = false;
+	bool benchTextures = false;
+	GLint jobThreads = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0)
+			headless = true;
+		else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+			benchFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+			benchWarmup = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc)
+			benchOutput = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			traceOutput = argv[++i];
+		else if (strcmp(argv[i], "--check-allocs") == 0)
+			checkAllocs = true;
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+			instanceNum = clamp(atoi(argv[++i]), 1, MAX_INSTANCES);
+		else if (strcmp(argv[i], "--instance-format") == 0 && i + 1 < argc) {
+			if (!ParseInstanceFormat(argv[++i], instanceFormat))
+				cout << "ERROR::ARGUMENTS::UNKNOWN_INSTANCE_FORMAT " << argv[i] << endl;
+		}
+		else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+			lightCount = clamp(atoi(argv[++i]), 1, (int)MAX_POINT_LIGHTS);
+		else if (strcmp(argv[i], "--no-batch") == 0)
+			useStaticBatch = false;
+		else if (strcmp(argv[i], "--no-cull") == 0)
+			cullInstances = false;
+		else if (strcmp(argv[i], "--gpu-cull") == 0)
+			gpuCull = true;
+		else if (strcmp(argv[i], "--no-animate") == 0)
+			animateInstances = false;
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			jobThreads = max(atoi(argv[++i]), 1);
+		else if (strcmp(argv[i], "--models") == 0 && i + 1 < argc)
+			modelNum = clamp(atoi(argv[++i]), 4, MAX_MODELS);
+		else if (strcmp(argv[i], "--sync-load") == 0)
+			syncLoad = true;
+		else if (strcmp(argv[i], "--no-pbo") == 0)
+			pboUpload = false;
+		else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+			TextureCache::shared.SetBudget((GLuint64)(max(atof(argv[++i]), 0.0) * (1 << 20)));
+		else if (strcmp(argv[i], "--no-texture-compression") == 0)
+			TextureCache::compressTextures = false;
+		else if (strcmp(argv[i], "--no-mesh-cache") == 0)
+			Model::useMeshCache = false;
+		else if (strcmp(argv[i], "--no-mesh-opt") == 0)
+			Model::optimizeMeshes = false;
+		else if (strcmp(argv[i], "--no-lod") == 0)
+			Model::generateLods = false;
+		else if (strcmp(argv[i], "--lod") == 0 && i + 1 < argc)
+			forcedLod = clamp(atoi(argv[++i]), 0, (int)MAX_MESH_LODS - 1);
+		else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc)
+			lodTolerance = max((GLfloat)atof(argv[++i]), 0.0f);
+		else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+			if (!ParseVertexFormat(argv[++i], Mesh::bufferFormat))
+				cout << "ERROR::ARGUMENTS::UNKNOWN_VERTEX_FORMAT " << argv[i] << endl;
+		}
+		else if (strcmp(argv[i], "--bloom") == 0 && i + 1 < argc) {
+			if (!Bloom::ParsePath(argv[++i], bloomPass.path))
+				cout << "ERROR::ARGUMENTS::UNKNOWN_BLOOM_PATH " << argv[i] << endl;
+		}
+		else if (strcmp(argv[i], "--bloom-levels") == 0 && i + 1 < argc)
+			bloomLevels = clamp(atoi(argv[++i]), 1, (int)BLOOM_MAX_LEVELS);
+		else if (strcmp(argv[i], "--bloom-threshold") == 0 && i + 1 < argc)
+			bloomThreshold = (GLfloat)max(atof(argv[++i]), 0.0);
+		else if (strcmp(argv[i], "--bloom-sigma") == 0 && i + 1 < argc)
+			bloomPass.sigma = QuantizeSigma((GLfloat)atof(argv[++i]));
+		else if (strcmp(argv[i], "--resolution") == 0 && i + 1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &displayWidth, &displayHeight) != 2 || displayWidth <= 0 || displayHeight <= 0) {
+				cout << "ERROR::ARGUMENTS::BAD_RESOLUTION " << argv[i] << endl;
+				displayWidth = SCREEN_WIDTH;
+				displayHeight = SCREEN_HEIGHT;
+			}
+		}
+		else if (strcmp(argv[i], "--resolution-scale") == 0 && i + 1 < argc)
+			dynamicRes.scale = DynamicResolution::Quantize((GLfloat)atof(argv[++i]));
+		else if (strcmp(argv[i], "--dynamic-res") == 0 && i + 1 < argc)
+			dynamicRes.budgetMs = (GLfloat)max(atof(argv[++i]), 0.0);
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+			depthPrepass = true;
+		else if (strcmp(argv[i], "--no-depth-sort") == 0)
+			depthSort = false;
+		else if (strcmp(argv[i], "--overdraw") == 0)
+			showOverdraw = true;
+		else if (strcmp(argv[i], "--bench-lights") == 0)
+			benchLights = true;
+		else if (strcmp(argv[i], "--bench-cull") == 0)
+			benchCull = true;
+		else if (strcmp(argv[i], "--bench-instances") == 0)
+			benchInstances = true;
+		else if (strcmp(argv[i], "--bench-sim") == 0)
+			benchSim = true;
+		else if (strcmp(argv[i], "--bench-jobs") == 0)
+			benchJobs = true;
+		else if (strcmp(argv[i], "--bench-mesh-cache") == 0)
+			benchMeshCache = true;
+		else if (strcmp(argv[i], "--bench-mesh-opt") == 0)
+			benchMeshOpt = true;
+		else if (strcmp(argv[i], "--bench-lod") == 0)
+			benchLod = true;
+		else if (strcmp(argv[i], "--bench-vertex-format") == 0)
+			benchVertexFormat = true;
+		else if (strcmp(argv[i], "--bench-textures") == 0)
+			benchTextures = true;
+	}
+
+	// Microbenchmarks need no window or GL context
+	if (benchLights)
+		return BenchLightClusters(benchOutput) ? 0 : 1;
+	if (benchCull)
+		return BenchInstanceCulling(benchOutput) ? 0 : 1;
+	if (benchInstances)
+		return BenchInstanceFormats(benchOutput) ? 0 : 1;
+	if (benchSim)
+		return BenchInstanceSimulation(benchOutput) ? 0 : 1;
+	if (benchJobs)
+		return BenchJobSystem(benchOutput) ? 0 : 1;
+	if (benchMeshCache)
+		return BenchMeshCache(benchOutput) ? 0 : 1;
+	if (benchMeshOpt)
+		return BenchMeshOptimizer(benchOutput) ? 0 : 1;
+	if (benchLod)
+		return BenchLodChains(benchOutput) ? 0 : 1;
+	if (benchVertexFormat)
+		return BenchVertexFormats(benchOutput) ? 0 : 1;
+	if (benchTextures)
+		return BenchTextureCompression(benchOutput) ? 0 : 1;
+
+	cout << "Starting GLFW context, OpenGL 3.3" << endl;
+
+	cout << "-----------------------------------\n" 
+		<< " Demo Scene\n"
+		<< "-----------------------------------\n"
+		<< "Features Implemented:\n"
+		<< "* Framebuffers: High Dynamic Range\n"
+		<< "* Framebuffers: Bloom\n"
+		<< "* Instancing: 10000 objects\n"
+		<< endl
+
+		<< " Camera Controls:\n"
+		<< "* Move around the scene with [W][A][S][D] keys\n"
+		<< "* Adjust camera angle by moving the [MOUSE]\n"
+		<< "* Zoom in and out using the [SCROLL-WHEEL]\n"
+		<< "* Press [R] for camera auto-rotation\n"
+		<< "* Use [SPACE] to lock mouse controls for camera\n"
+		<< "* Exit the program with the [ESC] key\n"
+		<< endl
+
+		<< " Feature Controls:\n"
+		<< "* Use [H] to toggle HDR on/off \n"
+		<< "* Use [B] to toggle Bloom on/off \n"
+		<< "* Use [Q] & [E] to increase/decrease light exposure \n"	
+		<< endl;
+
+	// Initialzie required options -----------------------
+#ifdef GLFW_PLATFORM_NULL
+	// Render nodes have no display server, so headless runs use GLFW's null
+	// platform with a surfaceless OSMesa (llvmpipe) context
+	if (headless)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+#endif
+	glfwInit();
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_RESIZABLE, headless ? GL_FALSE : GL_TRUE);
+	glfwWindowHint(GLFW_SAMPLES, 4);
+	if (headless) {
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+#ifdef GLFW_PLATFORM_NULL
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+#endif
+	}
+
+	// Make a Window  & Set Callbacks --------------------
+	GLFWwindow* window = glfwCreateWindow(displayWidth, displayHeight, "Demo Scene", nullptr, nullptr);
+	if (!window) {
+		cout << "ERROR::GLFW::WINDOW_CREATION_FAILED" << endl;
+		glfwTerminate();
+		return 1;
+	}
+	glfwMakeContextCurrent(window);
+	glfwGetFramebufferSize(window, &displayWidth, &displayHeight);
+	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
+
+	if (!headless) {
+		glfwSetKeyCallback(window, keyCallback);
+		glfwSetCursorPosCallback(window, mouseCallback);
+		glfwSetScrollCallback(window, scrollCallback);
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
+
+	glewExperimental = GL_TRUE;
+	glewInit();
+
+	// Define viewport dimensions 
+	glViewport(0, 0, displayWidth, displayHeight);
+
+	// Enable Depth Test --------------------------------
+	glEnable(GL_MULTISAMPLE);
+	glEnable(GL_DEPTH_TEST);
+
+	// Build, Compile, and Link Shaders -----------------
+	Shader shader("Shaders/main_vshader.glsl", "Shaders/main_fshader.glsl");
+	Shader depthShader("Shaders/main_vshader.glsl", "Shaders/depth_fshader.glsl", "#define DEPTH_ONLY\n");
+	ShaderVariants blurShaders;
+	blurShaders.Init("Shaders/blur_vshader.glsl", "Shaders/blur_fshader.glsl");
+	Shader bloomShader("Shaders/bloom_vshader.glsl", "Shaders/bloom_fshader.glsl");
+	Shader bloomDownShader("Shaders/blur_vshader.glsl", "Shaders/bloom_down_fshader.glsl");
+	Shader bloomUpShader("Shaders/blur_vshader.glsl", "Shaders/bloom_up_fshader.glsl");
+	Shader cullShader("Shaders/cull_vshader.glsl", "Shaders/cull_gshader.glsl", GPU_CULL_VARYINGS, 2);
+
+	LoadUniformHandles(shader, depthShader, bloomShader);
+	shader.BindBlock("Camera", CAMERA_BLOCK_BINDING);
+	shader.BindBlock("Lights", LIGHT_BLOCK_BINDING);
+	depthShader.BindBlock("Camera", CAMERA_BLOCK_BINDING);
+
+	// Both blocks share a ring slot so a frame is written with one map
+	lightBlockOffset = frameRing.Align(sizeof(CameraBlock));
+	frameRing.Init(lightBlockOffset + sizeof(LightBlock));
+
+	// Light lists are read from texture buffers on units 4 - 6
+	jobSystem.Init(jobThreads - 1);
+	lightClusters.Init(&jobSystem);
+	lightClusters.InitBuffers();
+	shader.Use();
+	shader.SetInt("lightData", LIGHT_TEXTURE_UNIT);
+	shader.SetInt("clusterGrid", LIGHT_TEXTURE_UNIT + 1);
+	shader.SetInt("lightIndices", LIGHT_TEXTURE_UNIT + 2);
+	shader.SetInt("materialTextures", BATCH_TEXTURE_UNIT);
+	shader.SetInt("drawData", BATCH_DRAW_DATA_UNIT);
+	shader.SetFloat("bloomThreshold", bloomThreshold);
+	depthShader.Use();
+	depthShader.SetInt("drawData", BATCH_DRAW_DATA_UNIT);
+	overdrawCounter.Init();
+
+	bloomShader.Use();
+	bloomShader.SetInt(postLoc.scene, 0);
+	bloomShader.SetInt(postLoc.bloomTex, 1);
+
+	// Load Models --------------------------------------
+	const char* extraPaths[2] = { "Models/Objs/Char.obj", "Models/Objs/FirePoi.obj" };
+	ReleaseModels();
+	extraModels.resize(modelNum - 4);
+	chrono::high_resolution_clock::time_point loadBegin = chrono::high_resolution_clock::now();
+	if (syncLoad) {
+		figureModel = Model("Models/Objs/Char.obj");
+		poiModel = Model("Models/Objs/FirePoi.obj");
+		groundModel = Model("Models/Objs/Ground.obj");
+		particleModel = Model("Models/Objs/Butterfly2.obj");
+		for (GLuint i = 0; i < extraModels.size(); i++)
+			extraModels[i] = Model((GLchar*)extraPaths[i % 2]);
+	}
+	else {
+		AssetLoader loader;
+		loader.Init(&jobSystem, pboUpload);
+		loader.Add(figureModel, "Models/Objs/Char.obj");
+		loader.Add(poiModel, "Models/Objs/FirePoi.obj");
+		loader.Add(groundModel, "Models/Objs/Ground.obj");
+		loader.Add(particleModel, "Models/Objs/Butterfly2.obj");
+		for (GLuint i = 0; i < extraModels.size(); i++)
+			loader.Add(extraModels[i], extraPaths[i % 2]);
+		loader.Run();
+		cout << "Loaded " << modelNum << " models in " << loader.loadMs << " ms (parse " << loader.parseMs << " ms, decode "
+			<< loader.decodeMs << " ms on " << jobSystem.ThreadCount() << " threads, upload " << loader.uploadMs
+			<< " ms in " << loader.batches << " batches)" << endl;
+	}
+	GLdouble loadMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - loadBegin).count();
+	TextureCacheStats textureStats = TextureCache::shared.Stats();
+	cout << "Texture cache: " << textureStats.textures << " textures, " << textureStats.residentBytes / (1 << 20)
+		<< " MB resident, hit rate " << textureStats.hitRate * 100.0f << "%" << endl;
+
+	// Bounds the levels of detail are picked with
+	figureSphere = figureModel.BoundingSphere();
+	poiSphere = poiModel.BoundingSphere();
+	groundSphere = groundModel.BoundingSphere();
+	for (GLuint i = 0; i < extraModels.size(); i++)
+		extraSpheres.push_back(extraModels[i].BoundingSphere());
+	extraOrder.resize(extraModels.size());
+	extraDepths.resize(extraModels.size());
+
+	// Pack the static models into one batch
+	if (useStaticBatch) {
+		figureBatch = staticBatch.Add(figureModel);
+		poiBatch = staticBatch.Add(poiModel);
+		groundBatch = staticBatch.Add(groundModel);
+		staticBatch.Build(shader);
+	}
+
+	// Set up instancing here ---------------------------
+	
+	// Generate orientation of each butterfly on all cores (fixed seed when
+	// benchmarking, so every run sees the same field). Positions, scales and
+	// rotations keep the original scene's steps of 1/100 of their range.
+	GLuint seed = headless ? 0 : (GLuint)glfwGetTime();
+	GLfloat expanse = 2000.0f;
+	auto butterfly = [expanse](InstanceRng& rng, GLuint i) {
+		mat4 model = mat4();
+
+		GLfloat x = (expanse / 2 - expanse * ((rng.Next() % 100) / 100.0f));
+		GLfloat y = 0.32f * (expanse * ((rng.Next() % 100) / 100.0f));
+		GLfloat z = (expanse / 2 - expanse * ((rng.Next() % 100) / 100.0f));
+		model = translate(model, vec3(x, y, z));
+
+		GLfloat scale_size = 0.5f + 0.5f * ((rng.Next() % 100) / 100.0f);
+		model = scale(model, vec3(scale_size));
+
+		GLfloat rotation_x = 5.0f - (GLfloat)(rng.Next() % 10);
+		GLfloat rotation_y = atan2(z, x);
+		GLfloat rotation_z = 5.0f - (GLfloat)(rng.Next() % 10);
+		model = rotate(model, rotation_x, vec3(1.0, 0.0, 0.0));
+		model = rotate(model, rotation_y, vec3(0.0, 1.0, 0.0));
+		model = rotate(model, rotation_z, vec3(0.0, 0.0, 1.0));
+		return model;
+	};
+	butterflies.Init(&jobSystem);
+	if (!butterflies.Resize(instanceNum)) {
+		glfwTerminate();
+		return 1;
+	}
+	butterflies.Generate(seed, butterfly);
+
+	// World-space bounding sphere of each butterfly, for culling
+	vec4 bounds = particleModel.BoundingSphere();
+	butterflyBounds = bounds;
+	mat4 butterflyModel = scale(mat4(), vec3(BUTTERFLY_SCALE));
+	butterflyCuller.Resize(instanceNum);
+	for (GLuint i = 0; i < instanceNum; i++) {
+		mat4 world = butterflyModel * butterflies[i];
+		butterflyCuller.SetSphere(i, vec3(world * vec4(vec3(bounds), 1.0f)), bounds.w * InstanceCuller::MaxScale(world));
+	}
+
+	if (animateInstances)
+		butterflySim.Init(&jobSystem, butterflies, butterflyModel, bounds);
+	butterflyBox = InstanceQuantizationOf(butterflies.Matrices(), instanceNum, animateInstances ? SIM_REACH : 0.0f);
+
+	// Visible orientations (and their original index, which picks the glow
+	// group) are streamed to the butterfly VAO each frame, or written there
+	// by the GPU cull pass
+	if (gpuCull) {
+		// The cull pass reads and writes full matrices. Animated ones are
+		// streamed to it every frame.
+		instanceFormat = INSTANCE_MAT4;
+		if (animateInstances) {
+			instanceStream.Init(instanceNum * sizeof(mat4));
+			gpuCuller.Init(cullShader, particleModel, instanceStream.Buffer(), instanceNum, bounds);
+		}
+		else {
+			butterflies.Upload();
+			gpuCuller.Init(cullShader, particleModel, butterflies.Buffer(), instanceNum, bounds);
+		}
+		gpuCuller.BindInstances(particleModel, 3, INSTANCE_INDEX_ATTRIB);
+
+		// Headless reports count the butterflies' triangles, so the visible
+		// count is read back even when it could stay on the GPU
+		gpuCuller.readBack = headless;
+	}
+	else {
+		// Encode still butterflies once; each frame only copies the visible ones
+		if (!animateInstances && instanceFormat != INSTANCE_MAT4) {
+			GLuint stride = InstanceStride(instanceFormat);
+			encodedButterflies.resize(instanceNum * stride);
+			auto encode = [stride](GLuint begin, GLuint end) {
+				for (GLuint i = begin; i < end; i++)
+					EncodeInstance(instanceFormat, butterflies[i], butterflyBox, &encodedButterflies[i * stride]);
+			};
+			jobSystem.ParallelFor(instanceNum, INSTANCE_RNG_BLOCK, encode);
+		}
+
+		instanceStream.Init(instanceNum * (InstanceStride(instanceFormat) + sizeof(GLuint)));
+		for (GLuint i = 0; i < particleModel.meshes.size(); i++) {
+			glBindVertexArray(particleModel.meshes[i].VAO);
+			glEnableVertexAttribArray(INSTANCE_INDEX_ATTRIB);
+			glVertexAttribDivisor(INSTANCE_INDEX_ATTRIB, 1);
+			glBindVertexArray(0);
+		}
+	}
+	BuildFrameGraph();
+
+	// Clear colorbuffer
+	//glClearColor(0.1f, 0.05f, 0.15f, 1.0f);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+
+	// Initialize HDR / Bloom ---------------------------
+	// The floating point color / brightness targets, depth and the bloom
+	// targets are all taken from renderTargets each frame
+	dynamicRes.Size(displayWidth, displayHeight, renderWidth, renderHeight);
+	bloomPass.Init(blurShaders, bloomDownShader, bloomUpShader, renderTargets, renderWidth, renderHeight, bloomLevels);
+	cout << "Bloom: " << Bloom::PathName(bloomPass.path) << ", " << bloomPass.LevelCount() << " levels" << endl;
+	cout << "Resolution: " << displayWidth << "x" << displayHeight << ", rendered at " << renderWidth << "x" << renderHeight;
+	if (dynamicRes.budgetMs > 0.0f)
+		cout << " (dynamic, " << dynamicRes.budgetMs << " ms budget)";
+	cout << endl;
+
+	// Render graph passes -----------------------
+	// The scene is drawn into HDR color, bright pass and depth; the
+	// butterflies are culled on the GPU between the scene and the FX that
+	// draw them, while the CPU tasks finish writing the stream
+	renderGraph.Init(renderTargets);
+
+	// Shading state: with the pre-pass the depth buffer is already final,
+	// so only the nearest fragment passes and depth is not written again.
+	// The overdraw view adds one per shaded fragment.
+	auto beginShading = [&]() {
+		if (depthPrepass) {
+			glDepthFunc(GL_EQUAL);
+			glDepthMask(GL_FALSE);
+		}
+		if (showOverdraw) {
+			glEnable(GL_BLEND);
+			glBlendFunc(GL_ONE, GL_ONE);
+		}
+		shader.Use();
+		shader.SetInt(sceneLoc.overdraw, showOverdraw);
+		overdrawCounter.Begin();
+	};
+	auto endShading = [&]() {
+		overdrawCounter.End();
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+	};
+
+	// Depth pre-pass of the scene and the butterflies. Triangles are counted
+	// once, by the shading passes.
+	auto depthPass = [&]() {
+		GLuint triangles = frameTriangles;
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		depthShader.Use();
+		RenderScene(depthShader, depthLoc);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		frameTriangles = triangles;
+	};
+	auto fxDepthPass = [&]() {
+		GLuint triangles = frameTriangles;
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		depthShader.Use();
+		RenderFX(depthShader, depthLoc);
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		frameTriangles = triangles;
+	};
+	auto scenePass = [&]() {
+		sceneColor = renderGraph.Texture(colorTarget);
+		sceneBright = renderGraph.Texture(brightTarget);
+		beginShading();
+		RenderScene(shader, sceneLoc);
+		endShading();
+	};
+	auto cullPass = [&]() {
+		frameGraph.Wait(streamTask);
+		if (!gpuCull || animateInstances)
+			instanceStream.Unmap();
+		if (gpuCull) {
+			if (animateInstances)
+				gpuCuller.SetSource(instanceStream.Buffer(), instanceStream.RegionOffset());
+			gpuCuller.Cull(scale(mat4(), vec3(BUTTERFLY_SCALE)), frameState.projection * frameState.view);
+		}
+	};
+	auto fxPass = [&]() {
+		beginShading();
+		RenderFX(shader, sceneLoc);
+		endShading();
+	};
+
+	// Blur the bright areas of the framebuffer (mip chain or Gaussian)
+	auto blurPass = [&]() {
+		bloomPass.Render(renderGraph.Texture(brightTarget), renderGraph.Texture(bloomTarget), renderWidth, renderHeight, RenderQuad);
+	};
+
+	// Add HDR / Bloom effects to the default framebuffer
+	auto compositePass = [&]() {
+		bloomShader.Use();
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, renderGraph.Texture(colorTarget));
+		glActiveTexture(GL_TEXTURE1);
+		glBindTexture(GL_TEXTURE_2D, renderGraph.Texture(bloomTarget));
+		bloomShader.SetInt(postLoc.hdr, hdr);
+		bloomShader.SetInt(postLoc.bloom, bloom);
+		bloomShader.SetFloat(postLoc.exposure, exposure);
+		bloomShader.SetFloat(postLoc.bloomScale, bloomPass.CompositeScale());
+		bloomShader.SetInt(postLoc.overdraw, showOverdraw);
+		RenderQuad();
+	};
+
+	// Imgui Test
+	if (!headless)
+		ImGui_ImplGlfwGL3_Init(window, false);
+	else {
+		glfwSwapInterval(0);
+		benchmark.Enable(benchWarmup, benchFrames);
+	}
+
+	// Loop ---------------------------------------------
+	GLuint frameNum = 0;
+	while (!glfwWindowShouldClose(window) && (!headless || frameNum < benchWarmup + benchFrames)) {
+		// Calculate deltatime between frames. Headless runs use a simulated
+		// clock so every run renders exactly the same frames.
+		if (headless)
+			sceneTime = frameNum * BENCH_TIMESTEP;
+		else
+			sceneTime = glfwGetTime();
+		GLfloat currentFrame = sceneTime;
+		deltaTime = currentFrame - lastFrame;
+		lastFrame = currentFrame;
+		// Capture exactly the recorded frames; the trace is written after the
+		// loop
+		if (headless && traceOutput && frameNum == benchWarmup)
+			profiler.Capture(benchFrames);
+		frameNum++;
+
+		// Check for events 
+		if (!headless) {
+			glfwPollEvents();
+			doMovement();
+
+			// Imgui 
+			ImGui_ImplGlfwGL3_NewFrame();
+			drawGui();
+		}
+		profiler.BeginFrame();
+		benchmark.BeginFrame();
+
+		// Pick this frame's render size from the last measured GPU time
+		dynamicRes.Update(profiler.FrameGpuMs());
+		dynamicRes.Size(displayWidth, displayHeight, renderWidth, renderHeight);
+		overdrawCounter.BeginFrame((GLuint64)renderWidth * renderHeight);
+
+		// Set up camera --------------------------
+		shader.Use();
+		mat4 view;
+
+		if (camRotate) {
+			camera.position.x = sin(0.3*sceneTime) * 9.5f;
+			camera.position.z = cos(0.3*sceneTime) * 9.5f;
+			view = glm::lookAt(glm::vec3(camera.position.x, camera.position.y, camera.position.z), glm::vec3(0.0f, 3.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+		}
+		else 
+			view = camera.GetViewMatrix();
+
+		GLfloat aspect = (float)displayWidth / (float)displayHeight;
+		mat4 projection = perspective(camera.zoom, aspect, 0.1f, 100.0f);
+
+		// Start this frame's CPU work ------------
+		frameState.view = view;
+		frameState.projection = projection;
+		frameState.eye = camera.position;
+		frameState.aspect = aspect;
+		frameState.height = renderHeight;
+		frameTriangles = 0;
+		if (!gpuCull || animateInstances)
+			frameState.instances = instanceStream.Map();
+		frameGraph.Kick();
+
+		// Upload the lights once they are binned -
+		profiler.Begin("lights");
+		frameGraph.Wait(lightsTask);
+		lightClusters.Upload(&lights[0], lightCount);
+		lightClusters.BindTextures(LIGHT_TEXTURE_UNIT);
+		profiler.End();
+
+		// Write the Camera and Lights blocks -----
+		GLubyte* frameData = frameRing.Map();
+		CameraBlock* cameraBlock = (CameraBlock*)frameData;
+		cameraBlock->projection = projection;
+		cameraBlock->view = view;
+		cameraBlock->viewPos = vec4(camera.position, 1.0f);
+		lightClusters.FillBlock(*(LightBlock*)(frameData + lightBlockOffset), renderWidth, renderHeight);
+		frameRing.Unmap();
+		frameRing.BindRange(CAMERA_BLOCK_BINDING, 0, sizeof(CameraBlock));
+		frameRing.BindRange(LIGHT_BLOCK_BINDING, lightBlockOffset, sizeof(LightBlock));
+
+		// Declare the frame's passes -----------
+		// Without bloom (or in the overdraw view) the composite does not read
+		// the blur, which is culled
+		RenderTargetDesc colorDesc = { renderWidth, renderHeight, GL_RGBA16F };
+		RenderTargetDesc depthDesc = { renderWidth, renderHeight, GL_DEPTH_COMPONENT24 };
+		renderGraph.Reset();
+		colorTarget = renderGraph.Create("color", colorDesc);
+		brightTarget = renderGraph.Create("bright", colorDesc);
+		depthTarget = renderGraph.Create("depth", depthDesc);
+		bloomTarget = renderGraph.Create("bloom", bloomPass.ResultDesc(renderWidth, renderHeight));
+		instanceTarget = renderGraph.Import("instances", 0);
+
+		// With the pre-pass, "depth" takes the scene's place ahead of the cull
+		// and the scene is shaded after the butterflies' depth
+		GLuint first = depthPrepass ? renderGraph.AddPass("depth", depthPass) : renderGraph.AddPass("scene", scenePass);
+		renderGraph.Color(first, colorTarget);
+		renderGraph.Color(first, brightTarget);
+		renderGraph.Depth(first, depthTarget);
+		renderGraph.Clear(first, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+		GLuint cull = renderGraph.AddPass("cull", cullPass);
+		renderGraph.Write(cull, instanceTarget);
+
+		if (depthPrepass) {
+			GLuint fxDepth = renderGraph.AddPass("fx depth", fxDepthPass);
+			renderGraph.Read(fxDepth, instanceTarget);
+			renderGraph.Color(fxDepth, colorTarget);
+			renderGraph.Color(fxDepth, brightTarget);
+			renderGraph.Depth(fxDepth, depthTarget);
+
+			GLuint scene = renderGraph.AddPass("scene", scenePass);
+			renderGraph.Color(scene, colorTarget);
+			renderGraph.Color(scene, brightTarget);
+			renderGraph.Depth(scene, depthTarget);
+		}
+
+		GLuint fx = renderGraph.AddPass("fx", fxPass);
+		renderGraph.Read(fx, instanceTarget);
+		renderGraph.Color(fx, colorTarget);
+		renderGraph.Color(fx, brightTarget);
+		renderGraph.Depth(fx, depthTarget);
+
+		GLuint blur = renderGraph.AddPass("blur", blurPass);
+		renderGraph.Read(blur, brightTarget);
+		renderGraph.Write(blur, bloomTarget);
+
+		GLuint composite = renderGraph.AddPass("composite", compositePass);
+		renderGraph.Read(composite, colorTarget);
+		if (bloom && !showOverdraw)
+			renderGraph.Read(composite, bloomTarget);
+		renderGraph.Clear(composite, GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		renderGraph.Present(composite, displayWidth, displayHeight);
+
+		renderGraph.Compile();
+		renderGraph.Execute(profiler);
+
+		// Swap frame buffers
+		if (!headless)
+			ImGui::Render();
+		frameGraph.WaitAll();
+		frameRing.EndFrame();
+		if (!gpuCull || animateInstances)
+			instanceStream.EndFrame();
+		glfwSwapBuffers(window);
+		if (frameNum == 1) {
+			GLdouble firstFrameMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startupBegin).count();
+			cout << "Time to first frame: " << firstFrameMs << " ms (models " << loadMs << " ms)" << endl;
+			benchmark.SetStartup(loadMs, firstFrameMs);
+		}
+		benchmark.SetTriangles(frameTriangles);
+		benchmark.SetShadedFragments(overdrawCounter.FragmentsPerPixel());
+		if (benchmark.Enabled())
+			benchmark.EndFrame(profiler);
+		else
+			profiler.EndFrame();
+		renderTargets.EndFrame();
+	}
+
+	// End ----------------------------------------------
+	// Write the benchmark report
+	int result = 0;
+	if (headless) {
+		// Both bloom paths on the last frame's bright pass (released targets
+		// keep their contents, and the bloom targets have another format)
+		BloomComparison bloomAB = bloomPass.Compare(sceneColor, sceneBright, renderWidth, renderHeight, exposure, RenderQuad);
+		cout << "Bloom A/B: chain " << bloomAB.chainMs << " ms, gaussian " << bloomAB.gaussianMs << " ms, "
+			<< bloomAB.psnr << " dB (max difference " << bloomAB.maxDifference << ")" << endl;
+		benchmark.SetBloom(Bloom::PathName(bloomPass.path), bloomPass.LevelCount(), bloomThreshold, bloomAB);
+
+		RenderTargetStats targetStats = renderTargets.Stats();
+		cout << "Render targets: " << targetStats.targets << " (" << targetStats.residentBytes / 1048576.0 << " MB, peak in use "
+			<< targetStats.peakBytes / 1048576.0 << " MB, requested " << targetStats.requestedBytes / 1048576.0 << " MB) at "
+			<< renderWidth << "x" << renderHeight << endl;
+		benchmark.SetRenderTargets(targetStats, displayWidth, displayHeight, dynamicRes.scale);
+		renderGraph.Report(cout, profiler);
+		cout << "Shaded fragments per pixel: " << overdrawCounter.FragmentsPerPixel() << " (depth pre-pass "
+			<< (depthPrepass ? "on" : "off") << ", " << (depthSort ? "front to back" : "unsorted") << ")" << endl;
+		benchmark.SetDepthMode(depthPrepass, depthSort);
+
+		ofstream report(benchOutput);
+		benchmark.WriteReport(report);
+		cout << "Benchmark report written to " << benchOutput << endl;
+		if (traceOutput)
+			profiler.WriteChromeTrace(traceOutput);
+
+		// Warm frames must not touch the heap
+		if (checkAllocs && benchmark.MaxFrameAllocations() > 0) {
+			cout << "ERROR::BENCHMARK::FRAME_ALLOCATIONS " << benchmark.MaxFrameAllocations() << " per frame" << endl;
+			result = 1;
+		}
+
+		// Models give their textures back, which the cache must then evict
+		if (!CheckTextureRelease())
+			result = 1;
+	}
+
+	// Terminate
+	ReleaseModels();
+	if (!headless)
+		ImGui_ImplGlfwGL3_Shutdown();
+	glfwTerminate();
+	return result;
+}
+
+//Imgui stuff
+void drawGui() {
+	bool show_test_window = true;
+	bool show_another_window = false;
+	//ImVec4 clear_color = ImColor(114, 144, 154);
+
+	ImGui::Text("Framebuffers: High Dynamic Range (HDR), Bloom");
+	ImGui::Text("Instancing: 10000 objects");
+	ImGui::Text("\n");
+
+	ImGui::Text("[W][A][S][D] - Pan camera | [ESC] - Exit program");
+	ImGui::Text("[MOUSE SCROLL] - Look around | [MOUSE WHEEL] - Dolly camera");
+	ImGui::Text("[R] - Auto-rotate camera | [SPACE] - Lock mouse");
+	ImGui::Text("[H] - toggle HDR on/off | [B] - toggle Bloom on/off");
+	ImGui::Text("[Q][E] - increase/decrease camera light exposure");
+	ImGui::Text("\n");
+
+	ImGui::Text("Auto-rotate: %s | Freelook: %s", camRotate ? "on" : "off", free_look ? "on" : "off");
+	ImGui::Text("HDR: %s | Bloom: %s", hdr ? "on" : "off", bloom ? "on" : "off");
+	ImGui::Text("Exposure: %f", exposure);
+	ImGui::SliderInt("Point lights", &lightCount, 1, MAX_POINT_LIGHTS);
+	ImGui::Text("Clustered light indices: %d", lightClusters.indexCount);
+	if (!gpuCull)
+		ImGui::Text("Butterflies visible: %d / %d (%s)", butterflyCuller.visibleCount, instanceNum,
+			cullInstances ? InstanceCuller::KernelName(InstanceCuller::BestKernel()) : "culling off");
+	else if (gpuCuller.QueryBuffer())
+		ImGui::Text("Butterflies: culled on the GPU (count stays on the GPU)");
+	else
+		ImGui::Text("Butterflies visible: %d / %d (GPU)", gpuCuller.visibleCount, instanceNum);
+	ImGui::Text("Instance format: %s (%d bytes)", InstanceFormatName(instanceFormat), InstanceStride(instanceFormat));
+	ImGui::Text("Vertex format: %s (%d bytes)", VertexFormatName(Mesh::bufferFormat), VertexStride(Mesh::bufferFormat));
+	TextureCacheStats textureStats = TextureCache::shared.Stats();
+	ImGui::Text("Textures: %u (%.1f MB, %s) | hit rate %.0f%%", textureStats.textures, textureStats.residentBytes / 1048576.0,
+		!TextureCache::compressTextures ? "RGB" : CompressedTexturesSupported() ? "BC1" : "BC1 expanded", textureStats.hitRate * 100.0f);
+	ImGui::Text("Triangles: %u | LOD figure %u, flames %u, ground %u", frameTriangles, figureLod, poiLod, groundLod);
+	if (!gpuCull) {
+		ImGui::Text("Butterflies per LOD:");
+		for (GLuint l = 0; l < butterflyCuller.lodCount; l++) {
+			ImGui::SameLine();
+			ImGui::Text("%u", butterflyCuller.lodFirst[l + 1] - butterflyCuller.lodFirst[l]);
+		}
+	}
+	ImGui::Text("Frame tasks (%d threads):", jobSystem.ThreadCount());
+	for (GLuint i = 0; i < frameGraph.TaskCount(); i++)
+		ImGui::Text("  %s: %.3f ms", frameGraph.TaskName(i), frameGraph.TaskMs(i));
+	ImGui::Text("\n");
+	
+	ImGui::Text("Bloom Texture Preview (<- Extracted | Blurred ->):");
+	ImGui::ImageButton((void*)sceneBright, ImVec2(192, 108));
+	ImGui::SameLine();
+	ImGui::ImageButton((void*)bloomPass.Result(), ImVec2(192, 108));
+	RenderTargetStats targetStats = renderTargets.Stats();
+	ImGui::Text("Resolution: %dx%d, rendered at %dx%d (scale %.2f%s)", displayWidth, displayHeight, renderWidth, renderHeight,
+		dynamicRes.scale, dynamicRes.budgetMs > 0.0f ? ", dynamic" : "");
+	ImGui::Text("Render targets: %u (%.1f MB, peak %.1f MB in use)", targetStats.targets, targetStats.residentBytes / 1048576.0,
+		targetStats.peakBytes / 1048576.0);
+	ImGui::Text("Render graph: %u passes, %u culled, %u framebuffer binds", renderGraph.PassCount(), renderGraph.CulledCount(),
+		renderGraph.FramebufferBinds());
+	ImGui::Checkbox("Depth pre-pass", &depthPrepass);
+	ImGui::SameLine();
+	ImGui::Checkbox("Front to back", &depthSort);
+	ImGui::SameLine();
+	ImGui::Checkbox("Overdraw view", &showOverdraw);
+	ImGui::Text("Shaded fragments per pixel: %.2f", overdrawCounter.FragmentsPerPixel());
+	ImGui::Text("Bloom: %s, %u levels, %.1fM texel fetches", Bloom::PathName(bloomPass.path), bloomPass.LevelCount(), bloomPass.TexelFetches(bloomPass.path) / 1e6);
+	if (bloomPass.path == BLOOM_GAUSSIAN) {
+		ImGui::SliderFloat("Blur sigma", &bloomPass.sigma, GAUSSIAN_MIN_SIGMA, GAUSSIAN_MAX_SIGMA);
+		ImGui::Text("Blur variants compiled: %u", bloomPass.BlurVariants());
+	}
+	ImGui::Text("\n");
+
+	profiler.DrawGui();
+}
+
+// Display Models
+void RenderScene(Shader &shader, const SceneUniforms &loc) {
+	// Set Emission intensity;
+	GLfloat emiInten;
+
+	// Level of detail of each model, from the same transform
+	mat4 sceneModel = scale(mat4(), vec3(0.2f, 0.2f, 0.2f));
+	figureLod = ModelLod(figureModel, figureSphere, sceneModel, 0.2f);
+	poiLod = ModelLod(poiModel, poiSphere, sceneModel, 0.2f);
+	groundLod = ModelLod(groundModel, groundSphere, sceneModel, 0.2f);
+
+	// Batched: all three models in one submission. The ground has always
+	// been drawn with the flames' emission intensity.
+	if (useStaticBatch) {
+		GLfloat poiEmission = 0.6f + sin(sceneTime) * 0.4f;
+		staticBatch.SetModel(figureBatch, sceneModel, 0.9f + sin(1.6 * sceneTime) * 0.1f);
+		staticBatch.SetModel(poiBatch, sceneModel, poiEmission);
+		staticBatch.SetModel(groundBatch, sceneModel, poiEmission);
+		staticBatch.SetLod(figureBatch, figureLod);
+		staticBatch.SetLod(poiBatch, poiLod);
+		staticBatch.SetLod(groundBatch, groundLod);
+		shader.SetInt(loc.instance, 0);
+		staticBatch.Draw(shader);
+		frameTriangles += staticBatch.TriangleCount();
+		RenderExtraModels(shader, loc);
+		return;
+	}
+
+	// Figure
+	mat4 model;
+	model = mat4();
+	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
+	model = scale(model, vec3(0.2f, 0.2f, 0.2f));
+	emiInten = sin(1.6 * sceneTime) * 0.1f;
+	shader.SetInt(loc.instance, 0);
+	shader.SetFloat(loc.emiIntensity, 0.9f + emiInten);
+	shader.SetMat4(loc.model, model);
+	figureModel.Draw(shader, figureLod);
+
+	// Flames
+	model = mat4();
+	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
+	model = scale(model, vec3(0.2f, 0.2f, 0.2f));
+	emiInten = sin(sceneTime) * 0.4f;
+	shader.SetInt(loc.instance, 0);
+	shader.SetFloat(loc.emiIntensity, 0.6f + emiInten);
+	shader.SetMat4(loc.model, model);
+	poiModel.Draw(shader, poiLod);
+
+	// Ground
+	model = mat4();
+	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
+	model = scale(model, vec3(0.2f, 0.2f, 0.2f));
+	shader.SetInt(loc.instance, 0);
+	shader.SetMat4(loc.model, model);
+	groundModel.Draw(shader, groundLod);
+	frameTriangles += figureModel.TriangleCount(figureLod) + poiModel.TriangleCount(poiLod) + groundModel.TriangleCount(groundLod);
+
+	RenderExtraModels(shader, loc);
+}
+
+// Extra figure / flame pairs (--models), in a ring around the figure,
+// nearest first unless --no-depth-sort
+void RenderExtraModels(Shader &shader, const SceneUniforms &loc) {
+	if (extraModels.empty())
+		return;
+	GLuint pairs = (extraModels.size() + 1) / 2;
+	vec3 forward = ViewForward(frameState.view);
+	for (GLuint i = 0; i < extraModels.size(); i++) {
+		GLfloat angle = 2.0f * PI * (i / 2) / pairs;
+		extraOrder[i] = i;
+		extraDepths[i] = dot(vec3(cos(angle) * 7.0f, 0.0f, sin(angle) * 7.0f) - frameState.eye, forward);
+	}
+	if (depthSort)
+		sort(extraOrder.begin(), extraOrder.end(), [](GLuint a, GLuint b) { return extraDepths[a] < extraDepths[b]; });
+
+	shader.SetInt(loc.instance, 0);
+	shader.SetFloat(loc.emiIntensity, 0.9f + sin(1.6 * sceneTime) * 0.1f);
+	for (GLuint n = 0; n < extraModels.size(); n++) {
+		GLuint i = extraOrder[n];
+		GLfloat angle = 2.0f * PI * (i / 2) / pairs;
+		mat4 model = translate(mat4(), vec3(cos(angle) * 7.0f, 0.0f, sin(angle) * 7.0f));
+		model = scale(model, vec3(0.2f, 0.2f, 0.2f));
+		shader.SetMat4(loc.model, model);
+		GLuint lod = ModelLod(extraModels[i], extraSpheres[i], model, 0.2f);
+		extraModels[i].Draw(shader, lod);
+		frameTriangles += extraModels[i].TriangleCount(lod);
+	}
+}
+
+// Display more FX stuff
+void RenderFX(Shader &shader, const SceneUniforms &loc) {
+	// Set Emission intensity;
+	GLfloat partInten, partInten2, partInten3, partInten4;
+	
+	mat4 model;
+	model = mat4();
+	model = translate(model, vec3(0.0f, 0.0f, 0.0f));
+	model = scale(model, vec3(BUTTERFLY_SCALE));
+
+	// Set timing for butterfly glows
+	partInten = sin(0.5 * sceneTime) * 0.3f;
+	partInten2 = sin(0.5 * sceneTime + 0.5 * PI) * 0.3f;
+	partInten3 = sin(0.5 * sceneTime + 1.0 * PI) * 0.3f;
+	partInten4 = sin(0.5 * sceneTime + 1.5 * PI) * 0.3f;
+	shader.SetFloat(loc.particleIntensity[0], 0.7f + partInten);
+	shader.SetFloat(loc.particleIntensity[1], 0.7f + partInten2);
+	shader.SetFloat(loc.particleIntensity[2], 0.7f + partInten3);
+	shader.SetFloat(loc.particleIntensity[3], 0.7f + partInten4);
+
+	// Render the visible butterflies as instances
+	shader.SetInt(loc.instance, 1);
+	shader.SetInt(loc.instanceNum, instanceNum);
+	shader.SetInt(loc.instanceFormat, instanceFormat);
+	shader.SetVec4(loc.instanceOffset, butterflyBox.offset);
+	shader.SetVec4(loc.instanceScale, butterflyBox.scale);
+	shader.SetMat4(loc.model, model);
+	if (gpuCull) {
+		gpuCuller.Draw(shader, particleModel);
+		frameTriangles += gpuCuller.visibleCount * particleModel.TriangleCount(0);
+		return;
+	}
+
+	// One instanced draw per level of detail bucket
+	for (GLuint l = 0; l < butterflyCuller.lodCount; l++) {
+		GLuint first = butterflyCuller.lodFirst[l];
+		GLuint count = butterflyCuller.lodFirst[l + 1] - first;
+		if (count == 0)
+			continue;
+		BindVisibleInstances(first);
+		particleModel.DrawInstance(shader, count, l);
+		frameTriangles += count * particleModel.TriangleCount(l);
+	}
+}
+
+// Declare the per-frame CPU tasks. Light binning runs alongside the
+// butterflies; the stream task writes into this frame's mapped region.
+void BuildFrameGraph() {
+	static auto binLights = []() {
+		UpdateLights();
+		lightClusters.SetProjection(camera.zoom, frameState.aspect, 0.1f, 100.0f);
+		lightClusters.Bin(&lights[0], lightCount, frameState.view);
+	};
+	static auto simulate = []() {
+		butterflySim.Update(deltaTime, sceneTime, gpuCull ? nullptr : &butterflyCuller);
+	};
+	static auto cull = []() {
+		CullInstances(frameState.projection * frameState.view);
+	};
+	static auto stream = []() {
+		if (gpuCull)
+			butterflySim.WriteAll(INSTANCE_MAT4, butterflyBox, frameState.instances);
+		else
+			WriteVisibleInstances(frameState.instances);
+	};
+
+	// Tasks that do not apply to this run are left out (id = TASK_GRAPH_MAX_TASKS)
+	frameGraph.Init(&jobSystem);
+	lightsTask = frameGraph.Add("lights", binLights);
+	simulateTask = animateInstances ? frameGraph.Add("simulate", simulate) : TASK_GRAPH_MAX_TASKS;
+	cullTask = !gpuCull ? frameGraph.Add("cull", cull) : TASK_GRAPH_MAX_TASKS;
+	streamTask = !gpuCull || animateInstances ? frameGraph.Add("stream", stream) : TASK_GRAPH_MAX_TASKS;
+	frameGraph.Depend(cullTask, simulateTask);
+	frameGraph.Depend(streamTask, cullTask);
+	frameGraph.Depend(streamTask, simulateTask);
+}
+
+// Frustum cull the butterflies (every one is visible with --no-cull), sort
+// them front to back, then bucket the visible ones by level of detail
+void CullInstances(const mat4& viewProjection) {
+	if (cullInstances)
+		butterflyCuller.Cull(viewProjection, InstanceCuller::BestKernel());
+	else
+		butterflyCuller.CullNone();
+	if (depthSort)
+		butterflyCuller.SortByDepth(frameState.eye, ViewForward(frameState.view));
+	if (particleModel.LodCount() > 1)
+		SortButterflyLods();
+}
+
+// A butterfly at distance d with bounding radius r shows a level's error e
+// (object space) as e * (r / butterflyBounds.w) * pixels / d pixels, so
+// each level has a limit on r / d
+void SortButterflyLods() {
+	GLuint lods = min(particleModel.LodCount(), CULL_MAX_LODS);
+	GLfloat limits[CULL_MAX_LODS];
+	GLfloat pixels = PixelsPerUnit(frameState.projection, frameState.height, 1.0f);
+	for (GLuint l = 0; l < lods; l++) {
+		GLfloat error = particleModel.LodError(l);
+		if (forcedLod >= 0)
+			limits[l] = (GLint)l <= forcedLod ? 1e30f : -1.0f;
+		else
+			limits[l] = error > 0.0f ? lodTolerance * butterflyBounds.w / (error * pixels) : 1e30f;
+	}
+	butterflyCuller.SortByLod(frameState.eye, limits, lods);
+}
+
+// Level of detail of a model drawn with a uniform scale: the coarsest whose
+// error stays within lodTolerance pixels at the model's nearest point
+GLuint ModelLod(Model& model, const vec4& sphere, const mat4& world, GLfloat scale) {
+	if (forcedLod >= 0)
+		return min((GLuint)forcedLod, model.LodCount() - 1);
+	vec3 center = vec3(world * vec4(vec3(sphere), 1.0f));
+	GLfloat distance = max(length(center - camera.position) - sphere.w * scale, 0.1f);
+	return model.SelectLod(scale * PixelsPerUnit(frameState.projection, frameState.height, distance), lodTolerance);
+}
+
+// World space direction the view looks along (view depth = dot with it)
+vec3 ViewForward(const mat4& view) {
+	return -vec3(view[0][2], view[1][2], view[2][2]);
+}
+
+// Write the visible orientations and indices into this frame's stream
+// region. Animated butterflies are encoded straight into it.
+void WriteVisibleInstances(GLubyte* data) {
+	GLuint visible = butterflyCuller.visibleCount;
+	GLuint stride = InstanceStride(instanceFormat);
+	if (visible == 0)
+		return;
+	if (animateInstances)
+		butterflySim.Write(instanceFormat, butterflyBox, &butterflyCuller.visible[0], visible, data);
+	else {
+		const GLubyte* source = instanceFormat == INSTANCE_MAT4 ? (const GLubyte*)butterflies.Matrices() : &encodedButterflies[0];
+		GatherInstances(instanceFormat, source, &butterflyCuller.visible[0], visible, data);
+	}
+	memcpy(data + instanceNum * stride, &butterflyCuller.visible[0], visible * sizeof(GLuint));
+}
+
+// Point the butterfly VAOs at this frame's stream region, starting at the
+// first-th visible butterfly
+void BindVisibleInstances(GLuint first) {
+	GLuint stride = InstanceStride(instanceFormat);
+	GLintptr base = instanceStream.RegionOffset();
+	glBindBuffer(GL_ARRAY_BUFFER, instanceStream.Buffer());
+	for (GLuint i = 0; i < particleModel.meshes.size(); i++) {
+		glBindVertexArray(particleModel.meshes[i].VAO);
+		SetInstanceAttributes(instanceFormat, 3, base + first * stride);
+		glVertexAttribIPointer(INSTANCE_INDEX_ATTRIB, 1, GL_UNSIGNED_INT, sizeof(GLuint),
+			(GLvoid*)(base + instanceNum * stride + first * sizeof(GLuint)));
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Look up every uniform the render loop sets, once
+void LoadUniformHandles(Shader &shader, Shader &depthShader, Shader &bloomShader) {
+	LoadSceneUniforms(shader, sceneLoc);
+	LoadSceneUniforms(depthShader, depthLoc);
+
+	postLoc.scene = bloomShader.Uniform("scene");
+	postLoc.bloomTex = bloomShader.Uniform("bloomTex");
+	postLoc.hdr = bloomShader.Uniform("hdr");
+	postLoc.bloom = bloomShader.Uniform("bloom");
+	postLoc.exposure = bloomShader.Uniform("exposure");
+	postLoc.bloomScale = bloomShader.Uniform("bloomScale");
+	postLoc.overdraw = bloomShader.Uniform("overdraw");
+}
+
+// Give every model's texture references back to the texture cache, before
+// the models are replaced and at shutdown
+void ReleaseModels() {
+	figureModel.ReleaseTextures();
+	poiModel.ReleaseTextures();
+	groundModel.ReleaseTextures();
+	particleModel.ReleaseTextures();
+	for (GLuint i = 0; i < extraModels.size(); i++)
+		extraModels[i].ReleaseTextures();
+}
+
+// Release the models and check the texture cache's bookkeeping: nothing is
+// referenced afterwards, and with no budget every texture is evicted. Then
+// one of the figure's readable textures is loaded twice, released twice and
+// evicted, checking its references and the resident bytes at each step.
+bool CheckTextureRelease() {
+	string path;
+	for (GLuint i = 0; i < figureModel.textures_loaded.size() && path.empty(); i++) {
+		if (figureModel.textures_loaded[i].id)
+			path = figureModel.TexturePath(figureModel.textures_loaded[i]);
+	}
+	TextureCacheStats loaded = TextureCache::shared.Stats();
+	ReleaseModels();
+	TextureCacheStats released = TextureCache::shared.Stats();
+	bool passed = released.referenced == 0 && released.textures + (released.evictions - loaded.evictions) == loaded.textures;
+
+	TextureCache::shared.SetBudget(0);
+	TextureCacheStats evicted = TextureCache::shared.Stats();
+	passed = passed && evicted.textures == 0 && evicted.residentBytes == 0;
+
+	GLuint64 textureBytes = 0;
+	if (!path.empty()) {
+		GLuint id = TextureCache::shared.Load(path);
+		TextureCacheStats first = TextureCache::shared.Stats();
+		textureBytes = first.residentBytes;
+		passed = passed && TextureCache::shared.References(id) == 1 && first.textures == 1 && textureBytes > 0;
+		passed = passed && TextureCache::shared.Load(path) == id && TextureCache::shared.References(id) == 2;
+		TextureCacheStats second = TextureCache::shared.Stats();
+		passed = passed && second.residentBytes == textureBytes && second.hits == first.hits + 1;
+
+		TextureCache::shared.Release(id);
+		passed = passed && TextureCache::shared.References(id) == 1 && TextureCache::shared.Stats().residentBytes == textureBytes;
+		TextureCache::shared.Release(id);
+		TextureCacheStats last = TextureCache::shared.Stats();
+		passed = passed && last.textures == 0 && last.residentBytes == 0 && last.evictions == second.evictions + 1;
+	}
+	TextureCache::shared.SetBudget(loaded.budgetBytes);
+
+	if (passed)
+		cout << "Texture release: " << loaded.textures << " textures (" << loaded.residentBytes / 1048576.0 << " MB) released and evicted, "
+			<< textureBytes / 1048576.0 << " MB texture reloaded, released and evicted" << endl;
+	else
+		cout << "ERROR::TEXTURE_CACHE::RELEASE_CHECK_FAILED" << endl;
+	return passed;
+}
+
+// Handles of a program built from main_vshader.glsl; the ones a program
+// does not use are -1, which the setters ignore
+void LoadSceneUniforms(Shader &shader, SceneUniforms &loc) {
+	loc.model = shader.Uniform("model");
+	loc.instance = shader.Uniform("instance");
+	loc.instanceNum = shader.Uniform("instanceNum");
+	loc.instanceFormat = shader.Uniform("instanceFormat");
+	loc.instanceOffset = shader.Uniform("instanceOffset");
+	loc.instanceScale = shader.Uniform("instanceScale");
+	loc.emiIntensity = shader.Uniform("emiIntensity");
+	for (GLuint i = 0; i < 4; i++)
+		loc.particleIntensity[i] = shader.Uniform("particleIntensity" + to_string(i + 1));
+	loc.overdraw = shader.Uniform("overdraw");
+}
+
+// Animate the two fire lights and the embers drifting up around the figure
+void UpdateLights() {
+	GLfloat lightDist = sin(sceneTime) * 9.0f;
+	for (GLint i = 0; i < lightCount; i++) {
+		PointLightData& light = lights[i];
+		light.constant = 1.0f;
+		if (i < 2) {
+			light.lightColor = vec3(0.45f, 0.3f, 0.3f);
+			light.lightPos = i == 0 ? vec3(-1.6f, 0.5f, 0.55f) : vec3(1.6f, 4.6f, 1.55f);
+			light.linear = distToLinear(29 + lightDist);
+			light.quadratic = distToQuad(29 + lightDist);
+		}
+		else {
+			// Fixed pseudo-random spread per ember
+			GLfloat h0 = fmod(i * 0.618034f, 1.0f);
+			GLfloat h1 = fmod(i * 0.754878f, 1.0f);
+			GLfloat h2 = fmod(i * 0.569840f, 1.0f);
+			GLfloat angle = 2.0f * PI * h0 + 0.3f * sceneTime;
+			GLfloat ring = 1.5f + 4.5f * h1;
+			GLfloat height = fmod(6.0f * h2 + 0.4f * sceneTime, 6.0f);
+			GLfloat flicker = 0.6f + 0.4f * sin(7.0f * sceneTime + 20.0f * h0);
+			light.lightColor = vec3(0.9f, 0.35f + 0.2f * h1, 0.05f) * flicker;
+			light.lightPos = vec3(cos(angle) * ring, height, sin(angle) * ring);
+			light.linear = distToLinear(3.0f);
+			light.quadratic = distToQuad(3.0f);
+		}
+		light.radius = LightClusters::LightRadius(light);
+	}
+}
+
+// Display framebuffer quad
+void RenderQuad() {
+	if (quadVAO == 0) {
+		GLfloat quadVertices[] = {
+			// Positions			// Texture Coords
+			-1.0f, 1.0f, 0.0f,		0.0f, 1.0f,
+			-1.0f, -1.0f, 0.0f,		0.0f, 0.0f,
+			1.0f, 1.0f, 0.0f,		1.0f, 1.0f,
+			1.0f, -1.0f, 0.0f,		1.0f, 0.0f,
+		};
+
+		// Setup plane VAO
+		glGenVertexArrays(1, &quadVAO);
+		glGenBuffers(1, &quadVBO);
+		glBindVertexArray(quadVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)0);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (GLvoid*)(3 * sizeof(GLfloat)));
+	}
+	glBindVertexArray(quadVAO);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glBindVertexArray(0);
+}
+
+// Convert distance to light linear constant
+GLfloat distToLinear(GLfloat dist) {
+	return 5.4399f * pow(dist, -1.063);
+}
+
+// Convert distance to light quadratic constant
+GLfloat distToQuad(GLfloat dist) {
+	return 107.35f * pow(dist, -2.115);
+}
+
+// The window was resized; render targets follow on the next frame
+void framebufferSizeCallback(GLFWwindow* window, int width, int height) {
+	displayWidth = max(width, 1);
+	displayHeight = max(height, 1);
+}
+
+// Track mouse movements
+void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
+	if (firstMouse) {
+		lastX = xpos;
+		lastY = ypos;
+		firstMouse = false;
+	}
+
+	GLfloat xoffset = xpos - lastX;
+	GLfloat yoffset = lastY - ypos;
+
+	lastX = xpos;
+	lastY = ypos;
+
+	if (free_look) 
+		camera.ProcessMouseMovement(xoffset, yoffset);	
+}
+
+// Track mouse scrollwheel
+void scrollCallback(GLFWwindow* window, double xoffset, double yoffset) {
+	camera.ProcessMouseScroll(yoffset);
+}
+
+// Handler for whenever a key is pressed
+void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
+	if(key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
+		glfwSetWindowShouldClose(window, GL_TRUE);
+	if(key >= 0 && key < 1024) {
+		if(action == GLFW_PRESS)
+			keys[key] = true;
+		else if (action == GLFW_RELEASE) {
+			keys[key] = false;
+			keysPressed[key] = false;
+		}
+	}
+}
+
+// Track keyboard presses
+void doMovement() {
+	//ImGui_ImplGlfwGL3_KeyCallback();
+
+	// Camera Movement
+	GLfloat cameraSpeed = 8.0f * deltaTime;
+	if(keys[GLFW_KEY_W])
+		camera.ProcessKeyboard(FORWARD, deltaTime);
+	if(keys[GLFW_KEY_S])
+		camera.ProcessKeyboard(BACKWARD, deltaTime);
+	if(keys[GLFW_KEY_A])
+		camera.ProcessKeyboard(LEFT, deltaTime);
+	if(keys[GLFW_KEY_D])
+		camera.ProcessKeyboard(RIGHT, deltaTime);
+
+	// HDR / Bloom Controls
+	if (keys[GLFW_KEY_H] && !keysPressed[GLFW_KEY_H]) {
+		hdr = !hdr;
+		keysPressed[GLFW_KEY_H] = true;
+	}
+
+	if (keys[GLFW_KEY_B] && !keysPressed[GLFW_KEY_B]) {
+		bloom = !bloom;
+		keysPressed[GLFW_KEY_B] = true;
+	}
+
+	if (keys[GLFW_KEY_Q])
+		exposure -= 2.0 * deltaTime;
+	else if (keys[GLFW_KEY_E])
+		exposure += 2.0 * deltaTime;
+
+	// Freelook
+	if (keys[GLFW_KEY_SPACE] && !keysPressed[GLFW_KEY_SPACE]) {
+		free_look = !free_look;
+		keysPressed[GLFW_KEY_SPACE] = true;
+	}
+
+	// Camera Auto-rotate
+	if (keys[GLFW_KEY_R] && !keysPressed[GLFW_KEY_R]) {
+		camRotate = !camRotate;
+		keysPressed[GLFW_KEY_R] = true;
+	}
+}
+
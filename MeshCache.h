@@ -0,0 +1,372 @@
+// ============================================================================
+//
+// MeshCache.h
+// -----------------------------------
+//
+// MESH CACHE HEADER FILE
+//
+// A baked binary copy of an imported model, written next to the source file
+// ("Char.obj" -> "Char.obj.mesh") the first time it goes through Assimp.
+// It holds each mesh's interleaved vertices and indices, already in the
+// layout the vertex buffers use, its levels of detail and its texture
+// references. Later loads map the file into memory and read the arrays in
+// place: nothing is parsed or converted, and the mapped bytes are handed
+// straight to glBufferData. A cache whose recorded source size or
+// modification time no longer matches is ignored and rewritten.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <functional>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+// OpenGL includes
+#include "GL\glew.h"
+
+// Other includes
+#include "MeshObj.h"
+
+using namespace std;
+
+// File identification
+const GLuint MESH_CACHE_MAGIC = 0x4853454D;		// "MESH"
+const GLuint MESH_CACHE_VERSION = 2;
+
+// How the meshes were prepared before baking
+const GLuint MESH_CACHE_OPTIMIZED = 1;		// MeshOptimizer.h reordering
+const GLuint MESH_CACHE_LODS = 2;			// MeshLod.h level of detail chains
+
+// Vertex and index arrays start on this boundary in the file
+const GLuint MESH_CACHE_ALIGN = 16;
+
+// Longest texture type / path stored for a texture reference
+const GLuint MESH_CACHE_TYPE_LENGTH = 32;
+const GLuint MESH_CACHE_PATH_LENGTH = 224;
+
+// Start of the file
+struct MeshCacheHeader {
+	GLuint magic;
+	GLuint version;
+	GLuint vertexSize;				// sizeof(Vertex) the file was baked with
+	GLuint meshCount;
+	GLuint textureCount;
+	GLuint flags;
+	GLuint64 sourceSize;
+	GLint64 sourceTime;
+};
+
+// One mesh, following the header
+struct MeshCacheMesh {
+	GLuint64 vertexOffset;			// bytes from the start of the file
+	GLuint64 indexOffset;
+	GLuint vertexCount;
+	GLuint indexCount;
+	GLuint firstTexture;
+	GLuint textureCount;
+	GLuint lodCount;
+	MeshLod lods[MAX_MESH_LODS];	// ranges of the index array
+};
+
+// One texture reference, following the meshes
+struct MeshCacheTexture {
+	char type[MESH_CACHE_TYPE_LENGTH];		// "texture_diffuse", ...
+	char path[MESH_CACHE_PATH_LENGTH];		// relative to the model
+};
+
+// Mesh cache class
+class MeshCache {
+private:
+	// Data
+	const GLubyte* data;
+	GLuint64 size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+
+	static bool sourceStamp(const string& source, GLuint64& size, GLint64& time);
+	bool inFile(GLuint64 offset, GLuint64 bytes) const;
+	bool valid(const string& source, GLuint flags);
+
+	// The mapping cannot be shared between copies
+	MeshCache(const MeshCache&);
+	MeshCache& operator=(const MeshCache&);
+
+public:
+	MeshCache();
+	~MeshCache();
+
+	static string PathFor(const string& source);
+	static bool Write(const string& source, const vector<Mesh>& meshes, GLuint flags);
+
+	bool Open(const string& source, GLuint flags);
+	void Close();
+
+	GLuint MeshCount();
+	const MeshCacheMesh& GetMesh(GLuint mesh);
+	const MeshCacheTexture& GetTexture(GLuint texture);
+	const Vertex* Vertices(GLuint mesh);
+	const GLuint* Indices(GLuint mesh);
+};
+
+// Constructor
+MeshCache::MeshCache() {
+	this->data = nullptr;
+	this->size = 0;
+#ifdef _WIN32
+	this->file = INVALID_HANDLE_VALUE;
+	this->mapping = NULL;
+#endif
+}
+
+MeshCache::~MeshCache() {
+	this->Close();
+}
+
+// Cache file of a model
+string MeshCache::PathFor(const string& source) {
+	return source + ".mesh";
+}
+
+// Size and modification time of the source model
+bool MeshCache::sourceStamp(const string& source, GLuint64& size, GLint64& time) {
+	struct stat info;
+	if (stat(source.c_str(), &info) != 0)
+		return false;
+	size = info.st_size;
+	time = info.st_mtime;
+	return true;
+}
+
+// Bake a model's meshes. Written to a temporary file and renamed, so a
+// reader (or another writer) never sees half a cache.
+bool MeshCache::Write(const string& source, const vector<Mesh>& meshes, GLuint flags) {
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.meshCount = meshes.size();
+	header.flags = flags;
+	if (!sourceStamp(source, header.sourceSize, header.sourceTime))
+		return false;
+
+	// Lay out the tables, then every mesh's arrays
+	vector<MeshCacheMesh> records(meshes.size());
+	vector<MeshCacheTexture> textures;
+	GLuint64 offset = sizeof(MeshCacheHeader) + meshes.size() * sizeof(MeshCacheMesh);
+	for (GLuint i = 0; i < meshes.size(); i++)
+		header.textureCount += meshes[i].textures.size();
+	offset += header.textureCount * sizeof(MeshCacheTexture);
+	for (GLuint i = 0; i < meshes.size(); i++) {
+		const Mesh& mesh = meshes[i];
+		MeshCacheMesh& record = records[i];
+		record.vertexCount = mesh.VertexCount();
+		record.indexCount = mesh.IndexCount();
+		record.firstTexture = textures.size();
+		record.textureCount = mesh.textures.size();
+		record.lodCount = min(mesh.LodCount(), MAX_MESH_LODS);
+		for (GLuint l = 0; l < record.lodCount; l++)
+			record.lods[l] = mesh.Lod(l);
+		offset = (offset + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN;
+		record.vertexOffset = offset;
+		offset += record.vertexCount * sizeof(Vertex);
+		offset = (offset + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN;
+		record.indexOffset = offset;
+		offset += record.indexCount * sizeof(GLuint);
+
+		for (GLuint t = 0; t < mesh.textures.size(); t++) {
+			MeshCacheTexture texture;
+			memset(&texture, 0, sizeof(texture));
+			const Texture& used = mesh.textures[t];
+			if (used.type.size() >= MESH_CACHE_TYPE_LENGTH || used.path.length >= MESH_CACHE_PATH_LENGTH) {
+				cout << "ERROR::MESH_CACHE::TEXTURE_PATH_TOO_LONG " << used.path.C_Str() << endl;
+				return false;
+			}
+			strcpy(texture.type, used.type.c_str());
+			strcpy(texture.path, used.path.C_Str());
+			textures.push_back(texture);
+		}
+	}
+
+	string path = PathFor(source);
+	string temporary = path + ".tmp" + to_string(hash<thread::id>()(this_thread::get_id()));
+	ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+	if (!out) {
+		cout << "ERROR::MESH_CACHE::NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	static const char padding[MESH_CACHE_ALIGN] = { 0 };
+	out.write((const char*)&header, sizeof(header));
+	if (!records.empty())
+		out.write((const char*)&records[0], records.size() * sizeof(MeshCacheMesh));
+	if (!textures.empty())
+		out.write((const char*)&textures[0], textures.size() * sizeof(MeshCacheTexture));
+	for (GLuint i = 0; i < meshes.size(); i++) {
+		out.write(padding, records[i].vertexOffset - (GLuint64)out.tellp());
+		out.write((const char*)meshes[i].VertexData(), records[i].vertexCount * sizeof(Vertex));
+		out.write(padding, records[i].indexOffset - (GLuint64)out.tellp());
+		out.write((const char*)meshes[i].IndexData(), records[i].indexCount * sizeof(GLuint));
+	}
+	bool written = out.good();
+	out.close();
+
+	remove(path.c_str());
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		cout << "ERROR::MESH_CACHE::NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+// Whether a section lies inside the mapping. Compared without adding the
+// offset, which a corrupt file can set anywhere near 2^64.
+bool MeshCache::inFile(GLuint64 offset, GLuint64 bytes) const {
+	return offset <= this->size && bytes <= this->size - offset;
+}
+
+// Check a freshly mapped file against its source and against itself. Every
+// index is checked once here, so meshes built from the mapping never read
+// past their vertices.
+bool MeshCache::valid(const string& source, GLuint flags) {
+	if (this->size < sizeof(MeshCacheHeader))
+		return false;
+	const MeshCacheHeader& header = *(const MeshCacheHeader*)this->data;
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(Vertex)
+		|| header.flags != flags)
+		return false;
+
+	// A missing source is fine (only the cache was shipped), a changed one
+	// is not
+	GLuint64 sourceSize;
+	GLint64 sourceTime;
+	if (sourceStamp(source, sourceSize, sourceTime) && (sourceSize != header.sourceSize || sourceTime != header.sourceTime))
+		return false;
+
+	GLuint64 tables = sizeof(MeshCacheHeader) + (GLuint64)header.meshCount * sizeof(MeshCacheMesh)
+		+ (GLuint64)header.textureCount * sizeof(MeshCacheTexture);
+	if (tables > this->size)
+		return false;
+	for (GLuint i = 0; i < header.meshCount; i++) {
+		const MeshCacheMesh& mesh = this->GetMesh(i);
+		if (mesh.vertexOffset % MESH_CACHE_ALIGN || mesh.indexOffset % MESH_CACHE_ALIGN
+			|| !this->inFile(mesh.vertexOffset, (GLuint64)mesh.vertexCount * sizeof(Vertex))
+			|| !this->inFile(mesh.indexOffset, (GLuint64)mesh.indexCount * sizeof(GLuint))
+			|| (GLuint64)mesh.firstTexture + mesh.textureCount > header.textureCount
+			|| mesh.lodCount < 1 || mesh.lodCount > MAX_MESH_LODS)
+			return false;
+		for (GLuint l = 0; l < mesh.lodCount; l++) {
+			if ((GLuint64)mesh.lods[l].firstIndex + mesh.lods[l].indexCount > mesh.indexCount)
+				return false;
+		}
+		const GLuint* indices = this->Indices(i);
+		for (GLuint k = 0; k < mesh.indexCount; k++) {
+			if (indices[k] >= mesh.vertexCount)
+				return false;
+		}
+	}
+	return true;
+}
+
+// Map the cache of a model, baked with the given flags. False when there is
+// none, it is stale, or it was prepared differently.
+bool MeshCache::Open(const string& source, GLuint flags) {
+	this->Close();
+	string path = PathFor(source);
+#ifdef _WIN32
+	this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (this->file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(this->file, &fileSize) && fileSize.QuadPart > 0)
+		this->mapping = CreateFileMappingA(this->file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (this->mapping) {
+		this->data = (const GLubyte*)MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0);
+		this->size = fileSize.QuadPart;
+	}
+#else
+	int file = open(path.c_str(), O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat info;
+	if (fstat(file, &info) == 0 && info.st_size > 0) {
+		void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+		if (mapped != MAP_FAILED) {
+			this->data = (const GLubyte*)mapped;
+			this->size = info.st_size;
+		}
+	}
+	close(file);
+#endif
+
+	if (!this->data || !this->valid(source, flags)) {
+		this->Close();
+		return false;
+	}
+	return true;
+}
+
+// Unmap the file. Meshes read from it must not be used afterwards.
+void MeshCache::Close() {
+#ifdef _WIN32
+	if (this->data)
+		UnmapViewOfFile(this->data);
+	if (this->mapping)
+		CloseHandle(this->mapping);
+	if (this->file != INVALID_HANDLE_VALUE)
+		CloseHandle(this->file);
+	this->mapping = NULL;
+	this->file = INVALID_HANDLE_VALUE;
+#else
+	if (this->data)
+		munmap((void*)this->data, this->size);
+#endif
+	this->data = nullptr;
+	this->size = 0;
+}
+
+GLuint MeshCache::MeshCount() {
+	return ((const MeshCacheHeader*)this->data)->meshCount;
+}
+
+const MeshCacheMesh& MeshCache::GetMesh(GLuint mesh) {
+	const MeshCacheMesh* meshes = (const MeshCacheMesh*)(this->data + sizeof(MeshCacheHeader));
+	return meshes[mesh];
+}
+
+const MeshCacheTexture& MeshCache::GetTexture(GLuint texture) {
+	const MeshCacheHeader& header = *(const MeshCacheHeader*)this->data;
+	const MeshCacheTexture* textures = (const MeshCacheTexture*)(this->data + sizeof(MeshCacheHeader)
+		+ header.meshCount * sizeof(MeshCacheMesh));
+	return textures[texture];
+}
+
+// A mesh's arrays, in place in the mapping
+const Vertex* MeshCache::Vertices(GLuint mesh) {
+	return (const Vertex*)(this->data + this->GetMesh(mesh).vertexOffset);
+}
+
+const GLuint* MeshCache::Indices(GLuint mesh) {
+	return (const GLuint*)(this->data + this->GetMesh(mesh).indexOffset);
+}
@@ -0,0 +1,356 @@
+// ============================================================================
+//
+// MeshLod.h
+// -----------------------------------
+//
+// MESH LOD HEADER FILE
+//
+// Import-time level of detail chains. Each level is a simplified index list
+// over the mesh's own vertices, built by quadric error edge collapse
+// (Garland & Heckbert 1997): every vertex carries the planes of the faces
+// around it, and the vertex whose move onto a neighbour costs the least
+// squared distance to those planes is collapsed first. Vertices are only
+// ever moved onto existing ones, so all levels share one vertex buffer and
+// differ only in their index ranges. Vertices on a UV / normal seam are
+// never moved, and open borders only collapse along themselves, so levels
+// do not crack. At runtime a level is picked from its error projected to
+// the screen.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+// Other includes
+#include "MeshObj.h"
+#include "MeshOptimizer.h"
+
+using namespace std;
+using namespace glm;
+
+// Each level aims for this fraction of the previous level's triangles
+const GLfloat MESH_LOD_RATIO = 0.5f;
+
+// A level is only kept if it has at most this fraction of the triangles of
+// the level before it
+const GLfloat MESH_LOD_MIN_REDUCTION = 0.85f;
+
+// Levels are not simplified below this many triangles
+const GLuint MESH_LOD_MIN_TRIANGLES = 16;
+
+// Weight of the planes that hold open borders in place, relative to the faces
+const GLdouble MESH_LOD_BORDER_WEIGHT = 10.0;
+
+// A collapse may turn a face by at most acos of this
+const GLfloat MESH_LOD_MAX_FOLD = 0.5f;
+
+// Collapses up to this factor costlier than the pass's median are taken in
+// the same pass
+const GLdouble MESH_LOD_PASS_SLACK = 1.5;
+
+// How a vertex may move during simplification
+enum LodVertexKind {
+	LOD_VERTEX_FREE,		// interior: onto any neighbour
+	LOD_VERTEX_BORDER,		// on an open border: onto a neighbour along it
+	LOD_VERTEX_LOCKED		// seam or non-manifold: never
+};
+
+// Area-weighted sum of squared distances to a set of planes, as the
+// symmetric 4x4 matrix of the plane equations
+struct Quadric {
+	GLdouble a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+	GLdouble weight;
+};
+
+// One plane (unit normal n, n.p + d = 0) with a weight
+Quadric PlaneQuadric(const vec3& n, GLdouble d, GLdouble weight) {
+	Quadric q;
+	q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z; q.a03 = weight * n.x * d;
+	q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a13 = weight * n.y * d;
+	q.a22 = weight * n.z * n.z; q.a23 = weight * n.z * d;
+	q.a33 = weight * d * d;
+	q.weight = weight;
+	return q;
+}
+
+void QuadricAdd(Quadric& q, const Quadric& r) {
+	q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+	q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+	q.a22 += r.a22; q.a23 += r.a23;
+	q.a33 += r.a33;
+	q.weight += r.weight;
+}
+
+// Mean squared distance of a point to the quadric's planes
+GLdouble QuadricError(const Quadric& q, const vec3& p) {
+	GLdouble x = p.x, y = p.y, z = p.z;
+	GLdouble e = q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x
+		+ q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y
+		+ q.a22 * z * z + 2.0 * q.a23 * z
+		+ q.a33;
+	return q.weight > 0.0 ? fabs(e) / q.weight : 0.0;
+}
+
+// Exact position key, for finding the copies of a vertex on a seam
+struct PositionHash {
+	size_t operator()(const vec3& p) const {
+		const GLuint* words = (const GLuint*)&p;
+		return ((words[0] * 73856093u) ^ (words[1] * 19349663u) ^ (words[2] * 83492791u));
+	}
+};
+
+struct PositionEqual {
+	bool operator()(const vec3& a, const vec3& b) const {
+		return a.x == b.x && a.y == b.y && a.z == b.z;
+	}
+};
+
+// Simplify a triangle list towards targetIndexCount indices, moving
+// vertices only onto existing ones. Returns the new index list; error is
+// set to the largest distance (object space) a collapse moved the surface.
+// Stops early when no collapse is left that keeps the mesh intact.
+vector<GLuint> SimplifyMesh(const vector<Vertex>& vertices, const vector<GLuint>& indices, GLuint targetIndexCount, GLfloat& error) {
+	GLuint vertexCount = vertices.size();
+	vector<GLuint> result(indices);
+	error = 0.0f;
+	if (result.size() <= targetIndexCount || result.size() % 3)
+		return result;
+
+	// Copies of the same position share a weld id
+	vector<GLuint> weld(vertexCount);
+	vector<GLuint> copies(vertexCount, 0);
+	unordered_map<vec3, GLuint, PositionHash, PositionEqual> positions;
+	positions.reserve(vertexCount);
+	for (GLuint v = 0; v < vertexCount; v++) {
+		weld[v] = positions.insert(make_pair(vertices[v].Position, v)).first->second;
+		copies[weld[v]]++;
+	}
+
+	// Welded edges used by one face are open borders; by more than two,
+	// non-manifold
+	unordered_map<GLuint64, GLuint> edges;
+	edges.reserve(result.size());
+	for (GLuint i = 0; i < result.size(); i++) {
+		GLuint a = weld[result[i]], b = weld[result[i - i % 3 + (i % 3 + 1) % 3]];
+		edges[(GLuint64)min(a, b) << 32 | max(a, b)]++;
+	}
+	vector<GLubyte> kind(vertexCount, LOD_VERTEX_FREE);
+	for (GLuint v = 0; v < vertexCount; v++) {
+		if (copies[weld[v]] > 1)
+			kind[v] = LOD_VERTEX_LOCKED;
+	}
+	vector<Quadric> quadrics(vertexCount, PlaneQuadric(vec3(0.0f), 0.0, 0.0));
+	for (GLuint t = 0; t < result.size() / 3; t++) {
+		const GLuint* corner = &result[t * 3];
+		vec3 p0 = vertices[corner[0]].Position, p1 = vertices[corner[1]].Position, p2 = vertices[corner[2]].Position;
+		vec3 n = cross(p1 - p0, p2 - p0);
+		GLfloat area = length(n);
+		if (area <= 0.0f)
+			continue;
+		n /= area;
+		Quadric face = PlaneQuadric(n, -dot(n, p0), area * 0.5);
+		for (GLuint c = 0; c < 3; c++) {
+			QuadricAdd(quadrics[corner[c]], face);
+			GLuint a = corner[c], b = corner[(c + 1) % 3];
+			GLuint uses = edges[(GLuint64)min(weld[a], weld[b]) << 32 | max(weld[a], weld[b])];
+			if (uses == 1) {
+				// Plane through the border edge, at right angles to the face
+				vec3 edge = vertices[b].Position - vertices[a].Position;
+				vec3 side = cross(edge, n);
+				GLfloat sideLength = length(side);
+				if (sideLength > 0.0f) {
+					side /= sideLength;
+					Quadric border = PlaneQuadric(side, -dot(side, vertices[a].Position), dot(edge, edge) * MESH_LOD_BORDER_WEIGHT);
+					QuadricAdd(quadrics[a], border);
+					QuadricAdd(quadrics[b], border);
+				}
+				for (GLuint e = 0; e < 2; e++) {
+					GLubyte& k = kind[e ? b : a];
+					if (k == LOD_VERTEX_FREE)
+						k = LOD_VERTEX_BORDER;
+				}
+			}
+			else if (uses > 2) {
+				kind[a] = kind[b] = LOD_VERTEX_LOCKED;
+			}
+		}
+	}
+
+	// Collapse in passes: each pass takes the cheapest collapses whose
+	// neighbourhoods do not overlap, then compacts the index list
+	vector<GLuint> first(vertexCount + 1), adjacency, cursor;
+	vector<GLuint> candidate(vertexCount), collapseTo(vertexCount);
+	vector<GLfloat> cost(vertexCount);
+	vector<GLuint> order;
+	vector<bool> touched(vertexCount);
+	GLdouble maxError = 0.0;
+	while (result.size() > targetIndexCount) {
+		GLuint triangleCount = result.size() / 3;
+
+		// Triangles around each vertex
+		fill(first.begin(), first.end(), 0);
+		for (GLuint i = 0; i < result.size(); i++)
+			first[result[i] + 1]++;
+		for (GLuint v = 0; v < vertexCount; v++)
+			first[v + 1] += first[v];
+		adjacency.resize(result.size());
+		cursor.assign(first.begin(), first.end() - 1);
+		for (GLuint t = 0; t < triangleCount; t++) {
+			for (GLuint c = 0; c < 3; c++)
+				adjacency[cursor[result[t * 3 + c]]++] = t;
+		}
+
+		// Cheapest allowed collapse of each vertex
+		order.clear();
+		for (GLuint v = 0; v < vertexCount; v++) {
+			collapseTo[v] = candidate[v] = v;
+			if (kind[v] == LOD_VERTEX_LOCKED)
+				continue;
+			GLdouble best = 1e30;
+			for (GLuint a = first[v]; a < first[v + 1]; a++) {
+				const GLuint* corner = &result[adjacency[a] * 3];
+				for (GLuint c = 0; c < 3; c++) {
+					GLuint u = corner[c];
+					if (u == v)
+						continue;
+
+					// Border vertices stay on the border: the edge must have
+					// exactly one face
+					if (kind[v] == LOD_VERTEX_BORDER) {
+						GLuint shared = 0;
+						for (GLuint b = first[v]; b < first[v + 1]; b++) {
+							const GLuint* other = &result[adjacency[b] * 3];
+							shared += weld[other[0]] == weld[u] || weld[other[1]] == weld[u] || weld[other[2]] == weld[u];
+						}
+						if (shared != 1)
+							continue;
+					}
+					Quadric merged = quadrics[v];
+					QuadricAdd(merged, quadrics[u]);
+					GLdouble e = QuadricError(merged, vertices[u].Position);
+					if (e < best) {
+						best = e;
+						candidate[v] = u;
+					}
+				}
+			}
+			if (candidate[v] != v) {
+				cost[v] = best;
+				order.push_back(v);
+			}
+		}
+		sort(order.begin(), order.end(), [&](GLuint a, GLuint b) { return cost[a] < cost[b]; });
+
+		// A collapse removes about two faces. Ones much costlier than the
+		// pass needs wait for the next pass, when cheaper ones may open up.
+		fill(touched.begin(), touched.end(), false);
+		GLuint removed = 0, needed = (result.size() - targetIndexCount + 2) / 3;
+		GLdouble passLimit = needed / 2 < order.size() ? cost[order[needed / 2]] * MESH_LOD_PASS_SLACK : 1e30;
+		for (GLuint i = 0; i < order.size() && removed < needed && cost[order[i]] <= passLimit; i++) {
+			GLuint v = order[i], u = candidate[v];
+			if (touched[v] || touched[u])
+				continue;
+
+			// Faces that keep their area must not flip or fold onto a copy
+			// of u; faces holding u itself disappear
+			bool valid = true;
+			GLuint collapsed = 0;
+			for (GLuint a = first[v]; a < first[v + 1] && valid; a++) {
+				const GLuint* corner = &result[adjacency[a] * 3];
+				if (corner[0] == u || corner[1] == u || corner[2] == u) {
+					collapsed++;
+					continue;
+				}
+				vec3 p[3], q[3];
+				for (GLuint c = 0; c < 3; c++) {
+					valid = valid && weld[corner[c]] != weld[u];
+					p[c] = vertices[corner[c]].Position;
+					q[c] = corner[c] == v ? vertices[u].Position : p[c];
+				}
+				vec3 before = cross(p[1] - p[0], p[2] - p[0]);
+				vec3 after = cross(q[1] - q[0], q[2] - q[0]);
+				valid = valid && dot(before, after) > MESH_LOD_MAX_FOLD * length(before) * length(after);
+			}
+			if (!valid)
+				continue;
+
+			collapseTo[v] = u;
+			QuadricAdd(quadrics[u], quadrics[v]);
+			maxError = std::max(maxError, (GLdouble)cost[v]);
+			removed += collapsed;
+			for (GLuint a = first[v]; a < first[v + 1]; a++) {
+				const GLuint* corner = &result[adjacency[a] * 3];
+				for (GLuint c = 0; c < 3; c++)
+					touched[corner[c]] = true;
+			}
+		}
+		if (removed == 0)
+			break;
+
+		// Apply the collapses and drop the faces that lost their area
+		GLuint n = 0;
+		for (GLuint t = 0; t < triangleCount; t++) {
+			GLuint a = collapseTo[result[t * 3]], b = collapseTo[result[t * 3 + 1]], c = collapseTo[result[t * 3 + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			result[n++] = a;
+			result[n++] = b;
+			result[n++] = c;
+		}
+		result.resize(n);
+	}
+	error = (GLfloat)sqrt(maxError);
+	return result;
+}
+
+// Append simplified levels to a mesh's index list, each with about
+// MESH_LOD_RATIO of the previous one's triangles, and describe every level
+// (level 0 is the list as given). Each level is ordered for the vertex
+// cache. Stops once a level no longer shrinks enough.
+void BuildLodChain(const vector<Vertex>& vertices, vector<GLuint>& indices, vector<MeshLod>& lods) {
+	MeshLod full = { 0, (GLuint)indices.size(), 0.0f };
+	lods.assign(1, full);
+	if (indices.empty() || indices.size() % 3)
+		return;
+	vector<GLuint> source(indices);
+	GLuint triangles = source.size() / 3;
+	for (GLuint level = 1; level < MAX_MESH_LODS; level++) {
+		GLuint target = (GLuint)(triangles * MESH_LOD_RATIO);
+		if (target < MESH_LOD_MIN_TRIANGLES)
+			break;
+		MeshLod lod;
+		vector<GLuint> simplified = SimplifyMesh(vertices, source, target * 3, lod.error);
+		if (simplified.size() / 3 > triangles * MESH_LOD_MIN_REDUCTION)
+			break;
+		simplified = TipsifyIndices(simplified, vertices.size());
+		lod.firstIndex = indices.size();
+		lod.indexCount = simplified.size();
+		lod.error = std::max(lod.error, lods.back().error);
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		lods.push_back(lod);
+		triangles = simplified.size() / 3;
+	}
+}
+
+// Screen pixels per world unit at a distance, for a projection drawn at a
+// given viewport height
+GLfloat PixelsPerUnit(const mat4& projection, GLfloat screenHeight, GLfloat distance) {
+	return 0.5f * screenHeight * projection[1][1] / std::max(distance, 1e-3f);
+}
+
+// Coarsest of a chain of levels whose error, in pixels, is within tolerance
+GLuint SelectLod(const GLfloat* errors, GLuint levels, GLfloat pixelsPerUnit, GLfloat tolerance) {
+	GLuint level = 0;
+	while (level + 1 < levels && errors[level + 1] * pixelsPerUnit <= tolerance)
+		level++;
+	return level;
+}
@@ -1,180 +1,317 @@
-// ============================================================================
-//
-// MeshObj.h
-// -----------------------------------
-//
-// MESH OBJECT HEADER FILE
-//
-// The Mesh object class is responsible for importing an .obj file along with 
-// any respective textures and material files.
-//
-// ============================================================================
-
-#pragma once
-
-// Standard Includes
-#include <string>
-#include <fstream>
-#include <sstream>
-#include <iostream>
-#include <vector>
-
-// OpenGL includes
-#include "GL\glew.h"
-#include "glm\glm.hpp"
-#include "glm\gtc\matrix_transform.hpp"
-#include "UseShader.h"
-#include "assimp\Importer.hpp"
-
-using namespace std;
-using namespace glm;
-
-// Holds vertex information for location, normals, and texture coords
-struct Vertex {
-	vec3 Position;
-	vec3 Normal;
-	vec2 TexCoords;
-};
-
-// Holds path for texture
-struct Texture {
-	GLuint id;
-	string type;
-	aiString path;
-};
-
-// Mesh class
-class Mesh {
-private:
-	// Buffer objects used when rendering	
-	void setupMesh();
-
-public:
-	// Data
-	vector<Vertex> vertices;
-	vector<GLuint> indices;
-	vector<Texture> textures;
-	GLuint VAO, VBO, EBO;
-
-	// Functions
-	Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures);
-	void Draw(Shader shader);
-	void DrawInstance(Shader shader, GLuint num);
-};
-
-// Set up the buffer objects 
-void Mesh::setupMesh() {
-	// Create buffers & arrays
-	glGenVertexArrays(1, &this->VAO);
-	glGenBuffers(1, &this->VBO);
-	glGenBuffers(1, &this->EBO);
-
-	// Load vertex information
-	glBindVertexArray(this->VAO);
-	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-	glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
-
-	// Indices
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-	// Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-
-	// Normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-
-	// Texture Coords
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-
-	glBindVertexArray(0);
-}
-
-// Constructor
-Mesh::Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures){
-	this->vertices = vertices;
-	this->indices = indices;
-	this->textures = textures;
-	this->setupMesh();
-}
-
-// Render the mesh in the window
-void Mesh::Draw(Shader shader){
-	// Keep track on the number of textures
-	GLuint diffuseNr = 1;
-	GLuint specularNr = 1;	
-	GLuint emissionNr = 1;
-
-	// Loop through and bind all the attached textures
-	for(GLint i = 0; i < this->textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		stringstream ss;
-		string number;
-		string name = this->textures[i].type;
-		if(name == "texture_diffuse")
-			ss << diffuseNr++;
-		else if(name == "texture_specular")
-			ss << specularNr++;
-		else if(name == "texture_emission")
-			ss << emissionNr++;
-		number = ss.str();
-		glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-		glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-	}
-
-	// Default shininess 
-	//glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"), 16.0f);
-
-	// Render the mesh
-	glBindVertexArray(this->VAO);
-	glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
-
-	// Reset to defaults after the configuration has been completed
-	for(GLuint i = 0; i < this->textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0  + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
-}
-
-// Instanced Version
-void Mesh::DrawInstance(Shader shader, GLuint num) {
-	// Keep track on the number of textures
-	GLuint diffuseNr = 1;
-	GLuint specularNr = 1;
-	GLuint emissionNr = 1;
-
-	// Loop through and bind all the attached textures
-	for (GLint i = 0; i < this->textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		stringstream ss;
-		string number;
-		string name = this->textures[i].type;
-		if (name == "texture_diffuse")
-			ss << diffuseNr++;
-		else if (name == "texture_specular")
-			ss << specularNr++;
-		else if (name == "texture_emission")
-			ss << emissionNr++;
-		number = ss.str();
-		glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-		glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-	}
-
-	// Default shininess 
-	//glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"), 16.0f);
-
-	// Render the mesh
-	glBindVertexArray(this->VAO);
-	glDrawElementsInstanced(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0, num);
-	glBindVertexArray(0);
-
-	// Reset to defaults after the configuration has been completed
-	for (GLuint i = 0; i < this->textures.size(); i++) {
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, 0);
-	}
-}
\ No newline at end of file
+// ============================================================================
+//
+// MeshObj.h
+// -----------------------------------
+//
+// MESH OBJECT HEADER FILE
+//
+// The Mesh object class is responsible for importing an .obj file along with 
+// any respective textures and material files.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+#include "glm\gtc\matrix_transform.hpp"
+#include "UseShader.h"
+#include "VertexFormat.h"
+#include "assimp\Importer.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Holds path for texture
+struct Texture {
+	GLuint id;
+	string type;
+	aiString path;
+};
+
+// Layout read by glDrawElementsIndirect / glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// Most levels of detail a mesh holds (level 0 is the full mesh)
+const GLuint MAX_MESH_LODS = 4;
+
+// One level of detail: a range of the mesh's index list, and how far (in
+// object space) it strays from the full mesh
+struct MeshLod {
+	GLuint firstIndex;
+	GLuint indexCount;
+	GLfloat error;
+};
+
+// Most textures a single mesh can bind
+const GLuint MAX_MATERIAL_TEXTURES = 8;
+
+// Texture bindings of a mesh, built once when the model is loaded. Sampler
+// locations are resolved when the mesh is first drawn with a program, so
+// the draw path does no string work and no allocation.
+struct Material {
+	GLuint textureCount;
+	GLuint textures[MAX_MATERIAL_TEXTURES];
+	string samplers[MAX_MATERIAL_TEXTURES];		// "texture_diffuse1", ...
+	UniformCache<MAX_MATERIAL_TEXTURES> locations;
+};
+
+// Mesh class
+class Mesh {
+private:
+	// Buffer objects used when rendering	
+	void setupMesh();
+	void bindTextures(const Shader& shader);
+	void bindFormat(const Shader& shader);
+	void unbindTextures();
+
+	// Arrays owned by a mesh read from a baked cache: they live in the mapped
+	// file, which the model keeps open
+	const Vertex* mappedVertices;
+	const GLuint* mappedIndices;
+	GLuint mappedVertexCount, mappedIndexCount;
+
+	// Layout of the vertex buffer, and the vertex shader uniforms that
+	// decode it (resolved per program, like the material's samplers)
+	VertexFormat format;
+	VertexQuantization quantization;
+	UniformCache<3> formatLocations;
+
+public:
+	// Data (vertices / indices stay empty when the mesh is mapped; use
+	// VertexData() / IndexData() to read either kind). The index list holds
+	// every level of detail, one after the other.
+	vector<Vertex> vertices;
+	vector<GLuint> indices;
+	vector<MeshLod> lods;
+	vector<Texture> textures;
+	Material material;
+	GLuint VAO, VBO, EBO;
+
+	// Functions
+	Mesh(vector<Vertex> vertices, vector<GLuint> indices, const vector<Texture>& textures, const Material& material, bool upload = true);
+	Mesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, const vector<Texture>& textures, const Material& material, bool upload = true);
+	void Upload();
+	const Vertex* VertexData() const;
+	const GLuint* IndexData() const;
+	GLuint VertexCount() const;
+	GLuint IndexCount() const;
+	GLuint LodCount() const;
+	const MeshLod& Lod(GLuint level) const;
+	void Draw(const Shader& shader, GLuint lod = 0);
+	void DrawInstance(const Shader& shader, GLuint num, GLuint lod = 0);
+	void DrawInstanceIndirect(const Shader& shader, GLintptr command);
+
+	// Layout of vertex buffers created from now on (--vertex-format)
+	static VertexFormat bufferFormat;
+};
+
+VertexFormat Mesh::bufferFormat = VERTEX_FLOAT;
+
+// Set up the buffer objects 
+void Mesh::setupMesh() {
+	// Create buffers & arrays
+	glGenVertexArrays(1, &this->VAO);
+	glGenBuffers(1, &this->VBO);
+	glGenBuffers(1, &this->EBO);
+
+	// Load vertex information, packed against the mesh bounds if asked to
+	glBindVertexArray(this->VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+	this->format = bufferFormat;
+	if (this->format == VERTEX_PACKED) {
+		vector<PackedVertex> packed;
+		this->quantization = QuantizationOf(this->VertexData(), this->VertexCount());
+		PackVertices(this->VertexData(), this->VertexCount(), this->quantization, packed);
+		glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, this->VertexCount() * sizeof(Vertex), this->VertexData(), GL_STATIC_DRAW);
+
+	// Indices
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->IndexCount() * sizeof(GLuint), this->IndexData(), GL_STATIC_DRAW);
+
+	// Positions, normals, texture coords
+	SetVertexAttributes(this->format);
+
+	glBindVertexArray(0);
+}
+
+// Constructor. Meshes built off the render thread pass upload = false and
+// call Upload() on the render thread later. The arrays are taken over, not
+// copied, when the caller passes them with move(). The mesh starts with a
+// single level of detail; set lods to describe more.
+Mesh::Mesh(vector<Vertex> vertices, vector<GLuint> indices, const vector<Texture>& textures, const Material& material, bool upload){
+	this->vertices.swap(vertices);
+	this->indices.swap(indices);
+	this->mappedVertices = nullptr;
+	this->mappedIndices = nullptr;
+	this->mappedVertexCount = this->mappedIndexCount = 0;
+	this->textures = textures;
+	this->material = material;
+	this->VAO = this->VBO = this->EBO = 0;
+	this->format = VERTEX_FLOAT;
+	MeshLod full = { 0, this->IndexCount(), 0.0f };
+	this->lods.assign(1, full);
+	if (upload)
+		this->setupMesh();
+}
+
+// Constructor for a mesh whose arrays stay in a mapped mesh cache
+Mesh::Mesh(const Vertex* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, const vector<Texture>& textures, const Material& material, bool upload) {
+	this->mappedVertices = vertices;
+	this->mappedIndices = indices;
+	this->mappedVertexCount = vertexCount;
+	this->mappedIndexCount = indexCount;
+	this->textures = textures;
+	this->material = material;
+	this->VAO = this->VBO = this->EBO = 0;
+	this->format = VERTEX_FLOAT;
+	MeshLod full = { 0, this->IndexCount(), 0.0f };
+	this->lods.assign(1, full);
+	if (upload)
+		this->setupMesh();
+}
+
+// Create the buffer objects, if that has not been done yet
+void Mesh::Upload() {
+	if (!this->VAO)
+		this->setupMesh();
+}
+
+const Vertex* Mesh::VertexData() const {
+	return this->mappedVertices ? this->mappedVertices : this->vertices.data();
+}
+
+const GLuint* Mesh::IndexData() const {
+	return this->mappedIndices ? this->mappedIndices : this->indices.data();
+}
+
+GLuint Mesh::VertexCount() const {
+	return this->mappedVertices ? this->mappedVertexCount : this->vertices.size();
+}
+
+GLuint Mesh::IndexCount() const {
+	return this->mappedIndices ? this->mappedIndexCount : this->indices.size();
+}
+
+GLuint Mesh::LodCount() const {
+	return this->lods.size();
+}
+
+// A level of detail; levels past the last give the last
+const MeshLod& Mesh::Lod(GLuint level) const {
+	return this->lods[std::min(level, (GLuint)this->lods.size() - 1)];
+}
+
+// Bind all the attached textures, resolving sampler locations the first
+// time the mesh is drawn with a program
+void Mesh::bindTextures(const Shader& shader) {
+	Material& material = this->material;
+	GLint* locations = material.locations.Find(shader.Program);
+	if (!locations) {
+		locations = material.locations.Add(shader.Program);
+		for (GLuint i = 0; i < material.textureCount; i++)
+			locations[i] = shader.Uniform(material.samplers[i]);
+	}
+
+	for (GLuint i = 0; i < material.textureCount; i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		shader.SetInt(locations[i], i);
+		glBindTexture(GL_TEXTURE_2D, material.textures[i]);
+	}
+}
+
+// Tell the vertex shader how to read this mesh's vertex buffer
+void Mesh::bindFormat(const Shader& shader) {
+	GLint* locations = this->formatLocations.Find(shader.Program);
+	if (!locations) {
+		locations = this->formatLocations.Add(shader.Program);
+		locations[0] = shader.Uniform("vertexFormat");
+		locations[1] = shader.Uniform("positionOffset");
+		locations[2] = shader.Uniform("positionScale");
+	}
+	shader.SetInt(locations[0], this->format);
+	if (this->format == VERTEX_PACKED) {
+		shader.SetVec3(locations[1], this->quantization.offset);
+		shader.SetVec3(locations[2], this->quantization.scale);
+	}
+}
+
+// Reset to defaults after the configuration has been completed
+void Mesh::unbindTextures() {
+	for (GLuint i = 0; i < this->material.textureCount; i++) {
+		glActiveTexture(GL_TEXTURE0 + i);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+}
+
+// Render the mesh in the window
+void Mesh::Draw(const Shader& shader, GLuint lod){
+	// Bind all the attached textures
+	this->bindTextures(shader);
+	this->bindFormat(shader);
+
+	// Default shininess 
+	//glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"), 16.0f);
+
+	// Render the mesh
+	const MeshLod& level = this->Lod(lod);
+	glBindVertexArray(this->VAO);
+	glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (GLvoid*)(level.firstIndex * sizeof(GLuint)));
+	glBindVertexArray(0);
+
+	// Reset to defaults after the configuration has been completed
+	this->unbindTextures();
+}
+
+// Instanced Version
+void Mesh::DrawInstance(const Shader& shader, GLuint num, GLuint lod) {
+	// Bind all the attached textures
+	this->bindTextures(shader);
+	this->bindFormat(shader);
+
+	// Default shininess 
+	//glUniform1f(glGetUniformLocation(shader.Program, "material.shininess"), 16.0f);
+
+	// Render the mesh
+	const MeshLod& level = this->Lod(lod);
+	glBindVertexArray(this->VAO);
+	glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (GLvoid*)(level.firstIndex * sizeof(GLuint)), num);
+	glBindVertexArray(0);
+
+	// Reset to defaults after the configuration has been completed
+	this->unbindTextures();
+}
+
+// Instanced version whose instance count is read by the GPU from the
+// DrawElementsIndirectCommand at the given offset in the bound
+// GL_DRAW_INDIRECT_BUFFER
+void Mesh::DrawInstanceIndirect(const Shader& shader, GLintptr command) {
+	// Bind all the attached textures
+	this->bindTextures(shader);
+	this->bindFormat(shader);
+
+	// Render the mesh
+	glBindVertexArray(this->VAO);
+	glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (GLvoid*)command);
+	glBindVertexArray(0);
+
+	// Reset to defaults after the configuration has been completed
+	this->unbindTextures();
+}
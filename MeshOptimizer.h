@@ -0,0 +1,321 @@
+// ============================================================================
+//
+// MeshOptimizer.h
+// -----------------------------------
+//
+// MESH OPTIMIZER HEADER FILE
+//
+// Import-time reordering of a mesh for the GPU, run before it is baked:
+// - identical vertices are merged (Assimp emits one vertex per face corner)
+// - triangles are reordered for the post-transform vertex cache (Tipsify,
+//   Sander et al. 2007)
+// - the resulting clusters are sorted so outward-facing ones come first,
+//   which cuts overdraw from any viewpoint without giving up cache hits
+// - vertices are renumbered in first-use order for vertex fetch locality
+// Cache efficiency is measured on a FIFO cache as ACMR (vertices
+// transformed per triangle, 0.5 at best) and ATVR (vertices transformed
+// per distinct vertex, 1.0 at best).
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+// Other includes
+#include "MeshObj.h"
+
+using namespace std;
+using namespace glm;
+
+// Post-transform cache modelled when ordering and measuring
+const GLuint MESH_OPT_CACHE_SIZE = 16;
+
+// A cluster may end once its own ACMR is within this factor of the whole
+// mesh's; lower keeps more cache hits, higher gives more clusters to sort
+const GLfloat MESH_OPT_OVERDRAW_THRESHOLD = 1.05f;
+
+// Vertex cache efficiency of an index list
+struct VertexCacheStats {
+	GLuint transformed;		// cache misses
+	GLfloat acmr;
+	GLfloat atvr;
+};
+
+// Before / after figures for one mesh
+struct MeshOptStats {
+	GLuint verticesBefore, verticesAfter;
+	GLuint triangles;
+	VertexCacheStats before, after;
+};
+
+// Simulate a FIFO post-transform cache over the index list
+VertexCacheStats AnalyzeVertexCache(const vector<GLuint>& indices, GLuint vertexCount) {
+	vector<GLuint> stamp(vertexCount, 0);		// time the vertex entered the cache
+	vector<bool> used(vertexCount, false);
+	GLuint time = MESH_OPT_CACHE_SIZE + 1;
+	GLuint distinct = 0;
+	VertexCacheStats stats = { 0, 0.0f, 0.0f };
+	for (GLuint i = 0; i < indices.size(); i++) {
+		GLuint v = indices[i];
+		if (!used[v]) {
+			used[v] = true;
+			distinct++;
+		}
+		if (time - stamp[v] > MESH_OPT_CACHE_SIZE) {
+			stamp[v] = time++;
+			stats.transformed++;
+		}
+	}
+	GLuint triangles = indices.size() / 3;
+	stats.acmr = triangles ? (GLfloat)stats.transformed / triangles : 0.0f;
+	stats.atvr = distinct ? (GLfloat)stats.transformed / distinct : 0.0f;
+	return stats;
+}
+
+// Hash of a vertex's bytes, for merging exact duplicates
+struct VertexHash {
+	size_t operator()(const Vertex& vertex) const {
+		const GLuint* words = (const GLuint*)&vertex;
+		size_t hash = 2166136261u;
+		for (GLuint i = 0; i < sizeof(Vertex) / sizeof(GLuint); i++)
+			hash = (hash ^ words[i]) * 16777619u;
+		return hash;
+	}
+};
+
+struct VertexEqual {
+	bool operator()(const Vertex& a, const Vertex& b) const {
+		return memcmp(&a, &b, sizeof(Vertex)) == 0;
+	}
+};
+
+// Merge vertices that are identical bit for bit
+void DeduplicateVertices(vector<Vertex>& vertices, vector<GLuint>& indices) {
+	unordered_map<Vertex, GLuint, VertexHash, VertexEqual> unique;
+	unique.reserve(vertices.size());
+	vector<GLuint> remap(vertices.size());
+	vector<Vertex> merged;
+	merged.reserve(vertices.size());
+	for (GLuint i = 0; i < vertices.size(); i++) {
+		pair<unordered_map<Vertex, GLuint, VertexHash, VertexEqual>::iterator, bool> found =
+			unique.insert(make_pair(vertices[i], (GLuint)merged.size()));
+		if (found.second)
+			merged.push_back(vertices[i]);
+		remap[i] = found.first->second;
+	}
+	for (GLuint i = 0; i < indices.size(); i++)
+		indices[i] = remap[indices[i]];
+	vertices.swap(merged);
+}
+
+// Tipsify: fan around one vertex at a time, moving next to the vertex that
+// will still be in the cache and has the fewest triangles left, or to a
+// recent dead end when none will. Returns the new index list.
+vector<GLuint> TipsifyIndices(const vector<GLuint>& indices, GLuint vertexCount) {
+	GLuint triangleCount = indices.size() / 3;
+
+	// Triangles around each vertex
+	vector<GLuint> live(vertexCount, 0);
+	for (GLuint i = 0; i < indices.size(); i++)
+		live[indices[i]]++;
+	vector<GLuint> first(vertexCount + 1, 0);
+	for (GLuint v = 0; v < vertexCount; v++)
+		first[v + 1] = first[v] + live[v];
+	vector<GLuint> adjacency(indices.size());
+	vector<GLuint> fill(first.begin(), first.end() - 1);
+	for (GLuint t = 0; t < triangleCount; t++) {
+		for (GLuint c = 0; c < 3; c++)
+			adjacency[fill[indices[t * 3 + c]]++] = t;
+	}
+
+	vector<GLuint> stamp(vertexCount, 0);
+	vector<bool> emitted(triangleCount, false);
+	vector<GLuint> deadEnds;
+	vector<GLuint> candidates;
+	vector<GLuint> result;
+	result.reserve(indices.size());
+	GLuint time = MESH_OPT_CACHE_SIZE + 1;
+	GLuint cursor = 0;
+	GLint fan = vertexCount ? 0 : -1;
+
+	while (fan >= 0) {
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (GLuint a = first[fan]; a < first[fan + 1]; a++) {
+			GLuint t = adjacency[a];
+			if (emitted[t])
+				continue;
+			for (GLuint c = 0; c < 3; c++) {
+				GLuint v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - stamp[v] > MESH_OPT_CACHE_SIZE)
+					stamp[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Best candidate still in the cache after its own triangles
+		GLint next = -1;
+		GLint best = -1;
+		for (GLuint i = 0; i < candidates.size(); i++) {
+			GLuint v = candidates[i];
+			if (!live[v])
+				continue;
+			GLint priority = 0;
+			if (time - stamp[v] + 2 * live[v] <= MESH_OPT_CACHE_SIZE)
+				priority = time - stamp[v];
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		// Otherwise a recent vertex with triangles left, then any vertex
+		while (next < 0 && !deadEnds.empty()) {
+			GLuint v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v])
+				next = v;
+		}
+		while (next < 0 && cursor < vertexCount) {
+			if (live[cursor])
+				next = cursor;
+			cursor++;
+		}
+		fan = next;
+	}
+	return result;
+}
+
+// Split a cache-ordered index list into clusters and sort them so that
+// triangles on the outside of the mesh, facing away from its center, are
+// drawn first. A cluster ends where its own ACMR (cache cold at its start)
+// is within MESH_OPT_OVERDRAW_THRESHOLD of the whole list's.
+void OptimizeOverdraw(const vector<Vertex>& vertices, vector<GLuint>& indices) {
+	GLuint triangleCount = indices.size() / 3;
+	if (triangleCount < 2)
+		return;
+	GLfloat target = AnalyzeVertexCache(indices, vertices.size()).acmr * MESH_OPT_OVERDRAW_THRESHOLD;
+
+	// Cluster boundaries
+	vector<GLuint> clusterStart;
+	vector<GLuint> stamp(vertices.size(), 0);
+	GLuint time = MESH_OPT_CACHE_SIZE + 1;
+	GLuint misses = 0, start = 0;
+	for (GLuint t = 0; t < triangleCount; t++) {
+		if (t == start) {
+			clusterStart.push_back(t);
+			time += MESH_OPT_CACHE_SIZE + 1;		// flush the cache
+			misses = 0;
+		}
+		for (GLuint c = 0; c < 3; c++) {
+			GLuint v = indices[t * 3 + c];
+			if (time - stamp[v] > MESH_OPT_CACHE_SIZE) {
+				stamp[v] = time++;
+				misses++;
+			}
+		}
+		if ((GLfloat)misses / (t - start + 1) <= target)
+			start = t + 1;
+	}
+	clusterStart.push_back(triangleCount);
+	GLuint clusterCount = clusterStart.size() - 1;
+	if (clusterCount < 2)
+		return;
+
+	// Area-weighted centroid and normal of each cluster, and of the mesh
+	vector<vec3> centroid(clusterCount, vec3(0.0f));
+	vector<vec3> normal(clusterCount, vec3(0.0f));
+	vector<GLfloat> area(clusterCount, 0.0f);
+	vec3 meshCentroid(0.0f);
+	GLfloat meshArea = 0.0f;
+	for (GLuint k = 0; k < clusterCount; k++) {
+		for (GLuint t = clusterStart[k]; t < clusterStart[k + 1]; t++) {
+			vec3 p0 = vertices[indices[t * 3]].Position;
+			vec3 p1 = vertices[indices[t * 3 + 1]].Position;
+			vec3 p2 = vertices[indices[t * 3 + 2]].Position;
+			vec3 n = cross(p1 - p0, p2 - p0);
+			GLfloat a = length(n) * 0.5f;
+			centroid[k] += (p0 + p1 + p2) * (a / 3.0f);
+			normal[k] += n;
+			area[k] += a;
+		}
+		meshCentroid += centroid[k];
+		meshArea += area[k];
+		if (area[k] > 0.0f)
+			centroid[k] /= area[k];
+		GLfloat n = length(normal[k]);
+		if (n > 0.0f)
+			normal[k] /= n;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	vector<GLfloat> sortKey(clusterCount);
+	vector<GLuint> order(clusterCount);
+	for (GLuint k = 0; k < clusterCount; k++) {
+		sortKey[k] = dot(centroid[k] - meshCentroid, normal[k]);
+		order[k] = k;
+	}
+	stable_sort(order.begin(), order.end(), [&](GLuint a, GLuint b) { return sortKey[a] > sortKey[b]; });
+
+	vector<GLuint> sorted;
+	sorted.reserve(indices.size());
+	for (GLuint k = 0; k < clusterCount; k++) {
+		GLuint cluster = order[k];
+		sorted.insert(sorted.end(), indices.begin() + clusterStart[cluster] * 3, indices.begin() + clusterStart[cluster + 1] * 3);
+	}
+	indices.swap(sorted);
+}
+
+// Renumber vertices in the order the index list first uses them, dropping
+// any it never uses
+void OptimizeVertexFetch(vector<Vertex>& vertices, vector<GLuint>& indices) {
+	const GLuint unused = ~0u;
+	vector<GLuint> remap(vertices.size(), unused);
+	vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (GLuint i = 0; i < indices.size(); i++) {
+		GLuint& slot = remap[indices[i]];
+		if (slot == unused) {
+			slot = ordered.size();
+			ordered.push_back(vertices[indices[i]]);
+		}
+		indices[i] = slot;
+	}
+	vertices.swap(ordered);
+}
+
+// Run every stage on a triangle list. Lists that are not whole triangles
+// are left alone.
+MeshOptStats OptimizeMesh(vector<Vertex>& vertices, vector<GLuint>& indices) {
+	MeshOptStats stats;
+	stats.verticesBefore = vertices.size();
+	stats.triangles = indices.size() / 3;
+	stats.before = AnalyzeVertexCache(indices, vertices.size());
+	if (indices.size() % 3 == 0 && !indices.empty()) {
+		DeduplicateVertices(vertices, indices);
+
+		// Both ATVRs count against the distinct vertices: the imported mesh
+		// transforms every duplicate again
+		stats.before.atvr = (GLfloat)stats.before.transformed / vertices.size();
+		indices = TipsifyIndices(indices, vertices.size());
+		OptimizeOverdraw(vertices, indices);
+		OptimizeVertexFetch(vertices, indices);
+	}
+	stats.verticesAfter = vertices.size();
+	stats.after = AnalyzeVertexCache(indices, vertices.size());
+	return stats;
+}
@@ -0,0 +1,1079 @@
+// ============================================================================
+//
+// Microbench.h
+// -----------------------------------
+//
+// MICROBENCHMARK HEADER FILE
+//
+// CPU-only benchmarks of the renderer's frame systems. These run before any
+// window or GL context is created, so they work on machines without a GPU,
+// and each one checks its own results while it measures them.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+#include "glm\gtc\matrix_transform.hpp"
+
+// Custom headers
+#include "UniformBuffer.h"
+#include "LightCluster.h"
+#include "JobSystem.h"
+#include "TaskGraph.h"
+#include "InstanceCuller.h"
+#include "InstancePool.h"
+#include "InstanceFormat.h"
+#include "InstanceSim.h"
+#include "ModelObj.h"
+
+using namespace std;
+using namespace glm;
+
+// Microbenchmark settings
+const GLuint MICROBENCH_ITERATIONS = 200;
+const GLuint MICROBENCH_WIDTH = 1280;
+const GLuint MICROBENCH_HEIGHT = 720;
+
+// Median of a set of samples (sorts them)
+GLdouble MedianMs(vector<GLdouble>& samples) {
+	sort(samples.begin(), samples.end());
+	return samples.empty() ? 0.0 : samples[samples.size() / 2];
+}
+
+// Fill a light list the way the demo scene does: two large fire lights, then
+// small ember lights scattered around the figure
+void ScatterLights(vector<PointLightData>& lights, GLuint count) {
+	lights.resize(count);
+	srand(0);
+	for (GLuint i = 0; i < count; i++) {
+		PointLightData& light = lights[i];
+		bool fire = i < 2;
+		light.lightColor = fire ? vec3(0.45f, 0.3f, 0.3f) : vec3(0.9f, 0.45f, 0.05f);
+		light.lightPos = vec3(6.0f - 12.0f * (rand() % 1000) / 1000.0f, 6.0f * (rand() % 1000) / 1000.0f,
+			6.0f - 12.0f * (rand() % 1000) / 1000.0f);
+		light.constant = 1.0f;
+		light.linear = fire ? 0.15f : 1.7f;
+		light.quadratic = fire ? 0.08f : 10.8f;
+		light.radius = LightClusters::LightRadius(light);
+	}
+}
+
+// Check that every point inside a light's radius lands in a cluster that
+// lists the light. Points are mapped to clusters with the fragment shader's
+// math, so this also checks FillBlock. Returns the number of misses.
+GLuint CheckLightClusters(LightClusters& clusters, const vector<PointLightData>& lights, const mat4& view,
+	const mat4& projection, const LightBlock& block) {
+	GLuint misses = 0;
+	for (GLuint i = 0; i < lights.size(); i++) {
+		for (GLuint s = 0; s < 64; s++) {
+			// Deterministic points spread through the sphere
+			GLfloat u = (s * 0.618034f) - floor(s * 0.618034f);
+			GLfloat v = (s * 0.754878f) - floor(s * 0.754878f);
+			GLfloat r = lights[i].radius * 0.999f * sqrt((s % 8 + 0.5f) / 8.0f);
+			GLfloat theta = 2.0f * 3.14159265f * u, cosPhi = 1.0f - 2.0f * v;
+			GLfloat sinPhi = sqrt(1.0f - cosPhi * cosPhi);
+			vec3 point = lights[i].lightPos + r * vec3(sinPhi * cos(theta), cosPhi, sinPhi * sin(theta));
+
+			vec4 viewPos = view * vec4(point, 1.0f);
+			GLfloat depth = -viewPos.z;
+			vec4 clip = projection * viewPos;
+			if (depth <= block.clusterDepth.x || depth >= block.clusterDepth.y ||
+				abs(clip.x) >= clip.w || abs(clip.y) >= clip.w)
+				continue;
+
+			// Same lookup as ClusterIndex() in main_fshader.glsl
+			GLfloat pixelX = (clip.x / clip.w * 0.5f + 0.5f) * MICROBENCH_WIDTH;
+			GLfloat pixelY = (clip.y / clip.w * 0.5f + 0.5f) * MICROBENCH_HEIGHT;
+			GLint slice = clamp((GLint)(log(depth) * block.clusterDepth.z + block.clusterDepth.w), 0, (GLint)CLUSTER_Z - 1);
+			GLint tileX = min((GLint)(pixelX / block.clusterTile.x), (GLint)CLUSTER_X - 1);
+			GLint tileY = min((GLint)(pixelY / block.clusterTile.y), (GLint)CLUSTER_Y - 1);
+			GLuint c = tileX + tileY * CLUSTER_X + slice * CLUSTER_X * CLUSTER_Y;
+
+			GLuint offset = clusters.grid[c * 2], count = clusters.grid[c * 2 + 1];
+			bool found = false;
+			for (GLuint j = 0; j < count && !found; j++)
+				found = clusters.indices[offset + j] == i;
+			if (!found && count < MAX_LIGHTS_PER_CLUSTER)
+				misses++;
+		}
+	}
+	return misses;
+}
+
+// Light binning cost from 2 to MAX_POINT_LIGHTS lights, on one thread and
+// on the job system. Writes a JSON report; returns false if binning missed
+// any light.
+bool BenchLightClusters(const char* path) {
+	JobSystem pool;
+	pool.Init();
+	LightClusters serial, parallel;
+	serial.Init(nullptr);
+	parallel.Init(&pool);
+
+	GLfloat fovY = radians(45.0f), aspect = (GLfloat)MICROBENCH_WIDTH / MICROBENCH_HEIGHT;
+	mat4 projection = perspective(fovY, aspect, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0.0f, 2.5f, 9.5f), vec3(0.0f, 3.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+	serial.SetProjection(fovY, aspect, 0.1f, 100.0f);
+	parallel.SetProjection(fovY, aspect, 0.1f, 100.0f);
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"light_clusters\",\n  \"clusters\": [" << CLUSTER_X << ", " << CLUSTER_Y << ", " << CLUSTER_Z
+		<< "],\n  \"threads\": " << pool.ThreadCount() << ",\n  \"iterations\": " << MICROBENCH_ITERATIONS
+		<< ",\n  \"runs\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	vector<PointLightData> lights;
+	vector<GLdouble> serialMs(MICROBENCH_ITERATIONS), parallelMs(MICROBENCH_ITERATIONS);
+	bool passed = true;
+	for (GLuint count = 2; count <= MAX_POINT_LIGHTS; count *= 2) {
+		ScatterLights(lights, count);
+		for (GLuint i = 0; i < MICROBENCH_ITERATIONS; i++) {
+			Clock::time_point start = Clock::now();
+			serial.Bin(&lights[0], count, view);
+			Clock::time_point middle = Clock::now();
+			parallel.Bin(&lights[0], count, view);
+			Clock::time_point end = Clock::now();
+			serialMs[i] = chrono::duration<double, milli>(middle - start).count();
+			parallelMs[i] = chrono::duration<double, milli>(end - middle).count();
+		}
+
+		// Both must produce the same lists, and no light may be missed
+		LightBlock block;
+		parallel.FillBlock(block, MICROBENCH_WIDTH, MICROBENCH_HEIGHT);
+		bool same = serial.indexCount == parallel.indexCount && serial.grid == parallel.grid &&
+			equal(serial.indices.begin(), serial.indices.begin() + serial.indexCount, parallel.indices.begin());
+		GLuint misses = CheckLightClusters(parallel, lights, view, projection, block);
+		passed = passed && same && misses == 0;
+
+		out << (count == 2 ? "\n" : ",\n") << "    {\"lights\": " << count
+			<< ", \"serial_ms\": " << MedianMs(serialMs) << ", \"parallel_ms\": " << MedianMs(parallelMs)
+			<< ", \"indices\": " << parallel.indexCount << ", \"match\": " << (same ? "true" : "false")
+			<< ", \"misses\": " << misses << "}";
+		cout << "lights " << count << ": serial " << MedianMs(serialMs) << " ms, parallel " << MedianMs(parallelMs)
+			<< " ms" << (same && misses == 0 ? "" : "  ERROR::MICROBENCH::LIGHT_CLUSTERS_MISMATCH") << endl;
+	}
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Light cluster benchmark written to " << path << endl;
+	return passed;
+}
+
+// Frustum culling throughput of each kernel the build supports at 10k, 100k
+// and 1M instances, scattered like the butterflies. Writes a JSON report;
+// returns false if a SIMD kernel disagrees with the scalar one.
+bool BenchInstanceCulling(const char* path) {
+	static const GLuint sizes[3] = { 10000, 100000, 1000000 };
+	CullKernel best = InstanceCuller::BestKernel();
+
+	mat4 projection = perspective(radians(45.0f), (GLfloat)MICROBENCH_WIDTH / MICROBENCH_HEIGHT, 0.1f, 100.0f);
+	mat4 view = lookAt(vec3(0.0f, 2.5f, 9.5f), vec3(0.0f, 3.0f, 0.0f), vec3(0.0f, 1.0f, 0.0f));
+	mat4 viewProjection = projection * view;
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"instance_culling\",\n  \"runs\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	InstanceCuller culler;
+	vector<GLuint> reference;
+	bool passed = true, first = true;
+	srand(0);
+	for (GLuint s = 0; s < 3; s++) {
+		GLuint count = sizes[s];
+		culler.Resize(count);
+		for (GLuint i = 0; i < count; i++) {
+			vec3 center(25.0f - 50.0f * (rand() % 1000) / 1000.0f, 16.0f * (rand() % 1000) / 1000.0f,
+				25.0f - 50.0f * (rand() % 1000) / 1000.0f);
+			culler.SetSphere(i, center, 0.05f + 0.05f * (rand() % 100) / 100.0f);
+		}
+
+		// Roughly 20M sphere tests per kernel
+		GLuint iterations = max(20000000u / count, 5u);
+		vector<GLdouble> samples(iterations);
+		for (GLuint k = CULL_SCALAR; k <= (GLuint)best; k++) {
+			CullKernel kernel = (CullKernel)k;
+			for (GLuint i = 0; i < iterations; i++) {
+				Clock::time_point start = Clock::now();
+				culler.Cull(viewProjection, kernel);
+				samples[i] = chrono::duration<double, milli>(Clock::now() - start).count();
+			}
+			GLdouble ms = MedianMs(samples);
+
+			// Every kernel must keep exactly the scalar kernel's instances
+			bool same = true;
+			if (kernel == CULL_SCALAR)
+				reference.assign(culler.visible.begin(), culler.visible.begin() + culler.visibleCount);
+			else
+				same = culler.visibleCount == reference.size() && equal(reference.begin(), reference.end(), culler.visible.begin());
+			passed = passed && same;
+
+			out << (first ? "\n" : ",\n") << "    {\"instances\": " << count << ", \"kernel\": \""
+				<< InstanceCuller::KernelName(kernel) << "\", \"ms\": " << ms << ", \"instances_per_ns\": "
+				<< count / (ms * 1.0e6) << ", \"visible\": " << culler.visibleCount << ", \"match\": "
+				<< (same ? "true" : "false") << "}";
+			cout << count << " instances, " << InstanceCuller::KernelName(kernel) << ": " << ms << " ms, "
+				<< count / (ms * 1.0e6) << " instances/ns" << (same ? "" : "  ERROR::MICROBENCH::CULLING_MISMATCH") << endl;
+			first = false;
+		}
+	}
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Culling benchmark written to " << path << endl;
+	return passed;
+}
+
+// Random translate * uniform scale * rotate transforms, spread like the
+// butterfly field
+mat4 ScatterInstance(InstanceRng& rng, GLuint index) {
+	mat4 model = translate(mat4(), vec3(1000.0f - 2000.0f * rng.Uniform(), 640.0f * rng.Uniform(), 1000.0f - 2000.0f * rng.Uniform()));
+	model = scale(model, vec3(0.5f + 0.5f * rng.Uniform()));
+	model = rotate(model, 5.0f - (GLfloat)(rng.Next() % 10), vec3(1.0f, 0.0f, 0.0f));
+	model = rotate(model, 6.2831853f * rng.Uniform(), vec3(0.0f, 1.0f, 0.0f));
+	model = rotate(model, 5.0f - (GLfloat)(rng.Next() % 10), vec3(0.0f, 0.0f, 1.0f));
+	return model;
+}
+
+// Size and CPU cost of each instance format at 1M instances: bytes streamed
+// per frame, one-time encode time, and the per-frame copy of the visible
+// instances (all of them here). Decoded transforms are checked against the
+// originals; returns false if one drifts too far. Vertex throughput needs
+// the GPU: compare the fx pass of --headless runs with --instances 1000000.
+bool BenchInstanceFormats(const char* path) {
+	const GLuint count = 1000000;
+	const GLuint iterations = 20;
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"instance_formats\",\n  \"instances\": " << count << ",\n  \"runs\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	InstancePool pool;
+	if (!pool.Resize(count))
+		return false;
+	pool.Generate(0, ScatterInstance);
+	InstanceQuantization box = InstanceQuantizationOf(pool.Matrices(), count, 0.0f);
+	vector<GLuint> indices(count);
+	for (GLuint i = 0; i < count; i++)
+		indices[i] = i;
+
+	bool passed = true;
+	for (GLuint f = INSTANCE_MAT4; f <= INSTANCE_TRS_PACKED; f++) {
+		InstanceFormat format = (InstanceFormat)f;
+		GLuint stride = InstanceStride(format);
+		vector<GLubyte> encoded(count * stride), streamed(count * stride);
+
+		Clock::time_point start = Clock::now();
+		for (GLuint i = 0; i < count; i++)
+			EncodeInstance(format, pool[i], box, &encoded[i * stride]);
+		GLdouble encodeMs = chrono::duration<double, milli>(Clock::now() - start).count();
+
+		vector<GLdouble> samples(iterations);
+		for (GLuint i = 0; i < iterations; i++) {
+			start = Clock::now();
+			GatherInstances(format, &encoded[0], &indices[0], count, &streamed[0]);
+			samples[i] = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+		GLdouble streamMs = MedianMs(samples);
+
+		// Largest error of the rotation / scale columns (relative to the
+		// scale) and of the position (in instance units: a relative error
+		// would hide how far far-off instances move)
+		GLfloat basisError = 0.0f, positionError = 0.0f;
+		for (GLuint i = 0; i < count; i++) {
+			mat4 decoded = DecodeInstance(format, &streamed[i * stride], box);
+			GLfloat scale = length(vec3(pool[i][0]));
+			for (GLuint c = 0; c < 3; c++)
+				basisError = max(basisError, length(vec3(decoded[c]) - vec3(pool[i][c])) / scale);
+			positionError = max(positionError, length(vec3(decoded[3]) - vec3(pool[i][3])));
+		}
+		bool packed = format == INSTANCE_TRS_PACKED;
+		bool accurate = basisError < (packed ? 1.0e-3f : 1.0e-4f) && positionError < (packed ? 0.05f : 1.0e-3f);
+		passed = passed && accurate;
+
+		out << (f == INSTANCE_MAT4 ? "\n" : ",\n") << "    {\"format\": \"" << InstanceFormatName(format)
+			<< "\", \"bytes_per_instance\": " << stride << ", \"upload_mb\": " << count * stride / 1048576.0
+			<< ", \"encode_ms\": " << encodeMs << ", \"stream_ms\": " << streamMs
+			<< ", \"basis_error\": " << basisError << ", \"position_error\": " << positionError << ", \"accurate\": " << (accurate ? "true" : "false") << "}";
+		cout << InstanceFormatName(format) << ": " << stride << " bytes, " << count * stride / 1048576.0 << " MB/frame, encode "
+			<< encodeMs << " ms, stream " << streamMs << " ms, error " << basisError << " / " << positionError
+			<< (accurate ? "" : "  ERROR::MICROBENCH::INSTANCE_FORMAT_INACCURATE") << endl;
+	}
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Instance format benchmark written to " << path << endl;
+	return passed;
+}
+
+// Butterfly simulation plus encoding (packed format) of 100k instances on 1
+// to N threads, N being the hardware threads (at least 2). Every thread
+// count must produce exactly the single-threaded output.
+bool BenchInstanceSimulation(const char* path) {
+	const GLuint count = 100000;
+	const GLuint frames = 60;
+	const GLfloat step = 1.0f / 60.0f;
+	GLuint maxThreads = max(thread::hardware_concurrency(), 2u);
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"instance_simulation\",\n  \"instances\": " << count << ",\n  \"runs\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	InstancePool instances;
+	if (!instances.Resize(count))
+		return false;
+	instances.Generate(0, ScatterInstance);
+	mat4 model = scale(mat4(), vec3(0.025f));
+	vec4 bounds(0.0f, 0.0f, 0.0f, 10.0f);
+	InstanceQuantization box = InstanceQuantizationOf(instances.Matrices(), count, SIM_REACH);
+	GLuint stride = InstanceStride(INSTANCE_TRS_PACKED);
+	vector<GLubyte> output(count * stride), reference;
+
+	bool passed = true;
+	GLdouble singleMs = 0.0;
+	for (GLuint threads = 1; threads <= maxThreads; threads++) {
+		JobSystem pool;
+		if (threads > 1)
+			pool.Init(threads - 1);
+		InstanceSimulation sim;
+		InstanceCuller culler;
+		culler.Resize(count);
+		sim.Init(&pool, instances, model, bounds);
+
+		vector<GLdouble> samples(frames);
+		for (GLuint f = 0; f < frames; f++) {
+			Clock::time_point start = Clock::now();
+			sim.Update(step, f * step, &culler);
+			sim.WriteAll(INSTANCE_TRS_PACKED, box, &output[0]);
+			samples[f] = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+		GLdouble ms = MedianMs(samples);
+		if (threads == 1) {
+			singleMs = ms;
+			reference = output;
+		}
+		bool same = output == reference;
+		passed = passed && same;
+
+		out << (threads == 1 ? "\n" : ",\n") << "    {\"threads\": " << threads << ", \"ms\": " << ms
+			<< ", \"speedup\": " << singleMs / ms << ", \"efficiency\": " << singleMs / ms / threads
+			<< ", \"match\": " << (same ? "true" : "false") << "}";
+		cout << threads << " threads: " << ms << " ms, " << singleMs / ms << "x"
+			<< (same ? "" : "  ERROR::MICROBENCH::SIMULATION_MISMATCH") << endl;
+	}
+	out << "\n  ],\n  \"hardware_threads\": " << thread::hardware_concurrency()
+		<< ",\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Simulation benchmark written to " << path << endl;
+	return passed;
+}
+
+// Per-element work for the job system benchmark: a short dependent chain of
+// float math, the same on every thread count
+GLfloat JobWork(GLuint index, GLuint steps) {
+	GLfloat x = (index & 1023) * (1.0f / 1024.0f);
+	for (GLuint s = 0; s < steps; s++)
+		x = x * 0.999f + 0.5f / (1.0f + x * x);
+	return x;
+}
+
+// Job system scaling and contention on 1 to N threads (N = hardware
+// threads, at least 2):
+// - scaling: a 1M element ParallelFor of real work, grain 4096
+// - contention: 256k one-element jobs, so nearly every job is split off,
+//   queued and stolen; reports the cost per job and the steal races (one
+//   thread runs the whole range inline, so it shows the floor)
+// - graph: two independent ParallelFor tasks feeding a third, and a fourth
+//   after it, the shape of a frame
+// Every run is checked against the single-threaded result.
+bool BenchJobSystem(const char* path) {
+	const GLuint count = 1 << 20;
+	const GLuint steps = 16;
+	const GLuint tinyCount = 1 << 18;
+	const GLuint iterations = 20;
+	GLuint maxThreads = max(thread::hardware_concurrency(), 2u);
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"job_system\",\n  \"hardware_threads\": " << thread::hardware_concurrency()
+		<< ",\n  \"runs\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	vector<GLfloat> output(count), reference(count);
+	vector<GLuint> tiny(tinyCount);
+	for (GLuint i = 0; i < count; i++)
+		reference[i] = JobWork(i, steps);
+
+	bool passed = true;
+	GLdouble singleMs = 0.0, singleGraphMs = 0.0;
+	for (GLuint threads = 1; threads <= maxThreads; threads++) {
+		JobSystem jobs;
+		jobs.Init(threads - 1);
+		vector<GLdouble> samples(iterations);
+
+		// Scaling
+		auto work = [&](GLuint begin, GLuint end) {
+			for (GLuint i = begin; i < end; i++)
+				output[i] = JobWork(i, steps);
+		};
+		for (GLuint it = 0; it < iterations; it++) {
+			fill(output.begin(), output.end(), 0.0f);
+			Clock::time_point start = Clock::now();
+			jobs.ParallelFor(count, 4096, work);
+			samples[it] = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+		GLdouble ms = MedianMs(samples);
+		if (threads == 1)
+			singleMs = ms;
+		bool scaled = output == reference;
+
+		// Contention
+		auto mark = [&](GLuint begin, GLuint end) {
+			for (GLuint i = begin; i < end; i++)
+				tiny[i]++;
+		};
+		fill(tiny.begin(), tiny.end(), 0);
+		jobs.ResetStats();
+		for (GLuint it = 0; it < iterations; it++) {
+			Clock::time_point start = Clock::now();
+			jobs.ParallelFor(tinyCount, 1, mark);
+			samples[it] = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+		JobStats stats = jobs.Stats();
+		GLdouble nsPerJob = MedianMs(samples) * 1.0e6 / tinyCount;
+		bool contended = count_if(tiny.begin(), tiny.end(), [&](GLuint n) { return n != iterations; }) == 0;
+
+		// Graph: a and b fill the two halves, c checks them, d runs last
+		GLuint half = count / 2;
+		atomic<GLuint> order(0);
+		GLuint mismatches = 0, dOrder = 0;
+		auto fillA = [&](GLuint begin, GLuint end) { work(begin, end); };
+		auto fillB = [&](GLuint begin, GLuint end) { work(half + begin, half + end); };
+		auto a = [&]() { jobs.ParallelFor(half, 4096, fillA); order++; };
+		auto b = [&]() { jobs.ParallelFor(count - half, 4096, fillB); order++; };
+		auto c = [&]() {
+			for (GLuint i = 0; i < count; i++)
+				mismatches += output[i] != reference[i];
+			order++;
+		};
+		auto d = [&]() { dOrder = ++order; };
+		TaskGraph graph;
+		graph.Init(&jobs);
+		GLuint ta = graph.Add("a", a), tb = graph.Add("b", b), tc = graph.Add("c", c), td = graph.Add("d", d);
+		graph.Depend(tc, ta);
+		graph.Depend(tc, tb);
+		graph.Depend(td, tc);
+		for (GLuint it = 0; it < iterations; it++) {
+			fill(output.begin(), output.end(), 0.0f);
+			order = 0;
+			Clock::time_point start = Clock::now();
+			graph.Kick();
+			graph.WaitAll();
+			samples[it] = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+		GLdouble graphMs = MedianMs(samples);
+		if (threads == 1)
+			singleGraphMs = graphMs;
+		bool ordered = mismatches == 0 && dOrder == 4;
+
+		bool match = scaled && contended && ordered;
+		passed = passed && match;
+		out << (threads == 1 ? "\n" : ",\n") << "    {\"threads\": " << threads
+			<< ", \"scaling_ms\": " << ms << ", \"speedup\": " << singleMs / ms << ", \"efficiency\": " << singleMs / ms / threads
+			<< ", \"tiny_jobs\": " << tinyCount << ", \"ns_per_job\": " << nsPerJob
+			<< ", \"jobs_run\": " << stats.executed << ", \"steals\": " << stats.steals << ", \"failed_steals\": " << stats.failedSteals
+			<< ", \"graph_ms\": " << graphMs << ", \"graph_speedup\": " << singleGraphMs / graphMs
+			<< ", \"match\": " << (match ? "true" : "false") << "}";
+		cout << threads << " threads: " << ms << " ms (" << singleMs / ms << "x), " << nsPerJob << " ns/job, "
+			<< stats.steals << " steals (" << stats.failedSteals << " lost), graph " << graphMs << " ms"
+			<< (match ? "" : "  ERROR::MICROBENCH::JOB_SYSTEM_MISMATCH") << endl;
+	}
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Job system benchmark written to " << path << endl;
+	return passed;
+}
+
+// True if a baked model holds exactly the imported model's data
+bool SameModel(Model& imported, Model& baked) {
+	if (imported.meshes.size() != baked.meshes.size())
+		return false;
+	for (GLuint i = 0; i < imported.meshes.size(); i++) {
+		const Mesh& a = imported.meshes[i];
+		const Mesh& b = baked.meshes[i];
+		if (a.VertexCount() != b.VertexCount() || a.IndexCount() != b.IndexCount() || a.textures.size() != b.textures.size()
+			|| a.LodCount() != b.LodCount() || memcmp(a.lods.data(), b.lods.data(), a.LodCount() * sizeof(MeshLod)) != 0)
+			return false;
+		if (memcmp(a.VertexData(), b.VertexData(), a.VertexCount() * sizeof(Vertex)) != 0
+			|| memcmp(a.IndexData(), b.IndexData(), a.IndexCount() * sizeof(GLuint)) != 0)
+			return false;
+		for (GLuint t = 0; t < a.textures.size(); t++) {
+			if (a.textures[t].type != b.textures[t].type || !(a.textures[t].path == b.textures[t].path))
+				return false;
+		}
+	}
+	return true;
+}
+
+// Load time of each scene model through Assimp, on a first run (Assimp,
+// then writing the bake) and from the baked cache (every later run), all
+// on this thread without GL. The cache is read from the OS file cache here;
+// a run straight after boot adds the disk read to it. Every baked model
+// must match its import byte for byte. The models' caches are rewritten.
+bool BenchMeshCache(const char* path) {
+	static const char* models[4] = { "Models/Objs/Char.obj", "Models/Objs/FirePoi.obj",
+		"Models/Objs/Ground.obj", "Models/Objs/Butterfly2.obj" };
+	const GLuint iterations = 5;
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"mesh_cache\",\n  \"models\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	bool useCache = Model::useMeshCache;
+	bool passed = true;
+	vector<GLdouble> samples(iterations);
+	for (GLuint m = 0; m < 4; m++) {
+		const char* source = models[m];
+		string cachePath = MeshCache::PathFor(source);
+
+		// Assimp only
+		Model::useMeshCache = false;
+		for (GLuint i = 0; i < iterations; i++) {
+			Model model;
+			Clock::time_point start = Clock::now();
+			model.Parse(source);
+			samples[i] = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+		GLdouble assimpMs = MedianMs(samples);
+		Model imported;
+		if (!imported.Parse(source)) {
+			cout << "ERROR::MICROBENCH::MODEL_NOT_LOADED " << source << endl;
+			passed = false;
+			continue;
+		}
+
+		// First run: import and bake
+		Model::useMeshCache = true;
+		remove(cachePath.c_str());
+		GLdouble coldMs;
+		{
+			Model model;
+			Clock::time_point start = Clock::now();
+			model.Parse(source);
+			coldMs = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+
+		// Later runs: map the bake
+		for (GLuint i = 0; i < iterations; i++) {
+			Model model;
+			Clock::time_point start = Clock::now();
+			model.Parse(source);
+			samples[i] = chrono::duration<double, milli>(Clock::now() - start).count();
+		}
+		GLdouble warmMs = MedianMs(samples);
+
+		Model baked;
+		baked.Parse(source);
+		bool same = SameModel(imported, baked);
+		passed = passed && same;
+		ifstream cache(cachePath.c_str(), ios::binary | ios::ate);
+		GLuint64 bytes = cache ? (GLuint64)cache.tellg() : 0;
+		GLuint vertices = 0, indices = 0;
+		for (GLuint i = 0; i < imported.meshes.size(); i++) {
+			vertices += imported.meshes[i].VertexCount();
+			indices += imported.meshes[i].IndexCount();
+		}
+
+		out << (m == 0 ? "\n" : ",\n") << "    {\"model\": \"" << source << "\", \"meshes\": " << imported.meshes.size()
+			<< ", \"vertices\": " << vertices << ", \"indices\": " << indices << ", \"cache_bytes\": " << bytes
+			<< ", \"assimp_ms\": " << assimpMs << ", \"cold_ms\": " << coldMs << ", \"warm_ms\": " << warmMs
+			<< ", \"speedup\": " << assimpMs / warmMs << ", \"match\": " << (same ? "true" : "false") << "}";
+		cout << source << ": Assimp " << assimpMs << " ms, first run " << coldMs << " ms, baked " << warmMs << " ms ("
+			<< assimpMs / warmMs << "x)" << (same ? "" : "  ERROR::MICROBENCH::MESH_CACHE_MISMATCH") << endl;
+	}
+	Model::useMeshCache = useCache;
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Mesh cache benchmark written to " << path << endl;
+	return passed;
+}
+
+// Triangles of an indexed mesh as vertex contents, each rotated to start
+// at its smallest vertex (winding kept), sorted
+vector<Vertex> CanonicalTriangles(const vector<Vertex>& vertices, const vector<GLuint>& indices) {
+	VertexEqual equalTo;
+	auto less = [](const Vertex& a, const Vertex& b) { return memcmp(&a, &b, sizeof(Vertex)) < 0; };
+	vector<array<Vertex, 3> > triangles(indices.size() / 3);
+	for (GLuint t = 0; t < triangles.size(); t++) {
+		GLuint first = 0;
+		for (GLuint c = 1; c < 3; c++) {
+			if (less(vertices[indices[t * 3 + c]], vertices[indices[t * 3 + first]]))
+				first = c;
+		}
+		for (GLuint c = 0; c < 3; c++)
+			triangles[t][c] = vertices[indices[t * 3 + (first + c) % 3]];
+	}
+	sort(triangles.begin(), triangles.end(), [&](const array<Vertex, 3>& a, const array<Vertex, 3>& b) {
+		for (GLuint c = 0; c < 3; c++) {
+			if (!equalTo(a[c], b[c]))
+				return less(a[c], b[c]);
+		}
+		return false;
+	});
+	vector<Vertex> flat;
+	for (GLuint t = 0; t < triangles.size(); t++)
+		flat.insert(flat.end(), triangles[t].begin(), triangles[t].end());
+	return flat;
+}
+
+// A UV sphere the way Assimp imports an .obj: one vertex per face corner,
+// faces in no useful order
+void ScatteredSphere(vector<Vertex>& vertices, vector<GLuint>& indices, GLuint rings, GLuint segments) {
+	vector<Vertex> grid((rings + 1) * (segments + 1));
+	for (GLuint r = 0; r <= rings; r++) {
+		for (GLuint s = 0; s <= segments; s++) {
+			GLfloat theta = 3.14159265f * r / rings, phi = 6.2831853f * s / segments;
+			Vertex& vertex = grid[r * (segments + 1) + s];
+			vertex.Normal = vec3(sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi));
+			vertex.Position = vertex.Normal;
+			vertex.TexCoords = vec2((GLfloat)s / segments, (GLfloat)r / rings);
+		}
+	}
+	vector<GLuint> quads(rings * segments);
+	for (GLuint i = 0; i < quads.size(); i++)
+		quads[i] = i;
+	srand(0);
+	for (GLuint i = quads.size() - 1; i > 0; i--)
+		swap(quads[i], quads[rand() % (i + 1)]);
+	vertices.clear();
+	indices.clear();
+	for (GLuint q = 0; q < quads.size(); q++) {
+		GLuint r = quads[q] / segments, s = quads[q] % segments;
+		GLuint a = r * (segments + 1) + s, b = a + segments + 1;
+		GLuint corners[6] = { a, b, a + 1, a + 1, b, b + 1 };
+		for (GLuint c = 0; c < 6; c++) {
+			indices.push_back(vertices.size());
+			vertices.push_back(grid[corners[c]]);
+		}
+	}
+}
+
+// Vertex cache (ACMR / ATVR) and vertex count of every mesh before and
+// after the import-time optimization, for a scattered sphere and the scene
+// models (read through Assimp, bypassing the mesh cache). Every optimized
+// mesh must hold exactly the triangles it was given.
+bool BenchMeshOptimizer(const char* path) {
+	static const char* models[4] = { "Models/Objs/Char.obj", "Models/Objs/FirePoi.obj",
+		"Models/Objs/Ground.obj", "Models/Objs/Butterfly2.obj" };
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"mesh_optimizer\",\n  \"cache_size\": " << MESH_OPT_CACHE_SIZE << ",\n  \"meshes\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	bool useCache = Model::useMeshCache, optimize = Model::optimizeMeshes, lods = Model::generateLods;
+	Model::useMeshCache = false;
+	Model::generateLods = false;
+	bool passed = true, first = true;
+	for (GLint m = -1; m < 4; m++) {
+		// Source meshes, as imported
+		Model model;
+		const char* name = m < 0 ? "sphere" : models[m];
+		if (m < 0) {
+			vector<Vertex> vertices;
+			vector<GLuint> indices;
+			ScatteredSphere(vertices, indices, 64, 128);
+			model.meshes.push_back(Mesh(move(vertices), move(indices), vector<Texture>(), Material(), false));
+		}
+		else {
+			Model::optimizeMeshes = false;
+			if (!model.Parse(name)) {
+				cout << "ERROR::MICROBENCH::MODEL_NOT_LOADED " << name << endl;
+				passed = false;
+				continue;
+			}
+		}
+
+		for (GLuint i = 0; i < model.meshes.size(); i++) {
+			vector<Vertex> vertices = model.meshes[i].vertices;
+			vector<GLuint> indices = model.meshes[i].indices;
+			Clock::time_point start = Clock::now();
+			MeshOptStats stats = OptimizeMesh(vertices, indices);
+			GLdouble ms = chrono::duration<double, milli>(Clock::now() - start).count();
+
+			vector<Vertex> after = CanonicalTriangles(vertices, indices);
+			vector<Vertex> before = CanonicalTriangles(model.meshes[i].vertices, model.meshes[i].indices);
+			bool same = after.size() == before.size() && memcmp(after.data(), before.data(), after.size() * sizeof(Vertex)) == 0;
+			passed = passed && same;
+			out << (first ? "\n" : ",\n") << "    {\"model\": \"" << name << "\", \"mesh\": " << i
+				<< ", \"triangles\": " << stats.triangles << ", \"vertices_before\": " << stats.verticesBefore
+				<< ", \"vertices_after\": " << stats.verticesAfter
+				<< ", \"acmr_before\": " << stats.before.acmr << ", \"acmr_after\": " << stats.after.acmr
+				<< ", \"atvr_before\": " << stats.before.atvr << ", \"atvr_after\": " << stats.after.atvr
+				<< ", \"ms\": " << ms << ", \"match\": " << (same ? "true" : "false") << "}";
+			cout << name << " mesh " << i << ": " << stats.triangles << " triangles, " << stats.verticesBefore << " -> "
+				<< stats.verticesAfter << " vertices, ACMR " << stats.before.acmr << " -> " << stats.after.acmr
+				<< ", ATVR " << stats.before.atvr << " -> " << stats.after.atvr << ", " << ms << " ms"
+				<< (same ? "" : "  ERROR::MICROBENCH::MESH_OPTIMIZER_MISMATCH") << endl;
+			first = false;
+		}
+	}
+	Model::useMeshCache = useCache;
+	Model::optimizeMeshes = optimize;
+	Model::generateLods = lods;
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Mesh optimizer benchmark written to " << path << endl;
+	return passed;
+}
+
+// Worst-case error of the packed vertex layout for a sphere and every scene
+// mesh, and the vertex fetch cost of both layouts: bytes per vertex, and the
+// time to gather every vertex in index order from 8 copies of a 256 x 512
+// sphere (32 / 16 MB, past the CPU caches). The gather only reads the
+// words, as the GPU's fetch units decode packed attributes for free.
+// Positions must stay within 1 / 65535 of the mesh bounds, normals within
+// 0.05 degrees and texture coordinates within half float precision.
+// Vertex throughput needs the GPU: compare the fx pass of --headless runs
+// with --instances 1000000 and each --vertex-format.
+bool BenchVertexFormats(const char* path) {
+	static const char* models[4] = { "Models/Objs/Char.obj", "Models/Objs/FirePoi.obj",
+		"Models/Objs/Ground.obj", "Models/Objs/Butterfly2.obj" };
+	const GLuint copies = 8;
+	const GLuint iterations = 20;
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"vertex_formats\",\n  \"meshes\": [";
+
+	// Error bounds, mesh by mesh
+	bool passed = true, first = true;
+	for (GLint m = -1; m < 4; m++) {
+		Model model;
+		const char* name = m < 0 ? "sphere" : models[m];
+		if (m < 0) {
+			vector<Vertex> vertices;
+			vector<GLuint> indices;
+			ScatteredSphere(vertices, indices, 64, 128);
+			OptimizeMesh(vertices, indices);
+			model.meshes.push_back(Mesh(move(vertices), move(indices), vector<Texture>(), Material(), false));
+		}
+		else if (!model.Parse(name)) {
+			cout << "ERROR::MICROBENCH::MODEL_NOT_LOADED " << name << endl;
+			passed = false;
+			continue;
+		}
+
+		for (GLuint i = 0; i < model.meshes.size(); i++) {
+			const Vertex* vertices = model.meshes[i].VertexData();
+			GLuint count = model.meshes[i].VertexCount();
+			VertexQuantization quantization = QuantizationOf(vertices, count);
+			VertexPackingError error = MeasurePackingError(vertices, count, quantization);
+			GLfloat texCoordRange = 1.0f;
+			for (GLuint v = 0; v < count; v++)
+				texCoordRange = max(texCoordRange, max(fabs(vertices[v].TexCoords.x), fabs(vertices[v].TexCoords.y)));
+			bool accurate = error.positionRelative <= 1.0f / 65535.0f && error.normalDegrees <= 0.05f
+				&& error.texCoords <= texCoordRange / 2048.0f;
+			passed = passed && accurate;
+			out << (first ? "\n" : ",\n") << "    {\"model\": \"" << name << "\", \"mesh\": " << i << ", \"vertices\": " << count
+				<< ", \"position_error\": " << error.position << ", \"position_error_relative\": " << error.positionRelative
+				<< ", \"normal_error_degrees\": " << error.normalDegrees << ", \"texcoord_error\": " << error.texCoords
+				<< ", \"accurate\": " << (accurate ? "true" : "false") << "}";
+			cout << name << " mesh " << i << ": " << count << " vertices, position error " << error.position << " ("
+				<< error.positionRelative << " of the bounds), normal " << error.normalDegrees << " deg, uv " << error.texCoords
+				<< (accurate ? "" : "  ERROR::MICROBENCH::VERTEX_FORMAT_INACCURATE") << endl;
+			first = false;
+		}
+	}
+	out << "\n  ],\n  \"fetch\": [";
+
+	// Fetch, in the optimized index order, from a buffer of several meshes
+	vector<Vertex> sphere;
+	vector<GLuint> sphereIndices;
+	ScatteredSphere(sphere, sphereIndices, 256, 512);
+	OptimizeMesh(sphere, sphereIndices);
+	vector<Vertex> vertices;
+	vector<GLuint> indices;
+	for (GLuint c = 0; c < copies; c++) {
+		GLuint base = vertices.size();
+		vertices.insert(vertices.end(), sphere.begin(), sphere.end());
+		for (GLuint i = 0; i < sphereIndices.size(); i++)
+			indices.push_back(base + sphereIndices[i]);
+	}
+	vector<PackedVertex> packed;
+	PackVertices(&vertices[0], vertices.size(), QuantizationOf(&vertices[0], vertices.size()), packed);
+
+	typedef chrono::high_resolution_clock Clock;
+	for (GLuint f = VERTEX_FLOAT; f <= VERTEX_PACKED; f++) {
+		VertexFormat format = (VertexFormat)f;
+		GLuint stride = VertexStride(format);
+		const GLuint* words = f == VERTEX_FLOAT ? (const GLuint*)&vertices[0] : (const GLuint*)&packed[0];
+		GLuint wordsPerVertex = stride / sizeof(GLuint);
+		vector<GLdouble> samples(iterations);
+		GLuint checksum = 0;
+		for (GLuint i = 0; i < iterations; i++) {
+			Clock::time_point start = Clock::now();
+			GLuint sum = 0;
+			for (GLuint k = 0; k < indices.size(); k++) {
+				const GLuint* vertex = words + (size_t)indices[k] * wordsPerVertex;
+				for (GLuint w = 0; w < wordsPerVertex; w++)
+					sum += vertex[w];
+			}
+			samples[i] = chrono::duration<double, milli>(Clock::now() - start).count();
+			checksum ^= sum;
+		}
+		GLdouble fetchMs = MedianMs(samples);
+		GLdouble megabytes = vertices.size() * stride / 1048576.0;
+
+		out << (f == VERTEX_FLOAT ? "\n" : ",\n") << "    {\"format\": \"" << VertexFormatName(format)
+			<< "\", \"bytes_per_vertex\": " << stride << ", \"vertices\": " << vertices.size() << ", \"indices\": " << indices.size()
+			<< ", \"buffer_mb\": " << megabytes << ", \"fetch_ms\": " << fetchMs << ", \"checksum\": " << checksum << "}";
+		cout << VertexFormatName(format) << ": " << stride << " bytes per vertex, " << megabytes << " MB, fetch "
+			<< fetchMs << " ms for " << indices.size() << " indices" << endl;
+	}
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Vertex format benchmark written to " << path << endl;
+	return passed;
+}
+
+// Level of detail chain of a sphere and every scene mesh (read through
+// Assimp, bypassing the mesh cache): triangles and error of each level and
+// the time to build the chain. Every level must be a valid, smaller
+// triangle list over the mesh's vertices. Frame times per level need the
+// GPU: compare --headless runs with --lod 0 to 3 (the report includes the
+// triangles drawn per frame).
+bool BenchLodChains(const char* path) {
+	static const char* models[4] = { "Models/Objs/Char.obj", "Models/Objs/FirePoi.obj",
+		"Models/Objs/Ground.obj", "Models/Objs/Butterfly2.obj" };
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"lod_chains\",\n  \"max_levels\": " << MAX_MESH_LODS << ",\n  \"meshes\": [";
+
+	typedef chrono::high_resolution_clock Clock;
+	bool useCache = Model::useMeshCache, lods = Model::generateLods;
+	Model::useMeshCache = false;
+	Model::generateLods = false;
+	bool passed = true, first = true;
+	for (GLint m = -1; m < 4; m++) {
+		Model model;
+		const char* name = m < 0 ? "sphere" : models[m];
+		if (m < 0) {
+			vector<Vertex> vertices;
+			vector<GLuint> indices;
+			ScatteredSphere(vertices, indices, 64, 128);
+			OptimizeMesh(vertices, indices);
+			model.meshes.push_back(Mesh(move(vertices), move(indices), vector<Texture>(), Material(), false));
+		}
+		else if (!model.Parse(name)) {
+			cout << "ERROR::MICROBENCH::MODEL_NOT_LOADED " << name << endl;
+			passed = false;
+			continue;
+		}
+		GLfloat radius = model.BoundingSphere().w;
+
+		for (GLuint i = 0; i < model.meshes.size(); i++) {
+			const vector<Vertex>& vertices = model.meshes[i].vertices;
+			vector<GLuint> indices = model.meshes[i].indices;
+			vector<MeshLod> chain;
+			Clock::time_point start = Clock::now();
+			BuildLodChain(vertices, indices, chain);
+			GLdouble ms = chrono::duration<double, milli>(Clock::now() - start).count();
+
+			// Ranges in order and shrinking, indices in range, no collapsed faces
+			bool valid = true;
+			for (GLuint l = 0; l < chain.size(); l++) {
+				const MeshLod& lod = chain[l];
+				valid = valid && lod.firstIndex + lod.indexCount <= indices.size() && lod.indexCount % 3 == 0;
+				valid = valid && (l == 0 || (lod.indexCount < chain[l - 1].indexCount && lod.error >= chain[l - 1].error));
+				for (GLuint t = lod.firstIndex; valid && t < lod.firstIndex + lod.indexCount; t += 3) {
+					GLuint a = indices[t], b = indices[t + 1], c = indices[t + 2];
+					valid = a < vertices.size() && b < vertices.size() && c < vertices.size() && a != b && b != c && c != a;
+				}
+			}
+			passed = passed && valid;
+
+			out << (first ? "\n" : ",\n") << "    {\"model\": \"" << name << "\", \"mesh\": " << i << ", \"vertices\": " << vertices.size()
+				<< ", \"ms\": " << ms << ", \"valid\": " << (valid ? "true" : "false") << ", \"levels\": [";
+			cout << name << " mesh " << i << ":";
+			for (GLuint l = 0; l < chain.size(); l++) {
+				out << (l ? ", " : "") << "{\"triangles\": " << chain[l].indexCount / 3 << ", \"error\": " << chain[l].error
+					<< ", \"error_relative\": " << chain[l].error / radius << "}";
+				cout << " " << chain[l].indexCount / 3 << " (" << chain[l].error / radius << ")";
+			}
+			out << "]}";
+			cout << " triangles (error / radius), " << ms << " ms" << (valid ? "" : "  ERROR::MICROBENCH::LOD_CHAIN_INVALID") << endl;
+			first = false;
+		}
+	}
+	Model::useMeshCache = useCache;
+	Model::generateLods = lods;
+	out << "\n  ],\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "LOD chain benchmark written to " << path << endl;
+	return passed;
+}
+
+// PSNR of an RGB image against a reference, in dB (100 when identical)
+GLdouble PeakSignalToNoise(const GLubyte* image, const GLubyte* reference, size_t bytes) {
+	GLdouble squared = 0.0;
+	for (size_t i = 0; i < bytes; i++) {
+		GLdouble d = (GLdouble)image[i] - reference[i];
+		squared += d * d;
+	}
+	if (squared == 0.0)
+		return 100.0;
+	return 10.0 * log10(255.0 * 255.0 * bytes / squared);
+}
+
+// BC1 compression of a synthetic image, an odd-sized one and every scene
+// texture: PNG decode time, mip chain + encode time and throughput, .ktx
+// write / read times, GPU memory uncompressed (RGBA8 + generated mipmaps)
+// against BC1, and the level 0 PSNR. Every bake must read back exactly
+// with a full mip chain, and the synthetic images must keep their detail.
+bool BenchTextureCompression(const char* path) {
+	static const char* models[4] = { "Models/Objs/Char.obj", "Models/Objs/FirePoi.obj",
+		"Models/Objs/Ground.obj", "Models/Objs/Butterfly2.obj" };
+	const GLdouble minSyntheticPsnr = 32.0;
+
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::MICROBENCH::REPORT_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	out << "{\n  \"benchmark\": \"texture_compression\",\n  \"format\": \"bc1\",\n  \"textures\": [";
+
+	// Texture files the scene uses
+	vector<string> files;
+	for (GLuint m = 0; m < 4; m++) {
+		Model model;
+		if (!model.Parse(models[m])) {
+			cout << "ERROR::MICROBENCH::MODEL_NOT_LOADED " << models[m] << endl;
+			continue;
+		}
+		for (GLuint t = 0; t < model.textures_loaded.size(); t++) {
+			string file = model.TexturePath(model.textures_loaded[t]);
+			if (find(files.begin(), files.end(), file) == files.end())
+				files.push_back(file);
+		}
+	}
+
+	typedef chrono::high_resolution_clock Clock;
+	bool passed = true;
+	GLuint64 totalRaw = 0, totalCompressed = 0;
+	for (GLint f = -2; f < (GLint)files.size(); f++) {
+		string name = f == -2 ? "synthetic 512x512" : f == -1 ? "synthetic 37x19" : files[f];
+		GLint width, height;
+		GLdouble decodeMs = 0.0;
+		vector<GLubyte> rgb;
+		if (f < 0) {
+			width = f == -2 ? 512 : 37;
+			height = f == -2 ? 512 : 19;
+			rgb.resize((size_t)width * height * 3);
+			for (GLint y = 0; y < height; y++) {
+				for (GLint x = 0; x < width; x++) {
+					GLubyte* texel = &rgb[((size_t)y * width + x) * 3];
+					texel[0] = (GLubyte)(x * 255 / max(width - 1, 1));
+					texel[1] = (GLubyte)(y * 255 / max(height - 1, 1));
+					texel[2] = (GLubyte)(127.5 + 127.5 * sin(x * 0.05) * cos(y * 0.05));
+				}
+			}
+		}
+		else {
+			vector<GLubyte> bytes;
+			Clock::time_point start = Clock::now();
+			GLubyte* pixels = nullptr;
+			if (TextureCache::ReadFile(name, bytes) && !bytes.empty())
+				pixels = SOIL_load_image_from_memory(bytes.data(), bytes.size(), &width, &height, 0, SOIL_LOAD_RGB);
+			decodeMs = chrono::duration<double, milli>(Clock::now() - start).count();
+			if (!pixels) {
+				cout << "ERROR::MICROBENCH::TEXTURE_NOT_DECODED " << name << endl;
+				passed = false;
+				continue;
+			}
+			rgb.assign(pixels, pixels + (size_t)width * height * 3);
+			SOIL_free_image_data(pixels);
+		}
+
+		TextureImage image;
+		Clock::time_point start = Clock::now();
+		CompressImage(&rgb[0], width, height, image);
+		GLdouble encodeMs = chrono::duration<double, milli>(Clock::now() - start).count();
+
+		string bake = string(path) + ".bench.ktx";
+		start = Clock::now();
+		bool written = WriteKtx(bake, image, "0 0 0");
+		GLdouble writeMs = chrono::duration<double, milli>(Clock::now() - start).count();
+		TextureImage read;
+		string stamp;
+		start = Clock::now();
+		bool readBack = ReadKtx(bake, read, stamp);
+		GLdouble readMs = chrono::duration<double, milli>(Clock::now() - start).count();
+		remove(bake.c_str());
+
+		vector<GLubyte> decoded(rgb.size());
+		DecodeBC1(&image.data[0], width, height, &decoded[0]);
+		GLdouble psnr = PeakSignalToNoise(&decoded[0], &rgb[0], rgb.size());
+
+		TextureImage raw;
+		raw.width = width;
+		raw.height = height;
+		raw.format = GL_RGB;
+		raw.levels = 1;
+		GLuint64 rawBytes = TextureMemory(raw), compressedBytes = TextureMemory(image);
+		totalRaw += rawBytes;
+		totalCompressed += compressedBytes;
+		GLdouble encodeMBs = rgb.size() / 1048576.0 / max(encodeMs / 1000.0, 1e-9);
+
+		bool valid = written && readBack && read.levels == MipLevelCount(width, height) && read.width == width
+			&& read.height == height && read.data == image.data && stamp == "0 0 0" && (f >= 0 || psnr >= minSyntheticPsnr);
+		passed = passed && valid;
+
+		out << (f == -2 ? "\n" : ",\n") << "    {\"texture\": \"" << name << "\", \"width\": " << width << ", \"height\": " << height
+			<< ", \"levels\": " << image.levels << ", \"decode_ms\": " << decodeMs << ", \"encode_ms\": " << encodeMs
+			<< ", \"encode_mb_per_s\": " << encodeMBs << ", \"ktx_write_ms\": " << writeMs << ", \"ktx_read_ms\": " << readMs
+			<< ", \"rgba8_bytes\": " << rawBytes << ", \"bc1_bytes\": " << compressedBytes << ", \"psnr_db\": " << psnr
+			<< ", \"valid\": " << (valid ? "true" : "false") << "}";
+		cout << name << ": " << width << "x" << height << ", " << image.levels << " levels, encode " << encodeMs << " ms ("
+			<< encodeMBs << " MB/s), .ktx read " << readMs << " ms, " << rawBytes / 1024 << " -> " << compressedBytes / 1024
+			<< " KB, PSNR " << psnr << " dB" << (valid ? "" : "  ERROR::MICROBENCH::TEXTURE_BAKE_INVALID") << endl;
+	}
+	out << "\n  ],\n  \"rgba8_bytes\": " << totalRaw << ",\n  \"bc1_bytes\": " << totalCompressed
+		<< ",\n  \"passed\": " << (passed ? "true" : "false") << "\n}" << endl;
+	cout << "Textures: " << totalRaw / 1024 << " KB as RGBA8 -> " << totalCompressed / 1024 << " KB as BC1" << endl;
+	cout << "Texture compression benchmark written to " << path << endl;
+	return passed;
+}
@@ -1,238 +1,446 @@
-// ============================================================================
-//
-// ModelObj.h
-// -----------------------------------
-//
-// MODEL OBJECT HEADER FILE
-//
-// The model class allows several smaller meshes to be grouped up and to be 
-// treated as a larger 'Model' object that can handle all of the smaller 
-// meshes at once.
-//
-// ============================================================================
-
-
-#pragma once
-
-// Standard includes
-#include <string>
-#include <fstream>
-#include <sstream>
-#include <iostream>
-#include <vector>
-#include <map>
-
-// OpenGL includes
-#include "GL\glew.h"
-#include "glm\glm.hpp"
-#include "glm\gtc\matrix_transform.hpp"
-#include "soil\SOIL.h"
-#include "assimp\Importer.hpp"
-#include "assimp\scene.h"
-#include "assimp\postprocess.h"
-
-// Custom headers
-#include "MeshObj.h"
-#include "UseShader.h"
-
-using namespace std;
-using namespace glm;
-using namespace Assimp;
-
-// Function prototype
-GLint TextureFromFile(const char* path, string directory);
-
-// Model class
-class Model {
-private:
-	// Data
-	string directory;
-	
-
-	// Functions
-	void loadModel(string path);
-	void processNode(aiNode* node, const aiScene* scene);
-	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
-	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
-
-public:
-	Model();
-	Model(GLchar* path);
-	void Draw(Shader shader);
-	void DrawInstance(Shader shader, GLuint num);
-
-	vector<Mesh> meshes;
-	vector<Texture> textures_loaded;
-};
-
-// Loads a model and stores the mesh data in seperate mesh classes
-void Model::loadModel(string path){
-	// Read in file
-	Importer importer;
-	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
-
-	// Error Handling
-	if(!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
-		cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
-		return;
-	}
-
-	// Retrieve directory of file
-	this->directory = path.substr(0, path.find_last_of('/'));
-
-	// Process nodes recursively
-	this->processNode(scene->mRootNode, scene);
-}
-
-// The model class is structured as a tree of mesh classes, and this function
-// will recursively process through all of the mesh nodes.
-void Model::processNode(aiNode* node, const aiScene* scene){
-	// Process mesh at current node
-	for(GLuint i = 0; i < node->mNumMeshes; i++) {
-		// Only containts indices
-		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-		this->meshes.push_back(this->processMesh(mesh, scene));
-	}
-
-	// Process the child nodes
-	for(GLuint i = 0; i < node->mNumChildren; i++) {
-		this->processNode(node->mChildren[i], scene);
-	}
-}
-
-// Take the mesh data and store it in a node within Model class
-Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene){
-	vector<Vertex> vertices;
-	vector<GLuint> indices;
-	vector<Texture> textures;
-
-	// Go through each mesh vertices
-	for(GLuint i = 0; i < mesh->mNumVertices; i++) {
-		Vertex vertex;
-		vec3 vector;
-
-		vector.x = mesh->mVertices[i].x;
-		vector.y = mesh->mVertices[i].y;
-		vector.z = mesh->mVertices[i].z;
-		vertex.Position = vector;
-
-		vector.x = mesh->mNormals[i].x;
-		vector.y = mesh->mNormals[i].y;
-		vector.z = mesh->mNormals[i].z;
-		vertex.Normal = vector;
-
-		if(mesh->mTextureCoords[0]) {
-			vec2 vec;
-
-			vec.x = mesh->mTextureCoords[0][i].x;
-			vec.y = mesh->mTextureCoords[0][i].y;
-			vertex.TexCoords = vec;
-		}
-		else
-			vertex.TexCoords = vec2(0.0f, 0.0f);
-		vertices.push_back(vertex);
-	}
-
-	// Go through each face and get indices
-	for(GLuint i = 0; i < mesh->mNumFaces; i++) {
-		aiFace face = mesh->mFaces[i];
-		for(GLuint j = 0; j < face.mNumIndices; j++) 
-			indices.push_back(face.mIndices[j]);
-	}
-
-	// Process Materials
-	if(mesh->mMaterialIndex >= 0) {
-		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-		// Diffuse Map
-		vector<Texture> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-
-		// Specular Map
-		vector<Texture> specularMaps = this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-
-		// Emission Map
-		vector<Texture> emissionMaps = this->loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_emission");
-		textures.insert(textures.end(), emissionMaps.begin(), emissionMaps.end());
-	}
-
-	return Mesh(vertices, indices, textures);
-}
-
-// Check the materials and load textures
-vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName){
-	// Check material type and load appropriate textures if needed
-	vector<Texture> textures;
-	for(GLuint i = 0; i < mat->GetTextureCount(type); i++) {
-		aiString str;
-		mat->GetTexture(type, i, &str);
-
-		// Load texture only if it's not loaded before
-		GLboolean skip = false;
-		for(GLuint j = 0; j < textures_loaded.size(); j++) {
-			if(textures_loaded[j].path == str) {
-				textures.push_back(textures_loaded[j]);
-				skip = true;
-				break;
-			}
-		}
-		if(!skip) {
-			Texture texture;
-			texture.id = TextureFromFile(str.C_Str(), this->directory);
-			texture.type = typeName;
-			texture.path = str;
-			textures.push_back(texture);
-			this->textures_loaded.push_back(texture);
-		}
-	}
-	return textures;
-}
-
-// Empty Constructor
-Model::Model(){
-}
-
-// Constructor that loads a model's filepath
-Model::Model(GLchar* path){
-	this->loadModel(path);
-}
-
-// Draw the entire model
-void Model::Draw(Shader shader){
-	for(GLuint i = 0; i < this->meshes.size(); i++)
-		this->meshes[i].Draw(shader);
-}
-
-// Draw the entire model (instanced)
-void Model::DrawInstance(Shader shader, GLuint num) {
-	for (GLuint i = 0; i < this->meshes.size(); i++)
-		this->meshes[i].DrawInstance(shader, num);
-}
-
-// Import textures (not part of Model class)
-GLint TextureFromFile(const char* path, string directory){
-	// Generate texture ID
-	string filename = string(path);
-	filename = directory + '/' + filename;
-	cout << filename << endl;
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-	int width, height;
-	unsigned char* image = SOIL_load_image(filename.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
-
-	// Load texture to ID
-	glBindTexture(GL_TEXTURE_2D, textureID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// Initiate texture parameters
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	SOIL_free_image_data(image);
-
-	return textureID;
-}
\ No newline at end of file
+// ============================================================================
+//
+// ModelObj.h
+// -----------------------------------
+//
+// MODEL OBJECT HEADER FILE
+//
+// The model class allows several smaller meshes to be grouped up and to be 
+// treated as a larger 'Model' object that can handle all of the smaller 
+// meshes at once.
+//
+// ============================================================================
+
+
+#pragma once
+
+// Standard includes
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+#include "glm\gtc\matrix_transform.hpp"
+#include "soil\SOIL.h"
+#include "assimp\Importer.hpp"
+#include "assimp\scene.h"
+#include "assimp\postprocess.h"
+
+// Custom headers
+#include "MeshObj.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshLod.h"
+#include "TextureCache.h"
+#include "UseShader.h"
+
+using namespace std;
+using namespace glm;
+using namespace Assimp;
+
+// Function prototype
+GLint TextureFromFile(const char* path, string directory);
+
+// Model class
+class Model {
+private:
+	// Data
+	string directory;
+	bool deferGL;		// parsing off the render thread: no GL calls
+	shared_ptr<MeshCache> cache;	// mapped meshes, when read from a bake
+
+	// Functions
+	void loadModel(string path);
+	bool loadBaked(const string& path);
+	void processNode(aiNode* node, const aiScene* scene);
+	Mesh processMesh(aiMesh* mesh, const aiScene* scene);
+	Material buildMaterial(const vector<Texture>& textures);
+	vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName);
+	Texture loadTexture(const aiString& path, const string& typeName);
+
+public:
+	Model();
+	Model(GLchar* path);
+	bool Parse(const string& path);
+	void Upload();
+	void ReleaseTextures();
+	string TexturePath(const Texture& texture);
+	void Draw(const Shader& shader, GLuint lod = 0);
+	void DrawInstance(const Shader& shader, GLuint num, GLuint lod = 0);
+	void DrawInstanceIndirect(const Shader& shader, GLuint commandBuffer);
+	vec4 BoundingSphere();
+	GLuint LodCount();
+	GLfloat LodError(GLuint level);
+	GLuint SelectLod(GLfloat pixelsPerUnit, GLfloat tolerance);
+	GLuint TriangleCount(GLuint lod);
+
+	vector<Mesh> meshes;
+	vector<Texture> textures_loaded;
+	map<string, GLuint> textureIndex;		// texture path -> textures_loaded slot
+	vector<MeshOptStats> optimizeStats;		// per mesh, when imported and optimized
+
+	// Read and write baked mesh caches (on unless --no-mesh-cache)
+	static bool useMeshCache;
+
+	// Optimize imported meshes for the vertex cache and overdraw (on unless
+	// --no-mesh-opt)
+	static bool optimizeMeshes;
+
+	// Build simplified levels of detail for imported meshes (on unless
+	// --no-lod)
+	static bool generateLods;
+};
+
+bool Model::useMeshCache = true;
+bool Model::optimizeMeshes = true;
+bool Model::generateLods = true;
+
+// Flags a baked model must have been prepared with to be used as it is
+GLuint BakeFlags() {
+	return (Model::optimizeMeshes ? MESH_CACHE_OPTIMIZED : 0) | (Model::generateLods ? MESH_CACHE_LODS : 0);
+}
+
+// Loads a model and stores the mesh data in seperate mesh classes
+void Model::loadModel(string path){
+	// Retrieve directory of file
+	this->directory = path.substr(0, path.find_last_of('/'));
+
+	// Baked copy, if it is still current and optimized the same way
+	if (useMeshCache && this->loadBaked(path))
+		return;
+
+	// Read in file
+	Importer importer;
+	const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
+
+	// Error Handling
+	if(!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+		cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+		return;
+	}
+
+	// Process nodes recursively
+	this->processNode(scene->mRootNode, scene);
+	for (GLuint i = 0; i < this->optimizeStats.size(); i++) {
+		const MeshOptStats& stats = this->optimizeStats[i];
+		cout << path << " mesh " << i << ": " << stats.verticesBefore << " -> " << stats.verticesAfter
+			<< " vertices, ACMR " << stats.before.acmr << " -> " << stats.after.acmr
+			<< ", ATVR " << stats.before.atvr << " -> " << stats.after.atvr << endl;
+	}
+	for (GLuint i = 0; generateLods && i < this->meshes.size(); i++) {
+		const Mesh& mesh = this->meshes[i];
+		cout << path << " mesh " << i << " LODs: ";
+		for (GLuint l = 0; l < mesh.LodCount(); l++)
+			cout << (l ? " / " : "") << mesh.Lod(l).indexCount / 3;
+		cout << " triangles, error ";
+		for (GLuint l = 0; l < mesh.LodCount(); l++)
+			cout << (l ? " / " : "") << mesh.Lod(l).error;
+		cout << endl;
+	}
+
+	// Bake it for the next run
+	if (useMeshCache)
+		MeshCache::Write(path, this->meshes, BakeFlags());
+}
+
+// Map the model's mesh cache and build the meshes on top of it. The arrays
+// are not copied: the meshes point into the mapping, which the model (and
+// its copies) keep open.
+bool Model::loadBaked(const string& path) {
+	shared_ptr<MeshCache> cache = make_shared<MeshCache>();
+	if (!cache->Open(path, BakeFlags()))
+		return false;
+	this->cache = cache;
+
+	for (GLuint i = 0; i < cache->MeshCount(); i++) {
+		const MeshCacheMesh& baked = cache->GetMesh(i);
+		vector<Texture> textures;
+		for (GLuint t = 0; t < baked.textureCount; t++) {
+			// The strings come from the file, so they may not be terminated
+			const MeshCacheTexture& texture = cache->GetTexture(baked.firstTexture + t);
+			string path(texture.path, strnlen(texture.path, sizeof texture.path));
+			string type(texture.type, strnlen(texture.type, sizeof texture.type));
+			textures.push_back(this->loadTexture(aiString(path), type));
+		}
+		const Vertex* vertices = cache->Vertices(i);
+		const GLuint* indices = cache->Indices(i);
+		if (this->deferGL)
+			this->meshes.push_back(Mesh(vertices, baked.vertexCount, indices, baked.indexCount, textures, Material(), false));
+		else
+			this->meshes.push_back(Mesh(vertices, baked.vertexCount, indices, baked.indexCount, textures, this->buildMaterial(textures)));
+		this->meshes.back().lods.assign(baked.lods, baked.lods + baked.lodCount);
+	}
+	return true;
+}
+
+// The model class is structured as a tree of mesh classes, and this function
+// will recursively process through all of the mesh nodes.
+void Model::processNode(aiNode* node, const aiScene* scene){
+	// Process mesh at current node
+	for(GLuint i = 0; i < node->mNumMeshes; i++) {
+		// Only containts indices
+		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+		this->meshes.push_back(this->processMesh(mesh, scene));
+	}
+
+	// Process the child nodes
+	for(GLuint i = 0; i < node->mNumChildren; i++) {
+		this->processNode(node->mChildren[i], scene);
+	}
+}
+
+// Take the mesh data and store it in a node within Model class
+Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene){
+	vector<Vertex> vertices;
+	vector<GLuint> indices;
+	vector<Texture> textures;
+	vertices.reserve(mesh->mNumVertices);
+	indices.reserve(mesh->mNumFaces * 3);
+
+	// Go through each mesh vertices
+	for(GLuint i = 0; i < mesh->mNumVertices; i++) {
+		Vertex vertex;
+		vec3 vector;
+
+		vector.x = mesh->mVertices[i].x;
+		vector.y = mesh->mVertices[i].y;
+		vector.z = mesh->mVertices[i].z;
+		vertex.Position = vector;
+
+		vector.x = mesh->mNormals[i].x;
+		vector.y = mesh->mNormals[i].y;
+		vector.z = mesh->mNormals[i].z;
+		vertex.Normal = vector;
+
+		if(mesh->mTextureCoords[0]) {
+			vec2 vec;
+
+			vec.x = mesh->mTextureCoords[0][i].x;
+			vec.y = mesh->mTextureCoords[0][i].y;
+			vertex.TexCoords = vec;
+		}
+		else
+			vertex.TexCoords = vec2(0.0f, 0.0f);
+		vertices.push_back(vertex);
+	}
+
+	// Go through each face and get indices
+	for(GLuint i = 0; i < mesh->mNumFaces; i++) {
+		aiFace face = mesh->mFaces[i];
+		for(GLuint j = 0; j < face.mNumIndices; j++) 
+			indices.push_back(face.mIndices[j]);
+	}
+	if (optimizeMeshes)
+		this->optimizeStats.push_back(OptimizeMesh(vertices, indices));
+	vector<MeshLod> lods;
+	if (generateLods)
+		BuildLodChain(vertices, indices, lods);
+
+	// Process Materials
+	if(mesh->mMaterialIndex >= 0) {
+		aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+
+		// Diffuse Map
+		vector<Texture> diffuseMaps = this->loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+		textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+
+		// Specular Map
+		vector<Texture> specularMaps = this->loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+
+		// Emission Map
+		vector<Texture> emissionMaps = this->loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_emission");
+		textures.insert(textures.end(), emissionMaps.begin(), emissionMaps.end());
+	}
+
+	Mesh result = this->deferGL ? Mesh(move(vertices), move(indices), textures, Material(), false)
+		: Mesh(move(vertices), move(indices), textures, this->buildMaterial(textures));
+	if (!lods.empty())
+		result.lods = lods;
+	return result;
+}
+
+// Resolve a mesh's textures into the binding record its draws use. Each
+// sampler is named by type and per-type count ("texture_diffuse1", ...).
+Material Model::buildMaterial(const vector<Texture>& textures) {
+	Material material;
+	GLuint diffuseNr = 1;
+	GLuint specularNr = 1;
+	GLuint emissionNr = 1;
+
+	if (textures.size() > MAX_MATERIAL_TEXTURES)
+		cout << "ERROR::MODEL::TOO_MANY_TEXTURES " << textures.size() << endl;
+	material.textureCount = min((GLuint)textures.size(), MAX_MATERIAL_TEXTURES);
+	for (GLuint i = 0; i < material.textureCount; i++) {
+		const string& name = textures[i].type;
+		GLuint number = 0;
+		if (name == "texture_diffuse")
+			number = diffuseNr++;
+		else if (name == "texture_specular")
+			number = specularNr++;
+		else if (name == "texture_emission")
+			number = emissionNr++;
+		material.textures[i] = textures[i].id;
+		material.samplers[i] = number ? name + to_string(number) : name;
+	}
+	return material;
+}
+
+// Check the materials and load textures
+vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName){
+	// Check material type and load appropriate textures if needed
+	vector<Texture> textures;
+	for(GLuint i = 0; i < mat->GetTextureCount(type); i++) {
+		aiString str;
+		mat->GetTexture(type, i, &str);
+		textures.push_back(this->loadTexture(str, typeName));
+	}
+	return textures;
+}
+
+// Load a texture only if this model has not loaded it before. Other
+// models' textures are shared through TextureCache::shared.
+Texture Model::loadTexture(const aiString& path, const string& typeName) {
+	map<string, GLuint>::iterator found = this->textureIndex.find(path.C_Str());
+	if (found != this->textureIndex.end())
+		return this->textures_loaded[found->second];
+	Texture texture;
+	texture.id = this->deferGL ? 0 : TextureFromFile(path.C_Str(), this->directory);
+	texture.type = typeName;
+	texture.path = path;
+	this->textureIndex[path.C_Str()] = this->textures_loaded.size();
+	this->textures_loaded.push_back(texture);
+	return texture;
+}
+
+// Empty Constructor
+Model::Model(){
+	this->deferGL = false;
+}
+
+// Constructor that loads a model's filepath
+Model::Model(GLchar* path){
+	this->deferGL = false;
+	this->loadModel(path);
+}
+
+// Read the model's meshes without touching GL, so it can run on any thread.
+// Texture ids stay 0 until the caller fills them in; Upload() then creates
+// the buffers and materials on the render thread.
+bool Model::Parse(const string& path) {
+	this->deferGL = true;
+	this->loadModel(path);
+	this->deferGL = false;
+	return !this->meshes.empty();
+}
+
+// Finish a parsed model: buffer objects and texture bindings
+void Model::Upload() {
+	for (GLuint i = 0; i < this->meshes.size(); i++) {
+		this->meshes[i].material = this->buildMaterial(this->meshes[i].textures);
+		this->meshes[i].Upload();
+	}
+}
+
+// Give the model's references to its textures back to the texture cache.
+// Copies of a model share its references, so only one of them may do this.
+void Model::ReleaseTextures() {
+	for (GLuint i = 0; i < this->textures_loaded.size(); i++) {
+		if (this->textures_loaded[i].id)
+			TextureCache::shared.Release(this->textures_loaded[i].id);
+		this->textures_loaded[i].id = 0;
+	}
+}
+
+// Path of one of the model's textures, as TextureFromFile resolves it
+string Model::TexturePath(const Texture& texture) {
+	return this->directory + '/' + texture.path.C_Str();
+}
+
+// Draw the entire model, at a level of detail
+void Model::Draw(const Shader& shader, GLuint lod){
+	for(GLuint i = 0; i < this->meshes.size(); i++)
+		this->meshes[i].Draw(shader, lod);
+}
+
+// Draw the entire model (instanced)
+void Model::DrawInstance(const Shader& shader, GLuint num, GLuint lod) {
+	for (GLuint i = 0; i < this->meshes.size(); i++)
+		this->meshes[i].DrawInstance(shader, num, lod);
+}
+
+// Draw the entire model (instanced), taking the instance count from a
+// buffer holding one DrawElementsIndirectCommand per mesh
+void Model::DrawInstanceIndirect(const Shader& shader, GLuint commandBuffer) {
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+	for (GLuint i = 0; i < this->meshes.size(); i++)
+		this->meshes[i].DrawInstanceIndirect(shader, i * sizeof(DrawElementsIndirectCommand));
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+// Sphere around every vertex of the model (xyz = center, w = radius),
+// centered on the bounding box
+vec4 Model::BoundingSphere() {
+	vec3 lo(1e30f), hi(-1e30f);
+	for (GLuint i = 0; i < this->meshes.size(); i++) {
+		const Vertex* vertices = this->meshes[i].VertexData();
+		for (GLuint j = 0; j < this->meshes[i].VertexCount(); j++) {
+			lo = min(lo, vertices[j].Position);
+			hi = max(hi, vertices[j].Position);
+		}
+	}
+	vec3 center = (lo + hi) * 0.5f;
+	GLfloat radius = 0.0f;
+	for (GLuint i = 0; i < this->meshes.size(); i++) {
+		const Vertex* vertices = this->meshes[i].VertexData();
+		for (GLuint j = 0; j < this->meshes[i].VertexCount(); j++)
+			radius = max(radius, length(vertices[j].Position - center));
+	}
+	return vec4(center, radius);
+}
+
+// Levels of detail of the mesh with the most
+GLuint Model::LodCount() {
+	GLuint levels = 1;
+	for (GLuint i = 0; i < this->meshes.size(); i++)
+		levels = max(levels, this->meshes[i].LodCount());
+	return levels;
+}
+
+// Largest error of any mesh at a level (object space)
+GLfloat Model::LodError(GLuint level) {
+	GLfloat error = 0.0f;
+	for (GLuint i = 0; i < this->meshes.size(); i++)
+		error = max(error, this->meshes[i].Lod(level).error);
+	return error;
+}
+
+// Coarsest level whose error stays within tolerance pixels when one object
+// space unit covers pixelsPerUnit pixels
+GLuint Model::SelectLod(GLfloat pixelsPerUnit, GLfloat tolerance) {
+	GLfloat errors[MAX_MESH_LODS];
+	GLuint levels = min(this->LodCount(), MAX_MESH_LODS);
+	for (GLuint l = 0; l < levels; l++)
+		errors[l] = this->LodError(l);
+	return ::SelectLod(errors, levels, pixelsPerUnit, tolerance);
+}
+
+// Triangles drawn at a level of detail
+GLuint Model::TriangleCount(GLuint lod) {
+	GLuint triangles = 0;
+	for (GLuint i = 0; i < this->meshes.size(); i++)
+		triangles += this->meshes[i].Lod(lod).indexCount / 3;
+	return triangles;
+}
+
+// Import textures (not part of Model class), through the shared cache
+GLint TextureFromFile(const char* path, string directory){
+	return TextureCache::shared.Load(directory + '/' + path);
+}
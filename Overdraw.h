@@ -0,0 +1,111 @@
+// ============================================================================
+//
+// Overdraw.h
+// -----------------------------------
+//
+// OVERDRAW HEADER FILE
+//
+// Counts the fragments the shading passes run the fragment shader for, with
+// GL_SAMPLES_PASSED queries around each of them, and reports the count per
+// rendered pixel: 1.0 means every pixel was shaded once, anything above
+// is overdraw paid for in full. Queries are double-buffered like the
+// profiler's, so a frame's count is read back two frames later instead of
+// stalling. Early depth testing happens before the query counts a sample,
+// so fragments a depth pre-pass rejects are not counted.
+//
+// ============================================================================
+
+#pragma once
+
+// OpenGL includes
+#include "GL\glew.h"
+
+// Query sets in flight, and ranges (shading passes) per frame
+const GLuint OVERDRAW_FRAMES = 2;
+const GLuint OVERDRAW_MAX_RANGES = 4;
+
+// Overdraw counter class
+class OverdrawCounter {
+private:
+	// Data
+	GLuint queries[OVERDRAW_FRAMES][OVERDRAW_MAX_RANGES];
+	GLuint issued[OVERDRAW_FRAMES];			// ranges begun in each set
+	GLuint64 pixels[OVERDRAW_FRAMES];
+	GLuint frame;
+	GLboolean counting;
+	GLdouble perPixel;
+
+	// Functions
+	void resolve(GLuint set);
+
+public:
+	OverdrawCounter();
+	void Init();
+	void BeginFrame(GLuint64 pixels);
+	void Begin();
+	void End();
+	GLdouble FragmentsPerPixel() const;
+};
+
+// Constructor
+OverdrawCounter::OverdrawCounter() {
+	this->frame = 0;
+	this->counting = false;
+	this->perPixel = 0.0;
+	for (GLuint i = 0; i < OVERDRAW_FRAMES; i++) {
+		this->issued[i] = 0;
+		this->pixels[i] = 0;
+	}
+}
+
+void OverdrawCounter::Init() {
+	glGenQueries(OVERDRAW_FRAMES * OVERDRAW_MAX_RANGES, &this->queries[0][0]);
+}
+
+// Read a set back if every range is done; a set still in flight after a
+// full frame is dropped rather than waited on
+void OverdrawCounter::resolve(GLuint set) {
+	if (this->issued[set] == 0)
+		return;
+	GLint available = GL_TRUE;
+	glGetQueryObjectiv(this->queries[set][this->issued[set] - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available) {
+		GLuint64 samples = 0;
+		for (GLuint i = 0; i < this->issued[set]; i++) {
+			GLuint64 range = 0;
+			glGetQueryObjectui64v(this->queries[set][i], GL_QUERY_RESULT, &range);
+			samples += range;
+		}
+		this->perPixel = this->pixels[set] ? (GLdouble)samples / this->pixels[set] : 0.0;
+	}
+	this->issued[set] = 0;
+}
+
+// Start a frame rendered at pixels pixels, picking up the set it reuses
+void OverdrawCounter::BeginFrame(GLuint64 pixels) {
+	this->frame++;
+	GLuint set = this->frame % OVERDRAW_FRAMES;
+	this->resolve(set);
+	this->pixels[set] = pixels;
+}
+
+// Count the fragments shaded until End()
+void OverdrawCounter::Begin() {
+	GLuint set = this->frame % OVERDRAW_FRAMES;
+	if (this->counting || this->issued[set] == OVERDRAW_MAX_RANGES)
+		return;
+	glBeginQuery(GL_SAMPLES_PASSED, this->queries[set][this->issued[set]++]);
+	this->counting = true;
+}
+
+void OverdrawCounter::End() {
+	if (!this->counting)
+		return;
+	glEndQuery(GL_SAMPLES_PASSED);
+	this->counting = false;
+}
+
+// Shaded fragments per pixel of the newest frame read back
+GLdouble OverdrawCounter::FragmentsPerPixel() const {
+	return this->perPixel;
+}
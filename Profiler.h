@@ -0,0 +1,339 @@
+// ============================================================================
+//
+// Profiler.h
+// -----------------------------------
+//
+// PROFILER HEADER FILE
+//
+// The profiler class times named render passes on the CPU and the GPU. GPU
+// times come from GL timestamp queries that are double-buffered, so results
+// are read a frame late instead of stalling the pipeline. Results feed a
+// rolling history for the ImGui panel and can be exported as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev).
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "imgui.h"
+
+using namespace std;
+
+// Profiler limits
+const GLuint PROFILER_FRAMES = 2;		// query sets in flight
+const GLuint PROFILER_MAX_PASSES = 16;
+const GLuint PROFILER_MAX_DEPTH = 8;
+const GLuint PROFILER_HISTORY = 120;	// samples kept for the histogram
+
+// Holds the queries and timing history of a single named pass
+struct ProfilerPass {
+	const char* name;
+	GLuint queries[PROFILER_FRAMES][2];		// begin / end timestamps per set
+	GLboolean issued[PROFILER_FRAMES];
+	GLdouble cpuBegin[PROFILER_FRAMES];		// ms since the profiler started
+	GLdouble cpuEnd[PROFILER_FRAMES];
+	GLfloat history[PROFILER_HISTORY];		// gpu ms
+	GLuint historyCount;
+	GLdouble lastCpuMs, lastGpuMs;
+	GLuint lastFrame;						// frame the last* values belong to
+};
+
+// Single complete event of a Chrome trace
+struct TraceEvent {
+	const char* name;
+	GLuint thread;		// 0 = cpu, 1 = gpu
+	GLdouble beginUs, durationUs;
+};
+
+// Profiler class
+class Profiler {
+private:
+	typedef chrono::high_resolution_clock Clock;
+
+	// Data
+	ProfilerPass passes[PROFILER_MAX_PASSES];
+	GLuint passCount;
+	GLint stack[PROFILER_MAX_DEPTH];
+	GLuint depth;
+	GLuint frame;
+	GLuint setFrame[PROFILER_FRAMES];		// frame number that wrote each set
+	GLuint resolvedFrame;					// newest frame read back
+	GLuint historyPos;
+	GLuint64 gpuOrigin;
+	Clock::time_point cpuOrigin;
+	vector<TraceEvent> trace;
+	GLuint captureFirst, captureLast;		// frames being captured
+	string capturePath;						// empty = written by the caller
+
+	// Functions
+	GLint findPass(const char* name);
+	GLdouble cpuNow();
+	bool resolve(GLuint set, bool wait);
+
+public:
+	Profiler();
+	void BeginFrame();
+	void EndFrame(bool wait = false);
+	GLint Begin(const char* name);
+	void End();
+	void Capture(GLuint frames, const char* path = nullptr);
+	bool WriteChromeTrace(const char* path);
+	void DrawGui();
+
+	GLuint PassCount();
+	const ProfilerPass& Pass(GLuint i);
+	GLuint Frame();
+	GLdouble FrameGpuMs();
+};
+
+// Scoped helper: times the enclosing block as a named pass
+class ProfileScope {
+private:
+	Profiler& profiler;
+
+public:
+	ProfileScope(Profiler& profiler, const char* name) : profiler(profiler) {
+		profiler.Begin(name);
+	}
+	~ProfileScope() {
+		profiler.End();
+	}
+};
+
+// Constructor
+Profiler::Profiler() {
+	this->passCount = 0;
+	this->depth = 0;
+	this->frame = 0;
+	this->historyPos = 0;
+	this->resolvedFrame = 0;
+	this->gpuOrigin = 0;
+	this->captureFirst = 1;
+	this->captureLast = 0;
+	for (GLuint i = 0; i < PROFILER_FRAMES; i++)
+		this->setFrame[i] = 0;
+	this->cpuOrigin = Clock::now();
+}
+
+GLdouble Profiler::cpuNow() {
+	return chrono::duration<double, milli>(Clock::now() - this->cpuOrigin).count();
+}
+
+// Find a pass by name, creating it on first use. Pass names are expected to
+// be string literals, so the pointer compare catches nearly every lookup.
+GLint Profiler::findPass(const char* name) {
+	for (GLuint i = 0; i < this->passCount; i++) {
+		if (this->passes[i].name == name || strcmp(this->passes[i].name, name) == 0)
+			return i;
+	}
+	if (this->passCount == PROFILER_MAX_PASSES)
+		return -1;
+
+	ProfilerPass& pass = this->passes[this->passCount];
+	memset(&pass, 0, sizeof(ProfilerPass));
+	pass.name = name;
+	glGenQueries(PROFILER_FRAMES * 2, &pass.queries[0][0]);
+	return this->passCount++;
+}
+
+// Read back one query set. Without wait, the set is only read if every
+// result is already available, so the GPU is never waited on.
+bool Profiler::resolve(GLuint set, bool wait) {
+	bool pending = false;
+	for (GLuint i = 0; i < this->passCount; i++) {
+		if (!this->passes[i].issued[set])
+			continue;
+		GLint available = GL_TRUE;
+		if (!wait)
+			glGetQueryObjectiv(this->passes[i].queries[set][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+		pending = true;
+	}
+	if (!pending)
+		return false;
+
+	bool captured = this->setFrame[set] >= this->captureFirst && this->setFrame[set] <= this->captureLast;
+	for (GLuint i = 0; i < this->passCount; i++) {
+		ProfilerPass& pass = this->passes[i];
+		if (!pass.issued[set]) {
+			// Pass was skipped that frame
+			pass.history[this->historyPos] = 0.0f;
+			continue;
+		}
+		GLuint64 begin, end;
+		glGetQueryObjectui64v(pass.queries[set][0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(pass.queries[set][1], GL_QUERY_RESULT, &end);
+		if (this->gpuOrigin == 0)
+			this->gpuOrigin = begin;
+
+		pass.lastGpuMs = (end - begin) / 1.0e6;
+		pass.lastCpuMs = pass.cpuEnd[set] - pass.cpuBegin[set];
+		pass.lastFrame = this->setFrame[set];
+		pass.history[this->historyPos] = (GLfloat)pass.lastGpuMs;
+		if (pass.historyCount < PROFILER_HISTORY)
+			pass.historyCount++;
+		pass.issued[set] = false;
+
+		if (captured) {
+			TraceEvent cpu = { pass.name, 0, pass.cpuBegin[set] * 1000.0, pass.lastCpuMs * 1000.0 };
+			TraceEvent gpu = { pass.name, 1, (begin - this->gpuOrigin) / 1000.0, (end - begin) / 1000.0 };
+			this->trace.push_back(cpu);
+			this->trace.push_back(gpu);
+		}
+	}
+	this->historyPos = (this->historyPos + 1) % PROFILER_HISTORY;
+	if (this->setFrame[set] > this->resolvedFrame)
+		this->resolvedFrame = this->setFrame[set];
+
+	// Finish an export once its last frame is in
+	if (captured && this->setFrame[set] == this->captureLast && !this->capturePath.empty()) {
+		this->WriteChromeTrace(this->capturePath.c_str());
+		this->trace.clear();
+		this->capturePath.clear();
+	}
+	return true;
+}
+
+// Start a frame. The query set about to be reused still holds the results of
+// frame N - PROFILER_FRAMES, which are picked up here if EndFrame missed them.
+void Profiler::BeginFrame() {
+	this->frame++;
+	GLuint set = this->frame % PROFILER_FRAMES;
+	if (!this->resolve(set, false)) {
+		// Still not back after a full frame: drop it rather than stall
+		for (GLuint i = 0; i < this->passCount; i++)
+			this->passes[i].issued[set] = false;
+	}
+	this->setFrame[set] = this->frame;
+	this->depth = 0;
+}
+
+// Finish a frame and collect every set that is ready. Passing wait = true
+// blocks until this frame's results are back (used by headless benchmarks).
+void Profiler::EndFrame(bool wait) {
+	for (GLuint i = 1; i <= PROFILER_FRAMES; i++) {
+		GLuint set = (this->frame + i) % PROFILER_FRAMES;
+		bool current = (set == this->frame % PROFILER_FRAMES);
+		if (current && !wait)
+			continue;
+		this->resolve(set, current && wait);
+	}
+}
+
+// Begin timing a pass. Passes may nest up to PROFILER_MAX_DEPTH deep.
+GLint Profiler::Begin(const char* name) {
+	if (this->depth == PROFILER_MAX_DEPTH)
+		return -1;
+	GLint index = this->findPass(name);
+	this->stack[this->depth++] = index;
+	if (index < 0)
+		return -1;
+
+	GLuint set = this->frame % PROFILER_FRAMES;
+	ProfilerPass& pass = this->passes[index];
+	glQueryCounter(pass.queries[set][0], GL_TIMESTAMP);
+	pass.cpuBegin[set] = this->cpuNow();
+	return index;
+}
+
+// End the innermost pass
+void Profiler::End() {
+	if (this->depth == 0)
+		return;
+
+	GLint index = this->stack[--this->depth];
+	if (index < 0)
+		return;
+
+	GLuint set = this->frame % PROFILER_FRAMES;
+	ProfilerPass& pass = this->passes[index];
+	pass.cpuEnd[set] = this->cpuNow();
+	glQueryCounter(pass.queries[set][1], GL_TIMESTAMP);
+	pass.issued[set] = true;
+}
+
+// Record the next few frames, from the next BeginFrame on. With a path they
+// are written as a Chrome trace once the last one is read back; without one
+// the caller writes them (headless runs do, after the frame loop, so the
+// file is not written during a measured frame). Room for every event is
+// reserved here.
+void Profiler::Capture(GLuint frames, const char* path) {
+	this->trace.clear();
+	this->trace.reserve(frames * PROFILER_MAX_PASSES * 2);
+	this->captureFirst = this->frame + 1;
+	this->captureLast = this->frame + frames;
+	this->capturePath = path ? path : "";
+}
+
+// Write captured events in the Chrome trace event format
+bool Profiler::WriteChromeTrace(const char* path) {
+	ofstream out(path);
+	if (!out) {
+		cout << "ERROR::PROFILER::TRACE_NOT_WRITTEN " << path << endl;
+		return false;
+	}
+
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"
+		<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"CPU\"}},\n"
+		<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"GPU\"}}";
+	for (GLuint i = 0; i < this->trace.size(); i++) {
+		const TraceEvent& e = this->trace[i];
+		out << ",\n{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << e.thread
+			<< ", \"ts\": " << e.beginUs << ", \"dur\": " << e.durationUs << "}";
+	}
+	out << "\n]}" << endl;
+	cout << "Profiler trace written to " << path << endl;
+	return true;
+}
+
+// Rolling per-pass GPU histogram for the ImGui panel
+void Profiler::DrawGui() {
+	ImGui::Text("GPU Profiler (ms, last %d frames):", PROFILER_HISTORY);
+	for (GLuint i = 0; i < this->passCount; i++) {
+		const ProfilerPass& pass = this->passes[i];
+		GLfloat peak = 0.0f;
+		for (GLuint j = 0; j < pass.historyCount; j++)
+			peak = pass.history[j] > peak ? pass.history[j] : peak;
+
+		char overlay[64];
+		snprintf(overlay, sizeof(overlay), "gpu %.3f | cpu %.3f", pass.lastGpuMs, pass.lastCpuMs);
+		ImGui::PlotHistogram(pass.name, pass.history, PROFILER_HISTORY, this->historyPos, overlay,
+			0.0f, peak * 1.2f + 0.001f, ImVec2(280, 40));
+	}
+	if (ImGui::Button("Export Chrome Trace (120 frames)"))
+		this->Capture(120, "profile_trace.json");
+}
+
+GLuint Profiler::PassCount() {
+	return this->passCount;
+}
+
+const ProfilerPass& Profiler::Pass(GLuint i) {
+	return this->passes[i];
+}
+
+GLuint Profiler::Frame() {
+	return this->frame;
+}
+
+// GPU time of every pass of the newest frame read back (0 before the first)
+GLdouble Profiler::FrameGpuMs() {
+	GLdouble total = 0.0;
+	for (GLuint i = 0; i < this->passCount; i++) {
+		if (this->passes[i].lastFrame == this->resolvedFrame && this->resolvedFrame > 0)
+			total += this->passes[i].lastGpuMs;
+	}
+	return total;
+}
@@ -0,0 +1,543 @@
+// ============================================================================
+//
+// RenderGraph.h
+// -----------------------------------
+//
+// RENDER GRAPH HEADER FILE
+//
+// The frame's GPU passes, declared with what they read and write instead of
+// in a hand-kept order. The graph is declared again every frame (sizes and
+// settings change), then compiled: passes nothing presented depends on are
+// culled, the rest are ordered so that passes drawing into the same targets
+// run back to back, and every transient texture gets a lifetime from the
+// first pass that uses it to the last. Execute() takes each transient from
+// the RenderTargetPool right before its first pass and hands it back after
+// its last one, so textures whose lifetimes do not overlap share memory,
+// and binds each pass's framebuffer only when it differs from the one that
+// is bound. Declaring, compiling and running the graph does not allocate.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <iostream>
+#include <iomanip>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+// Other includes
+#include "RenderTargets.h"
+#include "Profiler.h"
+
+using namespace std;
+
+// Graph limits (pass sets are kept as bit masks)
+const GLuint RENDER_GRAPH_MAX_PASSES = 16;
+const GLuint RENDER_GRAPH_MAX_RESOURCES = 16;
+const GLuint RENDER_GRAPH_MAX_READS = 4;
+const GLuint RENDER_GRAPH_MAX_WRITES = 4;
+
+typedef void (*RenderPassFunc)(void* context);
+
+// A texture (or, imported, any other GPU object) passes hand to each other
+struct GraphResource {
+	const char* name;
+	RenderTargetDesc desc;
+	GLuint texture;				// transient: from its first pass to its last
+	GLboolean imported;			// owned outside the graph, never pooled
+	GLuint first, last;			// positions in the execution order
+};
+
+// One pass. Attachments are bound by the graph; resources given to Write
+// are rendered by the pass itself, into framebuffers of its own.
+struct GraphPass {
+	const char* name;
+	RenderPassFunc func;
+	void* context;
+	GLuint reads[RENDER_GRAPH_MAX_READS];
+	GLuint readCount;
+	GLuint writes[RENDER_GRAPH_MAX_WRITES];		// attachments included
+	GLuint writeCount;
+	GLuint colors[RENDER_TARGET_MAX_COLORS];
+	GLuint colorCount;
+	GLuint depth;				// RENDER_GRAPH_MAX_RESOURCES = none
+	GLbitfield clear;			// glClear mask once the attachments are bound
+	GLboolean present;			// draws into the default framebuffer
+	GLboolean ownTargets;		// binds framebuffers itself
+	GLsizei presentWidth, presentHeight;
+	GLuint dependencies;		// mask of earlier passes it must follow
+	GLint profile;				// profiler pass of the last run
+};
+
+// Render graph class
+class RenderGraph {
+private:
+	// Data
+	RenderTargetPool* targets;
+	GraphPass passes[RENDER_GRAPH_MAX_PASSES];
+	GraphResource resources[RENDER_GRAPH_MAX_RESOURCES];
+	GLuint passCount, resourceCount;
+	GLuint alive;				// mask of passes that are not culled
+	GLuint order[RENDER_GRAPH_MAX_PASSES];
+	GLuint orderCount;
+	GLuint binds, declaredBinds;
+
+	// Functions
+	template<class Body>
+	static void invoke(void* context) {
+		(*(Body*)context)();
+	}
+
+	GLuint addPass(const char* name, RenderPassFunc func, void* context);
+	void addWrite(GLuint pass, GLuint resource);
+	bool valid(GLuint pass, GLuint resource) const;
+	bool draws(const GraphPass& pass) const;
+	bool sameTargets(const GraphPass& a, const GraphPass& b) const;
+	bool loads(const GraphPass& pass, GLuint resource) const;
+	bool touches(const GraphPass& pass, GLuint resource, bool writeOnly) const;
+	void cull();
+	void schedule();
+	GLuint countBinds(const GLuint* passes, GLuint count) const;
+	GLuint64 liveBytes(GLuint position) const;
+
+public:
+	RenderGraph();
+	void Init(RenderTargetPool& targets);
+	void Reset();
+
+	// Resources: a transient texture made to desc, or an outside object
+	GLuint Create(const char* name, const RenderTargetDesc& desc);
+	GLuint Import(const char* name, GLuint object);
+
+	// Add a pass that calls body(). The body must outlive the graph.
+	template<class Body>
+	GLuint AddPass(const char* name, Body& body) {
+		return this->addPass(name, &RenderGraph::invoke<Body>, &body);
+	}
+
+	// What a pass uses
+	void Read(GLuint pass, GLuint resource);
+	void Write(GLuint pass, GLuint resource);
+	void Color(GLuint pass, GLuint resource);
+	void Depth(GLuint pass, GLuint resource);
+	void Clear(GLuint pass, GLbitfield mask);
+	void Present(GLuint pass, GLsizei width, GLsizei height);
+
+	void Compile();
+	void Execute(Profiler& profiler);
+
+	GLuint Texture(GLuint resource) const;
+	GLuint PassCount() const;
+	GLuint CulledCount() const;
+	GLuint FramebufferBinds() const;
+	void Report(ostream& out, Profiler& profiler) const;
+};
+
+// Constructor
+RenderGraph::RenderGraph() {
+	this->targets = nullptr;
+	this->Reset();
+}
+
+void RenderGraph::Init(RenderTargetPool& targets) {
+	this->targets = &targets;
+}
+
+// Forget the last frame's passes and resources. Transients have all been
+// handed back by then.
+void RenderGraph::Reset() {
+	this->passCount = this->resourceCount = 0;
+	this->alive = 0;
+	this->orderCount = 0;
+	this->binds = this->declaredBinds = 0;
+}
+
+// Returns the new resource's id, or RENDER_GRAPH_MAX_RESOURCES when full
+GLuint RenderGraph::Create(const char* name, const RenderTargetDesc& desc) {
+	if (this->resourceCount == RENDER_GRAPH_MAX_RESOURCES) {
+		cout << "ERROR::RENDER_GRAPH::TOO_MANY_RESOURCES " << name << endl;
+		return RENDER_GRAPH_MAX_RESOURCES;
+	}
+	GraphResource& resource = this->resources[this->resourceCount];
+	resource.name = name;
+	resource.desc = desc;
+	resource.texture = 0;
+	resource.imported = false;
+	resource.first = resource.last = RENDER_GRAPH_MAX_PASSES;
+	return this->resourceCount++;
+}
+
+// Outside objects only order the passes that use them (a buffer written by
+// one pass and read by another, say)
+GLuint RenderGraph::Import(const char* name, GLuint object) {
+	RenderTargetDesc none = { 0, 0, GL_NONE };
+	GLuint id = this->Create(name, none);
+	if (id < RENDER_GRAPH_MAX_RESOURCES) {
+		this->resources[id].texture = object;
+		this->resources[id].imported = true;
+	}
+	return id;
+}
+
+// Returns the new pass's id, or RENDER_GRAPH_MAX_PASSES when the graph is full
+GLuint RenderGraph::addPass(const char* name, RenderPassFunc func, void* context) {
+	if (this->passCount == RENDER_GRAPH_MAX_PASSES) {
+		cout << "ERROR::RENDER_GRAPH::TOO_MANY_PASSES " << name << endl;
+		return RENDER_GRAPH_MAX_PASSES;
+	}
+	GraphPass& pass = this->passes[this->passCount];
+	pass.name = name;
+	pass.func = func;
+	pass.context = context;
+	pass.readCount = pass.writeCount = pass.colorCount = 0;
+	pass.depth = RENDER_GRAPH_MAX_RESOURCES;
+	pass.clear = 0;
+	pass.present = pass.ownTargets = false;
+	pass.presentWidth = pass.presentHeight = 0;
+	pass.dependencies = 0;
+	pass.profile = -1;
+	return this->passCount++;
+}
+
+bool RenderGraph::valid(GLuint pass, GLuint resource) const {
+	return pass < this->passCount && resource < this->resourceCount;
+}
+
+void RenderGraph::Read(GLuint pass, GLuint resource) {
+	if (!this->valid(pass, resource))
+		return;
+	GraphPass& p = this->passes[pass];
+	if (p.readCount == RENDER_GRAPH_MAX_READS) {
+		cout << "ERROR::RENDER_GRAPH::TOO_MANY_READS " << p.name << endl;
+		return;
+	}
+	p.reads[p.readCount++] = resource;
+}
+
+void RenderGraph::addWrite(GLuint pass, GLuint resource) {
+	GraphPass& p = this->passes[pass];
+	if (p.writeCount == RENDER_GRAPH_MAX_WRITES) {
+		cout << "ERROR::RENDER_GRAPH::TOO_MANY_WRITES " << p.name << endl;
+		return;
+	}
+	p.writes[p.writeCount++] = resource;
+}
+
+// The pass renders the resource itself (a transient texture means it binds
+// framebuffers of its own)
+void RenderGraph::Write(GLuint pass, GLuint resource) {
+	if (!this->valid(pass, resource))
+		return;
+	this->addWrite(pass, resource);
+	if (!this->resources[resource].imported)
+		this->passes[pass].ownTargets = true;
+}
+
+// Next color attachment of the pass's framebuffer
+void RenderGraph::Color(GLuint pass, GLuint resource) {
+	if (!this->valid(pass, resource))
+		return;
+	GraphPass& p = this->passes[pass];
+	if (p.colorCount == RENDER_TARGET_MAX_COLORS) {
+		cout << "ERROR::RENDER_GRAPH::TOO_MANY_COLORS " << p.name << endl;
+		return;
+	}
+	p.colors[p.colorCount++] = resource;
+	this->addWrite(pass, resource);
+}
+
+void RenderGraph::Depth(GLuint pass, GLuint resource) {
+	if (!this->valid(pass, resource))
+		return;
+	this->passes[pass].depth = resource;
+	this->addWrite(pass, resource);
+}
+
+// Clear the attachments before the pass runs. Attachments that are not
+// cleared keep what earlier passes drew, so they count as read too.
+void RenderGraph::Clear(GLuint pass, GLbitfield mask) {
+	if (pass < this->passCount)
+		this->passes[pass].clear = mask;
+}
+
+// The pass draws into the default framebuffer (a width x height viewport).
+// Presenting passes are what the rest of the graph is kept alive for.
+void RenderGraph::Present(GLuint pass, GLsizei width, GLsizei height) {
+	if (pass >= this->passCount)
+		return;
+	this->passes[pass].present = true;
+	this->passes[pass].presentWidth = width;
+	this->passes[pass].presentHeight = height;
+}
+
+// Passes the graph binds a framebuffer for
+bool RenderGraph::draws(const GraphPass& pass) const {
+	return pass.present || pass.colorCount > 0 || pass.depth < RENDER_GRAPH_MAX_RESOURCES;
+}
+
+bool RenderGraph::sameTargets(const GraphPass& a, const GraphPass& b) const {
+	if (a.present || b.present)
+		return a.present && b.present;
+	if (a.colorCount != b.colorCount || a.depth != b.depth)
+		return false;
+	for (GLuint i = 0; i < a.colorCount; i++) {
+		if (a.colors[i] != b.colors[i])
+			return false;
+	}
+	return true;
+}
+
+// An attachment the pass draws over without clearing first
+bool RenderGraph::loads(const GraphPass& pass, GLuint resource) const {
+	for (GLuint i = 0; i < pass.colorCount; i++) {
+		if (pass.colors[i] == resource)
+			return !(pass.clear & GL_COLOR_BUFFER_BIT);
+	}
+	if (pass.depth == resource)
+		return !(pass.clear & GL_DEPTH_BUFFER_BIT);
+	return false;
+}
+
+bool RenderGraph::touches(const GraphPass& pass, GLuint resource, bool writeOnly) const {
+	for (GLuint i = 0; i < pass.writeCount; i++) {
+		if (pass.writes[i] == resource)
+			return true;
+	}
+	for (GLuint i = 0; i < pass.readCount && !writeOnly; i++) {
+		if (pass.reads[i] == resource)
+			return true;
+	}
+	return false;
+}
+
+// Walk back from the presenting passes. A pass stays if a later pass that
+// stays reads something it writes; an attachment cleared by a pass that
+// stays is not needed from before it.
+void RenderGraph::cull() {
+	bool needed[RENDER_GRAPH_MAX_RESOURCES] = {};
+	this->alive = 0;
+	for (GLint i = this->passCount - 1; i >= 0; i--) {
+		const GraphPass& pass = this->passes[i];
+		bool keep = pass.present;
+		for (GLuint j = 0; j < pass.writeCount && !keep; j++)
+			keep = needed[pass.writes[j]];
+		if (!keep)
+			continue;
+		this->alive |= 1u << i;
+		for (GLuint j = 0; j < pass.writeCount; j++)
+			needed[pass.writes[j]] = this->loads(pass, pass.writes[j]);
+		for (GLuint j = 0; j < pass.readCount; j++)
+			needed[pass.reads[j]] = true;
+	}
+}
+
+// Each pass follows the earlier passes that write what it uses or read
+// what it writes. Of the passes that are ready, one that draws into the
+// targets already bound goes first, else the earliest declared. Passes that
+// draw into nothing (buffer work) leave the binding alone, so they keep
+// their declared place.
+void RenderGraph::schedule() {
+	for (GLuint i = 0; i < this->passCount; i++) {
+		GraphPass& pass = this->passes[i];
+		pass.dependencies = 0;
+		for (GLuint j = 0; j < i; j++) {
+			const GraphPass& earlier = this->passes[j];
+			bool depends = false;
+			for (GLuint k = 0; k < pass.readCount && !depends; k++)
+				depends = this->touches(earlier, pass.reads[k], true);
+			for (GLuint k = 0; k < pass.writeCount && !depends; k++)
+				depends = this->touches(earlier, pass.writes[k], false);
+			if (depends)
+				pass.dependencies |= 1u << j;
+		}
+	}
+
+	GLuint done = 0;
+	const GraphPass* bound = nullptr;
+	this->orderCount = 0;
+	while (done != this->alive) {
+		GLint pick = -1;
+		for (GLuint i = 0; i < this->passCount; i++) {
+			const GraphPass& pass = this->passes[i];
+			bool ready = (this->alive & ~done & (1u << i)) && !(pass.dependencies & this->alive & ~done);
+			if (!ready)
+				continue;
+			if (pick < 0)
+				pick = i;
+			if (bound && this->draws(pass) && this->sameTargets(pass, *bound)) {
+				pick = i;
+				break;
+			}
+		}
+		const GraphPass& pass = this->passes[pick];
+		if (this->draws(pass))
+			bound = &pass;
+		else if (pass.ownTargets)
+			bound = nullptr;
+		done |= 1u << pick;
+		this->order[this->orderCount++] = pick;
+	}
+}
+
+// Framebuffer binds a run in this order makes
+GLuint RenderGraph::countBinds(const GLuint* passes, GLuint count) const {
+	GLuint binds = 0;
+	const GraphPass* bound = nullptr;
+	for (GLuint i = 0; i < count; i++) {
+		const GraphPass& pass = this->passes[passes[i]];
+		if (this->draws(pass)) {
+			if (!bound || !this->sameTargets(pass, *bound))
+				binds++;
+			bound = &pass;
+		}
+		else if (pass.ownTargets)
+			bound = nullptr;
+	}
+	return binds;
+}
+
+// Cull, order, and give every transient its first and last pass
+void RenderGraph::Compile() {
+	this->cull();
+	this->schedule();
+
+	GLuint declared[RENDER_GRAPH_MAX_PASSES], declaredCount = 0;
+	for (GLuint i = 0; i < this->passCount; i++) {
+		if (this->alive & (1u << i))
+			declared[declaredCount++] = i;
+	}
+	this->binds = this->countBinds(this->order, this->orderCount);
+	this->declaredBinds = this->countBinds(declared, declaredCount);
+
+	for (GLuint r = 0; r < this->resourceCount; r++) {
+		GraphResource& resource = this->resources[r];
+		resource.first = resource.last = RENDER_GRAPH_MAX_PASSES;
+		for (GLuint i = 0; i < this->orderCount; i++) {
+			if (!this->touches(this->passes[this->order[i]], r, false))
+				continue;
+			if (resource.first == RENDER_GRAPH_MAX_PASSES)
+				resource.first = i;
+			resource.last = i;
+		}
+	}
+}
+
+// Run the passes in order, each timed as a profiler pass of its own name
+void RenderGraph::Execute(Profiler& profiler) {
+	const GraphPass* bound = nullptr;
+	for (GLuint i = 0; i < this->orderCount; i++) {
+		GraphPass& pass = this->passes[this->order[i]];
+		for (GLuint r = 0; r < this->resourceCount; r++) {
+			GraphResource& resource = this->resources[r];
+			if (!resource.imported && resource.first == i)
+				resource.texture = this->targets->Acquire(resource.desc);
+		}
+
+		if (this->draws(pass) && (!bound || !this->sameTargets(pass, *bound))) {
+			if (pass.present) {
+				glBindFramebuffer(GL_FRAMEBUFFER, 0);
+				glViewport(0, 0, pass.presentWidth, pass.presentHeight);
+			}
+			else {
+				GLuint colors[RENDER_TARGET_MAX_COLORS];
+				for (GLuint j = 0; j < pass.colorCount; j++)
+					colors[j] = this->resources[pass.colors[j]].texture;
+				bool depth = pass.depth < RENDER_GRAPH_MAX_RESOURCES;
+				const RenderTargetDesc& size = this->resources[pass.colorCount ? pass.colors[0] : pass.depth].desc;
+				glBindFramebuffer(GL_FRAMEBUFFER, this->targets->Framebuffer(colors, pass.colorCount, depth ? this->resources[pass.depth].texture : 0));
+				glViewport(0, 0, size.width, size.height);
+			}
+		}
+		if (this->draws(pass))
+			bound = &pass;
+		if (pass.clear)
+			glClear(pass.clear);
+
+		pass.profile = profiler.Begin(pass.name);
+		pass.func(pass.context);
+		profiler.End();
+		if (pass.ownTargets)
+			bound = nullptr;
+
+		for (GLuint r = 0; r < this->resourceCount; r++) {
+			GraphResource& resource = this->resources[r];
+			if (!resource.imported && resource.last == i) {
+				this->targets->Release(resource.texture);
+				resource.texture = 0;
+			}
+		}
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Texture of a resource; transients only have one while their passes run
+GLuint RenderGraph::Texture(GLuint resource) const {
+	return resource < this->resourceCount ? this->resources[resource].texture : 0;
+}
+
+GLuint RenderGraph::PassCount() const {
+	return this->passCount;
+}
+
+GLuint RenderGraph::CulledCount() const {
+	return this->passCount - this->orderCount;
+}
+
+GLuint RenderGraph::FramebufferBinds() const {
+	return this->binds;
+}
+
+// Memory of the transients alive while the pass at this position runs
+GLuint64 RenderGraph::liveBytes(GLuint position) const {
+	GLuint64 bytes = 0;
+	for (GLuint r = 0; r < this->resourceCount; r++) {
+		const GraphResource& resource = this->resources[r];
+		if (!resource.imported && resource.first <= position && position <= resource.last && resource.last < RENDER_GRAPH_MAX_PASSES)
+			bytes += RenderTargetPool::TargetBytes(resource.desc);
+	}
+	return bytes;
+}
+
+// The last frame's passes in the order they ran, with their profiler times
+// and the transient memory alive during each, then the culled ones
+void RenderGraph::Report(ostream& out, Profiler& profiler) const {
+	GLuint64 total = 0, peak = 0;
+	for (GLuint r = 0; r < this->resourceCount; r++) {
+		const GraphResource& resource = this->resources[r];
+		if (!resource.imported && resource.first < RENDER_GRAPH_MAX_PASSES)
+			total += RenderTargetPool::TargetBytes(resource.desc);
+	}
+	for (GLuint i = 0; i < this->orderCount; i++)
+		peak = max(peak, this->liveBytes(i));
+
+	out << "Render graph: " << this->orderCount << " passes, " << this->CulledCount() << " culled, "
+		<< this->binds << " framebuffer binds (" << this->declaredBinds << " in declared order)" << endl;
+	ios::fmtflags flags = out.flags();
+	streamsize precision = out.precision();
+	out << fixed << setprecision(3);
+	for (GLuint i = 0; i < this->orderCount; i++) {
+		const GraphPass& pass = this->passes[this->order[i]];
+		out << "  " << left << setw(12) << pass.name << right;
+		if (pass.profile >= 0) {
+			const ProfilerPass& timing = profiler.Pass(pass.profile);
+			out << " gpu " << setw(8) << timing.lastGpuMs << " ms, cpu " << setw(7) << timing.lastCpuMs << " ms";
+		}
+		out << ", " << setprecision(1) << setw(6) << this->liveBytes(i) / 1048576.0 << " MB live:" << setprecision(3);
+		for (GLuint r = 0; r < this->resourceCount; r++) {
+			const GraphResource& resource = this->resources[r];
+			if (!resource.imported && resource.first <= i && i <= resource.last && resource.last < RENDER_GRAPH_MAX_PASSES)
+				out << " " << resource.name;
+		}
+		out << endl;
+	}
+	for (GLuint i = 0; i < this->passCount; i++) {
+		if (!(this->alive & (1u << i)))
+			out << "  " << left << setw(12) << this->passes[i].name << right << " culled" << endl;
+	}
+	out << setprecision(1) << "  transients " << total / 1048576.0 << " MB if each had its own texture, "
+		<< peak / 1048576.0 << " MB alive at most" << endl;
+	out.flags(flags);
+	out.precision(precision);
+}
@@ -0,0 +1,284 @@
+// ============================================================================
+//
+// RenderTargets.h
+// -----------------------------------
+//
+// RENDER TARGETS HEADER FILE
+//
+// Pool of the frame's intermediate textures. Passes ask for a target by
+// size and format and hand it back after its last use; a target handed
+// back is given to the next request with the same descriptor, in the same
+// frame or a later one, so passes whose lifetimes do not overlap share
+// memory and nothing is reallocated from frame to frame. Targets nobody has
+// asked for in a while (sizes left behind by a resize or a resolution
+// change) are deleted. Framebuffers over pooled textures are cached too.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+using namespace std;
+
+// Frames a free target is kept before it is deleted
+const GLuint RENDER_TARGET_KEEP_FRAMES = 60;
+
+// Most color attachments of a cached framebuffer
+const GLuint RENDER_TARGET_MAX_COLORS = 2;
+
+// What a target is: size and internal format
+struct RenderTargetDesc {
+	GLsizei width, height;
+	GLenum format;
+};
+
+// Pool memory and activity (bytes are estimates: texels x format size)
+struct RenderTargetStats {
+	GLuint targets;				// textures held
+	GLuint inUse;				// of which currently acquired
+	GLuint64 residentBytes;		// memory of every texture held
+	GLuint64 peakBytes;			// most memory in use at once, last frame
+	GLuint64 requestedBytes;	// every acquire of the last frame, unshared
+	GLuint created, deleted;	// textures over the pool's lifetime
+};
+
+// Render Target Pool class
+class RenderTargetPool {
+private:
+	struct Target {
+		RenderTargetDesc desc;
+		GLuint texture;
+		GLuint framebuffer;		// single attachment, made on first use
+		GLboolean inUse;
+		GLuint lastUse;			// frame
+	};
+
+	struct Attachments {
+		GLuint colors[RENDER_TARGET_MAX_COLORS];
+		GLuint colorCount;
+		GLuint depth;
+		GLuint framebuffer;
+	};
+
+	// Data
+	vector<Target> targets;
+	vector<Attachments> framebuffers;
+	GLuint frame;
+	GLuint64 inUseBytes, framePeak, frameRequested;
+	GLuint64 lastPeak, lastRequested;
+	GLuint created, deleted;
+
+	// Functions
+	GLint find(GLuint texture) const;
+	void destroy(GLuint index);
+	static bool isDepth(GLenum format);
+
+public:
+	RenderTargetPool();
+	GLuint Acquire(const RenderTargetDesc& desc);
+	void Release(GLuint texture);
+	GLuint Framebuffer(GLuint texture);
+	GLuint Framebuffer(const GLuint* colors, GLuint colorCount, GLuint depth);
+	void EndFrame();
+	RenderTargetStats Stats() const;
+
+	static GLuint64 TargetBytes(const RenderTargetDesc& desc);
+};
+
+// Constructor
+RenderTargetPool::RenderTargetPool() {
+	this->frame = 0;
+	this->inUseBytes = this->framePeak = this->frameRequested = 0;
+	this->lastPeak = this->lastRequested = 0;
+	this->created = this->deleted = 0;
+}
+
+bool RenderTargetPool::isDepth(GLenum format) {
+	return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F;
+}
+
+// Estimated size. Drivers pad three channel formats to four.
+GLuint64 RenderTargetPool::TargetBytes(const RenderTargetDesc& desc) {
+	GLuint texel;
+	switch (desc.format) {
+	case GL_RGBA32F: texel = 16; break;
+	case GL_RGBA16F: case GL_RGB16F: texel = 8; break;
+	case GL_DEPTH_COMPONENT16: texel = 2; break;
+	default: texel = 4; break;		// RGBA8, R11F_G11F_B10F, 24 / 32 bit depth
+	}
+	return (GLuint64)desc.width * desc.height * texel;
+}
+
+GLint RenderTargetPool::find(GLuint texture) const {
+	for (GLuint i = 0; i < this->targets.size(); i++) {
+		if (this->targets[i].texture == texture)
+			return i;
+	}
+	return -1;
+}
+
+// A free target with this descriptor, or a new one
+GLuint RenderTargetPool::Acquire(const RenderTargetDesc& desc) {
+	GLint index = -1;
+	for (GLuint i = 0; i < this->targets.size() && index < 0; i++) {
+		const Target& t = this->targets[i];
+		if (!t.inUse && t.desc.width == desc.width && t.desc.height == desc.height && t.desc.format == desc.format)
+			index = i;
+	}
+
+	if (index < 0) {
+		Target target;
+		target.desc = desc;
+		target.framebuffer = 0;
+		GLenum filter = isDepth(desc.format) ? GL_NEAREST : GL_LINEAR;
+		glGenTextures(1, &target.texture);
+		glBindTexture(GL_TEXTURE_2D, target.texture);
+		glTexImage2D(GL_TEXTURE_2D, 0, desc.format, desc.width, desc.height, 0,
+			isDepth(desc.format) ? GL_DEPTH_COMPONENT : GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		index = this->targets.size();
+		this->targets.push_back(target);
+		this->created++;
+	}
+
+	Target& target = this->targets[index];
+	target.inUse = true;
+	target.lastUse = this->frame;
+	GLuint64 bytes = TargetBytes(desc);
+	this->inUseBytes += bytes;
+	this->frameRequested += bytes;
+	this->framePeak = max(this->framePeak, this->inUseBytes);
+	return target.texture;
+}
+
+// Hand a target back after its last use this frame. Its contents stay
+// until it is acquired again.
+void RenderTargetPool::Release(GLuint texture) {
+	GLint index = this->find(texture);
+	if (index < 0 || !this->targets[index].inUse) {
+		cout << "ERROR::RENDER_TARGETS::RELEASE_NOT_ACQUIRED " << texture << endl;
+		return;
+	}
+	this->targets[index].inUse = false;
+	this->inUseBytes -= TargetBytes(this->targets[index].desc);
+}
+
+// Framebuffer with the target as its only attachment (depth formats as
+// the depth attachment, with no color buffer)
+GLuint RenderTargetPool::Framebuffer(GLuint texture) {
+	GLint index = this->find(texture);
+	if (index < 0)
+		return 0;
+	Target& target = this->targets[index];
+	if (target.framebuffer == 0) {
+		glGenFramebuffers(1, &target.framebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, target.framebuffer);
+		if (isDepth(target.desc.format)) {
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
+			glDrawBuffer(GL_NONE);
+		}
+		else
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+	}
+	return target.framebuffer;
+}
+
+// Framebuffer over several targets (depth = 0 for none), made once per
+// combination
+GLuint RenderTargetPool::Framebuffer(const GLuint* colors, GLuint colorCount, GLuint depth) {
+	colorCount = min(colorCount, RENDER_TARGET_MAX_COLORS);
+	for (GLuint i = 0; i < this->framebuffers.size(); i++) {
+		const Attachments& a = this->framebuffers[i];
+		bool same = a.colorCount == colorCount && a.depth == depth;
+		for (GLuint j = 0; j < colorCount && same; j++)
+			same = a.colors[j] == colors[j];
+		if (same)
+			return a.framebuffer;
+	}
+
+	static const GLenum drawBuffers[RENDER_TARGET_MAX_COLORS] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	Attachments a;
+	a.colorCount = colorCount;
+	a.depth = depth;
+	glGenFramebuffers(1, &a.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, a.framebuffer);
+	for (GLuint j = 0; j < colorCount; j++) {
+		a.colors[j] = colors[j];
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + j, GL_TEXTURE_2D, colors[j], 0);
+	}
+	if (depth)
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depth, 0);
+	glDrawBuffers(colorCount, drawBuffers);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		cout << "ERROR::RENDER_TARGETS::FRAMEBUFFER_INCOMPLETE" << endl;
+	this->framebuffers.push_back(a);
+	return a.framebuffer;
+}
+
+// Delete a target and every framebuffer using it
+void RenderTargetPool::destroy(GLuint index) {
+	GLuint texture = this->targets[index].texture;
+	for (GLuint i = 0; i < this->framebuffers.size(); ) {
+		Attachments& a = this->framebuffers[i];
+		bool uses = a.depth == texture;
+		for (GLuint j = 0; j < a.colorCount; j++)
+			uses = uses || a.colors[j] == texture;
+		if (uses) {
+			glDeleteFramebuffers(1, &a.framebuffer);
+			this->framebuffers[i] = this->framebuffers.back();
+			this->framebuffers.pop_back();
+		}
+		else
+			i++;
+	}
+	if (this->targets[index].framebuffer)
+		glDeleteFramebuffers(1, &this->targets[index].framebuffer);
+	glDeleteTextures(1, &texture);
+	this->targets[index] = this->targets.back();
+	this->targets.pop_back();
+	this->deleted++;
+}
+
+// Close the frame's statistics and delete targets left unused for
+// RENDER_TARGET_KEEP_FRAMES
+void RenderTargetPool::EndFrame() {
+	for (GLuint i = 0; i < this->targets.size(); ) {
+		const Target& t = this->targets[i];
+		if (!t.inUse && this->frame - t.lastUse > RENDER_TARGET_KEEP_FRAMES)
+			this->destroy(i);
+		else
+			i++;
+	}
+	this->lastPeak = this->framePeak;
+	this->lastRequested = this->frameRequested;
+	this->framePeak = this->inUseBytes;
+	this->frameRequested = 0;
+	this->frame++;
+}
+
+RenderTargetStats RenderTargetPool::Stats() const {
+	RenderTargetStats stats;
+	stats.targets = this->targets.size();
+	stats.inUse = 0;
+	stats.residentBytes = 0;
+	for (GLuint i = 0; i < this->targets.size(); i++) {
+		stats.inUse += this->targets[i].inUse ? 1 : 0;
+		stats.residentBytes += TargetBytes(this->targets[i].desc);
+	}
+	stats.peakBytes = this->lastPeak;
+	stats.requestedBytes = this->lastRequested;
+	stats.created = this->created;
+	stats.deleted = this->deleted;
+	return stats;
+}
@@ -0,0 +1,50 @@
+// =================================================================
+//
+// bloom_down_fshader.glsl
+// -----------------------------------
+//
+// BLOOM DOWNSAMPLE FRAGMENT SHADER - halve the level above with a
+// 13 tap filter (four overlapping 2x2 boxes around a centre box)
+//
+// =================================================================
+
+#version 330 core
+
+// Input
+in vec2 TexCoords;
+
+// Output
+out vec4 FragColor;
+
+// Level above (or the bright pass)
+uniform sampler2D image;
+
+void main() {
+	// Source texel size
+	vec2 t = 1.0 / textureSize(image, 0);
+
+	// Outer ring, two source texels out
+	vec3 a = texture(image, TexCoords + vec2(-2.0, 2.0) * t).rgb;
+	vec3 b = texture(image, TexCoords + vec2(0.0, 2.0) * t).rgb;
+	vec3 c = texture(image, TexCoords + vec2(2.0, 2.0) * t).rgb;
+	vec3 d = texture(image, TexCoords + vec2(-2.0, 0.0) * t).rgb;
+	vec3 e = texture(image, TexCoords).rgb;
+	vec3 f = texture(image, TexCoords + vec2(2.0, 0.0) * t).rgb;
+	vec3 g = texture(image, TexCoords + vec2(-2.0, -2.0) * t).rgb;
+	vec3 h = texture(image, TexCoords + vec2(0.0, -2.0) * t).rgb;
+	vec3 i = texture(image, TexCoords + vec2(2.0, -2.0) * t).rgb;
+
+	// Inner ring, one source texel out
+	vec3 j = texture(image, TexCoords + vec2(-1.0, 1.0) * t).rgb;
+	vec3 k = texture(image, TexCoords + vec2(1.0, 1.0) * t).rgb;
+	vec3 l = texture(image, TexCoords + vec2(-1.0, -1.0) * t).rgb;
+	vec3 m = texture(image, TexCoords + vec2(1.0, -1.0) * t).rgb;
+
+	// Centre box 0.5, each outer box 0.125 (weights sum to 1)
+	vec3 result = e * 0.125;
+	result += (a + c + g + i) * 0.03125;
+	result += (b + d + f + h) * 0.0625;
+	result += (j + k + l + m) * 0.125;
+
+	FragColor = vec4(result, 1.0);
+}
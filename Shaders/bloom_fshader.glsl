@@ -23,15 +23,27 @@ uniform sampler2D bloomTex;
 uniform float exposure;
 uniform bool bloom;
 uniform bool hdr;
+uniform float bloomScale;	// 1 / level count for the mip chain
+uniform bool overdraw;		// scene holds shaded fragment counts
+
+// Overdraw colors: none, 1 (blue), 2 (green), 3 (yellow), 4 (red), 5+ (white)
+const vec3 HEAT[6] = vec3[](vec3(0.0), vec3(0.0, 0.2, 1.0), vec3(0.0, 0.9, 0.2),
+	vec3(1.0, 0.9, 0.0), vec3(1.0, 0.1, 0.0), vec3(1.0));
 
 void main() {             
 	// Input framebuffer textures for HDR and bloom
 	vec3 hdrColor = texture(scene, TexCoords).rgb;      
+	if (overdraw) {
+		float count = clamp(hdrColor.r, 0.0, 5.0);
+		int level = min(int(count), 4);
+		FragColor = vec4(mix(HEAT[level], HEAT[level + 1], count - float(level)), 1.0);
+		return;
+	}
 	vec3 bloomColor = texture(bloomTex, TexCoords).rgb;
 	
 	// Apply Bloom first
 	if(bloom)
-	hdrColor += bloomColor; 
+	hdrColor += bloomColor * bloomScale; 
 	
 	// Apply HDR adjustments
 	vec3 result = vec3(1.0) - exp(-hdrColor * exposure);
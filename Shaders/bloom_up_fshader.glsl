@@ -0,0 +1,41 @@
+// =================================================================
+//
+// bloom_up_fshader.glsl
+// -----------------------------------
+//
+// BLOOM UPSAMPLE FRAGMENT SHADER - 3x3 tent filter over the level
+// below, added onto the current level by blending
+//
+// =================================================================
+
+#version 330 core
+
+// Input
+in vec2 TexCoords;
+
+// Output
+out vec4 FragColor;
+
+// Level below
+uniform sampler2D image;
+
+// Tent radius in source texels
+uniform float radius;
+
+void main() {
+	// Source texel size
+	vec2 t = radius / textureSize(image, 0);
+
+	// Centre 4, edges 2, corners 1 (over 16)
+	vec3 result = texture(image, TexCoords).rgb * 4.0;
+	result += texture(image, TexCoords + vec2(0.0, t.y)).rgb * 2.0;
+	result += texture(image, TexCoords + vec2(-t.x, 0.0)).rgb * 2.0;
+	result += texture(image, TexCoords + vec2(t.x, 0.0)).rgb * 2.0;
+	result += texture(image, TexCoords + vec2(0.0, -t.y)).rgb * 2.0;
+	result += texture(image, TexCoords + vec2(-t.x, t.y)).rgb;
+	result += texture(image, TexCoords + vec2(t.x, t.y)).rgb;
+	result += texture(image, TexCoords + vec2(-t.x, -t.y)).rgb;
+	result += texture(image, TexCoords + vec2(t.x, -t.y)).rgb;
+
+	FragColor = vec4(result / 16.0, 1.0);
+}
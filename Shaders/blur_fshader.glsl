@@ -19,28 +19,26 @@ out vec4 FragColor;
 uniform sampler2D image;
 uniform bool horizontal;
 
-// Gaussian blur weights
-uniform float weight[5] = float[] (0.22702, 0.19459, 0.12162, 0.05405, 0.01622);
+// Gaussian kernel, merged for bilinear fetches (see GaussianKernel.h).
+// Without defines these are the original 9 tap weights, merged.
+#ifndef BLUR_TAPS
+#define BLUR_TAPS 3
+#define BLUR_WEIGHTS float[](0.2270270270, 0.3162162162, 0.0702702703)
+#define BLUR_OFFSETS float[](0.0, 1.3846153846, 3.2307692308)
+#endif
+const float weight[BLUR_TAPS] = BLUR_WEIGHTS;
+const float offset[BLUR_TAPS] = BLUR_OFFSETS;
 
 void main() {
-	// Get texel
-	vec2 tex_offset = 1.0 / textureSize(image, 0); 
+	// Step between taps in the blur direction
+	vec2 tex_offset = 1.0 / textureSize(image, 0);
+	vec2 direction = horizontal ? vec2(tex_offset.x, 0.0) : vec2(0.0, tex_offset.y);
 	vec3 result = texture(image, TexCoords).rgb * weight[0];
 	
-	// First blur horizontally (5 times total)
-	if(horizontal) {
-		for(int i = 1; i < 5; ++i) {
-			result += texture(image, TexCoords + vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-			result += texture(image, TexCoords - vec2(tex_offset.x * i, 0.0)).rgb * weight[i];
-		}
-	}
-	
-	// Then blur vertically (5 times total)
-	else {
-		for(int i = 1; i < 5; ++i) {
-			result += texture(image, TexCoords + vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-			result += texture(image, TexCoords - vec2(0.0, tex_offset.y * i)).rgb * weight[i];
-		}
+	// Each fetch lands between two texels and picks up both
+	for(int i = 1; i < BLUR_TAPS; ++i) {
+		result += texture(image, TexCoords + direction * offset[i]).rgb * weight[i];
+		result += texture(image, TexCoords - direction * offset[i]).rgb * weight[i];
 	}
 	
 	// Results
@@ -0,0 +1,33 @@
+// =================================================================
+//
+// cull_gshader.glsl
+// -----------------------------------
+//
+// CULL GEOMETRY SHADER - emit only visible instances, so the
+// transform feedback buffer holds a compacted instance list
+//
+// =================================================================
+
+#version 330 core
+
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+// Inputs from vertex shader
+in mat4 vsMatrix[];
+flat in uint vsIndex[];
+flat in int vsVisible[];
+
+// Captured outputs
+out mat4 outMatrix;
+flat out uint outIndex;
+
+// Main function
+void main() {
+	if (vsVisible[0] != 0) {
+		outMatrix = vsMatrix[0];
+		outIndex = vsIndex[0];
+		EmitVertex();
+		EndPrimitive();
+	}
+}
@@ -0,0 +1,42 @@
+// =================================================================
+//
+// cull_vshader.glsl
+// -----------------------------------
+//
+// CULL VERTEX SHADER - test one instance's bounding sphere
+// against the view frustum
+//
+// =================================================================
+
+#version 330 core
+
+// Inputs (one vertex per instance)
+layout (location = 0) in mat4 instanceMatrix;
+
+// Outputs
+out mat4 vsMatrix;
+flat out uint vsIndex;
+flat out int vsVisible;
+
+// Input Uniforms
+uniform mat4 model;			// transform shared by every instance
+uniform vec4 bounds;		// mesh bounding sphere: xyz = center, w = radius
+uniform vec4 planes[6];		// frustum planes: xyz = normal, w = distance
+
+// Main function
+void main() {
+	// World-space sphere, scaled by the largest axis scale
+	mat4 world = model * instanceMatrix;
+	vec3 center = vec3(world * vec4(bounds.xyz, 1.0));
+	float scale = sqrt(max(dot(world[0].xyz, world[0].xyz), max(dot(world[1].xyz, world[1].xyz), dot(world[2].xyz, world[2].xyz))));
+	float radius = bounds.w * scale;
+
+	// Visible unless entirely behind one plane
+	bool visible = true;
+	for (int i = 0; i < 6; i++)
+		visible = visible && dot(planes[i].xyz, center) + planes[i].w >= -radius;
+
+	vsMatrix = instanceMatrix;
+	vsIndex = uint(gl_VertexID);
+	vsVisible = visible ? 1 : 0;
+}
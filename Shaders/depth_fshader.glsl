@@ -0,0 +1,15 @@
+// =================================================================
+//
+// depth_fshader.glsl
+// -----------------------------------
+//
+// DEPTH FRAGMENT SHADER - nothing to shade in the depth pre-pass,
+// which only writes depth (paired with main_vshader.glsl built
+// with DEPTH_ONLY)
+//
+// =================================================================
+
+#version 330 core
+
+void main() {
+}
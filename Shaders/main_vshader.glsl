@@ -1,52 +1,117 @@
-// =================================================================
-//
-// main_vshader.glsl
-// -----------------------------------
-//
-// OBJECT VERTEX SHADER - Push the object's vertex positions,
-// normals, and texture coordinates to the fragment shader
-//
-// =================================================================
-
-#version 330 core
-
-// Inputs
-layout (location = 0) in vec3 position;
-layout (location = 1) in vec3 normal;
-layout (location = 2) in vec2 texCoords;
-layout (location = 3) in mat4 instanceMatrix;
-
-// Outputs
-out vec2 TexCoords;
-flat out int instanceID;
-
-// Output structure to fragment shader
-out VS_OUT {
-    vec3 FragPos;
-    vec3 Normal;
-    vec2 TexCoords;
-} vs_out;
-
-// Input Uniforms
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
-
-// Instance 
-uniform int instance;
-
-// Main function
-void main() {	
-	// See if I have to work with either instanced or non-instanced mesh
-	if(instance) {
-		gl_Position = projection * view  * model * instanceMatrix * vec4(position, 1.0f); 
-	}
-	else
-		gl_Position = projection * view * model * vec4(position, 1.0f);
-	
-	// Output to fragment shader
-    vs_out.FragPos = vec3(model * vec4(position, 1.0));
-    vs_out.Normal = transpose(inverse(mat3(model))) * normal;
-    vs_out.TexCoords = texCoords;
-	instanceID = gl_InstanceID;
+// =================================================================
+//
+// main_vshader.glsl
+// -----------------------------------
+//
+// OBJECT VERTEX SHADER - Push the object's vertex positions,
+// normals, and texture coordinates to the fragment shader. Built with
+// DEPTH_ONLY for the depth pre-pass, it only writes the position.
+//
+// =================================================================
+
+#version 330 core
+
+// Inputs
+layout (location = 0) in vec3 vertexPosition;	// packed: unorm16 within the mesh bounds
+layout (location = 1) in vec3 vertexNormal;		// packed: octahedral xy
+layout (location = 2) in vec2 texCoords;
+layout (location = 3) in mat4 instanceMatrix;	// compact formats: (position, scale), quaternion
+layout (location = 7) in uint drawIndex;
+layout (location = 8) in uint instanceIndex;	// original index of a culled instance
+
+// Outputs. The depth pre-pass and the shading pass must produce the
+// same depth, bit for bit, for the EQUAL depth test.
+invariant gl_Position;
+out vec2 TexCoords;
+flat out int instanceID;
+flat out vec3 drawMaterial;		// batched: emission intensity, diffuse layer, emission layer
+
+// Output structure to fragment shader
+out VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 TexCoords;
+} vs_out;
+
+// Per-frame camera block, shared with every program
+layout (std140) uniform Camera {
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;
+};
+
+// Input Uniforms
+uniform mat4 model;
+
+// Instance 
+uniform int instance;
+uniform int instanceFormat;		// 0 = mat4, otherwise position + scale and rotation
+uniform vec4 instanceOffset;	// packed (2) position + scale = offset + unorm * scale
+uniform vec4 instanceScale;
+
+// Vertex layout: 0 = float, 1 = packed (position = offset + unorm * scale)
+uniform int vertexFormat;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+// Static batch: per-draw model matrix and material, 5 texels per draw
+uniform int batched;
+uniform samplerBuffer drawData;
+
+// Rebuild translate * scale * rotate from a compact instance
+mat4 InstanceTransform(vec4 positionScale, vec4 q) {
+	float s = positionScale.w;
+	return mat4(
+		vec4(s * (1.0 - 2.0 * (q.y * q.y + q.z * q.z)), s * 2.0 * (q.x * q.y + q.w * q.z), s * 2.0 * (q.x * q.z - q.w * q.y), 0.0),
+		vec4(s * 2.0 * (q.x * q.y - q.w * q.z), s * (1.0 - 2.0 * (q.x * q.x + q.z * q.z)), s * 2.0 * (q.y * q.z + q.w * q.x), 0.0),
+		vec4(s * 2.0 * (q.x * q.z + q.w * q.y), s * 2.0 * (q.y * q.z - q.w * q.x), s * (1.0 - 2.0 * (q.x * q.x + q.y * q.y)), 0.0),
+		vec4(positionScale.xyz, 1.0));
+}
+
+// Unit vector from its octahedral encoding
+vec3 OctDecode(vec2 p) {
+	vec3 n = vec3(p, 1.0 - abs(p.x) - abs(p.y));
+	float t = max(-n.z, 0.0);
+	n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+	return normalize(n);
+}
+
+// Main function
+void main() {	
+	vec3 position = vertexPosition;
+	vec3 normal = vertexNormal;
+	if (vertexFormat != 0) {
+		position = positionOffset + vertexPosition * positionScale;
+		normal = OctDecode(vertexNormal.xy);
+	}
+
+	// Batched draws read their model matrix from the draw data
+	mat4 world = model;
+	drawMaterial = vec3(0.0);
+	if (batched != 0) {
+		int base = int(drawIndex) * 5;
+		world = mat4(texelFetch(drawData, base), texelFetch(drawData, base + 1),
+			texelFetch(drawData, base + 2), texelFetch(drawData, base + 3));
+		drawMaterial = texelFetch(drawData, base + 4).xyz;
+	}
+
+	// See if I have to work with either instanced or non-instanced mesh
+	if(instance != 0) {
+		mat4 instanceTransform = instanceMatrix;
+		if (instanceFormat == 2)
+			instanceTransform = InstanceTransform(instanceOffset + instanceMatrix[0] * instanceScale, instanceMatrix[1]);
+		else if (instanceFormat != 0)
+			instanceTransform = InstanceTransform(instanceMatrix[0], instanceMatrix[1]);
+		gl_Position = projection * view  * world * instanceTransform * vec4(position, 1.0f); 
+	}
+	else
+		gl_Position = projection * view * world * vec4(position, 1.0f);
+	
+	// Output to fragment shader
+#ifndef DEPTH_ONLY
+    vs_out.FragPos = vec3(world * vec4(position, 1.0));
+    vs_out.Normal = transpose(inverse(mat3(world))) * normal;
+    vs_out.TexCoords = texCoords;
+	instanceID = instance != 0 ? int(instanceIndex) : gl_InstanceID;
+#endif
 }
\ No newline at end of file
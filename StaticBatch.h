@@ -0,0 +1,389 @@
+// ============================================================================
+//
+// StaticBatch.h
+// -----------------------------------
+//
+// STATIC BATCH HEADER FILE
+//
+// The static batch packs every mesh of the non-instanced models into one
+// shared vertex / index arena and draws them all with a single
+// glMultiDrawElementsIndirect call. Each draw reads its model matrix and
+// material from a texture buffer, indexed by a per-draw attribute fed
+// through baseInstance. Textures are copied into one texture array so no
+// bindings change between draws. On GL 3.3 contexts the same arena is drawn
+// with a loop of glDrawElementsBaseVertex calls. With packed vertices the
+// arena is quantized against the bounds of all of its meshes. Every level of
+// detail of every mesh is in the arena; SetLod() points a model's draw
+// commands at another level.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <vector>
+#include <map>
+#include <iostream>
+#include <algorithm>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+// Custom headers
+#include "ModelObj.h"
+#include "UseShader.h"
+
+using namespace std;
+using namespace glm;
+
+// Attribute location of the per-draw index
+const GLuint DRAW_INDEX_ATTRIB = 7;
+
+// Texture units used by batched draws
+const GLuint BATCH_TEXTURE_UNIT = 7;		// material texture array
+const GLuint BATCH_DRAW_DATA_UNIT = 8;		// per-draw data buffer
+
+// Largest layer of the material texture array
+const GLint BATCH_MAX_LAYER_SIZE = 2048;
+
+// Texels of per-draw data: model matrix, then (emission, diffuse layer, emission layer, 0)
+const GLuint DRAW_DATA_TEXELS = 5;
+
+// Static batch class
+class StaticBatch {
+private:
+	// Data
+	vector<Vertex> vertices;
+	vector<GLuint> indices;
+	vector<DrawElementsIndirectCommand> commands;
+	vector<MeshLod> drawLods;				// MAX_MESH_LODS per draw, arena ranges
+	vector<GLuint> drawLodCount;
+	bool commandsChanged;
+	vector<vec4> drawData;					// DRAW_DATA_TEXELS per draw
+	vector<GLuint> modelFirst, modelCount;	// draws belonging to each added model
+	map<GLuint, GLuint> layers;				// texture id -> array layer
+	bool multiDraw;
+	VertexFormat format;
+	VertexQuantization quantization;
+
+	// GL objects
+	GLuint VAO, VBO, EBO, drawIndexBuffer, commandBuffer;
+	GLuint drawDataBuffer, drawDataTexture, textureArray;
+	UniformCache<4> locations;				// batched, vertexFormat, positionOffset, positionScale
+
+	// Functions
+	GLuint layerOf(GLuint texture);
+	void buildTextureArray();
+	const GLint* bindLocations(const Shader& shader);
+
+public:
+	StaticBatch();
+	GLuint Add(const Model& model);
+	void Build(const Shader& shader);
+	void SetModel(GLuint model, const mat4& matrix, GLfloat emission);
+	void SetLod(GLuint model, GLuint lod);
+	void Draw(const Shader& shader);
+
+	GLuint DrawCount();
+	GLuint TriangleCount();
+	bool MultiDraw();
+};
+
+// Constructor
+StaticBatch::StaticBatch() {
+	this->multiDraw = false;
+	this->commandsChanged = false;
+	this->format = VERTEX_FLOAT;
+	this->VAO = this->VBO = this->EBO = this->drawIndexBuffer = this->commandBuffer = 0;
+	this->drawDataBuffer = this->drawDataTexture = this->textureArray = 0;
+}
+
+// Layer of a texture in the material array. Layer 0 is black and stands in
+// for a missing map, as an unbound sampler would.
+GLuint StaticBatch::layerOf(GLuint texture) {
+	if (!texture)
+		return 0;
+	map<GLuint, GLuint>::iterator found = this->layers.find(texture);
+	if (found != this->layers.end())
+		return found->second;
+	GLuint layer = this->layers.size() + 1;
+	this->layers[texture] = layer;
+	return layer;
+}
+
+// Append every mesh of a model to the arena. Returns the handle used to
+// move the model with SetModel().
+GLuint StaticBatch::Add(const Model& model) {
+	this->modelFirst.push_back(this->commands.size());
+	this->modelCount.push_back(model.meshes.size());
+
+	for (GLuint i = 0; i < model.meshes.size(); i++) {
+		const Mesh& mesh = model.meshes[i];
+		DrawElementsIndirectCommand command;
+		command.count = mesh.Lod(0).indexCount;
+		command.instanceCount = 1;
+		command.firstIndex = this->indices.size() + mesh.Lod(0).firstIndex;
+		command.baseVertex = this->vertices.size();
+		command.baseInstance = this->commands.size();	// selects the draw index
+		this->commands.push_back(command);
+		this->drawLodCount.push_back(min(mesh.LodCount(), MAX_MESH_LODS));
+		for (GLuint l = 0; l < MAX_MESH_LODS; l++) {
+			MeshLod lod = mesh.Lod(l);
+			lod.firstIndex += this->indices.size();
+			this->drawLods.push_back(lod);
+		}
+		this->vertices.insert(this->vertices.end(), mesh.VertexData(), mesh.VertexData() + mesh.VertexCount());
+		this->indices.insert(this->indices.end(), mesh.IndexData(), mesh.IndexData() + mesh.IndexCount());
+
+		// The shader samples the first diffuse and first emission map
+		GLuint diffuse = 0, emission = 0;
+		for (GLuint j = 0; j < mesh.textures.size(); j++) {
+			if (!diffuse && mesh.textures[j].type == "texture_diffuse")
+				diffuse = this->layerOf(mesh.textures[j].id);
+			else if (!emission && mesh.textures[j].type == "texture_emission")
+				emission = this->layerOf(mesh.textures[j].id);
+		}
+		for (GLuint j = 0; j < 4; j++)
+			this->drawData.push_back(vec4(j == 0, j == 1, j == 2, j == 3));
+		this->drawData.push_back(vec4(1.0f, (GLfloat)diffuse, (GLfloat)emission, 0.0f));
+	}
+	return this->modelFirst.size() - 1;
+}
+
+// Copy every referenced texture into one array layer each, scaled to the
+// largest texture, so batched draws never rebind textures. Compressed
+// textures cannot be blitted from, so they are read back decompressed into
+// a scratch texture first.
+void StaticBatch::buildTextureArray() {
+	GLint width = 1, height = 1;
+	for (map<GLuint, GLuint>::iterator it = this->layers.begin(); it != this->layers.end(); ++it) {
+		GLint w, h;
+		glBindTexture(GL_TEXTURE_2D, it->first);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+		width = max(width, min(w, BATCH_MAX_LAYER_SIZE));
+		height = max(height, min(h, BATCH_MAX_LAYER_SIZE));
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLsizei layerCount = this->layers.size() + 1;
+	glGenTextures(1, &this->textureArray);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->textureArray);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+	// Blit each texture into its layer
+	GLuint framebuffers[2], scratch = 0;
+	vector<GLubyte> pixels;
+	glGenFramebuffers(2, framebuffers);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffers[0]);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[1]);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->textureArray, 0, 0);
+	GLfloat black[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	glClearBufferfv(GL_COLOR, 0, black);
+	for (map<GLuint, GLuint>::iterator it = this->layers.begin(); it != this->layers.end(); ++it) {
+		GLint w, h;
+		glBindTexture(GL_TEXTURE_2D, it->first);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &w);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &h);
+		GLint compressed = GL_FALSE;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+		GLuint source = it->first;
+		if (compressed) {
+			pixels.resize((size_t)w * h * 4);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+			if (!scratch)
+				glGenTextures(1, &scratch);
+			glBindTexture(GL_TEXTURE_2D, scratch);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+			source = scratch;
+		}
+		glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, source, 0);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, this->textureArray, 0, it->second);
+		glBlitFramebuffer(0, 0, w, h, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(2, framebuffers);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	if (scratch)
+		glDeleteTextures(1, &scratch);
+
+	// Same sampling as TextureFromFile (which never uses its mipmaps)
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+// Upload the arena, the draw commands and the textures. Call once after
+// every model has been added.
+void StaticBatch::Build(const Shader& shader) {
+	if (this->commands.empty())
+		return;
+	this->multiDraw = GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+
+	glGenVertexArrays(1, &this->VAO);
+	glGenBuffers(1, &this->VBO);
+	glGenBuffers(1, &this->EBO);
+	glBindVertexArray(this->VAO);
+	glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
+	this->format = Mesh::bufferFormat;
+	if (this->format == VERTEX_PACKED) {
+		vector<PackedVertex> packed;
+		this->quantization = QuantizationOf(&this->vertices[0], this->vertices.size());
+		PackVertices(&this->vertices[0], this->vertices.size(), this->quantization, packed);
+		glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), &packed[0], GL_STATIC_DRAW);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+
+	// Same layouts as Mesh::setupMesh
+	SetVertexAttributes(this->format);
+
+	// Draw index: one value per "instance", offset by each command's
+	// baseInstance. Without base instance support it is set per draw instead.
+	if (this->multiDraw) {
+		vector<GLuint> drawIndices(this->commands.size());
+		for (GLuint i = 0; i < drawIndices.size(); i++)
+			drawIndices[i] = i;
+		glGenBuffers(1, &this->drawIndexBuffer);
+		glBindBuffer(GL_ARRAY_BUFFER, this->drawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, drawIndices.size() * sizeof(GLuint), &drawIndices[0], GL_STATIC_DRAW);
+		glEnableVertexAttribArray(DRAW_INDEX_ATTRIB);
+		glVertexAttribIPointer(DRAW_INDEX_ATTRIB, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+		glVertexAttribDivisor(DRAW_INDEX_ATTRIB, 1);
+
+		glGenBuffers(1, &this->commandBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, this->commands.size() * sizeof(DrawElementsIndirectCommand),
+			&this->commands[0], GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// Per-draw data
+	glGenBuffers(1, &this->drawDataBuffer);
+	glGenTextures(1, &this->drawDataTexture);
+	glBindBuffer(GL_TEXTURE_BUFFER, this->drawDataBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, this->drawData.size() * sizeof(vec4), &this->drawData[0], GL_STREAM_DRAW);
+	glBindTexture(GL_TEXTURE_BUFFER, this->drawDataTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->drawDataBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	this->buildTextureArray();
+
+	// The CPU copy of the arena is no longer needed
+	vector<Vertex>().swap(this->vertices);
+	vector<GLuint>().swap(this->indices);
+
+	this->bindLocations(shader);
+	cout << "Static batch: " << this->commands.size() << " draws, " << this->layers.size() << " textures, "
+		<< (this->multiDraw ? "multi-draw indirect" : "draw loop fallback") << endl;
+}
+
+// Uniform locations in a program, looked up the first time the batch is
+// drawn with it (the depth pre-pass and the shading pass alternate)
+const GLint* StaticBatch::bindLocations(const Shader& shader) {
+	GLint* locations = this->locations.Find(shader.Program);
+	if (locations)
+		return locations;
+	locations = this->locations.Add(shader.Program);
+	locations[0] = shader.Uniform("batched");
+	locations[1] = shader.Uniform("vertexFormat");
+	locations[2] = shader.Uniform("positionOffset");
+	locations[3] = shader.Uniform("positionScale");
+	return locations;
+}
+
+// Move a model and set its emission intensity for this frame
+void StaticBatch::SetModel(GLuint model, const mat4& matrix, GLfloat emission) {
+	for (GLuint i = this->modelFirst[model]; i < this->modelFirst[model] + this->modelCount[model]; i++) {
+		vec4* data = &this->drawData[i * DRAW_DATA_TEXELS];
+		for (GLuint j = 0; j < 4; j++)
+			data[j] = matrix[j];
+		data[4].x = emission;
+	}
+}
+
+// Draw a model's meshes at a level of detail from now on (clamped to the
+// levels each mesh has)
+void StaticBatch::SetLod(GLuint model, GLuint lod) {
+	for (GLuint i = this->modelFirst[model]; i < this->modelFirst[model] + this->modelCount[model]; i++) {
+		const MeshLod& level = this->drawLods[i * MAX_MESH_LODS + min(lod, this->drawLodCount[i] - 1)];
+		DrawElementsIndirectCommand& command = this->commands[i];
+		if (command.firstIndex != level.firstIndex) {
+			command.firstIndex = level.firstIndex;
+			command.count = level.indexCount;
+			this->commandsChanged = true;
+		}
+	}
+}
+
+// Draw every batched mesh. The shader's materialTextures and drawData
+// samplers must point at BATCH_TEXTURE_UNIT and BATCH_DRAW_DATA_UNIT. The
+// per-draw data is orphaned and re-sent first; it is 80 bytes per draw.
+void StaticBatch::Draw(const Shader& shader) {
+	if (this->commands.empty())
+		return;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, this->drawDataBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, this->drawData.size() * sizeof(vec4), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, this->drawData.size() * sizeof(vec4), &this->drawData[0]);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glActiveTexture(GL_TEXTURE0 + BATCH_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, this->textureArray);
+	glActiveTexture(GL_TEXTURE0 + BATCH_DRAW_DATA_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, this->drawDataTexture);
+	glActiveTexture(GL_TEXTURE0);
+	const GLint* locations = this->bindLocations(shader);
+	shader.SetInt(locations[0], 1);
+	shader.SetInt(locations[1], this->format);
+	if (this->format == VERTEX_PACKED) {
+		shader.SetVec3(locations[2], this->quantization.offset);
+		shader.SetVec3(locations[3], this->quantization.scale);
+	}
+
+	glBindVertexArray(this->VAO);
+	if (this->multiDraw) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->commandBuffer);
+		if (this->commandsChanged)
+			glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, this->commands.size() * sizeof(DrawElementsIndirectCommand), &this->commands[0]);
+		this->commandsChanged = false;
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, this->commands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else {
+		// GL 3.3: the draw index comes from the current attribute value
+		for (GLuint i = 0; i < this->commands.size(); i++) {
+			const DrawElementsIndirectCommand& command = this->commands[i];
+			glVertexAttribI4ui(DRAW_INDEX_ATTRIB, i, 0, 0, 0);
+			glDrawElementsBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT,
+				(GLvoid*)(command.firstIndex * sizeof(GLuint)), command.baseVertex);
+		}
+	}
+	glBindVertexArray(0);
+	shader.SetInt(locations[0], 0);
+}
+
+GLuint StaticBatch::DrawCount() {
+	return this->commands.size();
+}
+
+// Triangles one Draw() submits at the current levels of detail
+GLuint StaticBatch::TriangleCount() {
+	GLuint triangles = 0;
+	for (GLuint i = 0; i < this->commands.size(); i++)
+		triangles += this->commands[i].count / 3;
+	return triangles;
+}
+
+bool StaticBatch::MultiDraw() {
+	return this->multiDraw;
+}
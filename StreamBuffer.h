@@ -0,0 +1,117 @@
+// ============================================================================
+//
+// StreamBuffer.h
+// -----------------------------------
+//
+// STREAM BUFFER HEADER FILE
+//
+// A vertex buffer split into one region per frame in flight, for data the
+// CPU rewrites every frame (such as the visible instance list). With GL 4.4
+// or ARB_buffer_storage the buffer is persistently mapped once; otherwise
+// each region is mapped unsynchronized. Either way a fence per region keeps
+// the CPU from overwriting data the GPU has not read yet.
+//
+// ============================================================================
+
+#pragma once
+
+// OpenGL includes
+#include "GL\glew.h"
+
+// Number of frames the stream can have in flight
+const GLuint STREAM_BUFFER_REGIONS = 3;
+
+// Stream buffer class
+class StreamBuffer {
+private:
+	// Data
+	GLuint buffer;
+	GLsizeiptr regionSize;
+	GLuint region;
+	GLubyte* persistent;		// whole buffer, when persistently mapped
+	GLsync fences[STREAM_BUFFER_REGIONS];
+
+public:
+	StreamBuffer();
+	void Init(GLsizeiptr regionSize);
+	GLubyte* Map();
+	void Unmap();
+	void EndFrame();
+
+	GLuint Buffer();
+	GLintptr RegionOffset();
+	bool Persistent();
+};
+
+// Constructor
+StreamBuffer::StreamBuffer() {
+	this->buffer = 0;
+	this->regionSize = 0;
+	this->region = 0;
+	this->persistent = nullptr;
+	for (GLuint i = 0; i < STREAM_BUFFER_REGIONS; i++)
+		this->fences[i] = 0;
+}
+
+// Allocate one region of regionSize bytes for every frame in flight
+void StreamBuffer::Init(GLsizeiptr regionSize) {
+	this->regionSize = regionSize;
+	glGenBuffers(1, &this->buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, regionSize * STREAM_BUFFER_REGIONS, NULL, flags);
+		this->persistent = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * STREAM_BUFFER_REGIONS, flags);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, regionSize * STREAM_BUFFER_REGIONS, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Move to the next region and return it for writing. The region was last
+// used STREAM_BUFFER_REGIONS - 1 frames ago, so its fence has normally
+// signalled already.
+GLubyte* StreamBuffer::Map() {
+	this->region = (this->region + 1) % STREAM_BUFFER_REGIONS;
+	if (this->fences[this->region]) {
+		while (glClientWaitSync(this->fences[this->region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(this->fences[this->region]);
+		this->fences[this->region] = 0;
+	}
+
+	if (this->persistent)
+		return this->persistent + this->RegionOffset();
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+	GLubyte* data = (GLubyte*)glMapBufferRange(GL_ARRAY_BUFFER, this->RegionOffset(), this->regionSize,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return data;
+}
+
+// Finish writing the current region (a no-op when persistently mapped)
+void StreamBuffer::Unmap() {
+	if (this->persistent)
+		return;
+	glBindBuffer(GL_ARRAY_BUFFER, this->buffer);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Mark the current region as in use by everything submitted this frame
+void StreamBuffer::EndFrame() {
+	this->fences[this->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+GLuint StreamBuffer::Buffer() {
+	return this->buffer;
+}
+
+// Byte offset of the current region in the buffer
+GLintptr StreamBuffer::RegionOffset() {
+	return this->region * this->regionSize;
+}
+
+bool StreamBuffer::Persistent() {
+	return this->persistent != nullptr;
+}
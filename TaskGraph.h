@@ -0,0 +1,190 @@
+// ============================================================================
+//
+// TaskGraph.h
+// -----------------------------------
+//
+// TASK GRAPH HEADER FILE
+//
+// A fixed graph of CPU tasks run once per frame on the job system. Tasks
+// and their dependencies are declared at startup; Kick() queues every task
+// with no dependencies, and each finished task queues the successors it
+// was the last dependency of. The render thread keeps making GL calls and
+// only waits on a task right before it needs that task's results. Tasks
+// must not make GL calls. Running the graph does not allocate.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <atomic>
+#include <chrono>
+#include <iostream>
+
+// OpenGL includes
+#include "GL\glew.h"
+
+// Other includes
+#include "JobSystem.h"
+
+using namespace std;
+
+// Graph limits
+const GLuint TASK_GRAPH_MAX_TASKS = 16;
+const GLuint TASK_GRAPH_MAX_SUCCESSORS = 8;
+
+class TaskGraph;
+
+// One node of the graph
+struct GraphTask {
+	const char* name;
+	JobFunc func;
+	void* context;
+	GLuint successors[TASK_GRAPH_MAX_SUCCESSORS];
+	GLuint successorCount;
+	GLuint dependencies;
+	atomic<GLuint> remaining;	// dependencies not finished this run
+	JobCounter done;			// 1 until the task has run
+	GLdouble ms;				// duration of the last run
+	TaskGraph* graph;
+};
+
+// Task graph class
+class TaskGraph {
+private:
+	typedef chrono::high_resolution_clock Clock;
+
+	// Data
+	JobSystem* jobs;
+	GraphTask tasks[TASK_GRAPH_MAX_TASKS];
+	GLuint taskCount;
+	bool running;
+
+	// Functions
+	static void runTask(void* context, GLuint begin, GLuint end);
+
+	template<class Body>
+	static void invoke(void* context, GLuint begin, GLuint end) {
+		(*(Body*)context)();
+	}
+
+public:
+	TaskGraph();
+	void Init(JobSystem* jobs);
+
+	// Add a task that calls body(). The body must outlive the graph.
+	template<class Body>
+	GLuint Add(const char* name, Body& body) {
+		return this->add(name, &TaskGraph::invoke<Body>, &body);
+	}
+	GLuint add(const char* name, JobFunc func, void* context);
+
+	// Make task run after dependency
+	void Depend(GLuint task, GLuint dependency);
+
+	void Kick();
+	void Wait(GLuint task);
+	void WaitAll();
+
+	GLuint TaskCount();
+	const char* TaskName(GLuint task);
+	GLdouble TaskMs(GLuint task);
+};
+
+// Constructor
+TaskGraph::TaskGraph() {
+	this->jobs = nullptr;
+	this->taskCount = 0;
+	this->running = false;
+}
+
+void TaskGraph::Init(JobSystem* jobs) {
+	this->jobs = jobs;
+}
+
+// Returns the new task's id, or TASK_GRAPH_MAX_TASKS when the graph is full
+GLuint TaskGraph::add(const char* name, JobFunc func, void* context) {
+	if (this->taskCount == TASK_GRAPH_MAX_TASKS) {
+		cout << "ERROR::TASK_GRAPH::TOO_MANY_TASKS " << name << endl;
+		return TASK_GRAPH_MAX_TASKS;
+	}
+	GraphTask& task = this->tasks[this->taskCount];
+	task.name = name;
+	task.func = func;
+	task.context = context;
+	task.successorCount = 0;
+	task.dependencies = 0;
+	task.remaining = 0;
+	task.done.value = 0;
+	task.ms = 0.0;
+	task.graph = this;
+	return this->taskCount++;
+}
+
+// Dependencies must be added before the task would run, i.e. at startup
+void TaskGraph::Depend(GLuint task, GLuint dependency) {
+	if (task >= this->taskCount || dependency >= this->taskCount)
+		return;
+	GraphTask& from = this->tasks[dependency];
+	if (from.successorCount == TASK_GRAPH_MAX_SUCCESSORS) {
+		cout << "ERROR::TASK_GRAPH::TOO_MANY_SUCCESSORS " << from.name << endl;
+		return;
+	}
+	from.successors[from.successorCount++] = task;
+	this->tasks[task].dependencies++;
+}
+
+// Run the task, then release every successor it was the last dependency of
+void TaskGraph::runTask(void* context, GLuint begin, GLuint end) {
+	GraphTask& task = *(GraphTask*)context;
+	Clock::time_point start = Clock::now();
+	task.func(task.context, 0, 1);
+	task.ms = chrono::duration<double, milli>(Clock::now() - start).count();
+
+	TaskGraph* graph = task.graph;
+	for (GLuint i = 0; i < task.successorCount; i++) {
+		GraphTask& next = graph->tasks[task.successors[i]];
+		if (next.remaining.fetch_sub(1) == 1)
+			graph->jobs->Submit(&TaskGraph::runTask, &next, &next.done);
+	}
+}
+
+// Start a run of the whole graph. The previous run must have been waited on.
+void TaskGraph::Kick() {
+	if (this->running)
+		this->WaitAll();
+	this->running = true;
+	for (GLuint i = 0; i < this->taskCount; i++) {
+		this->tasks[i].remaining = this->tasks[i].dependencies;
+		this->tasks[i].done.value = 1;
+	}
+	for (GLuint i = 0; i < this->taskCount; i++) {
+		if (this->tasks[i].dependencies == 0)
+			this->jobs->Submit(&TaskGraph::runTask, &this->tasks[i], &this->tasks[i].done);
+	}
+}
+
+// Help run jobs until the task (and so everything it depends on) is done
+void TaskGraph::Wait(GLuint task) {
+	if (task < this->taskCount)
+		this->jobs->Wait(this->tasks[task].done);
+}
+
+void TaskGraph::WaitAll() {
+	for (GLuint i = 0; i < this->taskCount; i++)
+		this->jobs->Wait(this->tasks[i].done);
+	this->running = false;
+}
+
+GLuint TaskGraph::TaskCount() {
+	return this->taskCount;
+}
+
+const char* TaskGraph::TaskName(GLuint task) {
+	return this->tasks[task].name;
+}
+
+// Milliseconds the task took on its last run
+GLdouble TaskGraph::TaskMs(GLuint task) {
+	return this->tasks[task].ms;
+}
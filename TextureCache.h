@@ -0,0 +1,364 @@
+// ============================================================================
+//
+// TextureCache.h
+// -----------------------------------
+//
+// TEXTURE CACHE HEADER FILE
+//
+// One cache of GL textures shared by every model. Textures are found by
+// canonical path, and a file that is not known by its path is hashed so
+// that the same image under another name (or in another model's folder)
+// reuses the texture already uploaded. Each user holds a reference; once
+// a texture has none it stays resident until the cache is over its memory
+// budget, when the least recently used unreferenced textures are deleted.
+// Files are read through their BC1 bakes (TextureCompress.h) unless
+// compression is turned off.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <fstream>
+#include <iostream>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "soil\SOIL.h"
+
+// Other includes
+#include "TextureCompress.h"
+
+using namespace std;
+
+// Default budget for resident textures (--texture-budget)
+const GLuint64 TEXTURE_CACHE_BUDGET = 256ull << 20;
+
+// Counters reported by TextureCache::Stats()
+struct TextureCacheStats {
+	GLuint textures;			// resident
+	GLuint referenced;			// resident with at least one user
+	GLuint64 residentBytes;		// estimated GPU memory, mipmaps included
+	GLuint64 budgetBytes;
+	GLuint64 hits;				// requests served by a resident texture
+	GLuint64 misses;			// requests that uploaded a texture
+	GLuint64 evictions;
+	GLfloat hitRate;			// hits / (hits + misses)
+};
+
+// Texture cache class
+class TextureCache {
+private:
+	// One resident texture
+	struct Entry {
+		GLuint64 hash;			// of the file's content
+		GLuint64 fileSize;
+		GLuint64 bytes;
+		GLuint references;
+		GLuint64 lastUse;		// tick of the last acquire or release
+		vector<string> paths;	// canonical paths it was requested by
+	};
+
+	// Data (one lock: models are parsed on the job system's workers)
+	mutex lock;
+	map<GLuint, Entry> entries;			// texture id -> entry
+	map<string, GLuint> paths;			// canonical path -> texture id
+	map<GLuint64, GLuint> contents;		// content hash -> texture id
+	GLuint64 tick;
+	GLuint64 residentBytes, budgetBytes;
+	GLuint64 hits, misses, evictions;
+
+	// Functions
+	GLuint upload(const TextureImage& image, const GLubyte* pixels);
+	void evict();
+
+public:
+	TextureCache();
+	static string CanonicalPath(const string& path);
+	static GLuint64 HashBytes(const unsigned char* data, GLuint64 size);
+	static bool ReadFile(const string& path, vector<unsigned char>& bytes);
+	static bool ReadImage(const string& path, TextureImage& image);
+	bool Acquire(const string& path, GLuint& id);
+	void AddRef(GLuint id);
+	GLuint Insert(const string& path, const TextureImage& image, const GLubyte* pixels);
+	GLuint Load(const string& path);
+	void Release(GLuint id);
+	GLuint References(GLuint id);
+	void SetBudget(GLuint64 bytes);
+	TextureCacheStats Stats();
+
+	// The cache every model loads through
+	static TextureCache shared;
+
+	// Upload BC1 levels read from (or written to) .ktx bakes (on unless
+	// --no-texture-compression)
+	static bool compressTextures;
+};
+
+TextureCache TextureCache::shared;
+bool TextureCache::compressTextures = true;
+
+// Constructor
+TextureCache::TextureCache() {
+	this->tick = 0;
+	this->residentBytes = 0;
+	this->budgetBytes = TEXTURE_CACHE_BUDGET;
+	this->hits = this->misses = this->evictions = 0;
+}
+
+// Path with '\' as '/', and "." / ".." / repeated separators resolved, so
+// that every spelling of a file finds the same entry
+string TextureCache::CanonicalPath(const string& path) {
+	vector<string> parts;
+	string part;
+	bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+	for (GLuint i = 0; i <= path.size(); i++) {
+		if (i < path.size() && path[i] != '/' && path[i] != '\\') {
+			part += path[i];
+			continue;
+		}
+		if (part == "..") {
+			if (!parts.empty() && parts.back() != "..")
+				parts.pop_back();
+			else if (!absolute)
+				parts.push_back(part);
+		}
+		else if (!part.empty() && part != ".")
+			parts.push_back(part);
+		part.clear();
+	}
+	string canonical = absolute ? "/" : "";
+	for (GLuint i = 0; i < parts.size(); i++)
+		canonical += (i ? "/" : "") + parts[i];
+	return canonical;
+}
+
+// 64 bit FNV-1a
+GLuint64 TextureCache::HashBytes(const unsigned char* data, GLuint64 size) {
+	GLuint64 hash = 14695981039346656037ull;
+	for (GLuint64 i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+// Whole file into memory; false if it cannot be read
+bool TextureCache::ReadFile(const string& path, vector<unsigned char>& bytes) {
+	ifstream file(path.c_str(), ios::binary | ios::ate);
+	if (!file)
+		return false;
+	streamoff size = file.tellg();
+	bytes.resize((size_t)size);
+	file.seekg(0);
+	return size == 0 || (bool)file.read((char*)bytes.data(), size);
+}
+
+// Everything needed to upload a texture file; can run on any thread. With
+// compression on, a current bake is read instead of the file, and a file
+// without one is compressed and baked. False (with an empty image) if the
+// file cannot be read or decoded.
+bool TextureCache::ReadImage(const string& path, TextureImage& image) {
+	string bakePath = TextureBakePath(path), stamp;
+	if (compressTextures && ReadKtx(bakePath, image, stamp) && TextureBakeCurrent(path, stamp, image.hash, image.fileSize)) {
+		if (!CompressedTexturesSupported())
+			DecompressImage(image);
+		return true;
+	}
+
+	vector<GLubyte> bytes;
+	GLint width = 0, height = 0;
+	GLubyte* pixels = nullptr;
+	if (ReadFile(path, bytes) && !bytes.empty())
+		pixels = SOIL_load_image_from_memory(bytes.data(), bytes.size(), &width, &height, 0, SOIL_LOAD_RGB);
+	image.hash = HashBytes(bytes.data(), bytes.size());
+	image.fileSize = bytes.size();
+	if (!pixels)
+		width = height = 0;
+
+	if (pixels && compressTextures) {
+		CompressImage(pixels, width, height, image);
+		WriteKtx(bakePath, image, TextureSourceStamp(path, image.hash));
+		if (!CompressedTexturesSupported())
+			DecompressImage(image);
+	}
+	else {
+		image.width = width;
+		image.height = height;
+		image.format = GL_RGB;
+		image.levels = 1;
+		image.levelOffset[0] = 0;
+		image.levelSize[0] = (GLsizeiptr)width * height * 3;
+		image.data.assign(pixels, pixels + image.levelSize[0]);
+	}
+	if (pixels)
+		SOIL_free_image_data(pixels);
+	return pixels != nullptr;
+}
+
+// Take a reference to the texture already loaded from a path. Can be called
+// from any thread; false if the path is not resident.
+bool TextureCache::Acquire(const string& path, GLuint& id) {
+	lock_guard<mutex> guard(this->lock);
+	map<string, GLuint>::iterator found = this->paths.find(CanonicalPath(path));
+	if (found == this->paths.end())
+		return false;
+	id = found->second;
+	Entry& entry = this->entries[id];
+	entry.references++;
+	entry.lastUse = ++this->tick;
+	this->hits++;
+	return true;
+}
+
+// Take another reference to a resident texture, for a new user of it
+void TextureCache::AddRef(GLuint id) {
+	lock_guard<mutex> guard(this->lock);
+	map<GLuint, Entry>::iterator found = this->entries.find(id);
+	if (found == this->entries.end())
+		return;
+	found->second.references++;
+	found->second.lastUse = ++this->tick;
+	this->hits++;
+}
+
+// Upload an image like every model texture: mipmapped, repeating, linear
+// filtering
+GLuint TextureCache::upload(const TextureImage& image, const GLubyte* pixels) {
+	GLuint id;
+	glGenTextures(1, &id);
+	glBindTexture(GL_TEXTURE_2D, id);
+	UploadImage(image, pixels);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return id;
+}
+
+// Add a read image (render thread) and take a reference to it. A file with
+// the same content as a resident texture reuses that texture instead of
+// uploading another. pixels holds the image's data: its own array, or an
+// offset into a bound GL_PIXEL_UNPACK_BUFFER it was copied to.
+GLuint TextureCache::Insert(const string& path, const TextureImage& image, const GLubyte* pixels) {
+	string canonical = CanonicalPath(path);
+	lock_guard<mutex> guard(this->lock);
+	map<GLuint64, GLuint>::iterator same = this->contents.find(image.hash);
+	if (same != this->contents.end() && this->entries[same->second].fileSize == image.fileSize) {
+		Entry& entry = this->entries[same->second];
+		if (!this->paths.count(canonical)) {
+			this->paths[canonical] = same->second;
+			entry.paths.push_back(canonical);
+		}
+		entry.references++;
+		entry.lastUse = ++this->tick;
+		this->hits++;
+		return same->second;
+	}
+
+	GLuint id = this->upload(image, pixels);
+	Entry entry;
+	entry.hash = image.hash;
+	entry.fileSize = image.fileSize;
+	entry.bytes = TextureMemory(image);
+	entry.references = 1;
+	entry.lastUse = ++this->tick;
+	entry.paths.push_back(canonical);
+	this->entries[id] = entry;
+	this->paths[canonical] = id;
+	this->contents[image.hash] = id;
+	this->residentBytes += entry.bytes;
+	this->misses++;
+	this->evict();
+	return id;
+}
+
+// Take a reference to a texture file, reading and uploading it only if
+// neither its path nor its content is resident (render thread). 0 if the
+// file cannot be read: failures are not cached, so that they do not pass
+// as the same (empty) content.
+GLuint TextureCache::Load(const string& path) {
+	GLuint id;
+	if (this->Acquire(path, id))
+		return id;
+
+	TextureImage image;
+	if (!ReadImage(path, image)) {
+		cout << "ERROR::TEXTURE_CACHE::TEXTURE_NOT_DECODED " << path << endl;
+		return 0;
+	}
+	cout << path << endl;
+	return this->Insert(path, image, image.data.data());
+}
+
+// Drop a reference (render thread). The texture stays resident for the
+// next user unless the cache needs the room.
+void TextureCache::Release(GLuint id) {
+	lock_guard<mutex> guard(this->lock);
+	map<GLuint, Entry>::iterator found = this->entries.find(id);
+	if (found == this->entries.end() || !found->second.references)
+		return;
+	found->second.references--;
+	found->second.lastUse = ++this->tick;
+	this->evict();
+}
+
+// Users of a texture (0 if it is not resident)
+GLuint TextureCache::References(GLuint id) {
+	lock_guard<mutex> guard(this->lock);
+	map<GLuint, Entry>::iterator found = this->entries.find(id);
+	return found != this->entries.end() ? found->second.references : 0;
+}
+
+// Change the budget (render thread), evicting at once if it is exceeded
+void TextureCache::SetBudget(GLuint64 bytes) {
+	lock_guard<mutex> guard(this->lock);
+	this->budgetBytes = bytes;
+	this->evict();
+}
+
+// Delete least recently used unreferenced textures until the cache fits its
+// budget. Referenced textures are never evicted, so the cache can stay over
+// budget while they are in use. Called with the lock held.
+void TextureCache::evict() {
+	while (this->residentBytes > this->budgetBytes) {
+		map<GLuint, Entry>::iterator oldest = this->entries.end();
+		for (map<GLuint, Entry>::iterator it = this->entries.begin(); it != this->entries.end(); ++it) {
+			if (!it->second.references && (oldest == this->entries.end() || it->second.lastUse < oldest->second.lastUse))
+				oldest = it;
+		}
+		if (oldest == this->entries.end())
+			return;
+
+		Entry& entry = oldest->second;
+		for (GLuint i = 0; i < entry.paths.size(); i++)
+			this->paths.erase(entry.paths[i]);
+		this->contents.erase(entry.hash);
+		this->residentBytes -= entry.bytes;
+		glDeleteTextures(1, &oldest->first);
+		this->entries.erase(oldest);
+		this->evictions++;
+	}
+}
+
+TextureCacheStats TextureCache::Stats() {
+	lock_guard<mutex> guard(this->lock);
+	TextureCacheStats stats;
+	stats.textures = this->entries.size();
+	stats.referenced = 0;
+	for (map<GLuint, Entry>::iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+		stats.referenced += it->second.references ? 1 : 0;
+	stats.residentBytes = this->residentBytes;
+	stats.budgetBytes = this->budgetBytes;
+	stats.hits = this->hits;
+	stats.misses = this->misses;
+	stats.evictions = this->evictions;
+	GLuint64 requests = this->hits + this->misses;
+	stats.hitRate = requests ? (GLfloat)this->hits / requests : 0.0f;
+	return stats;
+}
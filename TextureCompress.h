@@ -0,0 +1,503 @@
+// ============================================================================
+//
+// TextureCompress.h
+// -----------------------------------
+//
+// TEXTURE COMPRESSION HEADER FILE
+//
+// Block compression of model textures. The first time a texture file is
+// loaded its full mip chain is built on the CPU and encoded to BC1 (DXT1:
+// 4x4 pixels in 8 bytes, an eighth of the RGBA8 the driver would otherwise
+// keep), and the result is written next to the source as a KTX 1 file
+// ("Body.png" -> "Body.png.ktx"). Later loads read the levels straight
+// from that file: no PNG decode, no encode and no glGenerateMipmap. A bake
+// whose recorded source size or modification time no longer matches is
+// ignored and rewritten. Without S3TC support the levels are expanded back
+// to RGB before they are uploaded.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <functional>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Most mip levels of an image (a 32768 texel side)
+const GLuint TEXTURE_MAX_LEVELS = 16;
+
+// KTX 1 file identification
+const GLubyte KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const GLuint KTX_ENDIANNESS = 0x04030201;
+
+// Key of the KTX metadata entry recording the source file
+const char KTX_SOURCE_KEY[] = "source";
+
+// Start of a KTX 1 file, after the identifier
+struct KtxHeader {
+	GLuint endianness;
+	GLuint glType;					// 0 when compressed
+	GLuint glTypeSize;
+	GLuint glFormat;				// 0 when compressed
+	GLuint glInternalFormat;
+	GLuint glBaseInternalFormat;
+	GLuint pixelWidth;
+	GLuint pixelHeight;
+	GLuint pixelDepth;
+	GLuint numberOfArrayElements;
+	GLuint numberOfFaces;
+	GLuint numberOfMipmapLevels;
+	GLuint bytesOfKeyValueData;
+};
+
+// A texture ready to upload: every mip level, one after the other in data
+struct TextureImage {
+	GLint width, height;
+	GLenum format;					// GL_RGB (packed RGB rows) or GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+	GLuint levels;					// 1 for GL_RGB: mipmaps are generated on upload
+	GLsizeiptr levelOffset[TEXTURE_MAX_LEVELS];
+	GLsizeiptr levelSize[TEXTURE_MAX_LEVELS];
+	vector<GLubyte> data;
+	GLuint64 hash, fileSize;		// of the source file, for the texture cache
+};
+
+// Levels of a full mip chain down to 1x1
+GLuint MipLevelCount(GLint width, GLint height) {
+	GLuint levels = 1;
+	while ((width > 1 || height > 1) && levels < TEXTURE_MAX_LEVELS) {
+		width = max(width / 2, 1);
+		height = max(height / 2, 1);
+		levels++;
+	}
+	return levels;
+}
+
+// Bytes of one BC1 level
+GLsizeiptr BC1Size(GLint width, GLint height) {
+	return (GLsizeiptr)((width + 3) / 4) * ((height + 3) / 4) * 8;
+}
+
+// Halve an RGB image with a 2x2 box filter (a 1 texel side stays 1)
+void DownsampleRGB(const GLubyte* source, GLint width, GLint height, vector<GLubyte>& out) {
+	GLint halfWidth = max(width / 2, 1), halfHeight = max(height / 2, 1);
+	out.resize((size_t)halfWidth * halfHeight * 3);
+	for (GLint y = 0; y < halfHeight; y++) {
+		GLint y0 = min(y * 2, height - 1), y1 = min(y * 2 + 1, height - 1);
+		for (GLint x = 0; x < halfWidth; x++) {
+			GLint x0 = min(x * 2, width - 1), x1 = min(x * 2 + 1, width - 1);
+			for (GLint c = 0; c < 3; c++) {
+				GLuint sum = source[((size_t)y0 * width + x0) * 3 + c] + source[((size_t)y0 * width + x1) * 3 + c]
+					+ source[((size_t)y1 * width + x0) * 3 + c] + source[((size_t)y1 * width + x1) * 3 + c];
+				out[((size_t)y * halfWidth + x) * 3 + c] = (GLubyte)((sum + 2) / 4);
+			}
+		}
+	}
+}
+
+// RGB888 <-> RGB565
+GLushort PackRGB565(const vec3& color) {
+	GLuint r = (GLuint)(clamp(color.x, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	GLuint g = (GLuint)(clamp(color.y, 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+	GLuint b = (GLuint)(clamp(color.z, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+	return (GLushort)((r << 11) | (g << 5) | b);
+}
+
+vec3 UnpackRGB565(GLushort color) {
+	GLuint r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	return vec3((GLfloat)((r << 3) | (r >> 2)), (GLfloat)((g << 2) | (g >> 4)), (GLfloat)((b << 3) | (b >> 2)));
+}
+
+// The four colors a pair of 565 endpoints gives in 4 color mode
+void BC1Palette(GLushort color0, GLushort color1, vec3 palette[4]) {
+	palette[0] = UnpackRGB565(color0);
+	palette[1] = UnpackRGB565(color1);
+	palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+	palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+}
+
+// Pick the nearest palette entry for every texel; returns the squared error
+GLfloat BC1Indices(const vec3 texels[16], const vec3 palette[4], GLuint indices[16]) {
+	GLfloat error = 0.0f;
+	for (GLuint i = 0; i < 16; i++) {
+		GLfloat best = 1e30f;
+		for (GLuint p = 0; p < 4; p++) {
+			vec3 d = texels[i] - palette[p];
+			GLfloat distance = dot(d, d);
+			if (distance < best) {
+				best = distance;
+				indices[i] = p;
+			}
+		}
+		error += best;
+	}
+	return error;
+}
+
+// Encode one 4x4 block of RGB texels. The endpoints start at the extremes
+// of the block along its principal axis, then are refit once by least
+// squares to the texels' palette weights, keeping whichever is better.
+void EncodeBC1Block(const GLubyte block[16 * 3], GLubyte out[8]) {
+	vec3 texels[16], mean(0.0f);
+	for (GLuint i = 0; i < 16; i++) {
+		texels[i] = vec3(block[i * 3], block[i * 3 + 1], block[i * 3 + 2]);
+		mean += texels[i];
+	}
+	mean /= 16.0f;
+
+	// Principal axis by power iteration on the covariance
+	GLfloat xx = 0, xy = 0, xz = 0, yy = 0, yz = 0, zz = 0;
+	for (GLuint i = 0; i < 16; i++) {
+		vec3 d = texels[i] - mean;
+		xx += d.x * d.x; xy += d.x * d.y; xz += d.x * d.z;
+		yy += d.y * d.y; yz += d.y * d.z; zz += d.z * d.z;
+	}
+	vec3 axis(1.0f, 1.0f, 1.0f);
+	for (GLuint k = 0; k < 8; k++) {
+		vec3 next(xx * axis.x + xy * axis.y + xz * axis.z, xy * axis.x + yy * axis.y + yz * axis.z,
+			xz * axis.x + yz * axis.y + zz * axis.z);
+		GLfloat length2 = dot(next, next);
+		if (length2 < 1e-12f)
+			break;
+		axis = next / sqrt(length2);
+	}
+	GLfloat lo = 1e30f, hi = -1e30f;
+	for (GLuint i = 0; i < 16; i++) {
+		GLfloat t = dot(texels[i] - mean, axis);
+		lo = min(lo, t);
+		hi = max(hi, t);
+	}
+
+	GLushort color0 = PackRGB565(mean + axis * hi), color1 = PackRGB565(mean + axis * lo);
+	vec3 palette[4];
+	GLuint indices[16], refit[16];
+	BC1Palette(color0, color1, palette);
+	GLfloat error = BC1Indices(texels, palette, indices);
+
+	// Least squares endpoints for the chosen weights
+	static const GLfloat weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	GLfloat aa = 0, ab = 0, bb = 0;
+	vec3 ax(0.0f), bx(0.0f);
+	for (GLuint i = 0; i < 16; i++) {
+		GLfloat a = weights[indices[i]], b = 1.0f - a;
+		aa += a * a; ab += a * b; bb += b * b;
+		ax += texels[i] * a;
+		bx += texels[i] * b;
+	}
+	GLfloat determinant = aa * bb - ab * ab;
+	if (fabs(determinant) > 1e-6f) {
+		GLushort fit0 = PackRGB565((ax * bb - bx * ab) / determinant);
+		GLushort fit1 = PackRGB565((bx * aa - ax * ab) / determinant);
+		vec3 fitPalette[4];
+		BC1Palette(fit0, fit1, fitPalette);
+		GLfloat fitError = BC1Indices(texels, fitPalette, refit);
+		if (fitError < error) {
+			color0 = fit0;
+			color1 = fit1;
+			memcpy(indices, refit, sizeof(indices));
+		}
+	}
+
+	// 4 color mode needs color0 > color1; equal endpoints use index 0 only
+	if (color0 < color1) {
+		swap(color0, color1);
+		for (GLuint i = 0; i < 16; i++)
+			indices[i] ^= 1;
+	}
+	GLuint bits = 0;
+	for (GLuint i = 0; i < 16; i++)
+		bits |= (color0 == color1 ? 0 : indices[i]) << (i * 2);
+	out[0] = color0 & 0xFF; out[1] = color0 >> 8;
+	out[2] = color1 & 0xFF; out[3] = color1 >> 8;
+	for (GLuint i = 0; i < 4; i++)
+		out[4 + i] = (bits >> (i * 8)) & 0xFF;
+}
+
+// Expand one BC1 block to 16 RGB texels (both color modes)
+void DecodeBC1Block(const GLubyte in[8], GLubyte block[16 * 3]) {
+	GLushort color0 = in[0] | (in[1] << 8), color1 = in[2] | (in[3] << 8);
+	vec3 palette[4];
+	BC1Palette(color0, color1, palette);
+	if (color0 <= color1) {
+		palette[2] = (palette[0] + palette[1]) * 0.5f;
+		palette[3] = vec3(0.0f);
+	}
+	GLuint bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((GLuint)in[7] << 24);
+	for (GLuint i = 0; i < 16; i++) {
+		const vec3& color = palette[(bits >> (i * 2)) & 3];
+		block[i * 3] = (GLubyte)(color.x + 0.5f);
+		block[i * 3 + 1] = (GLubyte)(color.y + 0.5f);
+		block[i * 3 + 2] = (GLubyte)(color.z + 0.5f);
+	}
+}
+
+// Encode an RGB image; edge blocks repeat the last row / column
+void EncodeBC1(const GLubyte* rgb, GLint width, GLint height, GLubyte* out) {
+	GLubyte block[16 * 3];
+	for (GLint by = 0; by < height; by += 4) {
+		for (GLint bx = 0; bx < width; bx += 4) {
+			for (GLint i = 0; i < 16; i++) {
+				GLint x = min(bx + i % 4, width - 1), y = min(by + i / 4, height - 1);
+				memcpy(block + i * 3, rgb + ((size_t)y * width + x) * 3, 3);
+			}
+			EncodeBC1Block(block, out);
+			out += 8;
+		}
+	}
+}
+
+void DecodeBC1(const GLubyte* in, GLint width, GLint height, GLubyte* rgb) {
+	GLubyte block[16 * 3];
+	for (GLint by = 0; by < height; by += 4) {
+		for (GLint bx = 0; bx < width; bx += 4) {
+			DecodeBC1Block(in, block);
+			in += 8;
+			for (GLint i = 0; i < 16; i++) {
+				GLint x = bx + i % 4, y = by + i / 4;
+				if (x < width && y < height)
+					memcpy(rgb + ((size_t)y * width + x) * 3, block + i * 3, 3);
+			}
+		}
+	}
+}
+
+// Build the mip chain of an RGB image and encode every level to BC1
+void CompressImage(const GLubyte* rgb, GLint width, GLint height, TextureImage& image) {
+	image.width = width;
+	image.height = height;
+	image.format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	image.levels = MipLevelCount(width, height);
+	GLsizeiptr total = 0;
+	for (GLuint l = 0; l < image.levels; l++) {
+		image.levelOffset[l] = total;
+		image.levelSize[l] = BC1Size(max(width >> l, 1), max(height >> l, 1));
+		total += image.levelSize[l];
+	}
+	image.data.resize(total);
+
+	vector<GLubyte> level(rgb, rgb + (size_t)width * height * 3), next;
+	for (GLuint l = 0; l < image.levels; l++) {
+		GLint w = max(width >> l, 1), h = max(height >> l, 1);
+		EncodeBC1(&level[0], w, h, &image.data[image.levelOffset[l]]);
+		if (l + 1 < image.levels) {
+			DownsampleRGB(&level[0], w, h, next);
+			level.swap(next);
+		}
+	}
+}
+
+// Expand a BC1 image to RGB levels, for drivers without S3TC
+void DecompressImage(TextureImage& image) {
+	if (image.format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT)
+		return;
+	vector<GLubyte> rgb;
+	GLsizeiptr total = 0;
+	GLsizeiptr offsets[TEXTURE_MAX_LEVELS];
+	for (GLuint l = 0; l < image.levels; l++) {
+		offsets[l] = total;
+		total += (GLsizeiptr)max(image.width >> l, 1) * max(image.height >> l, 1) * 3;
+	}
+	rgb.resize(total);
+	for (GLuint l = 0; l < image.levels; l++) {
+		GLint w = max(image.width >> l, 1), h = max(image.height >> l, 1);
+		DecodeBC1(&image.data[image.levelOffset[l]], w, h, &rgb[offsets[l]]);
+		image.levelOffset[l] = offsets[l];
+		image.levelSize[l] = (GLsizeiptr)w * h * 3;
+	}
+	image.data.swap(rgb);
+	image.format = GL_RGB;
+}
+
+// GPU memory an image takes once uploaded. RGB8 is stored as RGBA8, and
+// mipmaps generated on upload add a third.
+GLuint64 TextureMemory(const TextureImage& image) {
+	if (image.format != GL_RGB) {
+		GLuint64 bytes = 0;
+		for (GLuint l = 0; l < image.levels; l++)
+			bytes += image.levelSize[l];
+		return bytes;
+	}
+	GLuint64 texels = 0;
+	for (GLuint l = 0; l < image.levels; l++)
+		texels += (GLuint64)max(image.width >> l, 1) * max(image.height >> l, 1);
+	return image.levels == 1 ? texels * 4 * 4 / 3 : texels * 4;
+}
+
+// Specify the bound GL_TEXTURE_2D from an image whose data starts at
+// pixels (client memory, or an offset into a bound GL_PIXEL_UNPACK_BUFFER)
+void UploadImage(const TextureImage& image, const GLubyte* pixels) {
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (GLuint l = 0; l < image.levels; l++) {
+		GLint w = max(image.width >> l, 1), h = max(image.height >> l, 1);
+		if (image.format == GL_RGB)
+			glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels + image.levelOffset[l]);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, l, image.format, w, h, 0, image.levelSize[l], pixels + image.levelOffset[l]);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	if (image.levels == 1)
+		glGenerateMipmap(GL_TEXTURE_2D);
+	else
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels - 1);
+}
+
+// Where the bake of a texture file lives
+string TextureBakePath(const string& source) {
+	return source + ".ktx";
+}
+
+// Whether the driver can take BC1 levels as they are
+bool CompressedTexturesSupported() {
+	return GLEW_EXT_texture_compression_s3tc != GL_FALSE;
+}
+
+// Size, modification time and content hash of a source, as recorded in
+// its bake
+string TextureSourceStamp(const string& source, GLuint64 hash) {
+	struct stat info;
+	ostringstream stamp;
+	if (stat(source.c_str(), &info) != 0)
+		return "";
+	stamp << (GLuint64)info.st_size << " " << (GLint64)info.st_mtime << " " << hash;
+	return stamp.str();
+}
+
+// Whether a bake's stamp still describes its source, and the source's
+// content hash and size it recorded. A missing source is fine (only the
+// bake was shipped), a changed one is not.
+bool TextureBakeCurrent(const string& source, const string& stamp, GLuint64& hash, GLuint64& fileSize) {
+	istringstream in(stamp);
+	GLint64 time;
+	if (!(in >> fileSize >> time >> hash))
+		return false;
+	struct stat info;
+	return stat(source.c_str(), &info) != 0 || ((GLuint64)info.st_size == fileSize && (GLint64)info.st_mtime == time);
+}
+
+// Write a compressed image as a KTX 1 file. Written to a temporary file and
+// renamed, like the mesh cache, so a reader never sees half a bake.
+bool WriteKtx(const string& path, const TextureImage& image, const string& stamp) {
+	string entry = string(KTX_SOURCE_KEY) + '\0' + stamp + '\0';
+	GLuint entrySize = entry.size();
+	GLuint entryPadding = (4 - entrySize % 4) % 4;
+
+	KtxHeader header;
+	memset(&header, 0, sizeof(header));
+	header.endianness = KTX_ENDIANNESS;
+	header.glInternalFormat = image.format;
+	header.glBaseInternalFormat = GL_RGB;
+	header.pixelWidth = image.width;
+	header.pixelHeight = image.height;
+	header.numberOfFaces = 1;
+	header.numberOfMipmapLevels = image.levels;
+	header.bytesOfKeyValueData = 4 + entrySize + entryPadding;
+
+	string temporary = path + ".tmp" + to_string(hash<thread::id>()(this_thread::get_id()));
+	ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+	if (!out) {
+		cout << "ERROR::TEXTURE_COMPRESS::NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	static const char padding[4] = { 0 };
+	out.write((const char*)KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+	out.write((const char*)&header, sizeof(header));
+	out.write((const char*)&entrySize, 4);
+	out.write(entry.data(), entrySize);
+	out.write(padding, entryPadding);
+	for (GLuint l = 0; l < image.levels; l++) {
+		GLuint size = image.levelSize[l];
+		out.write((const char*)&size, 4);
+		out.write((const char*)&image.data[image.levelOffset[l]], size);
+		out.write(padding, (4 - size % 4) % 4);
+	}
+	bool written = out.good();
+	out.close();
+
+	remove(path.c_str());
+	if (!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		remove(temporary.c_str());
+		cout << "ERROR::TEXTURE_COMPRESS::NOT_WRITTEN " << path << endl;
+		return false;
+	}
+	return true;
+}
+
+// Read a KTX 1 file holding a single BC1 2D texture; false if it is
+// missing or is not one
+bool ReadKtx(const string& path, TextureImage& image, string& stamp) {
+	vector<GLubyte> bytes;
+	ifstream file(path.c_str(), ios::binary | ios::ate);
+	if (!file)
+		return false;
+	bytes.resize((size_t)file.tellg());
+	file.seekg(0);
+	if (bytes.size() < sizeof(KTX_IDENTIFIER) + sizeof(KtxHeader) || !file.read((char*)&bytes[0], bytes.size()))
+		return false;
+
+	KtxHeader header;
+	memcpy(&header, &bytes[sizeof(KTX_IDENTIFIER)], sizeof(header));
+	if (memcmp(&bytes[0], KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header.endianness != KTX_ENDIANNESS
+		|| header.glInternalFormat != GL_COMPRESSED_RGB_S3TC_DXT1_EXT || header.pixelDepth || header.numberOfArrayElements > 1
+		|| header.numberOfFaces != 1 || header.numberOfMipmapLevels == 0 || header.numberOfMipmapLevels > TEXTURE_MAX_LEVELS
+		|| header.pixelWidth == 0 || header.pixelHeight == 0)
+		return false;
+
+	// Metadata: find the source stamp
+	size_t offset = sizeof(KTX_IDENTIFIER) + sizeof(KtxHeader);
+	size_t end = offset + header.bytesOfKeyValueData;
+	if (end > bytes.size())
+		return false;
+	stamp.clear();
+	while (offset + 4 <= end) {
+		GLuint size;
+		memcpy(&size, &bytes[offset], 4);
+		if (size > end - offset - 4)
+			return false;
+		const char* key = (const char*)&bytes[offset + 4];
+		size_t keyLength = strnlen(key, size);
+		if (keyLength < size && strcmp(key, KTX_SOURCE_KEY) == 0)
+			stamp.assign(key + keyLength + 1, strnlen(key + keyLength + 1, size - keyLength - 1));
+		offset += 4 + size + (4 - size % 4) % 4;
+	}
+	offset = end;
+
+	image.width = header.pixelWidth;
+	image.height = header.pixelHeight;
+	image.format = header.glInternalFormat;
+	image.levels = header.numberOfMipmapLevels;
+	GLsizeiptr total = 0;
+	vector<size_t> sources(image.levels);
+	for (GLuint l = 0; l < image.levels; l++) {
+		GLuint size;
+		if (offset + 4 > bytes.size())
+			return false;
+		memcpy(&size, &bytes[offset], 4);
+		if (size != BC1Size(max(image.width >> l, 1), max(image.height >> l, 1)) || offset + 4 + size > bytes.size())
+			return false;
+		sources[l] = offset + 4;
+		image.levelOffset[l] = total;
+		image.levelSize[l] = size;
+		total += size;
+		offset += 4 + size + (4 - size % 4) % 4;
+	}
+	image.data.resize(total);
+	for (GLuint l = 0; l < image.levels; l++)
+		memcpy(&image.data[image.levelOffset[l]], &bytes[sources[l]], image.levelSize[l]);
+	return true;
+}
@@ -0,0 +1,131 @@
+// ============================================================================
+//
+// UniformBuffer.h
+// -----------------------------------
+//
+// UNIFORM BUFFER HEADER FILE
+//
+// Holds the std140 layouts of the per-frame uniform blocks shared by the
+// shaders, the point light record, and a ring buffer that gives every frame
+// its own slot so the CPU can rewrite the blocks without waiting for the GPU
+// to finish reading them.
+//
+// ============================================================================
+
+#pragma once
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+
+using namespace glm;
+
+// Binding points of the shared uniform blocks
+const GLuint CAMERA_BLOCK_BINDING = 0;
+const GLuint LIGHT_BLOCK_BINDING = 1;
+
+// Number of frames the ring can have in flight
+const GLuint UNIFORM_RING_SLOTS = 3;
+
+// "Camera" block (std140)
+struct CameraBlock {
+	mat4 projection;
+	mat4 view;
+	vec4 viewPos;		// xyz = camera position
+};
+
+// "Lights" block (std140): where the fragment shader finds its cluster
+struct LightBlock {
+	GLuint clusterDims[4];	// x, y, z cluster counts, light count
+	vec4 clusterDepth;		// near, far, slice scale, slice bias
+	vec4 clusterTile;		// tile size in pixels
+};
+
+// One point light, stored as three RGBA32F texels in the light buffer
+struct PointLightData {
+	vec3 lightColor;
+	GLfloat constant;
+	vec3 lightPos;
+	GLfloat linear;
+	GLfloat quadratic;
+	GLfloat radius;			// range used for cluster binning
+	GLfloat padding[2];
+};
+
+// Uniform ring buffer class
+class UniformRing {
+private:
+	// Data
+	GLuint buffer;
+	GLsizeiptr slotSize;
+	GLuint slot;
+	GLsync fences[UNIFORM_RING_SLOTS];
+
+public:
+	UniformRing();
+	void Init(GLsizeiptr frameSize);
+	GLsizeiptr Align(GLsizeiptr size);
+	GLubyte* Map();
+	void Unmap();
+	void BindRange(GLuint binding, GLintptr offset, GLsizeiptr size);
+	void EndFrame();
+};
+
+// Constructor
+UniformRing::UniformRing() {
+	this->buffer = 0;
+	this->slotSize = 0;
+	this->slot = 0;
+	for (GLuint i = 0; i < UNIFORM_RING_SLOTS; i++)
+		this->fences[i] = 0;
+}
+
+// Allocate one slot of frameSize bytes for every frame in flight
+void UniformRing::Init(GLsizeiptr frameSize) {
+	this->slotSize = this->Align(frameSize);
+
+	glGenBuffers(1, &this->buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+	glBufferData(GL_UNIFORM_BUFFER, this->slotSize * UNIFORM_RING_SLOTS, NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Round a size up to the uniform buffer offset alignment
+GLsizeiptr UniformRing::Align(GLsizeiptr size) {
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	return (size + alignment - 1) / alignment * alignment;
+}
+
+// Move to the next slot and map it for writing. The slot was last used
+// UNIFORM_RING_SLOTS - 1 frames ago, so its fence has normally signalled and
+// the unsynchronized map never waits on the driver.
+GLubyte* UniformRing::Map() {
+	this->slot = (this->slot + 1) % UNIFORM_RING_SLOTS;
+	if (this->fences[this->slot]) {
+		while (glClientWaitSync(this->fences[this->slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED);
+		glDeleteSync(this->fences[this->slot]);
+		this->fences[this->slot] = 0;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+	return (GLubyte*)glMapBufferRange(GL_UNIFORM_BUFFER, this->slot * this->slotSize, this->slotSize,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+}
+
+void UniformRing::Unmap() {
+	glBindBuffer(GL_UNIFORM_BUFFER, this->buffer);
+	glUnmapBuffer(GL_UNIFORM_BUFFER);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+// Attach part of the current slot to a block binding point. The offset is
+// relative to the slot and must be aligned with Align().
+void UniformRing::BindRange(GLuint binding, GLintptr offset, GLsizeiptr size) {
+	glBindBufferRange(GL_UNIFORM_BUFFER, binding, this->buffer, this->slot * this->slotSize + offset, size);
+}
+
+// Mark the current slot as in use by everything submitted this frame
+void UniformRing::EndFrame() {
+	this->fences[this->slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
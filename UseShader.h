@@ -1,114 +1,342 @@
-// ============================================================================
-//
-// UseShader.h
-// -----------------------------------
-//
-// SHADER HEADER FILE
-//
-// The shader class handles opening and compiling shaders
-//
-// ============================================================================
-
-#ifndef SHADER_H
-#define SHADER_H
-
-// Standard Includes
-#include <iostream>
-#include <string>
-#include <fstream>
-#include <sstream>
-
-// OpenGL includes
-#include "GL\glew.h"
-
-using namespace std;
-
-// Shader Class
-class Shader {
-public:
-	GLuint Program;
-	Shader(const GLchar* vertexPath, const GLchar* fragmentPath);
-	void Use();
-};
-
-// Constructor that takes both a vertex and fragment shader path
-Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath) {
-	// Retrieve vertex  & fragment shader code 
-	// ------------------------------------------------------
-	string vertexCode, fragmentCode;
-	ifstream vShaderFile, fShaderFile;
-	vShaderFile.exceptions (ifstream::badbit);
-	fShaderFile.exceptions (ifstream::badbit);
-
-	try {
-		// Open Files
-		vShaderFile.open(vertexPath);
-		fShaderFile.open(fragmentPath);
-		stringstream vShaderStream, fShaderStream;
-
-		// Read file into stream
-		vShaderStream << vShaderFile.rdbuf();
-		fShaderStream << fShaderFile.rdbuf();
-		vShaderFile.close();
-		fShaderFile.close();
-
-		// Convert to string
-		vertexCode = vShaderStream.str();
-		fragmentCode = fShaderStream.str();
-		const GLchar* vShaderCode = vertexCode.c_str();
-		const GLchar* fShaderCode = fragmentCode.c_str();
-	}
-	catch (ifstream::failure e) {
-		cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
-	}
-	const GLchar* vShaderCode = vertexCode.c_str();
-	const GLchar * fShaderCode = fragmentCode.c_str();
-
-	// Compile shaders
-	// ------------------------------------------------------
-	GLuint vertex, fragment;
-	GLint success;
-	GLchar infoLog[512];
-
-	// Vertex shader
-	vertex = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex, 1, &vShaderCode, NULL);
-	glCompileShader(vertex);
-	glGetShaderiv(vertex, GL_COMPILE_STATUS, &success);
-	if(!success) {
-		glGetShaderInfoLog(vertex, 512, NULL, infoLog);
-		cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << endl;
-	}
-
-	// Fragment shader
-	fragment = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment, 1, &fShaderCode, NULL);
-	glCompileShader(fragment);
-	glGetShaderiv(fragment, GL_COMPILE_STATUS, &success);
-	if(!success) {
-		glGetShaderInfoLog(fragment, 512, NULL, infoLog);
-		cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << endl;
-	}
-
-	// Attach shaders
-	this->Program = glCreateProgram();
-	glAttachShader(this->Program, vertex);
-	glAttachShader(this->Program, fragment);
-	glLinkProgram(this->Program);
-
-	glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
-	if(!success) {
-		glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
-		cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-	}
-
-	// Delete linked shaders
-	glDeleteShader(vertex);
-	glDeleteShader(fragment);
-}
-
-void Shader::Use() {
-	glUseProgram(this->Program);
-}
-
+// ============================================================================
+//
+// UseShader.h
+// -----------------------------------
+//
+// SHADER HEADER FILE
+//
+// The shader class handles opening and compiling shaders, including
+// transform feedback programs without a fragment stage. After linking,
+// every active uniform is reflected into a lookup table so locations can be
+// fetched once and reused with the typed setters. Sources can be
+// specialized with #defines; ShaderVariants compiles each set once.
+//
+// ============================================================================
+
+#ifndef SHADER_H
+#define SHADER_H
+
+// Standard Includes
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+#include "glm\gtc\type_ptr.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Shader Class
+class Shader {
+private:
+	// Uniform name -> location, filled once at link time
+	unordered_map<string, GLint> uniforms;
+	void reflectUniforms();
+
+	// Compiling and linking
+	static string readSource(const GLchar* path);
+	static GLuint compileStage(GLenum type, const GLchar* path, const char* stageName, const string& defines);
+	void link(const GLuint* stages, GLuint count);
+
+public:
+	GLuint Program;
+	Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const string& defines = "");
+	Shader(const GLchar* vertexPath, const GLchar* geometryPath, const GLchar* const* varyings, GLsizei varyingCount);
+
+	// Not copyable: a copy would duplicate the uniform table on the heap,
+	// so draw calls take shaders by reference
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
+	Shader(Shader&&) = default;
+	void Use();
+
+	// Uniform lookup (-1 if the uniform is not active)
+	GLint Uniform(const string& name) const;
+
+	// Attach a named uniform block to a binding point
+	void BindBlock(const GLchar* name, GLuint binding);
+
+	// Typed setters for the currently used program
+	void SetInt(GLint location, GLint value) const;
+	void SetFloat(GLint location, GLfloat value) const;
+	void SetVec3(GLint location, const vec3& value) const;
+	void SetVec4(GLint location, const vec4& value) const;
+	void SetMat4(GLint location, const mat4& value) const;
+	void SetInt(const string& name, GLint value) const;
+	void SetFloat(const string& name, GLfloat value) const;
+	void SetVec3(const string& name, const vec3& value) const;
+	void SetVec4(const string& name, const vec4& value) const;
+	void SetMat4(const string& name, const mat4& value) const;
+};
+
+// Shader Variants Class
+// Programs built from one vertex / fragment pair with different #defines.
+// A set is compiled the first time it is asked for and kept after that.
+class ShaderVariants {
+private:
+	string vertexPath, fragmentPath;
+	map<string, Shader> variants;
+
+public:
+	void Init(const GLchar* vertexPath, const GLchar* fragmentPath);
+	const Shader& Get(const string& defines);
+	GLuint Count() const;
+};
+
+// Programs a UniformCache keeps locations for
+const GLuint UNIFORM_CACHE_PROGRAMS = 4;
+
+// Uniform Cache
+// Locations of a fixed set of uniforms, resolved once per program. A few
+// programs are kept side by side, so drawing with programs that alternate
+// every pass (the depth pre-pass and the shading pass) does no name lookups
+// after the first frame. The oldest program is replaced when all are used.
+template<GLuint Count>
+struct UniformCache {
+	GLuint programs[UNIFORM_CACHE_PROGRAMS];
+	GLint locations[UNIFORM_CACHE_PROGRAMS][Count];
+	GLuint next;
+
+	UniformCache();
+	GLint* Find(GLuint program);
+	GLint* Add(GLuint program);
+};
+
+// Read a shader file into a string
+string Shader::readSource(const GLchar* path) {
+	string code;
+	ifstream shaderFile;
+	shaderFile.exceptions (ifstream::badbit);
+
+	try {
+		// Open file and read it into a stream
+		shaderFile.open(path);
+		stringstream shaderStream;
+		shaderStream << shaderFile.rdbuf();
+		shaderFile.close();
+		code = shaderStream.str();
+	}
+	catch (ifstream::failure e) {
+		cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << endl;
+	}
+	return code;
+}
+
+// Compile one shader stage, reporting errors under the stage's name.
+// Defines go on the line after #version, which has to come first.
+GLuint Shader::compileStage(GLenum type, const GLchar* path, const char* stageName, const string& defines) {
+	string code = readSource(path);
+	size_t version = code.find("#version");
+	if (!defines.empty() && version != string::npos)
+		code.insert(min(code.find('\n', version), code.size() - 1) + 1, defines);
+	else if (!defines.empty())
+		code.insert(0, defines);
+	const GLchar* shaderCode = code.c_str();
+	GLint success;
+	GLchar infoLog[512];
+
+	GLuint stage = glCreateShader(type);
+	glShaderSource(stage, 1, &shaderCode, NULL);
+	glCompileShader(stage);
+	glGetShaderiv(stage, GL_COMPILE_STATUS, &success);
+	if(!success) {
+		glGetShaderInfoLog(stage, 512, NULL, infoLog);
+		cout << "ERROR::SHADER::" << stageName << "::COMPILATION_FAILED\n" << infoLog << endl;
+	}
+	return stage;
+}
+
+// Link the attached stages, then free them
+void Shader::link(const GLuint* stages, GLuint count) {
+	GLint success;
+	GLchar infoLog[512];
+
+	glLinkProgram(this->Program);
+	glGetProgramiv(this->Program, GL_LINK_STATUS, &success);
+	if(!success) {
+		glGetProgramInfoLog(this->Program, 512, NULL, infoLog);
+		cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+	}
+
+	// Delete linked shaders
+	for (GLuint i = 0; i < count; i++)
+		glDeleteShader(stages[i]);
+
+	this->reflectUniforms();
+}
+
+// Constructor that takes both a vertex and fragment shader path, and
+// #define lines to put in front of both sources
+Shader::Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const string& defines) {
+	GLuint stages[2];
+	stages[0] = compileStage(GL_VERTEX_SHADER, vertexPath, "VERTEX", defines);
+	stages[1] = compileStage(GL_FRAGMENT_SHADER, fragmentPath, "FRAGMENT", defines);
+
+	// Attach shaders
+	this->Program = glCreateProgram();
+	glAttachShader(this->Program, stages[0]);
+	glAttachShader(this->Program, stages[1]);
+	this->link(stages, 2);
+}
+
+// Constructor for a transform feedback program: a vertex and geometry shader
+// whose outputs (the listed varyings, interleaved) are captured to a buffer
+Shader::Shader(const GLchar* vertexPath, const GLchar* geometryPath, const GLchar* const* varyings, GLsizei varyingCount) {
+	GLuint stages[2];
+	stages[0] = compileStage(GL_VERTEX_SHADER, vertexPath, "VERTEX", "");
+	stages[1] = compileStage(GL_GEOMETRY_SHADER, geometryPath, "GEOMETRY", "");
+
+	// Varyings must be named before linking
+	this->Program = glCreateProgram();
+	glAttachShader(this->Program, stages[0]);
+	glAttachShader(this->Program, stages[1]);
+	glTransformFeedbackVaryings(this->Program, varyingCount, varyings, GL_INTERLEAVED_ATTRIBS);
+	this->link(stages, 2);
+}
+
+// Query every active uniform once. Arrays are stored under their base name
+// and under each element name, e.g. "weight", "weight[0]" ... "weight[4]".
+void Shader::reflectUniforms() {
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(this->Program, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(this->Program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	vector<GLchar> nameBuffer(maxLength + 1);
+
+	for (GLint i = 0; i < count; i++) {
+		GLint size;
+		GLenum type;
+		GLsizei length;
+		glGetActiveUniform(this->Program, i, maxLength + 1, &length, &size, &type, &nameBuffer[0]);
+		string name(&nameBuffer[0], length);
+
+		// Members of uniform blocks have no location
+		GLint location = glGetUniformLocation(this->Program, name.c_str());
+		if (location < 0)
+			continue;
+		this->uniforms[name] = location;
+
+		// Register array elements
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+			string base = name.substr(0, name.size() - 3);
+			this->uniforms[base] = location;
+			for (GLint j = 1; j < size; j++) {
+				string element = base + "[" + to_string(j) + "]";
+				this->uniforms[element] = glGetUniformLocation(this->Program, element.c_str());
+			}
+		}
+	}
+}
+
+void Shader::Use() {
+	glUseProgram(this->Program);
+}
+
+// Get a cached uniform location
+GLint Shader::Uniform(const string& name) const {
+	unordered_map<string, GLint>::const_iterator it = this->uniforms.find(name);
+	return it != this->uniforms.end() ? it->second : -1;
+}
+
+// Programs that do not use the block are left untouched
+void Shader::BindBlock(const GLchar* name, GLuint binding) {
+	GLuint index = glGetUniformBlockIndex(this->Program, name);
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(this->Program, index, binding);
+}
+
+// Setters by location
+void Shader::SetInt(GLint location, GLint value) const {
+	glUniform1i(location, value);
+}
+
+void Shader::SetFloat(GLint location, GLfloat value) const {
+	glUniform1f(location, value);
+}
+
+void Shader::SetVec3(GLint location, const vec3& value) const {
+	glUniform3fv(location, 1, value_ptr(value));
+}
+
+void Shader::SetVec4(GLint location, const vec4& value) const {
+	glUniform4fv(location, 1, value_ptr(value));
+}
+
+void Shader::SetMat4(GLint location, const mat4& value) const {
+	glUniformMatrix4fv(location, 1, GL_FALSE, value_ptr(value));
+}
+
+// Setters by name (one table lookup, no driver call)
+void Shader::SetInt(const string& name, GLint value) const {
+	this->SetInt(this->Uniform(name), value);
+}
+
+void Shader::SetFloat(const string& name, GLfloat value) const {
+	this->SetFloat(this->Uniform(name), value);
+}
+
+void Shader::SetVec3(const string& name, const vec3& value) const {
+	this->SetVec3(this->Uniform(name), value);
+}
+
+void Shader::SetVec4(const string& name, const vec4& value) const {
+	this->SetVec4(this->Uniform(name), value);
+}
+
+void Shader::SetMat4(const string& name, const mat4& value) const {
+	this->SetMat4(this->Uniform(name), value);
+}
+
+// Starts with no program resolved
+template<GLuint Count>
+UniformCache<Count>::UniformCache() {
+	for (GLuint i = 0; i < UNIFORM_CACHE_PROGRAMS; i++)
+		this->programs[i] = 0;
+	this->next = 0;
+}
+
+// Locations resolved for a program, or nullptr if there are none yet
+template<GLuint Count>
+GLint* UniformCache<Count>::Find(GLuint program) {
+	for (GLuint i = 0; i < UNIFORM_CACHE_PROGRAMS; i++) {
+		if (this->programs[i] == program)
+			return this->locations[i];
+	}
+	return nullptr;
+}
+
+// Slot for a program's locations, for the caller to fill in
+template<GLuint Count>
+GLint* UniformCache<Count>::Add(GLuint program) {
+	GLuint slot = this->next;
+	this->next = (this->next + 1) % UNIFORM_CACHE_PROGRAMS;
+	this->programs[slot] = program;
+	return this->locations[slot];
+}
+
+// Sources every variant is built from
+void ShaderVariants::Init(const GLchar* vertexPath, const GLchar* fragmentPath) {
+	this->vertexPath = vertexPath;
+	this->fragmentPath = fragmentPath;
+}
+
+// The program for a set of #define lines, compiled on first use
+const Shader& ShaderVariants::Get(const string& defines) {
+	map<string, Shader>::iterator it = this->variants.find(defines);
+	if (it == this->variants.end())
+		it = this->variants.insert(make_pair(defines, Shader(this->vertexPath.c_str(), this->fragmentPath.c_str(), defines))).first;
+	return it->second;
+}
+
+// Variants compiled so far
+GLuint ShaderVariants::Count() const {
+	return this->variants.size();
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+// ============================================================================
+//
+// VertexFormat.h
+// -----------------------------------
+//
+// VERTEX FORMAT HEADER FILE
+//
+// Mesh vertex buffer layouts. Besides the 32 byte float Vertex, a mesh can
+// be uploaded packed into 16 bytes: positions as unorm16 against the
+// mesh's bounding box, normals octahedral-encoded into two snorm16 values,
+// and texture coordinates as half floats. The vertex shader scales the
+// positions back with the mesh's quantization and decodes the normals.
+//
+// ============================================================================
+
+#pragma once
+
+// Standard Includes
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+
+// OpenGL includes
+#include "GL\glew.h"
+#include "glm\glm.hpp"
+#include "glm\gtc\packing.hpp"
+
+using namespace std;
+using namespace glm;
+
+// Holds vertex information for location, normals, and texture coords
+struct Vertex {
+	vec3 Position;
+	vec3 Normal;
+	vec2 TexCoords;
+};
+
+// Vertex buffer layouts, from largest to smallest
+enum VertexFormat {
+	VERTEX_FLOAT,
+	VERTEX_PACKED
+};
+
+// A vertex in the packed layout
+struct PackedVertex {
+	GLuint position[2];		// unorm16 x, y | z, 0 within the quantization box
+	GLuint normal;			// octahedral, snorm16 x, y
+	GLuint texCoords;		// half float u, v
+};
+
+// Box the packed positions span: position = offset + unorm * scale
+struct VertexQuantization {
+	vec3 offset;
+	vec3 scale;
+};
+
+// Largest difference between a set of vertices and their packed form
+struct VertexPackingError {
+	GLfloat position;			// object space units
+	GLfloat positionRelative;	// of the largest box side
+	GLfloat normalDegrees;
+	GLfloat texCoords;
+};
+
+// Bytes per vertex
+GLuint VertexStride(VertexFormat format) {
+	return format == VERTEX_FLOAT ? sizeof(Vertex) : sizeof(PackedVertex);
+}
+
+const char* VertexFormatName(VertexFormat format) {
+	static const char* names[2] = { "float", "packed" };
+	return names[format];
+}
+
+// Look a format up by name; false if there is no such format
+bool ParseVertexFormat(const char* name, VertexFormat& format) {
+	for (GLuint i = VERTEX_FLOAT; i <= VERTEX_PACKED; i++) {
+		if (strcmp(name, VertexFormatName((VertexFormat)i)) == 0) {
+			format = (VertexFormat)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Bounding box of the vertices. Flat sides get a scale of 1 so that they
+// still decode exactly.
+VertexQuantization QuantizationOf(const Vertex* vertices, GLuint count) {
+	VertexQuantization quantization = { vec3(0.0f), vec3(1.0f) };
+	if (!count)
+		return quantization;
+	vec3 lo = vertices[0].Position, hi = vertices[0].Position;
+	for (GLuint i = 1; i < count; i++) {
+		lo = min(lo, vertices[i].Position);
+		hi = max(hi, vertices[i].Position);
+	}
+	quantization.offset = lo;
+	for (GLuint a = 0; a < 3; a++)
+		quantization.scale[a] = hi[a] > lo[a] ? hi[a] - lo[a] : 1.0f;
+	return quantization;
+}
+
+// Map a unit vector onto the octahedron, unfolded into [-1, 1]^2
+vec2 OctEncode(const vec3& n) {
+	vec3 v = n / (fabs(n.x) + fabs(n.y) + fabs(n.z));
+	vec2 p(v.x, v.y);
+	if (v.z < 0.0f) {
+		p.x = (1.0f - fabs(v.y)) * (v.x >= 0.0f ? 1.0f : -1.0f);
+		p.y = (1.0f - fabs(v.x)) * (v.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return p;
+}
+
+// Inverse of OctEncode, as main_vshader.glsl does it
+vec3 OctDecode(const vec2& p) {
+	vec3 n(p.x, p.y, 1.0f - fabs(p.x) - fabs(p.y));
+	GLfloat t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+PackedVertex PackVertex(const Vertex& vertex, const VertexQuantization& quantization) {
+	PackedVertex packed;
+	vec3 unit = (vertex.Position - quantization.offset) / quantization.scale;
+	packed.position[0] = packUnorm2x16(vec2(unit.x, unit.y));
+	packed.position[1] = packUnorm2x16(vec2(unit.z, 0.0f));
+	GLfloat length2 = dot(vertex.Normal, vertex.Normal);
+	packed.normal = packSnorm2x16(length2 > 0.0f ? OctEncode(vertex.Normal) : vec2(0.0f));
+	packed.texCoords = packHalf2x16(vertex.TexCoords);
+	return packed;
+}
+
+// Rebuild a vertex the way main_vshader.glsl does (for checking)
+Vertex UnpackVertex(const PackedVertex& packed, const VertexQuantization& quantization) {
+	Vertex vertex;
+	vec2 xy = unpackUnorm2x16(packed.position[0]), z = unpackUnorm2x16(packed.position[1]);
+	vertex.Position = quantization.offset + vec3(xy.x, xy.y, z.x) * quantization.scale;
+	vertex.Normal = OctDecode(unpackSnorm2x16(packed.normal));
+	vertex.TexCoords = unpackHalf2x16(packed.texCoords);
+	return vertex;
+}
+
+void PackVertices(const Vertex* vertices, GLuint count, const VertexQuantization& quantization, vector<PackedVertex>& out) {
+	out.resize(count);
+	for (GLuint i = 0; i < count; i++)
+		out[i] = PackVertex(vertices[i], quantization);
+}
+
+// How far packing moves each attribute, at worst
+VertexPackingError MeasurePackingError(const Vertex* vertices, GLuint count, const VertexQuantization& quantization) {
+	VertexPackingError error = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (GLuint i = 0; i < count; i++) {
+		const Vertex& vertex = vertices[i];
+		Vertex unpacked = UnpackVertex(PackVertex(vertex, quantization), quantization);
+		error.position = std::max(error.position, length(unpacked.Position - vertex.Position));
+		GLfloat length2 = dot(vertex.Normal, vertex.Normal);
+		if (length2 > 0.0f) {
+			GLfloat cosine = clamp(dot(unpacked.Normal, vertex.Normal / sqrt(length2)), -1.0f, 1.0f);
+			error.normalDegrees = std::max(error.normalDegrees, degrees(acos(cosine)));
+		}
+		vec2 uv = abs(unpacked.TexCoords - vertex.TexCoords);
+		error.texCoords = std::max(error.texCoords, std::max(uv.x, uv.y));
+	}
+	GLfloat side = std::max(quantization.scale.x, std::max(quantization.scale.y, quantization.scale.z));
+	error.positionRelative = error.position / side;
+	return error;
+}
+
+// Point attributes 0 - 2 of the bound VAO at vertices of the given format in
+// the bound GL_ARRAY_BUFFER
+void SetVertexAttributes(VertexFormat format) {
+	GLsizei stride = VertexStride(format);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	if (format == VERTEX_FLOAT) {
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, Normal));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(Vertex, TexCoords));
+	}
+	else {
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (GLvoid*)0);
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (GLvoid*)offsetof(PackedVertex, normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (GLvoid*)offsetof(PackedVertex, texCoords));
+	}
+}